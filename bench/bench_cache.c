@@ -0,0 +1,153 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  bench_cache.c      –  cache lookup / insert microbenchmark
+ *
+ *  Reports Mops/s at 1, 2, 4 and 8 threads for:
+ *      find/hit    find() + cache_release() of random preloaded URLs
+ *      find/miss   find() of URLs never added
+ *      add         add_cache_element() of fresh URLs into a full cache,
+ *                  so every insert also evicts – or, never looked up
+ *                  before, is turned away by TinyLFU admission
+ *      mixed       90 % find/hit, 10 % add
+ *
+ *  Objects are BENCH_OBJECT bytes; URLs look like real proxied ones.
+ *  The admission policy is the proxy's default unless named:
+ *
+ *      bench_cache [tinylfu|tinylfu-bytes|lru]
+ *
+ *  Build:  make bench   →   build/bench/bench_cache
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_cache.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TARGET_SECONDS  0.5
+#define BENCH_KEYS      20000               /* preloaded URLs            */
+#define BENCH_OBJECT    1024
+#define BENCH_CAPACITY  (64u << 20)         /* holds the keys, not churn */
+
+typedef enum { OP_HIT, OP_MISS, OP_ADD, OP_MIXED } bench_op;
+
+typedef struct bench_thread {
+    pthread_t thread;
+    unsigned  id;
+    bench_op  op;
+    uint64_t  ops;
+} bench_thread;
+
+static atomic_int  stop;
+static atomic_uint generation;              /* keeps added URLs unique   */
+static char        object[BENCH_OBJECT];
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void key_url(char* url, size_t cap, const char* kind, unsigned a, unsigned b)
+{
+    snprintf(url, cap, "http://cdn.example.com/assets/%s/%u/%08x/app.bundle.js", kind, a, b);
+}
+
+static void* thread_main(void* arg)
+{
+    bench_thread* t = (bench_thread*)arg;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (t->id + 1);
+    unsigned gen = atomic_fetch_add(&generation, 1);
+    char url[128];
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int i = 0; i < 256; ++i) {
+            rng ^= rng >> 12; rng ^= rng << 25; rng ^= rng >> 27;
+            unsigned r = (unsigned)((rng * 2685821657736338717ULL) >> 32);
+            bench_op op = t->op;
+            if (op == OP_MIXED) op = r % 10 == 0 ? OP_ADD : OP_HIT;
+
+            if (op == OP_HIT) {
+                key_url(url, sizeof url, "k", 0, r % BENCH_KEYS);
+                cache_release(find(url));
+            }
+            else if (op == OP_MISS) {
+                key_url(url, sizeof url, "absent", t->id, r);
+                cache_release(find(url));
+            }
+            else {
+                key_url(url, sizeof url, "new", gen, (unsigned)t->ops + (unsigned)i);
+                add_cache_element(object, BENCH_OBJECT, url);
+            }
+        }
+        t->ops += 256;
+    }
+    return NULL;
+}
+
+static void run(const char* label, bench_op op, unsigned threads)
+{
+    bench_thread ts[8];
+    atomic_store(&stop, 0);
+    for (unsigned i = 0; i < threads; ++i) {
+        ts[i].id = i;
+        ts[i].op = op;
+        ts[i].ops = 0;
+        pthread_create(&ts[i].thread, NULL, thread_main, &ts[i]);
+    }
+
+    double t0 = now_sec();
+    struct timespec nap = { 0, (long)(TARGET_SECONDS * 1e9) };
+    nanosleep(&nap, NULL);
+    atomic_store(&stop, 1);
+
+    uint64_t ops = 0;
+    for (unsigned i = 0; i < threads; ++i) {
+        pthread_join(ts[i].thread, NULL);
+        ops += ts[i].ops;
+    }
+    double elapsed = now_sec() - t0;
+    printf("  %-10s %u thr %9.2f Mops/s %8.1f ns/op/thread\n", label, threads,
+           (double)ops / elapsed / 1e6, elapsed * 1e9 * threads / (double)ops);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct { const char* label; bench_op op; } cases[] = {
+        { "find/hit", OP_HIT }, { "find/miss", OP_MISS }, { "mixed", OP_MIXED }, { "add", OP_ADD },
+    };
+    static const unsigned thread_counts[] = { 1, 2, 4, 8 };
+    char url[128];
+
+    cache_admission admission = CACHE_ADMIT_TINYLFU;
+    if (argc > 1 && cache_admission_parse(argv[1], &admission) < 0) {
+        fprintf(stderr, "usage: %s [tinylfu|tinylfu-bytes|lru]\n", argv[0]);
+        return 2;
+    }
+
+    memset(object, 'x', sizeof object);
+    cache_set_admission(admission, 0);
+    cache_init(BENCH_CAPACITY, CACHE_SHARDS);
+    for (unsigned k = 0; k < BENCH_KEYS; ++k) {
+        key_url(url, sizeof url, "k", 0, k);
+        add_cache_element(object, BENCH_OBJECT, url);
+    }
+
+    cache_stats st;
+    cache_get_stats(&st);
+    printf("%zu entries, %zu bytes, %u shards, %s admission, %ld CPUs\n",
+           st.entries, st.bytes, st.shards, cache_admission_name(st.admission),
+           sysconf(_SC_NPROCESSORS_ONLN));
+
+    /* add runs last: its churn evicts the preloaded keys.             */
+    for (size_t c = 0; c < sizeof cases / sizeof cases[0]; ++c)
+        for (size_t t = 0; t < sizeof thread_counts / sizeof thread_counts[0]; ++t)
+            run(cases[c].label, cases[c].op, thread_counts[t]);
+    return 0;
+}
@@ -0,0 +1,180 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  bench_parse.c      –  request parse / unparse microbenchmark
+ *
+ *  Per request shape (curl-like, then browser-like with 10/20/40
+ *  headers) reports ns per request and Mreq/s for:
+ *      parse       ParsedRequest_parse() into a reused request (copy)
+ *      inplace     ParsedRequest_parse_inplace() on a scratch copy
+ *      lifecycle   create + parse + destroy, one request per client
+ *      unparse     ParsedRequest_unparse() of the parsed request
+ *      unparse_h   ParsedRequest_unparse_headers() only
+ *      get         ParsedHeader_get() of the four names the proxy asks
+ *                  about per request (two present, two absent)
+ *      get_id      the same through ParsedHeader_get_id()
+ *
+ *  bench_scan.c covers the scanner kernels underneath.
+ *
+ *  Build:  make bench   →   build/bench/bench_parse
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_parse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_SECONDS  0.25
+
+static const char* const browser_headers[] = {
+    "Host: www.example.com",
+    "Connection: keep-alive",
+    "Cache-Control: max-age=0",
+    "Upgrade-Insecure-Requests: 1",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+    "Referer: http://www.example.com/articles/2024/05/some-long-article-slug?utm_source=feed",
+    "Accept-Encoding: gzip, deflate, br",
+    "Accept-Language: en-GB,en-US;q=0.9,en;q=0.8",
+    "Cookie: session=9f8e7d6c5b4a39281706f5e4d3c2b1a0; prefs=theme%3Ddark%26lang%3Den",
+};
+#define N_BROWSER_HEADERS (sizeof browser_headers / sizeof browser_headers[0])
+
+static size_t build_request(char* dst, size_t cap, int headers)
+{
+    size_t n;
+    if (headers == 0)
+        return (size_t)snprintf(dst, cap, "GET http://www.example.com/index.html HTTP/1.1\r\n"
+                                          "Host: www.example.com\r\nUser-Agent: curl/8.5.0\r\n"
+                                          "Accept: */*\r\n\r\n");
+
+    n = (size_t)snprintf(dst, cap,
+        "GET http://www.example.com/articles/2024/05/index.html?page=2 HTTP/1.1\r\n");
+    for (int i = 0; i < headers; ++i) {
+        if ((size_t)i < N_BROWSER_HEADERS)
+            n += (size_t)snprintf(dst + n, cap - n, "%s\r\n", browser_headers[i]);
+        else
+            n += (size_t)snprintf(dst + n, cap - n,
+                "X-Trace-Attribute-%02d: tenant=acme region=eu-west-1 shard=%d\r\n", i, i * 7);
+    }
+    n += (size_t)snprintf(dst + n, cap - n, "\r\n");
+    return n;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static volatile size_t sink;
+static ParsedRequest*  bench_pr;            /* parsed once, for unparse */
+static char            out[16384];
+
+typedef size_t (*bench_fn)(const char* req, size_t len, char* scratch);
+
+static size_t run_parse(const char* req, size_t len, char* scratch)
+{
+    (void)scratch;
+    ParsedRequest_parse(bench_pr, req, (int)len);
+    return bench_pr->headers_in_use;
+}
+
+static size_t run_inplace(const char* req, size_t len, char* scratch)
+{
+    memcpy(scratch, req, len);
+    ParsedRequest_parse_inplace(bench_pr, scratch, (int)len);
+    return bench_pr->headers_in_use;
+}
+
+static size_t run_lifecycle(const char* req, size_t len, char* scratch)
+{
+    (void)scratch;
+    ParsedRequest* pr = ParsedRequest_create();
+    ParsedRequest_parse(pr, req, (int)len);
+    size_t n = pr->headers_in_use;
+    ParsedRequest_destroy(pr);
+    return n;
+}
+
+static size_t run_unparse(const char* req, size_t len, char* scratch)
+{
+    (void)req; (void)len; (void)scratch;
+    ParsedRequest_unparse(bench_pr, out, sizeof out);
+    return (size_t)out[0];
+}
+
+static size_t run_unparse_headers(const char* req, size_t len, char* scratch)
+{
+    (void)req; (void)len; (void)scratch;
+    ParsedRequest_unparse_headers(bench_pr, out, sizeof out);
+    return (size_t)out[0];
+}
+
+static size_t run_get(const char* req, size_t len, char* scratch)
+{
+    (void)req; (void)len; (void)scratch;
+    return (size_t)ParsedHeader_get(bench_pr, "Host")
+         + (size_t)ParsedHeader_get(bench_pr, "Connection")
+         + (size_t)ParsedHeader_get(bench_pr, "If-Modified-Since")
+         + (size_t)ParsedHeader_get(bench_pr, "Content-Length");
+}
+
+static size_t run_get_id(const char* req, size_t len, char* scratch)
+{
+    (void)req; (void)len; (void)scratch;
+    return (size_t)ParsedHeader_get_id(bench_pr, HDR_HOST)
+         + (size_t)ParsedHeader_get_id(bench_pr, HDR_CONNECTION)
+         + (size_t)ParsedHeader_get_id(bench_pr, HDR_IF_MODIFIED_SINCE)
+         + (size_t)ParsedHeader_get_id(bench_pr, HDR_CONTENT_LENGTH);
+}
+
+static void measure(const char* label, bench_fn fn, const char* req, size_t len)
+{
+    char* scratch = (char*)malloc(len + 1);
+
+    size_t iters = 1000;
+    double elapsed;
+    for (;;) {
+        double t0 = now_sec();
+        for (size_t i = 0; i < iters; ++i) sink += fn(req, len, scratch);
+        elapsed = now_sec() - t0;
+        if (elapsed >= TARGET_SECONDS) break;
+        iters *= elapsed > 0.01 ? (size_t)(TARGET_SECONDS / elapsed) + 1 : 10;
+    }
+
+    double ns = elapsed * 1e9 / (double)iters;
+    printf("  %-12s %9.1f ns/req %8.2f Mreq/s\n", label, ns, 1e3 / ns);
+    free(scratch);
+}
+
+int main(void)
+{
+    static const int header_counts[] = { 0, 10, 20, 40 };
+    char req[16384];
+
+    bench_pr = ParsedRequest_create();
+    for (size_t h = 0; h < sizeof header_counts / sizeof header_counts[0]; ++h) {
+        size_t len = build_request(req, sizeof req, header_counts[h]);
+        if (header_counts[h] == 0) printf("curl-like, %zu bytes\n", len);
+        else printf("%d headers, %zu bytes\n", header_counts[h], len);
+
+        if (ParsedRequest_parse(bench_pr, req, (int)len) < 0) {
+            printf("  parse failed\n");
+            continue;
+        }
+        measure("parse", run_parse, req, len);
+        measure("inplace", run_inplace, req, len);
+        measure("lifecycle", run_lifecycle, req, len);
+
+        ParsedRequest_parse(bench_pr, req, (int)len);
+        measure("unparse", run_unparse, req, len);
+        measure("unparse_h", run_unparse_headers, req, len);
+        measure("get", run_get, req, len);
+        measure("get_id", run_get_id, req, len);
+    }
+    ParsedRequest_destroy(bench_pr);
+    return 0;
+}
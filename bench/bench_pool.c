@@ -0,0 +1,120 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  bench_pool.c      –  task dispatch microbenchmark
+ *
+ *  Reports tasks/s and ns/task for trivial tasks handed out:
+ *      spawn       one detached pthread per task, the threaded front
+ *                  end's old model
+ *      inject      pool_submit() from outside the pool (the accept loop)
+ *      fanout      tasks that each submit two more from a worker, down
+ *                  to BENCH_DEPTH levels: own-deque pushes and steals
+ *
+ *  The pool is fixed at one worker per online CPU.
+ *
+ *  Build:  make bench   →   build/bench/bench_pool
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_TASKS     20000               /* spawn / inject            */
+#define BENCH_DEPTH     16                  /* fanout: 2^17 - 1 tasks    */
+
+static atomic_long      remaining;
+static pthread_mutex_t  done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   done_cond = PTHREAD_COND_INITIALIZER;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void task_done(void)
+{
+    if (atomic_fetch_sub(&remaining, 1) == 1) {
+        pthread_mutex_lock(&done_lock);
+        pthread_cond_signal(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+}
+
+static void wait_done(void)
+{
+    pthread_mutex_lock(&done_lock);
+    while (atomic_load(&remaining) > 0) pthread_cond_wait(&done_cond, &done_lock);
+    pthread_mutex_unlock(&done_lock);
+}
+
+static void* spawn_main(void* arg)
+{
+    (void)arg;
+    task_done();
+    return NULL;
+}
+
+static void leaf(void* arg)
+{
+    (void)arg;
+    task_done();
+}
+
+static void fan(void* arg)
+{
+    intptr_t depth = (intptr_t)arg;
+    if (depth > 0) {
+        pool_submit(fan, (void*)(depth - 1));
+        pool_submit(fan, (void*)(depth - 1));
+    }
+    task_done();
+}
+
+static void report(const char* label, long tasks, double elapsed)
+{
+    printf("  %-8s %8ld tasks %9.0f tasks/s %8.0f ns/task\n", label, tasks,
+           (double)tasks / elapsed, elapsed * 1e9 / (double)tasks);
+}
+
+int main(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (pool_init((int)(cpus > 0 ? cpus : 1)) < 0) { perror("pool_init"); return 1; }
+    printf("%ld CPUs, pool of %ld\n", cpus, cpus > 0 ? cpus : 1);
+
+    atomic_store(&remaining, BENCH_TASKS);
+    double t0 = now_sec();
+    for (int i = 0; i < BENCH_TASKS; ++i) {
+        pthread_t t;
+        while (pthread_create(&t, NULL, spawn_main, NULL) != 0) sched_yield();
+        pthread_detach(t);
+    }
+    wait_done();
+    report("spawn", BENCH_TASKS, now_sec() - t0);
+
+    atomic_store(&remaining, BENCH_TASKS);
+    t0 = now_sec();
+    for (int i = 0; i < BENCH_TASKS; ++i) pool_submit(leaf, NULL);
+    wait_done();
+    report("inject", BENCH_TASKS, now_sec() - t0);
+
+    long tasks = (2L << BENCH_DEPTH) - 1;
+    atomic_store(&remaining, tasks);
+    t0 = now_sec();
+    pool_submit(fan, (void*)(intptr_t)BENCH_DEPTH);
+    wait_done();
+    report("fanout", tasks, now_sec() - t0);
+
+    pool_stats ps;
+    pool_get_stats(&ps);
+    printf("  executed %llu, stolen %llu\n", (unsigned long long)ps.executed,
+           (unsigned long long)ps.stolen);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  bench_relay.c      –  origin → client forwarding throughput
+ *
+ *  Three threads over loopback TCP: a source writes a large body as
+ *  fast as it can, a relay forwards it, a sink reads and discards.
+ *  Reports throughput and the relay thread's CPU time per Gbit for:
+ *      copy     recv() into a 16 KB buffer, send() it – the relay loop
+ *               the proxy used for every response
+ *      splice   socket → pipe → socket (proxy_splice.c), the path now
+ *               taken by uncached bodies
+ *
+ *  Build:  make bench   →   build/bench/bench_relay
+ *  Run:    build/bench/bench_relay [MB per run, default 2048]
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_splice.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define COPY_CHUNK  (16 * 1024)             /* relay_buffer default, proxy_config.c */
+#define IO_CHUNK    (256 * 1024)
+
+typedef struct relay_job {
+    int    in, out;
+    size_t bytes;
+    int    use_splice;
+    double cpu;                             /* relay thread CPU seconds  */
+} relay_job;
+
+static double clock_sec(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* A connected TCP pair over 127.0.0.1: *a writes, *b reads.          */
+static int tcp_pair(int* a, int* b)
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { 0 };
+    socklen_t len = sizeof addr;
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (lfd < 0 || bind(lfd, (struct sockaddr*)&addr, sizeof addr) < 0
+        || listen(lfd, 1) < 0 || getsockname(lfd, (struct sockaddr*)&addr, &len) < 0)
+        return -1;
+
+    *a = socket(AF_INET, SOCK_STREAM, 0);
+    if (*a < 0 || connect(*a, (struct sockaddr*)&addr, sizeof addr) < 0) return -1;
+    *b = accept(lfd, NULL, NULL);
+    close(lfd);
+    return *b < 0 ? -1 : 0;
+}
+
+static void* source_main(void* arg)
+{
+    relay_job* job = (relay_job*)arg;
+    char* buf = (char*)malloc(IO_CHUNK);
+    memset(buf, 'x', IO_CHUNK);
+    for (size_t sent = 0; sent < job->bytes;) {
+        size_t n = job->bytes - sent < IO_CHUNK ? job->bytes - sent : IO_CHUNK;
+        ssize_t k = send(job->in, buf, n, MSG_NOSIGNAL);
+        if (k <= 0) break;
+        sent += (size_t)k;
+    }
+    shutdown(job->in, SHUT_WR);
+    free(buf);
+    return NULL;
+}
+
+static void* sink_main(void* arg)
+{
+    int fd = *(int*)arg;
+    char* buf = (char*)malloc(IO_CHUNK);
+    while (recv(fd, buf, IO_CHUNK, 0) > 0) {}
+    free(buf);
+    return NULL;
+}
+
+static void* relay_main(void* arg)
+{
+    relay_job* job = (relay_job*)arg;
+    double t0 = clock_sec(CLOCK_THREAD_CPUTIME_ID);
+
+    if (job->use_splice) {
+        splice_pipe p;
+        splice_pipe_init(&p);
+        if (splice_pipe_open(&p, 0) == 0) {
+            for (;;) {
+                ssize_t n = splice_fill(&p, job->in, SPLICE_PIPE_SIZE);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                while (p.held)
+                    if (splice_drain(&p, job->out) < 0 && errno != EINTR) goto done;
+            }
+        }
+    done:
+        splice_pipe_close(&p);
+    }
+    else {
+        char buf[COPY_CHUNK];
+        ssize_t n;
+        while ((n = recv(job->in, buf, sizeof buf, 0)) > 0) {
+            for (ssize_t off = 0; off < n;) {
+                ssize_t k = send(job->out, buf + off, (size_t)(n - off), MSG_NOSIGNAL);
+                if (k <= 0) goto out;
+                off += k;
+            }
+        }
+    out:;
+    }
+
+    job->cpu = clock_sec(CLOCK_THREAD_CPUTIME_ID) - t0;
+    shutdown(job->out, SHUT_WR);
+    return NULL;
+}
+
+static int run(const char* label, size_t bytes, int use_splice)
+{
+    int src_w, src_r, dst_w, dst_r;
+    if (tcp_pair(&src_w, &src_r) < 0 || tcp_pair(&dst_w, &dst_r) < 0) {
+        perror("loopback");
+        return -1;
+    }
+
+    relay_job source = { src_w, -1, bytes, 0, 0 };
+    relay_job relay = { src_r, dst_w, bytes, use_splice, 0 };
+    pthread_t ts, tr, tk;
+
+    double t0 = clock_sec(CLOCK_MONOTONIC);
+    pthread_create(&tk, NULL, sink_main, &dst_r);
+    pthread_create(&tr, NULL, relay_main, &relay);
+    pthread_create(&ts, NULL, source_main, &source);
+    pthread_join(ts, NULL);
+    pthread_join(tr, NULL);
+    pthread_join(tk, NULL);
+    double wall = clock_sec(CLOCK_MONOTONIC) - t0;
+
+    double gbit = (double)bytes * 8 / 1e9;
+    printf("  %-8s %8.2f Gbit/s %9.3f relay CPU s/Gbit\n", label, gbit / wall, relay.cpu / gbit);
+
+    close(src_w); close(src_r); close(dst_w); close(dst_r);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? (size_t)atol(argv[1]) : 2048;
+    size_t bytes = mb << 20;
+
+    printf("relaying %zu MB over loopback\n", mb);
+    run("copy", bytes, 0);
+    splice_pipe probe;
+    splice_pipe_init(&probe);
+    if (splice_pipe_open(&probe, 0) < 0) {
+        printf("  %-8s unsupported\n", "splice");
+        return 0;
+    }
+    splice_pipe_close(&probe);
+    run("splice", bytes, 1);
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  bench_scan.c      –  structural scanner / parser microbenchmark
+ *
+ *  Builds browser-like request header blocks with 10, 20 and 40 headers
+ *  and reports GB/s for:
+ *      legacy      strstr("\r\n") per line + memchr(':') per header – the
+ *                  scanning the parser did before proxy_scan.c
+ *      scan/<isa>  scan_structural() with each kernel the CPU supports
+ *      walk/<isa>  scan + hop LF to LF finding each header's colon – the
+ *                  same work as `legacy`, driven by the bitmaps
+ *      parse/<isa> full ParsedRequest_parse_inplace() with that kernel
+ *
+ *  Build:  make bench   →   build/bench/bench_scan
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_parse.h"
+#include "proxy_scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_SECONDS  0.25
+
+static const char* const browser_headers[] = {
+    "Host: www.example.com",
+    "Connection: keep-alive",
+    "Cache-Control: max-age=0",
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"",
+    "sec-ch-ua-mobile: ?0",
+    "sec-ch-ua-platform: \"Linux\"",
+    "Upgrade-Insecure-Requests: 1",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+    "Sec-Fetch-Site: same-origin",
+    "Sec-Fetch-Mode: navigate",
+    "Sec-Fetch-User: ?1",
+    "Sec-Fetch-Dest: document",
+    "Referer: http://www.example.com/articles/2024/05/some-long-article-slug?utm_source=feed",
+    "Accept-Encoding: gzip, deflate, br",
+    "Accept-Language: en-GB,en-US;q=0.9,en;q=0.8",
+    "Cookie: session=9f8e7d6c5b4a39281706f5e4d3c2b1a0; prefs=theme%3Ddark%26lang%3Den; _ga=GA1.2.1234567890.1700000000",
+    "If-None-Match: W/\"5e1f-18c2a3b4d5e\"",
+    "If-Modified-Since: Tue, 14 May 2024 09:12:44 GMT",
+    "DNT: 1",
+};
+#define N_BROWSER_HEADERS (sizeof browser_headers / sizeof browser_headers[0])
+
+static size_t build_request(char* dst, size_t cap, int headers)
+{
+    size_t n = (size_t)snprintf(dst, cap,
+        "GET http://www.example.com/articles/2024/05/index.html?page=2 HTTP/1.1\r\n");
+    for (int i = 0; i < headers; ++i) {
+        if ((size_t)i < N_BROWSER_HEADERS)
+            n += (size_t)snprintf(dst + n, cap - n, "%s\r\n", browser_headers[i]);
+        else
+            n += (size_t)snprintf(dst + n, cap - n,
+                "X-Trace-Attribute-%02d: tenant=acme region=eu-west-1 shard=%d\r\n", i, i * 7);
+    }
+    n += (size_t)snprintf(dst + n, cap - n, "\r\n");
+    return n;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* The old parser's scanning, minus its allocations. */
+static size_t legacy_walk(const char* buf, size_t len)
+{
+    size_t found = 0;
+    const char* eol = strstr(buf, "\r\n");
+    if (!eol) return 0;
+    const char* cursor = eol + 2;
+    while (cursor < buf + len && !(cursor[0] == '\r' && cursor[1] == '\n')) {
+        const char* line_end = strstr(cursor, "\r\n");
+        if (!line_end) break;
+        if (memchr(cursor, ':', (size_t)(line_end - cursor))) ++found;
+        cursor = line_end + 2;
+    }
+    return found;
+}
+
+static volatile size_t sink;
+
+typedef size_t (*bench_fn)(const char* req, size_t len, char* scratch, uint64_t* bits);
+
+static size_t run_legacy(const char* req, size_t len, char* scratch, uint64_t* bits)
+{
+    (void)scratch; (void)bits;
+    return legacy_walk(req, len);
+}
+
+static size_t run_scan(const char* req, size_t len, char* scratch, uint64_t* bits)
+{
+    (void)scratch;
+    scan_structural(req, len, bits, bits + scan_words(len));
+    return (size_t)bits[0];
+}
+
+static size_t next_bit(const uint64_t* map, size_t from, size_t to)
+{
+    while (from < to) {
+        uint64_t m = map[from >> 6] & (~0ull << (from & 63));
+        if (m) {
+            size_t p = (from & ~(size_t)63) + scan_ctz64(m);
+            return p < to ? p : to;
+        }
+        from = (from | 63) + 1;
+    }
+    return to;
+}
+
+static size_t run_walk(const char* req, size_t len, char* scratch, uint64_t* bits)
+{
+    (void)scratch;
+    uint64_t* lines = bits;
+    uint64_t* delims = bits + scan_words(len);
+    scan_structural(req, len, lines, delims);
+
+    size_t found = 0, start = 0;
+    for (size_t p = next_bit(lines, 0, len); p < len; p = next_bit(lines, p + 1, len)) {
+        if (req[p] != '\n') continue;
+        if (start > 0) {
+            for (size_t d = next_bit(delims, start, p); d < p; d = next_bit(delims, d + 1, p))
+                if (req[d] == ':') { ++found; break; }
+        }
+        start = p + 1;
+    }
+    return found;
+}
+
+static ParsedRequest* bench_pr;
+
+static size_t run_parse(const char* req, size_t len, char* scratch, uint64_t* bits)
+{
+    (void)bits;
+    memcpy(scratch, req, len);
+    ParsedRequest_parse_inplace(bench_pr, scratch, (int)len);
+    return bench_pr->headers_in_use;
+}
+
+static void measure(const char* label, bench_fn fn, const char* req, size_t len)
+{
+    char* scratch = (char*)malloc(len + 1);
+    uint64_t* bits = (uint64_t*)calloc(2 * scan_words(len), sizeof(uint64_t));
+
+    size_t iters = 1000;
+    double elapsed;
+    for (;;) {
+        double t0 = now_sec();
+        for (size_t i = 0; i < iters; ++i) sink += fn(req, len, scratch, bits);
+        elapsed = now_sec() - t0;
+        if (elapsed >= TARGET_SECONDS) break;
+        iters *= elapsed > 0.01 ? (size_t)(TARGET_SECONDS / elapsed) + 1 : 10;
+    }
+
+    double gbps = (double)len * (double)iters / elapsed / 1e9;
+    double ns = elapsed * 1e9 / (double)iters;
+    printf("  %-14s %8.2f GB/s %9.1f ns/req\n", label, gbps, ns);
+    free(scratch);
+    free(bits);
+}
+
+int main(void)
+{
+    static const scan_impl impls[] = { SCAN_IMPL_SCALAR, SCAN_IMPL_SSE42, SCAN_IMPL_AVX2 };
+    static const char* const names[] = { "scalar", "sse4.2", "avx2" };
+    static const int header_counts[] = { 10, 20, 40 };
+
+    bench_pr = ParsedRequest_create();
+    char req[16384];
+
+    for (size_t h = 0; h < sizeof header_counts / sizeof header_counts[0]; ++h) {
+        size_t len = build_request(req, sizeof req, header_counts[h]);
+        printf("%d headers, %zu bytes\n", header_counts[h], len);
+
+        measure("legacy", run_legacy, req, len);
+        for (size_t k = 0; k < 3; ++k) {
+            char label[32];
+            if (scan_set_impl(impls[k]) < 0) { printf("  %-14s unsupported\n", names[k]); continue; }
+            snprintf(label, sizeof label, "scan/%s", names[k]);
+            measure(label, run_scan, req, len);
+            snprintf(label, sizeof label, "walk/%s", names[k]);
+            measure(label, run_walk, req, len);
+            snprintf(label, sizeof label, "parse/%s", names[k]);
+            measure(label, run_parse, req, len);
+        }
+    }
+
+    ParsedRequest_destroy(bench_pr);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  cache_sim.c      –  offline trace replay through the cache
+ *
+ *  Feeds a request trace through proxy_cache.c itself – cache_open(),
+ *  a fill of the recorded size, cache_fill_finish() – once per admission
+ *  policy, and reports object and byte hit ratios side by side:
+ *
+ *      cache_sim [--capacity=MB] [--shards=N] [--max-object=BYTES]
+ *                [--policy=all|tinylfu|tinylfu-bytes|lru] [TRACE]
+ *
+ *  TRACE has one request per line, `URL [BYTES]` (BYTES defaults to
+ *  4096; blank lines and # comments are skipped), so most logs convert
+ *  with a one-liner, e.g. a Squid access.log: awk '{print $7, $5}'.
+ *
+ *  Without a trace it generates one: Zipf(0.9) requests over SIM_HOT
+ *  objects of 4–32 KB, with one request in five for a never-repeated
+ *  object of 64 KB–1 MB – the crawler and download traffic that flushes
+ *  a plain LRU.
+ *
+ *  Each policy runs in a forked child, so every run starts from an
+ *  empty cache (cache_init() is once per process). Fills don't write
+ *  their bytes, so pages are reserved but mostly never touched.
+ *
+ *  Build:  make bench   →   build/bench/cache_sim
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_cache.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_CAPACITY_MB 64
+#define SIM_DEFAULT_SIZE 4096               /* trace lines without one   */
+#define SIM_REQUESTS    2000000             /* generated trace           */
+#define SIM_HOT         50000
+#define SIM_ZIPF        0.9
+#define SIM_SCAN_EVERY  5                   /* one request in five       */
+
+typedef struct sim_trace {
+    char*     urls;                         /* NUL-separated             */
+    size_t    urls_len, urls_cap;
+    size_t*   url_off;
+    size_t*   size;
+    size_t    count, cap;
+} sim_trace;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void trace_add(sim_trace* t, const char* url, size_t len, size_t size)
+{
+    if (t->count == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 4096;
+        t->url_off = (size_t*)realloc(t->url_off, t->cap * sizeof *t->url_off);
+        t->size = (size_t*)realloc(t->size, t->cap * sizeof *t->size);
+        if (!t->url_off || !t->size) { perror("trace"); exit(1); }
+    }
+    while (t->urls_len + len + 1 > t->urls_cap) {
+        t->urls_cap = t->urls_cap ? t->urls_cap * 2 : 1 << 20;
+        t->urls = (char*)realloc(t->urls, t->urls_cap);
+        if (!t->urls) { perror("trace"); exit(1); }
+    }
+    t->url_off[t->count] = t->urls_len;
+    t->size[t->count] = size;
+    memcpy(t->urls + t->urls_len, url, len);
+    t->urls_len += len;
+    t->urls[t->urls_len++] = '\0';
+    ++t->count;
+}
+
+static int trace_load(sim_trace* t, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char* line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0) {
+        char* url = line + strspn(line, " \t");
+        size_t len = strcspn(url, " \t\r\n");
+        if (len == 0 || url[0] == '#') continue;
+
+        char* end;
+        unsigned long long size = strtoull(url + len, &end, 10);
+        if (end == url + len) size = SIM_DEFAULT_SIZE;
+        trace_add(t, url, len, (size_t)size);
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static uint64_t rng_next(uint64_t* s)
+{
+    *s ^= *s >> 12; *s ^= *s << 25; *s ^= *s >> 27;
+    return *s * 2685821657736338717ull;
+}
+
+static double rng_unit(uint64_t* s)
+{
+    return (double)(rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void trace_generate(sim_trace* t)
+{
+    double* cdf = (double*)malloc(SIM_HOT * sizeof *cdf);
+    if (!cdf) { perror("trace"); exit(1); }
+    double sum = 0;
+    for (unsigned k = 0; k < SIM_HOT; ++k) cdf[k] = sum += 1.0 / pow(k + 1, SIM_ZIPF);
+    for (unsigned k = 0; k < SIM_HOT; ++k) cdf[k] /= sum;
+
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    char url[96];
+    for (unsigned i = 0, scans = 0; i < SIM_REQUESTS; ++i) {
+        int len;
+        size_t size;
+        if (i % SIM_SCAN_EVERY == SIM_SCAN_EVERY - 1) {
+            len = snprintf(url, sizeof url, "http://downloads.example.com/scan/%u.bin", scans++);
+            size = (64u << 10) + rng_next(&rng) % (960u << 10);
+        }
+        else {
+            double u = rng_unit(&rng);
+            unsigned lo = 0, hi = SIM_HOT - 1;
+            while (lo < hi) {
+                unsigned mid = (lo + hi) / 2;
+                if (cdf[mid] < u) lo = mid + 1;
+                else hi = mid;
+            }
+            len = snprintf(url, sizeof url, "http://www.example.com/static/%u.js", lo);
+            size = (4u << 10) + (lo * 2654435761u) % (28u << 10);   /* fixed per key */
+        }
+        trace_add(t, url, (size_t)len, size);
+    }
+    free(cdf);
+}
+
+/* Replay t through a fresh cache under `policy`; one table row.     */
+static void replay(const sim_trace* t, cache_admission policy, size_t capacity,
+                   unsigned shards, size_t max_object)
+{
+    cache_set_admission(policy, max_object);
+    cache_init(capacity, shards);
+
+    uint64_t hits = 0, hit_bytes = 0, bytes = 0;
+    double t0 = now_sec();
+    for (size_t i = 0; i < t->count; ++i) {
+        const char* url = t->urls + t->url_off[i];
+        size_t len = strlen(url), size = t->size[i];
+        bytes += size;
+
+        int filler;
+        cache_element* e = cache_open(url, len, cache_hash(url, len), &filler, NULL);
+        if (!e) continue;
+        if (!filler) {
+            ++hits;
+            hit_bytes += size;
+        }
+        else if (cache_fill_reserve(e, size) == 0) {
+            for (size_t done = 0; done < size;) {
+                size_t room;
+                if (!cache_fill_space(e, &room)) break;
+                if (room > size - done) room = size - done;
+                cache_fill_commit(e, room);
+                done += room;
+            }
+            cache_fill_finish(e, 1);
+        }
+        cache_release(e);
+    }
+    double elapsed = now_sec() - t0;
+
+    cache_stats cs;
+    cache_get_stats(&cs);
+    printf("  %-14s %7.2f%% %7.2f%% %10llu %10llu %9llu %9.0f\n", cache_admission_name(policy),
+           100.0 * (double)hits / (double)t->count,
+           bytes ? 100.0 * (double)hit_bytes / (double)bytes : 0.0,
+           (unsigned long long)cs.evictions, (unsigned long long)cs.rejected,
+           (unsigned long long)cs.oversize, (double)t->count / elapsed);
+}
+
+int main(int argc, char** argv)
+{
+    size_t capacity = (size_t)SIM_CAPACITY_MB << 20, max_object = 0;
+    unsigned shards = CACHE_SHARDS;
+    const char* policy = "all";
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--capacity=", 11) == 0)
+            capacity = (size_t)strtoull(argv[i] + 11, NULL, 10) << 20;
+        else if (strncmp(argv[i], "--shards=", 9) == 0) shards = (unsigned)atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--max-object=", 13) == 0)
+            max_object = (size_t)strtoull(argv[i] + 13, NULL, 10);
+        else if (strncmp(argv[i], "--policy=", 9) == 0) policy = argv[i] + 9;
+        else if (argv[i][0] != '-') path = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [--capacity=MB] [--shards=N] [--max-object=BYTES]"
+                            " [--policy=all|tinylfu|tinylfu-bytes|lru] [TRACE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    cache_admission only = CACHE_ADMIT_LRU;
+    if (strcmp(policy, "all") != 0 && cache_admission_parse(policy, &only) < 0) {
+        fprintf(stderr, "%s: unknown policy\n", policy);
+        return 2;
+    }
+
+    sim_trace t = { 0 };
+    if (path && trace_load(&t, path) < 0) { perror(path); return 1; }
+    if (!path) trace_generate(&t);
+    if (!t.count) { fprintf(stderr, "empty trace\n"); return 1; }
+
+    printf("%zu requests from %s, %zu MB cache, %u shards\n", t.count,
+           path ? path : "the generator", capacity >> 20, shards);
+    printf("  %-14s %8s %8s %10s %10s %9s %9s\n", "policy", "hits", "bytehits",
+           "evicted", "rejected", "oversize", "req/s");
+
+    static const cache_admission policies[] = {
+        CACHE_ADMIT_LRU, CACHE_ADMIT_TINYLFU, CACHE_ADMIT_TINYLFU_BYTES,
+    };
+    for (unsigned p = 0; p < sizeof policies / sizeof policies[0]; ++p) {
+        if (strcmp(policy, "all") != 0 && policies[p] != only) continue;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); return 1; }
+        if (pid == 0) {
+            replay(&t, policies[p], capacity, shards, max_object);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    free(t.urls);
+    free(t.url_off);
+    free(t.size);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  loadgen.c      –  HTTP load generator for the proxy
+ *
+ *  Drives the proxy with GETs for bench/origin.c objects and reports
+ *  throughput and p50/p99/p999 latency, once per requested cache hit
+ *  ratio:
+ *
+ *      hit ratio h   each request is, with probability h, one of --keys
+ *                    "hot" URLs (fetched once beforehand, so they are
+ *                    cached), else a URL nobody asked for before – a
+ *                    guaranteed miss. Every run uses fresh URLs.
+ *      closed loop   (default) --conns requests in flight at all times;
+ *                    each worker sends its next request when the last
+ *                    one completes
+ *      open loop     --rate=R: requests start on a fixed schedule of R/s
+ *                    whatever the proxy does. Latency is measured from
+ *                    the scheduled start, so a stall is charged to every
+ *                    request queued behind it (no coordinated omission).
+ *                    --conns then bounds the requests in flight.
+ *
+ *  One connection per request (Connection: close) by default, latency
+ *  from connect() to the last body byte. --keepalive gives each worker
+ *  one persistent connection instead, so latency is from send() to the
+ *  last body byte and the connect is only paid when the proxy closes.
+ *
+ *  Run:    build/bench/loadgen [--proxy=127.0.0.1:8080]
+ *              [--origin=127.0.0.1:9100] [--conns=32] [--duration=10]
+ *              [--rate=0] [--hit=0,0.5,0.9,1] [--size=4096] [--keys=1000]
+ *              [--delay=0] [--keepalive]
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define RECV_CHUNK   (64 * 1024)
+#define MAX_HITS     16
+
+typedef struct config {
+    struct sockaddr_in proxy;
+    char     origin[64];            /* host:port in the URLs             */
+    unsigned conns;
+    double   duration, rate;        /* rate 0 → closed loop              */
+    double   hits[MAX_HITS];
+    unsigned n_hits;
+    long     size, delay;
+    unsigned keys;
+    int      keepalive;             /* reuse one connection per worker   */
+} config;
+
+typedef struct worker {
+    pthread_t  thread;
+    unsigned   id;
+    const config* cfg;
+    double     hit;
+    unsigned   run;                 /* makes URLs unique per run         */
+    double     start, end;          /* CLOCK_MONOTONIC seconds           */
+    uint64_t   rng;
+
+    uint64_t*  lat;                 /* ns per completed request          */
+    size_t     n_lat, cap_lat;
+    uint64_t   bytes, errors;
+} worker;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_rand(uint64_t* s)             /* xorshift64*        */
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+
+/*──────────────────── One request ──────────────────────────────────*/
+
+static int dial(const config* cfg)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if (connect(fd, (const struct sockaddr*)&cfg->proxy, sizeof cfg->proxy) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Body bytes received, or -1 on any failure (connect, status ≠ 200,
+ * short body). With --keepalive, *fd is the worker's connection: it is
+ * opened on demand and left open for the next request unless the
+ * proxy closes it or the body is close-delimited. A reused connection
+ * that fails before any response byte was closed by the proxy while
+ * idle, so the request is retried once on a fresh one.               */
+static long fetch(const config* cfg, int* fd, const char* url, char* buf)
+{
+    int reused = *fd >= 0;
+    if (!reused && (*fd = dial(cfg)) < 0) return -1;
+
+    int n = snprintf(buf, RECV_CHUNK, "GET %s HTTP/1.1\r\nHost: %s\r\n"
+                     "Connection: %s\r\n\r\n", url, cfg->origin,
+                     cfg->keepalive ? "keep-alive" : "close");
+    size_t have = 0;
+    long head = -1, length = -1, body = 0;
+    int status = 0, close_after = !cfg->keepalive;
+    if (send(*fd, buf, (size_t)n, MSG_NOSIGNAL) != n) goto fail;
+
+    while (head < 0 || length < 0 || body < length) {
+        ssize_t k = recv(*fd, buf + have, RECV_CHUNK - 1 - have, 0);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            if (head < 0 && have == 0) goto fail;
+            close_after = 1;
+            break;
+        }
+        if (head >= 0) {                            /* body: just count */
+            body += k;
+            continue;
+        }
+        have += (size_t)k;
+        buf[have] = '\0';
+        char* end = strstr(buf, "\r\n\r\n");
+        if (!end) {
+            if (have == RECV_CHUNK - 1) break;
+            continue;
+        }
+        head = end + 4 - buf;
+        body = (long)have - head;
+        sscanf(buf, "HTTP/1.%*d %d", &status);
+        char* cl = strcasestr(buf, "\r\nContent-Length:");
+        if (cl && cl < end) length = strtol(cl + 17, NULL, 10);
+        char* conn = strcasestr(buf, "\r\nConnection: close");
+        if (length < 0 || (conn && conn < end)) close_after = 1;
+        have = 0;
+    }
+    if (close_after || head < 0) {
+        close(*fd);
+        *fd = -1;
+    }
+
+    if (status != 200 || (length >= 0 && body != length)) return -1;
+    return body;
+
+fail:
+    close(*fd);
+    *fd = -1;
+    return reused ? fetch(cfg, fd, url, buf) : -1;
+}
+
+static void record(worker* w, double started)
+{
+    if (w->n_lat == w->cap_lat) {
+        size_t cap = w->cap_lat ? 2 * w->cap_lat : 4096;
+        uint64_t* lat = (uint64_t*)realloc(w->lat, cap * sizeof *lat);
+        if (!lat) return;
+        w->lat = lat;
+        w->cap_lat = cap;
+    }
+    w->lat[w->n_lat++] = (uint64_t)((now_sec() - started) * 1e9);
+}
+
+static void make_url(worker* w, char* url, size_t cap, unsigned seq)
+{
+    const config* cfg = w->cfg;
+    if (next_rand(&w->rng) % 1000000 < (uint64_t)(w->hit * 1000000))
+        snprintf(url, cap, "http://%s/%ld?d=%ld&k=r%u-h%u", cfg->origin, cfg->size,
+                 cfg->delay, w->run, (unsigned)(next_rand(&w->rng) % cfg->keys));
+    else
+        snprintf(url, cap, "http://%s/%ld?d=%ld&k=r%u-m%u-%u", cfg->origin, cfg->size,
+                 cfg->delay, w->run, w->id, seq);
+}
+
+
+/*──────────────────── Workers ──────────────────────────────────────*/
+
+static void* worker_main(void* arg)
+{
+    worker* w = (worker*)arg;
+    const config* cfg = w->cfg;
+    char* buf = (char*)malloc(RECV_CHUNK);
+    char url[256];
+    int fd = -1;
+    if (!buf) return NULL;
+
+    /* Open loop: worker i owns every conns-th slot of the schedule. */
+    double interval = cfg->rate > 0 ? cfg->conns / cfg->rate : 0;
+    double due = w->start + (cfg->rate > 0 ? w->id / cfg->rate : 0);
+
+    for (unsigned seq = 0;; ++seq) {
+        double started = now_sec();
+        if (interval > 0) {
+            if (due >= w->end) break;
+            if (due > started) {
+                struct timespec ts;
+                double wait = due - started;
+                ts.tv_sec = (time_t)wait;
+                ts.tv_nsec = (long)((wait - (double)ts.tv_sec) * 1e9);
+                nanosleep(&ts, NULL);
+            }
+            started = due;                          /* charge the queueing */
+            due += interval;
+        }
+        else if (started >= w->end) {
+            break;
+        }
+
+        make_url(w, url, sizeof url, seq);
+        long got = fetch(cfg, &fd, url, buf);
+        if (got < 0) {
+            ++w->errors;
+            continue;
+        }
+        w->bytes += (uint64_t)got;
+        record(w, started);
+    }
+    if (fd >= 0) close(fd);
+    free(buf);
+    return NULL;
+}
+
+/* Fetch every hot URL of `run` once so the measured run hits them.   */
+static void warm(const config* cfg, unsigned run)
+{
+    char* buf = (char*)malloc(RECV_CHUNK);
+    char url[256];
+    int fd = -1;
+    if (!buf) return;
+    for (unsigned k = 0; k < cfg->keys; ++k) {
+        snprintf(url, sizeof url, "http://%s/%ld?d=%ld&k=r%u-h%u",
+                 cfg->origin, cfg->size, cfg->delay, run, k);
+        fetch(cfg, &fd, url, buf);
+    }
+    if (fd >= 0) close(fd);
+    free(buf);
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t* v, size_t n, double p)
+{
+    if (n == 0) return 0;
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return (double)v[i] / 1e3;
+}
+
+static void run_one(const config* cfg, double hit, unsigned run)
+{
+    if (hit > 0) warm(cfg, run);
+
+    worker* ws = (worker*)calloc(cfg->conns, sizeof *ws);
+    if (!ws) return;
+    double start = now_sec() + 0.01;
+    for (unsigned i = 0; i < cfg->conns; ++i) {
+        ws[i].id = i;
+        ws[i].cfg = cfg;
+        ws[i].hit = hit;
+        ws[i].run = run;
+        ws[i].start = start;
+        ws[i].end = start + cfg->duration;
+        ws[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1) ^ run;
+        pthread_create(&ws[i].thread, NULL, worker_main, &ws[i]);
+    }
+
+    size_t total = 0;
+    uint64_t bytes = 0, errors = 0;
+    for (unsigned i = 0; i < cfg->conns; ++i) {
+        pthread_join(ws[i].thread, NULL);
+        total += ws[i].n_lat;
+        bytes += ws[i].bytes;
+        errors += ws[i].errors;
+    }
+    double wall = now_sec() - start;
+
+    uint64_t* all = (uint64_t*)malloc((total ? total : 1) * sizeof *all);
+    size_t n = 0;
+    for (unsigned i = 0; i < cfg->conns; ++i) {
+        if (all) memcpy(all + n, ws[i].lat, ws[i].n_lat * sizeof *all);
+        n += ws[i].n_lat;
+        free(ws[i].lat);
+    }
+    free(ws);
+    if (!all) return;
+    qsort(all, n, sizeof *all, cmp_u64);
+
+    printf("%5.2f %6s %6u %9zu %10.0f %9.1f %9.0f %9.0f %9.0f %7llu\n",
+           hit, cfg->rate > 0 ? "open" : "closed", cfg->conns, n,
+           (double)n / wall, (double)bytes / wall / 1e6,
+           pct_us(all, n, 0.50), pct_us(all, n, 0.99), pct_us(all, n, 0.999),
+           (unsigned long long)errors);
+    fflush(stdout);
+    free(all);
+}
+
+
+/*──────────────────── main ────────────────────────────────────────*/
+
+static int parse_hostport(const char* s, struct sockaddr_in* out)
+{
+    char host[64];
+    const char* colon = strrchr(s, ':');
+    if (!colon || (size_t)(colon - s) >= sizeof host) return -1;
+    memcpy(host, s, (size_t)(colon - s));
+    host[colon - s] = '\0';
+    memset(out, 0, sizeof *out);
+    out->sin_family = AF_INET;
+    out->sin_port = htons((unsigned short)atoi(colon + 1));
+    return inet_pton(AF_INET, host, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    config cfg = { 0 };
+    const char* proxy = "127.0.0.1:8080";
+    snprintf(cfg.origin, sizeof cfg.origin, "127.0.0.1:9100");
+    cfg.conns = 32;
+    cfg.duration = 10;
+    cfg.hits[0] = 0.9;
+    cfg.n_hits = 1;
+    cfg.size = 4096;
+    cfg.keys = 1000;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        if (strncmp(a, "--proxy=", 8) == 0)          proxy = a + 8;
+        else if (strncmp(a, "--origin=", 9) == 0)    snprintf(cfg.origin, sizeof cfg.origin, "%s", a + 9);
+        else if (strncmp(a, "--conns=", 8) == 0)     cfg.conns = (unsigned)atoi(a + 8);
+        else if (strncmp(a, "--duration=", 11) == 0) cfg.duration = atof(a + 11);
+        else if (strncmp(a, "--rate=", 7) == 0)      cfg.rate = atof(a + 7);
+        else if (strncmp(a, "--size=", 7) == 0)      cfg.size = atol(a + 7);
+        else if (strncmp(a, "--keys=", 7) == 0)      cfg.keys = (unsigned)atoi(a + 7);
+        else if (strncmp(a, "--delay=", 8) == 0)     cfg.delay = atol(a + 8);
+        else if (strcmp(a, "--keepalive") == 0)      cfg.keepalive = 1;
+        else if (strncmp(a, "--hit=", 6) == 0) {
+            cfg.n_hits = 0;
+            for (char* p = (char*)a + 6; *p && cfg.n_hits < MAX_HITS; ) {
+                cfg.hits[cfg.n_hits++] = strtod(p, &p);
+                if (*p == ',') ++p;
+                else break;
+            }
+        }
+        else {
+            fprintf(stderr, "usage: %s [--proxy=H:P] [--origin=H:P] [--conns=N] [--duration=S]\n"
+                            "          [--rate=R] [--hit=H[,H…]] [--size=B] [--keys=K] [--delay=MS]\n"
+                            "          [--keepalive]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (parse_hostport(proxy, &cfg.proxy) < 0 || cfg.conns == 0 || cfg.keys == 0) {
+        fprintf(stderr, "loadgen: bad --proxy, --conns or --keys\n");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("# proxy %s  origin %s  %ld-byte objects  %ld ms origin delay  %u hot keys  %.0f s/run%s\n",
+           proxy, cfg.origin, cfg.size, cfg.delay, cfg.keys, cfg.duration,
+           cfg.keepalive ? "  keep-alive" : "");
+    printf("%5s %6s %6s %9s %10s %9s %9s %9s %9s %7s\n",
+           "hit", "loop", "conns", "requests", "req/s", "MB/s", "p50 us", "p99 us", "p999 us", "errors");
+
+    unsigned base = (unsigned)time(NULL) ^ ((unsigned)getpid() << 16);
+    for (unsigned i = 0; i < cfg.n_hits; ++i) run_one(&cfg, cfg.hits[i], base + i);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  origin.c      –  stand-in origin server for load tests
+ *
+ *  Answers every GET with a Content-Length body whose size and delay
+ *  come from the URL, so a load run needs nothing but this and the
+ *  proxy:
+ *
+ *      /<bytes>[?d=<ms>&…]     <bytes> of body after <ms> of "think time"
+ *      anything else           --size bytes after --delay ms
+ *
+ *  Other query parameters are ignored; loadgen uses them to make
+ *  distinct cache keys for the same object. Connections are HTTP/1.1
+ *  keep-alive (the proxy pools them) unless the request says close.
+ *  One thread per connection: it only has to outrun the proxy.
+ *
+ *  Run:    build/bench/origin [--port=9100] [--size=BYTES] [--delay=MS]
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define ORIGIN_REQ_MAX   (16 * 1024)
+#define BODY_CHUNK       (256 * 1024)       /* one pattern, sent repeatedly */
+
+static long  default_size  = 4096;
+static long  default_delay = 0;             /* ms                          */
+static char  body[BODY_CHUNK];
+
+static int send_all(int fd, const char* p, size_t n)
+{
+    while (n > 0) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+/* Size and delay for the request line "GET <target> HTTP/1.x".      */
+static void parse_target(const char* req, long* size, long* delay)
+{
+    *size = default_size;
+    *delay = default_delay;
+
+    const char* t = strchr(req, ' ');
+    if (!t) return;
+    ++t;
+    if (strncmp(t, "http://", 7) == 0) {            /* absolute-form */
+        t = strchr(t + 7, '/');
+        if (!t) return;
+    }
+    if (*t == '/' && t[1] >= '0' && t[1] <= '9') *size = strtol(t + 1, NULL, 10);
+
+    const char* end = t + strcspn(t, " \r\n");
+    for (const char* q = t; q + 3 < end; ++q)
+        if ((*q == '?' || *q == '&') && q[1] == 'd' && q[2] == '=')
+            *delay = strtol(q + 3, NULL, 10);
+}
+
+static int wants_close(const char* req, const char* hdr_end)
+{
+    for (const char* p = strstr(req, "\r\n"); p && p < hdr_end; p = strstr(p + 2, "\r\n"))
+        if (strncasecmp(p + 2, "Connection:", 11) == 0) {
+            const char* v = p + 13;
+            while (*v == ' ') ++v;
+            return strncasecmp(v, "close", 5) == 0;
+        }
+    return strstr(req, "HTTP/1.0\r\n") != NULL;
+}
+
+static int respond(int fd, long size, int close_after)
+{
+    char head[256];
+    int n = snprintf(head, sizeof head,
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: %ld\r\n"
+                     "Connection: %s\r\n\r\n",
+                     size, close_after ? "close" : "keep-alive");
+    if (send_all(fd, head, (size_t)n) < 0) return -1;
+    for (long left = size; left > 0;) {
+        size_t k = left < BODY_CHUNK ? (size_t)left : BODY_CHUNK;
+        if (send_all(fd, body, k) < 0) return -1;
+        left -= (long)k;
+    }
+    return 0;
+}
+
+static void* conn_main(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char* buf = (char*)malloc(ORIGIN_REQ_MAX + 1);
+    size_t len = 0;
+
+    while (buf) {
+        buf[len] = '\0';
+        char* end = strstr(buf, "\r\n\r\n");
+        if (!end) {
+            if (len == ORIGIN_REQ_MAX) break;
+            ssize_t n = recv(fd, buf + len, ORIGIN_REQ_MAX - len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            len += (size_t)n;
+            continue;
+        }
+
+        long size, delay;
+        parse_target(buf, &size, &delay);
+        int close_after = wants_close(buf, end);
+        if (delay > 0) {
+            struct timespec ts = { delay / 1000, (delay % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+        if (respond(fd, size, close_after) < 0 || close_after) break;
+
+        size_t used = (size_t)(end + 4 - buf);          /* pipelined rest */
+        memmove(buf, buf + used, len - used);
+        len -= used;
+    }
+
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int port = 9100;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--port=", 7) == 0)       port = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--size=", 7) == 0)  default_size = atol(argv[i] + 7);
+        else if (strncmp(argv[i], "--delay=", 8) == 0) default_delay = atol(argv[i] + 8);
+        else {
+            fprintf(stderr, "usage: %s [--port=N] [--size=BYTES] [--delay=MS]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof body; ++i) body[i] = (char)('a' + i % 26);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (lfd < 0 || bind(lfd, (struct sockaddr*)&addr, sizeof addr) < 0 || listen(lfd, 1024) < 0) {
+        perror("origin");
+        return 1;
+    }
+    fprintf(stderr, "origin on 127.0.0.1:%d (default %ld bytes, %ld ms)\n",
+            port, default_size, default_delay);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            return 1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        pthread_t t;
+        if (pthread_create(&t, &attr, conn_main, (void*)(intptr_t)fd) != 0) close(fd);
+    }
+}
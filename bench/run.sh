@@ -0,0 +1,96 @@
+#!/bin/sh
+# Baseline load sweep: starts bench/origin and the proxy on loopback,
+# runs loadgen across cache hit ratios for each front end, then the
+# microbenchmarks. Run from the repo root after `make bench`, or via
+# `make bench-run`. Everything is overridable from the environment:
+#
+#   MODES="epoll uring threaded"  HITS=0,0.5,0.9,0.99,1  CONNS=32  DURATION=10
+#   SIZE=4096  KEYS=1000  DELAY=0  RATE=0 (closed loop)  KEEPALIVE=0  MICRO=1
+#   PROXY_PORT=8080  ORIGIN_PORT=9100
+#
+# After each mode's table comes what the proxy cost per request over
+# the whole sweep (hot-key warm-up included): context switches, from
+# /proc, and syscalls when perf(1) can count them. Those two are what
+# --mode=uring batches away.
+#
+# Compare two trees by running this in each and diffing the tables.
+
+set -eu
+
+BIN=build/bench
+MODES=${MODES:-"epoll uring threaded"}
+HITS=${HITS:-0,0.5,0.9,0.99,1}
+CONNS=${CONNS:-32}
+DURATION=${DURATION:-10}
+SIZE=${SIZE:-4096}
+KEYS=${KEYS:-1000}
+DELAY=${DELAY:-0}
+RATE=${RATE:-0}
+KEEPALIVE=${KEEPALIVE:-0}
+MICRO=${MICRO:-1}
+PROXY_PORT=${PROXY_PORT:-8080}
+ORIGIN_PORT=${ORIGIN_PORT:-9100}
+
+for b in proxy $BIN/origin $BIN/loadgen; do
+    [ -x "$b" ] || { echo "missing $b: run make bench" >&2; exit 1; }
+done
+
+pids=""
+cleanup() { [ -n "$pids" ] && kill $pids 2>/dev/null; wait 2>/dev/null || true; }
+out=$(mktemp -d)
+trap 'cleanup; rm -rf "$out"' EXIT INT TERM
+
+# Sum of voluntary + involuntary context switches over pid's threads.
+ctxsw() {
+    cat /proc/"$1"/task/*/status 2>/dev/null |
+        awk '/ctxt_switches/ { n += $2 } END { print n + 0 }'
+}
+
+# perf counting the proxy's syscalls, when it is there and allowed to.
+perf=""
+if command -v perf >/dev/null 2>&1 &&
+   perf stat -e raw_syscalls:sys_enter -x, -o /dev/null true 2>/dev/null; then
+    perf="perf stat -e raw_syscalls:sys_enter -x, -o $out/perf"
+fi
+
+$BIN/origin --port="$ORIGIN_PORT" 2>/dev/null &
+pids="$!"
+
+echo "## $(git rev-parse --short HEAD 2>/dev/null || echo '?')  $(uname -sr)  $(nproc) CPUs"
+for mode in $MODES; do
+    rm -f "$out/perf"
+    $perf ./proxy "$PROXY_PORT" --mode="$mode" >/dev/null 2>&1 &
+    proxy_pid=$!
+    pids="$pids $proxy_pid"
+    sleep 0.5
+    target=$proxy_pid
+    [ -n "$perf" ] && target=$(pgrep -P "$proxy_pid" -x proxy || echo "$proxy_pid")
+    sw0=$(ctxsw "$target")
+
+    ka=""
+    [ "$KEEPALIVE" = 1 ] && ka=--keepalive
+    echo "### $mode"
+    $BIN/loadgen $ka --proxy=127.0.0.1:"$PROXY_PORT" --origin=127.0.0.1:"$ORIGIN_PORT" \
+                 --conns="$CONNS" --duration="$DURATION" --rate="$RATE" --hit="$HITS" \
+                 --size="$SIZE" --keys="$KEYS" --delay="$DELAY" | tee "$out/table"
+
+    sw1=$(ctxsw "$target")
+    kill "$target"
+    wait "$proxy_pid" 2>/dev/null || true
+    reqs=$(awk '$1 ~ /^[0-9.]+$/ { n += $4 } END { print n + 0 }' "$out/table")
+    sys=$(awk -F, '/raw_syscalls/ { print $1 }' "$out/perf" 2>/dev/null || true)
+    awk -v r="$reqs" -v sw=$((sw1 - sw0)) -v sys="${sys:-}" 'BEGIN {
+        if (r == 0) exit
+        printf "  per request: %.2f context switches", sw / r
+        if (sys != "") printf ", %.2f syscalls", sys / r
+        printf "\n"
+    }'
+    pids=$(echo "$pids" | sed "s/ $proxy_pid//")
+done
+
+if [ "$MICRO" = 1 ]; then
+    for b in bench_parse bench_cache bench_pool cache_sim; do
+        echo "### $b"
+        $BIN/$b
+    done
+fi
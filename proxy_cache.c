@@ -0,0 +1,1128 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_cache.c      –  sharded, hash-indexed LRU response cache
+ *
+ *  Per shard:
+ *      slots[]   open-addressing table of {hash, element}, linear probing,
+ *                grown ×2 at 3/4 load, deletions by backward shift (no
+ *                tombstones, so probe lengths never degrade)
+ *      mru..lru  intrusive doubly linked list through the elements
+ *
+ *  Eviction is approximate LRU: when the shared byte budget is exceeded
+ *  we pop the tail of the inserting shard first, then walk the others.
+ *  Victims are unlinked under the shard lock but freed after it, once
+ *  the last reader has called cache_release().
+ *
+ *  Streamed entries sit in the index from the first miss on, so later
+ *  misses find and join them. They carry no charge until finished and
+ *  are never chosen as eviction victims while FILLING. The fill lock
+ *  only guards the waiter list; readers never take it to read bytes.
+ *
+ *  A revalidation successor stays out of the index while it fills, so
+ *  the stale entry keeps serving; it swaps in when it finishes with a
+ *  new response, or becomes an alias of the stale entry on a 304.
+ *
+ *  Admission happens where an insert runs over budget: the newcomer
+ *  faces each victim in turn, and the first one it loses to stays,
+ *  while the newcomer leaves the index instead. Victims it already beat
+ *  are gone – the same greedy order Caffeine uses – so an entry needing
+ *  many victims must beat every one. Updates of an entry already
+ *  cached (revalidation, coded replacement) aren't questioned.
+ *
+ *  The budget can change under a running cache (cache_set_limits()).
+ *  Nothing is flushed when it shrinks: an insert evicts at most about
+ *  what it adds, so the excess never grows, and cache_trim() works it
+ *  off a bounded batch at a time, one victim per shard lock.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_cache.h"
+#include "proxy_sketch.h"
+#include "proxy_slab.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_MIN_SLOTS  64                 /* per shard, power of two   */
+#define FILL_MIN_SPAN    (4 * 1024)         /* first span: the head, and
+                                               a small body, before any
+                                               reserve() can size it    */
+#define FILL_MAX_SPANS   24                 /* spans double: 4K → 10M+   */
+#define SKETCH_BYTES_PER_KEY (8 * 1024)     /* initial sketch size: the
+                                               mean entry it assumes     */
+
+typedef struct fill_span {
+    char*  ptr;
+    size_t start;                           /* offset of ptr[0]          */
+    size_t cap;
+} fill_span;
+
+struct cache_fill {
+    pthread_mutex_t lock;                   /* waiters + cond only       */
+    pthread_cond_t  cond;
+    cache_waiter*   waiters;
+    size_t          expect;                 /* reserve() hint, 0 → none  */
+    size_t          written;                /* filler-private; ≥ filled  */
+    int             held;                   /* revalidating: don't publish */
+    unsigned        spans;                  /* filler-private            */
+    fill_span       span[FILL_MAX_SPANS];
+};
+
+typedef struct cache_slot {
+    uint64_t       hash;
+    cache_element* element;                 /* NULL → empty slot         */
+} cache_slot;
+
+typedef struct cache_shard {
+    _Alignas(64) pthread_mutex_t lock;      /* one cache line per shard  */
+    cache_slot*    slots;
+    size_t         mask;                    /* slot count - 1            */
+    size_t         count;
+    cache_element* mru;
+    cache_element* lru;
+    size_t         bytes;
+    uint64_t       hits, misses, evictions, coalesced;
+    uint64_t       stale, revalidations, not_modified;
+    size_t         coded, coded_bytes, decoded_bytes;
+    uint64_t       rejected, oversize;
+    freq_sketch    sketch;                  /* admission, unless LRU     */
+} cache_shard;
+
+static cache_shard*   shards;
+static unsigned       shard_count;
+static unsigned       shard_bits;
+static atomic_size_t  capacity;
+static atomic_size_t  total_bytes;
+static atomic_uint    trim_cursor;          /* shard cache_trim() starts at */
+
+static void         (*evict_hook)(cache_element*);
+static cache_admission admission;           /* CACHE_ADMIT_TINYLFU       */
+static atomic_size_t  max_object;
+
+static size_t         requested_capacity;
+static unsigned       requested_shards;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+
+/*──────────────────── Setup ────────────────────────────────────────*/
+
+static void cache_setup(void)
+{
+    size_t budget = requested_capacity ? requested_capacity : MAX_SIZE;
+    atomic_store(&capacity, budget);
+
+    unsigned want = requested_shards ? requested_shards : CACHE_SHARDS;
+    shard_count = 1;
+    shard_bits = 0;
+    while (shard_count < want) { shard_count <<= 1; ++shard_bits; }
+
+    shards = (cache_shard*)aligned_alloc(64, shard_count * sizeof(cache_shard));
+    if (!shards) abort();
+    memset(shards, 0, shard_count * sizeof(cache_shard));
+
+    for (unsigned i = 0; i < shard_count; ++i) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].slots = (cache_slot*)calloc(INDEX_MIN_SLOTS, sizeof(cache_slot));
+        if (!shards[i].slots) abort();
+        shards[i].mask = INDEX_MIN_SLOTS - 1;
+        if (admission != CACHE_ADMIT_LRU
+            && sketch_init(&shards[i].sketch, budget / SKETCH_BYTES_PER_KEY / shard_count) < 0)
+            abort();
+    }
+    size_t cutoff = atomic_load(&max_object);
+    if (!cutoff || cutoff > MAX_ELEMENT_SIZE) atomic_store(&max_object, MAX_ELEMENT_SIZE);
+}
+
+void cache_init(size_t capacity_bytes, unsigned nshards)
+{
+    requested_capacity = capacity_bytes;
+    requested_shards = nshards;
+    pthread_once(&init_once, cache_setup);
+}
+
+static inline void ensure_init(void)
+{
+    pthread_once(&init_once, cache_setup);
+}
+
+void cache_set_admission(cache_admission policy, size_t max_object_bytes)
+{
+    admission = policy;
+    atomic_store(&max_object, max_object_bytes);
+}
+
+void cache_set_limits(size_t capacity_bytes, size_t max_object_bytes)
+{
+    ensure_init();
+    if (!max_object_bytes || max_object_bytes > MAX_ELEMENT_SIZE)
+        max_object_bytes = MAX_ELEMENT_SIZE;
+    atomic_store(&capacity, capacity_bytes ? capacity_bytes : MAX_SIZE);
+    atomic_store(&max_object, max_object_bytes);
+}
+
+static const char* const admission_names[] = { "tinylfu", "tinylfu-bytes", "lru" };
+
+int cache_admission_parse(const char* name, cache_admission* out)
+{
+    for (unsigned i = 0; i < sizeof admission_names / sizeof admission_names[0]; ++i) {
+        if (strcmp(name, admission_names[i]) == 0) {
+            *out = (cache_admission)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* cache_admission_name(cache_admission policy)
+{
+    return admission_names[policy];
+}
+
+uint64_t cache_hash(const char* url, size_t len)
+{
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (uint64_t)len * k;
+
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, url, 8);
+        h = (h ^ (w * k)) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+        url += 8;
+        len -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, url, len);
+    h = (h ^ (tail * k)) * 0x94D049BB133111EBull;
+
+    h ^= h >> 31;                           /* splitmix64 finaliser      */
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    return h;
+}
+
+static inline cache_shard* shard_of(uint64_t hash)
+{
+    return &shards[shard_bits ? hash >> (64 - shard_bits) : 0];
+}
+
+
+/*──────────────────── Open-addressing index ────────────────────────*/
+
+static cache_slot* index_lookup(cache_shard* s, const char* url, size_t len, uint64_t hash)
+{
+    for (size_t i = hash & s->mask;; i = (i + 1) & s->mask) {
+        cache_slot* slot = &s->slots[i];
+        if (!slot->element) return NULL;
+        if (slot->hash == hash && slot->element->url_len == len
+            && memcmp(slot->element->url, url, len) == 0)
+            return slot;
+    }
+}
+
+static void index_place(cache_slot* slots, size_t mask, uint64_t hash, cache_element* e)
+{
+    size_t i = hash & mask;
+    while (slots[i].element) i = (i + 1) & mask;
+    slots[i].hash = hash;
+    slots[i].element = e;
+}
+
+static int index_reserve(cache_shard* s)
+{
+    if ((s->count + 1) * 4 <= (s->mask + 1) * 3) return 0;
+
+    size_t new_mask = (s->mask << 1) | 1;
+    cache_slot* slots = (cache_slot*)calloc(new_mask + 1, sizeof(cache_slot));
+    if (!slots) return -1;
+    for (size_t i = 0; i <= s->mask; ++i)
+        if (s->slots[i].element)
+            index_place(slots, new_mask, s->slots[i].hash, s->slots[i].element);
+
+    free(s->slots);
+    s->slots = slots;
+    s->mask = new_mask;
+    return 0;
+}
+
+/* Backward-shift deletion keeps every probe chain contiguous. */
+static void index_erase(cache_shard* s, cache_slot* slot)
+{
+    size_t hole = (size_t)(slot - s->slots);
+    for (size_t j = (hole + 1) & s->mask; s->slots[j].element; j = (j + 1) & s->mask) {
+        size_t home = s->slots[j].hash & s->mask;
+        int movable = hole <= j ? (home <= hole || home > j)
+                                : (home <= hole && home > j);
+        if (movable) {
+            s->slots[hole] = s->slots[j];
+            hole = j;
+        }
+    }
+    s->slots[hole].element = NULL;
+    --s->count;
+}
+
+
+/*──────────────────── LRU list ─────────────────────────────────────*/
+
+static void lru_unlink(cache_shard* s, cache_element* e)
+{
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else             s->mru = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else             s->lru = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_front(cache_shard* s, cache_element* e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = s->mru;
+    if (s->mru) s->mru->lru_prev = e;
+    else        s->lru = e;
+    s->mru = e;
+}
+
+
+/*──────────────────── Admission ────────────────────────────────────*/
+
+/* A lookup of `hash`, under s->lock. The sketch grows with the shard:
+ * once it holds more entries than the sketch was sized for, a table
+ * twice as big starts over – the counts are only recent history.    */
+static void admit_record_locked(cache_shard* s, uint64_t hash)
+{
+    if (admission == CACHE_ADMIT_LRU) return;
+    if (s->count > s->sketch.keys) sketch_init(&s->sketch, s->sketch.keys * 2);
+    sketch_record(&s->sketch, hash);
+}
+
+/* Does newcomer c, estimated at c_freq, beat victim v? Under the lock
+ * of v's shard vs. TinyLFU compares hits per byte of cache; the byte
+ * variant values a hit by the bytes it serves, which cancels the
+ * sizes, so the estimates alone compare.                             */
+static int admit_wins_locked(cache_shard* vs, const cache_element* c, unsigned c_freq,
+                             const cache_element* v)
+{
+    uint64_t v_freq = sketch_estimate(&vs->sketch, v->hash);
+    if (admission == CACHE_ADMIT_TINYLFU)
+        return (uint64_t)c_freq * v->charge > v_freq * c->charge;
+    return c_freq > v_freq;
+}
+
+
+/*──────────────────── Element lifetime ─────────────────────────────*/
+
+static void free_element(cache_element* element)
+{
+    cache_fill* f = element->fill;
+    if (f) {
+        for (unsigned i = 0; i < f->spans; ++i) slab_free(f->span[i].ptr, f->span[i].cap);
+        pthread_mutex_destroy(&f->lock);
+        pthread_cond_destroy(&f->cond);
+        slab_free(f, sizeof *f);
+    }
+    else {
+        slab_free(element->data, (size_t)element->len);
+    }
+    cache_release(element->prior);
+    slab_free(element->url, element->url_len + 1);
+    slab_free(element, sizeof *element);
+}
+
+void cache_release(cache_element* element)
+{
+    if (element && atomic_fetch_sub(&element->refs, 1) == 1)
+        free_element(element);
+}
+
+void cache_retain(cache_element* element)
+{
+    atomic_fetch_add(&element->refs, 1);
+}
+
+void cache_set_evict_hook(void (*hook)(cache_element* victim))
+{
+    evict_hook = hook;
+}
+
+/* Caller holds s->lock. Count a charged, coded e in or out of the
+ * shard's compression totals.                                        */
+static void coded_account(cache_shard* s, const cache_element* e, int in)
+{
+    if (!e->coding || !e->charge) return;
+    if (in) {
+        ++s->coded;
+        s->coded_bytes += (size_t)e->len;
+        s->decoded_bytes += e->decoded_len;
+    }
+    else {
+        --s->coded;
+        s->coded_bytes -= (size_t)e->len;
+        s->decoded_bytes -= e->decoded_len;
+    }
+}
+
+/* Caller holds s->lock. Drops e from index, list and budget; the
+ * index's reference passes to the caller.                           */
+static void detach_locked(cache_shard* s, cache_element* e)
+{
+    cache_slot* slot = index_lookup(s, e->url, e->url_len, e->hash);
+    if (slot && slot->element == e) index_erase(s, slot);
+    e->indexed = 0;
+    lru_unlink(s, e);
+    coded_account(s, e, 0);
+    s->bytes -= e->charge;
+    atomic_fetch_sub(&total_bytes, e->charge);
+}
+
+/* Pop LRU victims until the budget holds or `quota` bytes have gone,
+ * never `keep` (in shard start, referenced by the caller; may be NULL).
+ * With `admit`, keep is a newcomer the admission policy may turn away:
+ * it must beat each victim, or it leaves the index instead, which
+ * counts against the quota. 0 → it was turned away.                 */
+static int evict_over_budget(cache_shard* start, cache_element* keep, int admit, size_t quota)
+{
+    size_t first = (size_t)(start - shards);
+    size_t freed = 0;
+    unsigned freq = 0;
+    int kept = 1;
+
+    if (admission == CACHE_ADMIT_LRU || atomic_load(&total_bytes) <= atomic_load(&capacity))
+        admit = 0;
+    if (admit) {
+        pthread_mutex_lock(&start->lock);
+        freq = sketch_estimate(&start->sketch, keep->hash);
+        pthread_mutex_unlock(&start->lock);
+    }
+
+    while (freed < quota && atomic_load(&total_bytes) > atomic_load(&capacity)) {
+        cache_element* victim = NULL;
+        int lost = 0;
+        for (unsigned k = 0; k < shard_count && !victim && !lost; ++k) {
+            cache_shard* s = &shards[(first + k) & (shard_count - 1)];
+            pthread_mutex_lock(&s->lock);
+            cache_element* v = s->lru;
+            while (v && (v == keep || atomic_load(&v->state) == CACHE_FILLING))
+                v = v->lru_prev;
+            if (v && admit && !admit_wins_locked(s, keep, freq, v)) {
+                lost = 1;
+            }
+            else if (v) {
+                detach_locked(s, v);
+                ++s->evictions;
+                victim = v;
+            }
+            pthread_mutex_unlock(&s->lock);
+        }
+        if (lost) {
+            int drop;
+            pthread_mutex_lock(&start->lock);
+            if ((drop = keep->indexed)) {
+                detach_locked(start, keep);
+                ++start->rejected;
+                freed += keep->charge;
+            }
+            pthread_mutex_unlock(&start->lock);
+            if (drop) cache_release(keep);
+            admit = 0;
+            kept = 0;
+            continue;
+        }
+        if (!victim) break;
+        freed += victim->charge;
+        if (evict_hook) evict_hook(victim);
+        cache_release(victim);
+    }
+    return kept;
+}
+
+
+/*──────────────────── Public API ───────────────────────────────────*/
+
+size_t cache_trim(size_t max_bytes)
+{
+    ensure_init();
+    unsigned start = atomic_fetch_add(&trim_cursor, 1) & (shard_count - 1);
+    evict_over_budget(&shards[start], NULL, 0, max_bytes);
+
+    size_t used = atomic_load(&total_bytes), budget = atomic_load(&capacity);
+    return used > budget ? used - budget : 0;
+}
+
+cache_element* cache_find_hashed(const char* url, size_t url_len, uint64_t hash)
+{
+    ensure_init();
+    cache_shard* s = shard_of(hash);
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&s->lock);
+    admit_record_locked(s, hash);
+    cache_slot* slot = index_lookup(s, url, url_len, hash);
+    cache_element* e = slot ? slot->element : NULL;
+    if (e && atomic_load(&e->state) != CACHE_COMPLETE) e = NULL;
+    if (e) {
+        if (s->mru != e) {
+            lru_unlink(s, e);
+            lru_push_front(s, e);
+        }
+        e->lru_time = now;
+        atomic_fetch_add(&e->refs, 1);
+        ++s->hits;
+    }
+    else {
+        ++s->misses;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+int cache_add_hashed(const char* data, int size, const char* url, size_t url_len, uint64_t hash)
+{
+    ensure_init();
+    if (size < 0) return 0;
+
+    /* Charged at what the allocator really hands out.               */
+    size_t charge = slab_size((size_t)size) + slab_size(url_len + 1)
+                  + slab_size(sizeof(cache_element));
+    cache_shard* s = shard_of(hash);
+    if (charge > atomic_load(&max_object) || charge > atomic_load(&capacity)) {
+        pthread_mutex_lock(&s->lock);
+        ++s->oversize;
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    cache_element* e = (cache_element*)slab_calloc(sizeof(cache_element));
+    if (!e) return 0;
+    e->len = size;
+    e->url_len = url_len;
+    e->data = (char*)slab_alloc((size_t)size);
+    e->url = (char*)slab_alloc(url_len + 1);
+    if (!e->data || !e->url) { free_element(e); return 0; }
+    memcpy(e->data, data, (size_t)size);
+    memcpy(e->url, url, url_len);
+    e->url[url_len] = '\0';
+    e->hash = hash;
+    e->charge = charge;
+    e->lru_time = time(NULL);
+    atomic_init(&e->refs, 2);                   /* index + ours, below */
+
+    cache_element* replaced = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    cache_slot* slot = index_lookup(s, url, url_len, hash);
+    if (slot) {
+        replaced = slot->element;
+        detach_locked(s, replaced);
+    }
+    if (index_reserve(s) < 0) {
+        pthread_mutex_unlock(&s->lock);
+        cache_release(replaced);
+        free_element(e);
+        return 0;
+    }
+    index_place(s->slots, s->mask, hash, e);
+    ++s->count;
+    e->indexed = 1;
+    lru_push_front(s, e);
+    s->bytes += charge;
+    atomic_fetch_add(&total_bytes, charge);
+    pthread_mutex_unlock(&s->lock);
+
+    /* A new URL faces admission; a new version of a cached one doesn't. */
+    int kept = evict_over_budget(s, e, !replaced, charge);
+    cache_release(replaced);
+    cache_release(e);
+    return kept;
+}
+
+cache_element* find(char* url)
+{
+    size_t len = strlen(url);
+    return cache_find_hashed(url, len, cache_hash(url, len));
+}
+
+int add_cache_element(char* data, int size, char* url)
+{
+    size_t len = strlen(url);
+    return cache_add_hashed(data, size, url, len, cache_hash(url, len));
+}
+
+void remove_cache_element(char* url)
+{
+    ensure_init();
+    size_t len = strlen(url);
+    uint64_t hash = cache_hash(url, len);
+    cache_shard* s = shard_of(hash);
+
+    pthread_mutex_lock(&s->lock);
+    cache_slot* slot = index_lookup(s, url, len, hash);
+    cache_element* victim = slot ? slot->element : NULL;
+    if (victim) detach_locked(s, victim);
+    pthread_mutex_unlock(&s->lock);
+
+    cache_release(victim);
+}
+
+
+/*──────────────────── Streaming fill ───────────────────────────────*/
+
+/* Hit on an indexed entry: bump it and take a reference. */
+static cache_element* attach_locked(cache_shard* s, cache_element* e, time_t now)
+{
+    if (s->mru != e) {
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+    }
+    e->lru_time = now;
+    atomic_fetch_add(&e->refs, 1);
+    if (atomic_load(&e->state) == CACHE_FILLING) ++s->coalesced;
+    else ++s->hits;
+    return e;
+}
+
+static cache_element* new_filling(const char* url, size_t url_len, uint64_t hash, time_t now)
+{
+    cache_element* e = (cache_element*)slab_calloc(sizeof(cache_element));
+    if (!e) return NULL;
+    e->url = (char*)slab_alloc(url_len + 1);
+    e->fill = (cache_fill*)slab_calloc(sizeof(cache_fill));
+    if (!e->url || !e->fill) {
+        slab_free(e->url, url_len + 1);
+        slab_free(e->fill, sizeof(cache_fill));
+        slab_free(e, sizeof(cache_element));
+        return NULL;
+    }
+    memcpy(e->url, url, url_len);
+    e->url[url_len] = '\0';
+    e->url_len = url_len;
+    e->hash = hash;
+    e->lru_time = now;
+    pthread_mutex_init(&e->fill->lock, NULL);
+    pthread_cond_init(&e->fill->cond, NULL);
+    atomic_init(&e->state, CACHE_FILLING);
+    atomic_init(&e->filled, 0);
+    atomic_init(&e->refs, 2);                   /* index + filler      */
+    return e;
+}
+
+/* Miss: index the new entry; the caller fills it. Shard lock held. */
+static cache_element* insert_filling_locked(cache_shard* s, cache_element* e, int* filler)
+{
+    if (index_reserve(s) < 0) return NULL;
+    index_place(s->slots, s->mask, e->hash, e);
+    ++s->count;
+    ++s->misses;
+    e->indexed = 1;
+    lru_push_front(s, e);
+    *filler = 1;
+    return e;
+}
+
+/* Stale `old`: make `e` its successor, unindexed and held. The stale
+ * entry is still served within its stale-while-revalidate window (e
+ * goes to *revalidate), else e itself is. Shard lock held.           */
+static cache_element* open_successor_locked(cache_shard* s, cache_element* old,
+                                            cache_element* e, time_t now,
+                                            int* filler, cache_element** revalidate)
+{
+    atomic_store(&e->refs, 1);                  /* the filler only      */
+    e->fill->held = 1;
+    e->prior = old;
+    atomic_fetch_add(&old->refs, 1);
+    ++s->revalidations;
+
+    if (now < old->stale_until && revalidate) {
+        old->successor = e;
+        *revalidate = e;
+        ++s->stale;
+        return attach_locked(s, old, now);
+    }
+    old->successor = e;
+    *filler = 1;
+    ++s->misses;
+    return e;
+}
+
+/* Stale: a finished entry past its freshness lifetime.              */
+static int stale_locked(const cache_element* e, time_t now)
+{
+    return e->fresh_until && now >= e->fresh_until
+        && atomic_load(&e->state) == CACHE_COMPLETE;
+}
+
+cache_element* cache_open(const char* url, size_t url_len, uint64_t hash, int* filler,
+                          cache_element** revalidate)
+{
+    ensure_init();
+    cache_shard* s = shard_of(hash);
+    time_t now = time(NULL);
+    cache_element* spare = NULL;                /* built unlocked        */
+    cache_element* e;
+    *filler = 0;
+    if (revalidate) *revalidate = NULL;
+
+    /* A miss or a stale entry needs a new FILLING entry: build it
+     * unlocked, then look again – the picture may have changed.      */
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        if (!spare) admit_record_locked(s, hash);   /* once per open   */
+        cache_slot* slot = index_lookup(s, url, url_len, hash);
+        e = slot ? slot->element : NULL;
+
+        if (e && (!stale_locked(e, now) || (e->successor && now < e->stale_until))) {
+            if (stale_locked(e, now)) ++s->stale;
+            e = attach_locked(s, e, now);
+            break;
+        }
+        if (e && e->successor) {                /* follow the revalidation */
+            e = e->successor;
+            atomic_fetch_add(&e->refs, 1);
+            ++s->coalesced;
+            break;
+        }
+        if (spare) {
+            e = e ? open_successor_locked(s, e, spare, now, filler, revalidate)
+                  : insert_filling_locked(s, spare, filler);
+            if (*filler || (revalidate && *revalidate)) spare = NULL;  /* taken */
+            break;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (!(spare = new_filling(url, url_len, hash, now))) return NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (spare) free_element(spare);
+    return e;
+}
+
+void cache_set_expiry(cache_element* e, time_t fresh_until, time_t stale_until)
+{
+    cache_shard* s = shard_of(e->hash);
+    pthread_mutex_lock(&s->lock);
+    e->fresh_until = fresh_until;
+    e->stale_until = stale_until > fresh_until ? stale_until : fresh_until;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Wake every reader parked on e. Called by the filler only.          */
+static void fill_notify(cache_element* e)
+{
+    cache_fill* f = e->fill;
+    pthread_mutex_lock(&f->lock);
+    cache_waiter* w = f->waiters;
+    f->waiters = NULL;
+    while (w) {
+        cache_waiter* next = w->next;
+        w->next = NULL;
+        w->wake(w);
+        w = next;
+    }
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+/* Make what the filler wrote readable, unless a revalidation is
+ * still holding it back.                                             */
+static void fill_publish(cache_element* e)
+{
+    cache_fill* f = e->fill;
+    if (f->held) return;
+    atomic_store_explicit(&e->filled, f->written, memory_order_release);
+    fill_notify(e);
+}
+
+/* Leave the index (if still there) and drop the index's reference.
+ * `oversize`: counted as turned away for its size.                   */
+static void fill_unindex(cache_element* e, int oversize)
+{
+    cache_shard* s = shard_of(e->hash);
+    int drop = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (e->indexed) {
+        detach_locked(s, e);
+        if (oversize) ++s->oversize;
+        drop = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (drop) cache_release(e);
+}
+
+/* A successor is done revalidating: prior may get another one.
+ * `replace` → e takes prior's place in the index (only if prior still
+ * holds it; otherwise the URL has moved on without us), charged
+ * `charge`. Returns 1 if e was indexed.                              */
+static int fill_leave_prior(cache_element* e, int replace, size_t charge)
+{
+    cache_shard* s = shard_of(e->hash);
+    cache_element* prior = e->prior;
+    cache_element* replaced = NULL;
+    int indexed = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (prior->successor == e) prior->successor = NULL;
+    if (replace) {
+        cache_slot* slot = index_lookup(s, e->url, e->url_len, e->hash);
+        if (slot && slot->element == prior) {
+            detach_locked(s, prior);
+            replaced = prior;
+            slot = NULL;
+        }
+        if (!slot && index_reserve(s) == 0) {
+            index_place(s->slots, s->mask, e->hash, e);
+            ++s->count;
+            e->indexed = indexed = 1;
+            atomic_fetch_add(&e->refs, 1);      /* the index's own ref  */
+            lru_push_front(s, e);
+            e->charge = charge;
+            s->bytes += charge;
+            atomic_fetch_add(&total_bytes, charge);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    cache_release(replaced);
+    if (!e->not_modified) {                     /* else we serve it     */
+        e->prior = NULL;
+        cache_release(prior);
+    }
+    return indexed;
+}
+
+
+/* Room at write position `filled`, opening a new span if the last is
+ * full. `want` sizes a fresh span; the result may be smaller.        */
+static char* fill_space(cache_element* e, size_t filled, size_t want, size_t* room)
+{
+    cache_fill* f = e->fill;
+    fill_span* sp = f->spans ? &f->span[f->spans - 1] : NULL;
+
+    if (!sp || filled == sp->start + sp->cap) {
+        if (f->spans == FILL_MAX_SPANS) return NULL;
+        size_t cap = f->expect > filled ? f->expect - filled
+                   : filled > FILL_MIN_SPAN ? filled : FILL_MIN_SPAN;
+        if (cap < want) cap = want;
+        cap = slab_size(cap);                   /* use the whole grant  */
+        sp = &f->span[f->spans];
+        sp->ptr = (char*)slab_alloc(cap);
+        if (!sp->ptr) return NULL;
+        sp->start = filled;
+        sp->cap = cap;
+        ++f->spans;
+    }
+    *room = sp->start + sp->cap - filled;
+    return sp->ptr + (filled - sp->start);
+}
+
+/* Would `n` more bytes take the entry past MAX_ELEMENT_SIZE?         */
+static int fill_too_big(cache_element* e, size_t n)
+{
+    size_t filled = e->fill->written;
+    size_t fixed = e->url_len + sizeof(cache_element);
+    return filled + n + fixed > MAX_ELEMENT_SIZE
+        || (e->fill->expect && e->fill->expect + fixed > MAX_ELEMENT_SIZE);
+}
+
+char* cache_fill_space(cache_element* e, size_t* room)
+{
+    if (!e->fill || atomic_load(&e->state) != CACHE_FILLING) return NULL;
+
+    size_t filled = e->fill->written;
+    char* p = fill_too_big(e, 1) ? NULL : fill_space(e, filled, 0, room);
+    if (!p) {
+        cache_fill_abort(e);
+        return NULL;
+    }
+    size_t limit = MAX_ELEMENT_SIZE - e->url_len - sizeof(cache_element) - filled;
+    if (*room > limit) *room = limit;
+    return p;
+}
+
+void cache_fill_commit(cache_element* e, size_t n)
+{
+    if (n == 0) return;
+    e->fill->written += n;
+    fill_publish(e);
+}
+
+int cache_fill_reserve(cache_element* e, size_t total)
+{
+    if (!e->fill || atomic_load(&e->state) != CACHE_FILLING) return -1;
+    e->fill->expect = total;
+    if (fill_too_big(e, 0)) {
+        cache_fill_abort(e);
+        return -1;
+    }
+    return 0;
+}
+
+int cache_fill_append(cache_element* e, const char* data, size_t n)
+{
+    cache_fill* f = e->fill;
+    if (!f || atomic_load(&e->state) != CACHE_FILLING) return -1;
+    if (fill_too_big(e, n)) {
+        cache_fill_abort(e);
+        return -1;
+    }
+
+    size_t filled = f->written;
+    while (n > 0) {
+        size_t room;
+        char* dst = fill_space(e, filled, n, &room);
+        if (!dst) { cache_fill_abort(e); return -1; }
+        size_t k = n < room ? n : room;
+        memcpy(dst, data, k);
+        filled += k;
+        data += k;
+        n -= k;
+    }
+
+    f->written = filled;
+    fill_publish(e);
+    return 0;
+}
+
+void cache_fill_finish(cache_element* e, int keep)
+{
+    cache_fill* f = e->fill;
+    if (!f || atomic_load(&e->state) != CACHE_FILLING) return;
+
+    size_t filled = f->written;
+    size_t charge = slab_size(e->url_len + 1) + slab_size(sizeof(cache_element))
+                  + slab_size(sizeof(cache_fill));
+    for (unsigned i = 0; i < f->spans; ++i) charge += f->span[i].cap;
+
+    e->len = (int)filled;
+    e->data = f->spans == 1 ? f->span[0].ptr : NULL;
+    f->held = 0;
+    atomic_store_explicit(&e->filled, filled, memory_order_release);
+    atomic_store_explicit(&e->state, CACHE_COMPLETE, memory_order_release);
+    fill_notify(e);
+
+    int fits = charge <= atomic_load(&capacity) && charge <= atomic_load(&max_object);
+    if (e->prior) {
+        if (fill_leave_prior(e, keep && fits, charge))
+            evict_over_budget(shard_of(e->hash), e, 0, charge);
+        return;
+    }
+    if (!keep || !fits) {
+        fill_unindex(e, keep);
+        return;
+    }
+
+    cache_shard* s = shard_of(e->hash);
+    int indexed;
+    pthread_mutex_lock(&s->lock);
+    indexed = e->indexed;
+    if (indexed) {
+        e->charge = charge;
+        coded_account(s, e, 1);
+        s->bytes += charge;
+        atomic_fetch_add(&total_bytes, charge);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (indexed) evict_over_budget(s, e, 1, charge);
+}
+
+void cache_fill_abort(cache_element* e)
+{
+    int expected = CACHE_FILLING;
+    if (!e->fill || !atomic_compare_exchange_strong(&e->state, &expected, CACHE_ABORTED))
+        return;
+    fill_notify(e);
+    if (e->prior) fill_leave_prior(e, 0, 0);
+    else fill_unindex(e, 0);
+}
+
+void cache_fill_publish(cache_element* e)
+{
+    if (!e->fill || atomic_load(&e->state) != CACHE_FILLING || !e->fill->held) return;
+    e->fill->held = 0;
+    fill_publish(e);
+}
+
+void cache_fill_not_modified(cache_element* e, time_t fresh_until, time_t stale_until)
+{
+    cache_element* prior = e->prior;
+    if (!e->fill || !prior || atomic_load(&e->state) != CACHE_FILLING) return;
+
+    cache_shard* s = shard_of(e->hash);
+    pthread_mutex_lock(&s->lock);
+    prior->fresh_until = fresh_until;
+    prior->stale_until = stale_until > fresh_until ? stale_until : fresh_until;
+    ++s->not_modified;
+    pthread_mutex_unlock(&s->lock);
+
+    /* What the 304 wrote stays held; readers get prior's bytes.      */
+    e->len = prior->len;
+    e->not_modified = 1;
+    atomic_store_explicit(&e->state, CACHE_COMPLETE, memory_order_release);
+    fill_notify(e);
+    fill_leave_prior(e, 0, 0);
+}
+
+void cache_fill_coding(cache_element* e, unsigned coding, size_t decoded_len)
+{
+    e->coding = coding;
+    e->decoded_len = decoded_len;
+}
+
+int cache_replace_coded(cache_element* old, const char* head, size_t head_len,
+                        const char* body, size_t body_len,
+                        unsigned coding, size_t decoded_len)
+{
+    size_t len = head_len + body_len;
+    size_t charge = slab_size(len) + slab_size(old->url_len + 1)
+                  + slab_size(sizeof(cache_element));
+    if (len > MAX_ELEMENT_SIZE) return 0;
+
+    cache_element* e = (cache_element*)slab_calloc(sizeof(cache_element));
+    if (!e) return 0;
+    e->len = (int)len;
+    e->url_len = old->url_len;
+    e->data = (char*)slab_alloc(len);
+    e->url = (char*)slab_alloc(old->url_len + 1);
+    if (!e->data || !e->url) { free_element(e); return 0; }
+    memcpy(e->data, head, head_len);
+    memcpy(e->data + head_len, body, body_len);
+    memcpy(e->url, old->url, old->url_len + 1);
+    e->hash = old->hash;
+    e->charge = charge;
+    e->coding = coding;
+    e->decoded_len = decoded_len;
+    atomic_init(&e->refs, 1);                   /* the index's own ref */
+
+    cache_shard* s = shard_of(e->hash);
+    pthread_mutex_lock(&s->lock);
+    cache_slot* slot = index_lookup(s, e->url, e->url_len, e->hash);
+    if (!slot || slot->element != old || old->successor
+        || atomic_load(&old->state) != CACHE_COMPLETE) {
+        pthread_mutex_unlock(&s->lock);
+        free_element(e);
+        return 0;
+    }
+
+    /* Same hash, same slot; and old's place in the LRU list.         */
+    slot->element = e;
+    e->indexed = 1;
+    old->indexed = 0;
+    e->lru_time = old->lru_time;
+    e->fresh_until = old->fresh_until;
+    e->stale_until = old->stale_until;
+    e->lru_prev = old->lru_prev;
+    e->lru_next = old->lru_next;
+    if (e->lru_prev) e->lru_prev->lru_next = e;
+    else             s->mru = e;
+    if (e->lru_next) e->lru_next->lru_prev = e;
+    else             s->lru = e;
+    old->lru_prev = old->lru_next = NULL;
+
+    coded_account(s, old, 0);
+    coded_account(s, e, 1);
+    s->bytes = s->bytes - old->charge + charge;
+    atomic_fetch_sub(&total_bytes, old->charge);
+    atomic_fetch_add(&total_bytes, charge);
+    pthread_mutex_unlock(&s->lock);
+
+    cache_release(old);                         /* the index's ref      */
+    return 1;
+}
+
+size_t cache_peek(cache_element* e, size_t offset, const char** ptr, cache_state* state)
+{
+    cache_state st = (cache_state)atomic_load_explicit(&e->state, memory_order_acquire);
+    if (state) *state = st;
+    if (st == CACHE_COMPLETE && e->not_modified) return cache_peek(e->prior, offset, ptr, NULL);
+
+    if (!e->fill) {
+        if (offset >= (size_t)e->len) return 0;
+        *ptr = e->data + offset;
+        return (size_t)e->len - offset;
+    }
+
+    size_t filled = atomic_load_explicit(&e->filled, memory_order_acquire);
+    if (offset >= filled) return 0;
+    for (const fill_span* sp = e->fill->span;; ++sp) {
+        if (offset < sp->start + sp->cap) {
+            size_t end = sp->start + sp->cap < filled ? sp->start + sp->cap : filled;
+            *ptr = sp->ptr + (offset - sp->start);
+            return end - offset;
+        }
+    }
+}
+
+/* Anything new for a reader at `offset`? Fill lock held.             */
+static int fill_ready(cache_element* e, size_t offset)
+{
+    return atomic_load(&e->state) != CACHE_FILLING || atomic_load(&e->filled) > offset;
+}
+
+int cache_wait(cache_element* e, size_t offset, cache_waiter* w)
+{
+    cache_fill* f = e->fill;
+    if (!f) return 1;
+
+    pthread_mutex_lock(&f->lock);
+    int ready = fill_ready(e, offset);
+    if (!ready) {
+        w->next = f->waiters;
+        f->waiters = w;
+    }
+    pthread_mutex_unlock(&f->lock);
+    return ready;
+}
+
+void cache_unwait(cache_element* e, cache_waiter* w)
+{
+    cache_fill* f = e->fill;
+    if (!f) return;
+
+    pthread_mutex_lock(&f->lock);
+    for (cache_waiter** pp = &f->waiters; *pp; pp = &(*pp)->next) {
+        if (*pp == w) { *pp = w->next; break; }
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+void cache_wait_blocking(cache_element* e, size_t offset)
+{
+    cache_fill* f = e->fill;
+    if (!f) return;
+
+    pthread_mutex_lock(&f->lock);
+    while (!fill_ready(e, offset)) pthread_cond_wait(&f->cond, &f->lock);
+    pthread_mutex_unlock(&f->lock);
+}
+
+void cache_get_stats(cache_stats* out)
+{
+    ensure_init();
+    memset(out, 0, sizeof *out);
+    out->capacity = atomic_load(&capacity);
+    out->shards = shard_count;
+    out->admission = admission;
+    out->max_object = atomic_load(&max_object);
+
+    for (unsigned i = 0; i < shard_count; ++i) {
+        cache_shard* s = &shards[i];
+        pthread_mutex_lock(&s->lock);
+        out->hits += s->hits;
+        out->misses += s->misses;
+        out->evictions += s->evictions;
+        out->coalesced += s->coalesced;
+        out->stale += s->stale;
+        out->revalidations += s->revalidations;
+        out->not_modified += s->not_modified;
+        out->entries += s->count;
+        out->bytes += s->bytes;
+        out->coded += s->coded;
+        out->coded_bytes += s->coded_bytes;
+        out->decoded_bytes += s->decoded_bytes;
+        out->rejected += s->rejected;
+        out->oversize += s->oversize;
+        out->agings += s->sketch.agings;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,277 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_cache.h
+ *
+ *  Sharded response cache, keyed by absolute URL.
+ *
+ *      • The URL is hashed once; the high bits pick a shard, the low bits
+ *        a slot in that shard's open-addressing (linear probe) index.
+ *      • Each shard keeps an intrusive doubly linked LRU list, so a hit
+ *        is a move-to-front and eviction pops the tail – both O(1).
+ *      • Every shard has its own lock; lookups on different cores only
+ *        contend when they land on the same shard.
+ *      • Capacity is a single byte budget shared by all shards. It may
+ *        be changed at any time; a cache left over a smaller budget
+ *        sheds the excess by cache_trim(), batch by batch, while it
+ *        keeps serving.
+ *
+ *  find() hands out a reference; drop it with cache_release() once the
+ *  bytes have been sent so eviction never frees data under a reader.
+ *
+ *  Streaming fill (miss coalescing):
+ *      cache_open() either returns the existing entry for a URL or
+ *      inserts a new one in the FILLING state and makes the caller its
+ *      filler. The filler appends origin bytes as they arrive; every
+ *      other requester attaches to the same entry and streams it with
+ *      cache_peek(), parking on cache_wait()/cache_wait_blocking() when
+ *      it has caught up. One origin fetch per URL, and followers see the
+ *      first bytes before the body is complete.
+ *
+ *      A streamed entry's bytes live in a few geometrically sized spans
+ *      that never move once written, so readers need no lock; the
+ *      filler publishes them by advancing `filled` (release).
+ *
+ *  Freshness and revalidation:
+ *      A finished fill carries the expiry its response head implies
+ *      (cache_set_expiry(), computed in proxy_http.h). cache_open() on
+ *      an entry past fresh_until doesn't refetch it blindly: it opens a
+ *      successor – an unindexed FILLING entry that remembers the stale
+ *      one as `prior` – whose filler asks the origin conditionally.
+ *          • 304: cache_fill_not_modified() pushes prior's expiry out
+ *            in place; the successor completes as an alias of prior.
+ *          • anything else: cache_fill_publish(), and the successor
+ *            takes prior's place in the index when it finishes.
+ *      Until the filler knows which, the successor's bytes are held
+ *      back from readers, so nobody sees a 304 they didn't ask for.
+ *      Before stale_until (stale-while-revalidate) the stale entry is
+ *      still served and the successor is filled in the background;
+ *      after it, requesters follow the successor like any other fill.
+ *      One successor per entry at a time.
+ *
+ *  Admission:
+ *      A new entry that would push the cache over budget doesn't evict
+ *      blindly. Under TinyLFU (the default) every lookup is recorded in
+ *      a per-shard frequency sketch (proxy_sketch.h), and the newcomer
+ *      only displaces an LRU victim it is estimated to be more popular
+ *      than, per byte it occupies; otherwise it is the one dropped, so
+ *      a scan of one-hit wonders passes through without flushing the
+ *      working set. The byte variant compares popularity alone, which
+ *      lets a large popular object push out several smaller ones –
+ *      fewer hits, more bytes served from cache. Plain LRU admits
+ *      everything. Objects over the max-object cutoff are never kept.
+ *      bench/cache_sim.c replays a trace under each policy.
+ *
+ *  Stored codings:
+ *      An entry's bytes may be a compressed form of the response
+ *      (`coding`, see proxy_codec.h). The compressor builds it beside a
+ *      finished entry and swaps it in with cache_replace_coded(); the
+ *      readers already streaming the old one keep it until released.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_CACHE_H
+#define PROXY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define MAX_SIZE           (200 * (1 << 20))    /* whole cache, in bytes     */
+#define MAX_ELEMENT_SIZE   (10 * (1 << 20))     /* largest cacheable object  */
+#define CACHE_SHARDS       16                   /* default, power of two     */
+
+typedef struct cache_element cache_element;
+typedef struct cache_fill cache_fill;
+typedef struct cache_waiter cache_waiter;
+
+typedef enum cache_state {
+    CACHE_COMPLETE,                 /* every byte present (default)     */
+    CACHE_FILLING,                  /* filler still appending           */
+    CACHE_ABORTED,                  /* filler gave up; bytes so far stay */
+} cache_state;
+
+/* One-shot wakeup for a reader parked on a FILLING entry. wake() runs
+ * on the filler's thread with the entry's fill lock held: it must only
+ * hand off (queue + signal), never block or call back into the cache. */
+struct cache_waiter {
+    void        (*wake)(cache_waiter* w);
+    cache_waiter* next;
+};
+
+struct cache_element {
+    char* data;                     /* NULL for multi-span streamed ones */
+    int len;
+    char* url;
+    time_t lru_time;
+
+    /* ───────── Index bookkeeping (owned by the shard lock)           */
+    uint64_t hash;                  /* cache_hash(url), computed once  */
+    size_t   url_len;
+    size_t   charge;                /* bytes counted against budget    */
+    atomic_int refs;                /* the index holds one             */
+    int        indexed;             /* still reachable through the index */
+    cache_element* lru_prev;        /* towards most recently used      */
+    cache_element* lru_next;        /* towards least recently used     */
+
+    /* ───────── Streaming fill (NULL fill → added whole)               */
+    atomic_int    state;            /* cache_state                     */
+    atomic_size_t filled;           /* readable bytes                  */
+    cache_fill*   fill;
+
+    /* ───────── Freshness (owned by the shard lock)                    */
+    time_t   fresh_until;           /* 0 → never goes stale            */
+    time_t   stale_until;           /* served stale while revalidating
+                                       until then                      */
+    cache_element* successor;       /* revalidation in flight, if any  */
+    cache_element* prior;           /* ref: stale entry we revalidate;
+                                       set at open, filler-owned       */
+    int      not_modified;          /* 304: serves prior's bytes       */
+
+    /* ───────── Stored coding (fixed before the first byte is readable) */
+    unsigned coding;                /* 0 → as the origin sent it, else
+                                       the proxy_codec.h codec id the
+                                       body was compressed with        */
+    size_t   decoded_len;           /* body bytes once decoded          */
+};
+
+typedef enum cache_admission {
+    CACHE_ADMIT_TINYLFU,            /* more hits per byte than the victim */
+    CACHE_ADMIT_TINYLFU_BYTES,      /* more hits: for byte hit ratio    */
+    CACHE_ADMIT_LRU,                /* everything; LRU alone decides    */
+} cache_admission;
+
+typedef struct cache_stats {
+    uint64_t hits, misses, evictions;
+    uint64_t coalesced;             /* misses that joined a fill       */
+    uint64_t stale;                 /* hits served stale, revalidating */
+    uint64_t revalidations;         /* successors opened               */
+    uint64_t not_modified;          /*   …that the origin answered 304 */
+    size_t   entries, bytes, capacity;
+    size_t   coded;                 /* entries stored compressed       */
+    size_t   coded_bytes;           /*   …their stored response bytes  */
+    size_t   decoded_bytes;         /*   …their bodies, decoded        */
+    uint64_t rejected;              /* new entries that lost to a victim */
+    uint64_t oversize;              /*   …or were over the cutoff      */
+    uint64_t agings;                /* sketch halvings, all shards     */
+    cache_admission admission;
+    size_t   max_object;
+    unsigned shards;
+} cache_stats;
+
+/* Optional: size the cache before first use (0 → defaults above).
+ * Shard count is rounded up to a power of two.                       */
+void            cache_init(size_t capacity_bytes, unsigned shards);
+
+/* Admission policy, and the largest entry kept (0 → MAX_ELEMENT_SIZE).
+ * Before cache_init() or first use; defaults TinyLFU, no cutoff.     */
+void            cache_set_admission(cache_admission policy, size_t max_object);
+
+/* Budget and max-object cutoff for a running cache (0 → defaults).
+ * Entries already over a lowered cutoff stay until evicted; bytes
+ * over a lowered budget go through cache_trim() and later inserts.
+ * The admission sketch keeps the size cache_init() gave it.         */
+void            cache_set_limits(size_t capacity_bytes, size_t max_object);
+
+/* Evict LRU victims until the cache is within budget or about
+ * max_bytes have gone; returns how far over budget it still is.     */
+size_t          cache_trim(size_t max_bytes);
+
+/* "lru", "tinylfu" or "tinylfu-bytes"; -1 for anything else.         */
+int             cache_admission_parse(const char* name, cache_admission* out);
+const char*     cache_admission_name(cache_admission policy);
+
+/* 64-bit URL hash used for both shard and slot selection.            */
+uint64_t        cache_hash(const char* url, size_t len);
+
+/* Classic entry points (hash computed internally). find() only returns
+ * COMPLETE entries; a URL still being filled counts as a miss.       */
+cache_element*  find(char* url);
+int             add_cache_element(char* data, int size, char* url);
+void            remove_cache_element(char* url);
+void            cache_release(cache_element* element);
+void            cache_retain(cache_element* element);
+
+/* Called for every entry evicted for space, after the shard lock is
+ * dropped and before the index's reference goes. cache_retain() it to
+ * keep it (e.g. to demote it to the disk tier, proxy_disk.h).        */
+void            cache_set_evict_hook(void (*hook)(cache_element* victim));
+
+/* Same, for callers that already hold the hash.                      */
+cache_element*  cache_find_hashed(const char* url, size_t url_len, uint64_t hash);
+int             cache_add_hashed(const char* data, int size,
+                                 const char* url, size_t url_len, uint64_t hash);
+
+/*──────── Streaming fill ────────*/
+
+/* Existing entry (any state, *filler = 0) or a new FILLING one whose
+ * filler is now the caller (*filler = 1). Both carry a reference.
+ * NULL only when out of memory.
+ *
+ * An entry that has gone stale comes back as a FILLING successor with
+ * `prior` set, *filler = 1 if we are to revalidate it, else one to
+ * follow. Within its stale-while-revalidate window the stale entry
+ * itself is returned instead, and *revalidate (NULL unless given) may
+ * hand the caller a successor to fill in the background.             */
+cache_element*  cache_open(const char* url, size_t url_len, uint64_t hash, int* filler,
+                           cache_element** revalidate);
+
+/* Expiry of e, normally set by the filler just before finishing.    */
+void            cache_set_expiry(cache_element* e, time_t fresh_until, time_t stale_until);
+
+/* Filler side. append() returns -1 (and aborts the entry) once it
+ * would pass MAX_ELEMENT_SIZE. reserve() is a size hint, e.g. from
+ * Content-Length, so the body lands in one span; it fails the same
+ * way when the hint is already too big. finish(keep = 0) completes
+ * it for current readers but drops it from the index.                */
+int             cache_fill_reserve(cache_element* e, size_t total);
+int             cache_fill_append(cache_element* e, const char* data, size_t n);
+void            cache_fill_finish(cache_element* e, int keep);
+
+/* Zero-copy append: receive straight into the entry. space() returns
+ * where the next bytes go and how many fit (NULL, and the entry is
+ * aborted, once it would pass MAX_ELEMENT_SIZE); commit() publishes
+ * the first n of them.                                               */
+char*           cache_fill_space(cache_element* e, size_t* room);
+void            cache_fill_commit(cache_element* e, size_t n);
+void            cache_fill_abort(cache_element* e);
+
+/* Successor filler, once the origin's final head is in: the response
+ * is new (publish: release what was held, stream on as usual), or a
+ * 304 (not_modified: prior is fresh again with the given expiry, and
+ * e completes serving prior's bytes – nothing more may be appended).  */
+void            cache_fill_publish(cache_element* e);
+void            cache_fill_not_modified(cache_element* e, time_t fresh_until,
+                                        time_t stale_until);
+
+/* Filler, before the first byte: e's bytes are stored in codec
+ * `coding` (proxy_codec.h), decoding to decoded_len body bytes.      */
+void            cache_fill_coding(cache_element* e, unsigned coding, size_t decoded_len);
+
+/* Put a whole entry holding head then body, stored in codec `coding`,
+ * in the place of old: same URL, expiry and LRU position. Only while
+ * old is COMPLETE, indexed and not being revalidated; 0 (nothing
+ * changed) if it has moved on meanwhile, or out of memory.          */
+int             cache_replace_coded(cache_element* old, const char* head, size_t head_len,
+                                    const char* body, size_t body_len,
+                                    unsigned coding, size_t decoded_len);
+
+/* The entry whose bytes e serves – prior, for a 304 alias – and so
+ * whose coding applies. Once a byte of e was readable.               */
+static inline const cache_element* cache_source(const cache_element* e)
+{
+    return e->not_modified ? e->prior : e;
+}
+
+/* Reader side. Contiguous bytes at `offset` (0 → caught up); *state is
+ * sampled before the length, so COMPLETE + 0 really means the end.   */
+size_t          cache_peek(cache_element* e, size_t offset,
+                           const char** ptr, cache_state* state);
+
+/* 1 → something changed past `offset` already, 0 → parked until the
+ * filler appends, finishes or aborts. unwait() cancels a parked w.   */
+int             cache_wait(cache_element* e, size_t offset, cache_waiter* w);
+void            cache_unwait(cache_element* e, cache_waiter* w);
+void            cache_wait_blocking(cache_element* e, size_t offset);
+
+void            cache_get_stats(cache_stats* out);
+
+#endif /* PROXY_CACHE_H */
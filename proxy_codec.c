@@ -0,0 +1,361 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_codec.c      –  compressed cache entries: codecs, compressor,
+ *                        decoding reader
+ *
+ *  The compressor is one thread behind a bounded ring of retained
+ *  entries. It reads an entry the way any reader would (cache_peek()),
+ *  so a multi-span entry is gathered into one buffer first, and codes
+ *  the body straight into a buffer sized to the saving it demands: a
+ *  body that doesn't fit isn't worth storing coded, and deflate stops
+ *  there instead of finishing the job.
+ *
+ *  Decoding is per client: a codec_reader walks the stored bytes with
+ *  cache_peek() as well, so it streams an entry that is still being
+ *  promoted from disk just as the plain path would.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_codec.h"
+#include "proxy_http.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PROXY_ZLIB
+#include <zlib.h>
+#endif
+
+#define GZIP_LEVEL  1                       /* fastest: one thread keeps up  */
+
+
+/*──────────────────── gzip ─────────────────────────────────────────*/
+
+#ifdef PROXY_ZLIB
+
+static size_t gzip_encode(const char* src, size_t n, char* dst, size_t cap)
+{
+    z_stream z;
+    memset(&z, 0, sizeof z);
+    /* windowBits 15 + 16: a gzip wrapper, not zlib's own.            */
+    if (deflateInit2(&z, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0;
+    z.next_in = (Bytef*)src;
+    z.avail_in = (uInt)n;
+    z.next_out = (Bytef*)dst;
+    z.avail_out = (uInt)cap;
+    int rc = deflate(&z, Z_FINISH);
+    size_t out = rc == Z_STREAM_END ? (size_t)z.total_out : 0;
+    deflateEnd(&z);
+    return out;
+}
+
+static void* gzip_decoder_new(void)
+{
+    z_stream* z = (z_stream*)calloc(1, sizeof *z);
+    if (z && inflateInit2(z, 15 + 16) != Z_OK) {
+        free(z);
+        return NULL;
+    }
+    return z;
+}
+
+static ssize_t gzip_decode(void* decoder, const char** in, size_t* in_len,
+                           char* out, size_t cap, int* done)
+{
+    z_stream* z = (z_stream*)decoder;
+    z->next_in = (Bytef*)*in;
+    z->avail_in = (uInt)*in_len;
+    z->next_out = (Bytef*)out;
+    z->avail_out = (uInt)cap;
+    int rc = inflate(z, Z_NO_FLUSH);
+    if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) return -1;
+
+    *in = (const char*)z->next_in;
+    *in_len = z->avail_in;
+    *done = rc == Z_STREAM_END;
+    return (ssize_t)(cap - z->avail_out);
+}
+
+static void gzip_decoder_free(void* decoder)
+{
+    inflateEnd((z_stream*)decoder);
+    free(decoder);
+}
+
+static const cache_codec gzip_codec = {
+    "gzip", gzip_encode, gzip_decoder_new, gzip_decode, gzip_decoder_free,
+};
+
+#endif /* PROXY_ZLIB */
+
+/* Index + 1 is the codec's id; ids are stored on disk, so append only. */
+static const cache_codec* const codecs[] = {
+#ifdef PROXY_ZLIB
+    &gzip_codec,
+#else
+    NULL,                                   /* gzip, not built in        */
+#endif
+};
+
+#define CODEC_COUNT (sizeof codecs / sizeof codecs[0])
+
+const double codec_ratio_bounds[CODEC_RATIO_BUCKETS - 1] = { 1.5, 2, 3, 4, 6, 10 };
+
+
+/*──────────────────── State ────────────────────────────────────────*/
+
+static pthread_mutex_t  queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   queue_cond = PTHREAD_COND_INITIALIZER;
+static cache_element*   queue[CODEC_QUEUE_MAX];
+static unsigned         queue_head, queue_len;
+
+static unsigned         storing;            /* codec id, 0 → off         */
+
+/* Compressor results, under queue_lock.                              */
+static uint64_t         compressed, skipped, dropped, body_in, body_out;
+static uint64_t         ratio[CODEC_RATIO_BUCKETS];
+static double           ratio_sum;
+
+static atomic_uint_fast64_t served_coded, served_decoded;
+
+
+/*──────────────────── Compressor ───────────────────────────────────*/
+
+/* Whole response of a COMPLETE entry: e->data, or gathered into a
+ * malloc'd copy (*copy, to free).                                    */
+static const char* entry_bytes(cache_element* e, char** copy)
+{
+    *copy = NULL;
+    if (e->data) return e->data;
+
+    size_t len = (size_t)e->len;
+    char* buf = (char*)malloc(len);
+    if (!buf) return NULL;
+    for (size_t done = 0; done < len;) {
+        const char* p;
+        size_t n = cache_peek(e, done, &p, NULL);
+        if (n == 0) { free(buf); return NULL; }
+        memcpy(buf + done, p, n);
+        done += n;
+    }
+    return *copy = buf;
+}
+
+/* One offer done: `in` body bytes coded to `out`, or 0 → skipped.   */
+static void count_result(size_t in, size_t out)
+{
+    pthread_mutex_lock(&queue_lock);
+    if (out) {
+        ++compressed;
+        body_in += in;
+        body_out += out;
+        double r = (double)in / (double)out;
+        unsigned b = 0;
+        while (b < CODEC_RATIO_BUCKETS - 1 && r > codec_ratio_bounds[b]) ++b;
+        ++ratio[b];
+        ratio_sum += r;
+    }
+    else {
+        ++skipped;
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void compress_entry(cache_element* e)
+{
+    const cache_codec* codec = codecs[storing - 1];
+    if (e->coding || e->not_modified || atomic_load(&e->state) != CACHE_COMPLETE) {
+        count_result(0, 0);
+        return;
+    }
+
+    char* copy;
+    const char* data = entry_bytes(e, &copy);
+    size_t len = (size_t)e->len, head;
+    if (!data || !http_response_encodable(data, len, &head) || len - head < CODEC_MIN_BODY) {
+        free(copy);
+        count_result(0, 0);
+        return;
+    }
+
+    size_t body = len - head;
+    size_t cap = body - body * CODEC_MIN_SAVING / 100;
+    char* coded = (char*)malloc(cap);
+    size_t n = coded ? codec->encode(data + head, body, coded, cap) : 0;
+
+    size_t new_head_len;
+    char* new_head = n ? http_recode_head(data, head, codec->name, n, &new_head_len) : NULL;
+    if (!new_head
+        || !cache_replace_coded(e, new_head, new_head_len, coded, n, storing, body))
+        n = 0;
+
+    free(new_head);
+    free(coded);
+    free(copy);
+    count_result(body, n);
+}
+
+static void* compressor_main(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_len == 0) pthread_cond_wait(&queue_cond, &queue_lock);
+        cache_element* e = queue[queue_head];
+        queue_head = (queue_head + 1) % CODEC_QUEUE_MAX;
+        --queue_len;
+        pthread_mutex_unlock(&queue_lock);
+
+        compress_entry(e);
+        cache_release(e);
+    }
+    return NULL;
+}
+
+
+/*──────────────────── Public API ───────────────────────────────────*/
+
+int codec_init(const char* name)
+{
+    if (storing) return 0;
+    for (unsigned i = 0; i < CODEC_COUNT; ++i) {
+        if (!codecs[i] || strcmp(codecs[i]->name, name) != 0) continue;
+
+        pthread_t t;
+        if (pthread_create(&t, NULL, compressor_main, NULL) != 0) return -1;
+        pthread_detach(t);
+        storing = i + 1;
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int codec_enabled(void)
+{
+    return storing != 0;
+}
+
+const cache_codec* codec_get(unsigned id)
+{
+    return id && id <= CODEC_COUNT ? codecs[id - 1] : NULL;
+}
+
+unsigned codec_accepted(ParsedRequest* pr)
+{
+    unsigned mask = 0;
+    for (unsigned i = 0; i < CODEC_COUNT; ++i)
+        if (codecs[i] && http_accepts_coding(pr, codecs[i]->name)) mask |= 1u << (i + 1);
+    return mask;
+}
+
+void codec_offer(cache_element* e)
+{
+    if (!storing || e->coding || (size_t)e->len < CODEC_MIN_BODY) return;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_len == CODEC_QUEUE_MAX) {
+        ++dropped;
+    }
+    else {
+        cache_retain(e);
+        queue[(queue_head + queue_len) % CODEC_QUEUE_MAX] = e;
+        ++queue_len;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+int codec_must_decode(const cache_element* e, unsigned accepted)
+{
+    unsigned coding = cache_source(e)->coding;
+    if (!coding) return 0;
+    int decode = !(accepted & (1u << coding));
+    atomic_fetch_add_explicit(decode ? &served_decoded : &served_coded, 1, memory_order_relaxed);
+    return decode;
+}
+
+int codec_reader_open(codec_reader* r, const cache_element* e)
+{
+    memset(r, 0, sizeof *r);
+    r->codec = codec_get(cache_source(e)->coding);
+    r->decoder = r->codec ? r->codec->decoder_new() : NULL;
+    return r->decoder ? 0 : -1;
+}
+
+ssize_t codec_reader_read(codec_reader* r, cache_element* e, char* buf, size_t cap,
+                          cache_state* state)
+{
+    const char* p = NULL;
+    cache_state st;
+
+    /* The stored head is in the first span, whole once it's there.   */
+    if (!r->head) {
+        size_t n = cache_peek(e, 0, &p, &st);
+        size_t head = http_head_length(p, n);
+        if (!head) {
+            if (st == CACHE_COMPLETE) return -1;
+            *state = st;
+            r->in_off = n;                          /* wait for more     */
+            return 0;
+        }
+        r->head = http_recode_head(p, head, NULL, cache_source(e)->decoded_len, &r->head_len);
+        if (!r->head) return -1;
+        r->in_off = head;
+    }
+    if (r->head_sent < r->head_len) {
+        size_t k = r->head_len - r->head_sent < cap ? r->head_len - r->head_sent : cap;
+        memcpy(buf, r->head + r->head_sent, k);
+        r->head_sent += k;
+        return (ssize_t)k;
+    }
+
+    /* Then the body: a decoder may still hold output when the input
+     * has run out, so it is asked even with none.                    */
+    while (!r->done) {
+        size_t n = cache_peek(e, r->in_off, &p, &st);
+        size_t left = n;
+        const char* in = n ? p : NULL;
+        ssize_t k = r->codec->decode(r->decoder, &in, &left, buf, cap, &r->done);
+        if (k < 0) return -1;
+        r->in_off += n - left;
+        if (k > 0) return k;
+        if (r->done) break;
+        if (left < n) continue;                     /* a header, say     */
+        if (n) return -1;                           /* took nothing      */
+        if (st == CACHE_COMPLETE) return -1;        /* truncated         */
+        *state = st;
+        return 0;
+    }
+    *state = CACHE_COMPLETE;
+    return 0;
+}
+
+void codec_reader_close(codec_reader* r)
+{
+    if (r->decoder) r->codec->decoder_free(r->decoder);
+    free(r->head);
+    memset(r, 0, sizeof *r);
+}
+
+void codec_get_stats(codec_stats* out)
+{
+    memset(out, 0, sizeof *out);
+    out->storing = storing ? codecs[storing - 1]->name : NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    out->compressed = compressed;
+    out->skipped = skipped;
+    out->dropped = dropped;
+    out->body_in = body_in;
+    out->body_out = body_out;
+    memcpy(out->ratio, ratio, sizeof ratio);
+    out->ratio_sum = ratio_sum;
+    pthread_mutex_unlock(&queue_lock);
+
+    out->served_coded = atomic_load_explicit(&served_coded, memory_order_relaxed);
+    out->served_decoded = atomic_load_explicit(&served_decoded, memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_codec.h
+ *
+ *  Compressed storage for cache entries (--compress=<codec>, off by
+ *  default).
+ *
+ *      • A finished, cacheable, textual response is offered to a
+ *        background compressor; the request that filled it never waits.
+ *        A full queue drops the offer, like disk demotion.
+ *      • The compressor encodes the body, rewrites the head for it
+ *        (Content-Encoding, Content-Length, Vary, a weakened ETag) and
+ *        swaps the coded copy in for the entry (cache_replace_coded()).
+ *        Bodies under CODEC_MIN_BODY, or that don't shrink by
+ *        CODEC_MIN_SAVING percent, stay as they are.
+ *      • A client whose Accept-Encoding takes the coding gets the stored
+ *        bytes as they are – no work per request. Any other client gets
+ *        them decoded on the fly by a codec_reader: an identity head,
+ *        then the body, a buffer at a time.
+ *
+ *  A codec is named by its Content-Encoding token, so the stored form is
+ *  one a client can take directly; its id (1…, 0 = none) is what an
+ *  entry's `coding` and the disk tier's records hold. gzip (zlib) is
+ *  built in when the build has PROXY_ZLIB; codecs[] in proxy_codec.c is
+ *  where another goes.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_CODEC_H
+#define PROXY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "proxy_cache.h"
+#include "proxy_parse.h"
+
+#define CODEC_MIN_BODY      1024                /* bytes, smaller stay as is */
+#define CODEC_MIN_SAVING    10                  /* %, else not worth it      */
+#define CODEC_QUEUE_MAX     256                 /* offers awaiting compression */
+#define CODEC_RATIO_BUCKETS 7                   /* proxy_codec_ratio histogram */
+
+typedef struct cache_codec {
+    const char* name;               /* its Content-Encoding token      */
+
+    /* Encode [src, src + n) into dst; the coded length, or 0 if it
+     * needs more than `cap` bytes.                                   */
+    size_t  (*encode)(const char* src, size_t n, char* dst, size_t cap);
+
+    /* One decoder per stream; NULL when out of memory. decode() takes
+     * what it can of [*in, *in + *in_len), advancing both, and writes
+     * at most `cap` bytes to out: their count, or -1 on corrupt input.
+     * *done once the coded stream has ended.                         */
+    void*   (*decoder_new)(void);
+    ssize_t (*decode)(void* decoder, const char** in, size_t* in_len,
+                      char* out, size_t cap, int* done);
+    void    (*decoder_free)(void* decoder);
+} cache_codec;
+
+/* Decoding one entry for one client.                                */
+typedef struct codec_reader {
+    const cache_codec* codec;
+    void*   decoder;
+    char*   head;                   /* identity head, malloc'd         */
+    size_t  head_len, head_sent;
+    size_t  in_off;                 /* entry bytes consumed            */
+    int     done;
+} codec_reader;
+
+typedef struct codec_stats {
+    const char* storing;            /* codec name, NULL → off          */
+    uint64_t compressed;            /* entries replaced by a coded copy */
+    uint64_t skipped;               /* offered, not encodable or not
+                                       worth it                        */
+    uint64_t dropped;               /* offers lost to a full queue     */
+    uint64_t body_in, body_out;     /* compressed bodies, before/after */
+    uint64_t served_coded;          /* coded entries sent as stored    */
+    uint64_t served_decoded;        /*   …and decoded for the client   */
+    uint64_t ratio[CODEC_RATIO_BUCKETS];        /* compressed, by ratio */
+    double   ratio_sum;
+} codec_stats;
+
+/* Upper bounds of the ratio buckets (body before / after), the last
+ * one open-ended.                                                    */
+extern const double codec_ratio_bounds[CODEC_RATIO_BUCKETS - 1];
+
+/* Store new entries in codec `name` and start the compressor. Once;
+ * -1 with errno = EINVAL for a codec this build doesn't have.        */
+int   codec_init(const char* name);
+int   codec_enabled(void);
+
+/* The codec behind an entry's `coding`; NULL for 0 or an unknown id. */
+const cache_codec* codec_get(unsigned id);
+
+/* Bit `id` set for every codec pr's Accept-Encoding takes.           */
+unsigned codec_accepted(ParsedRequest* pr);
+
+/* A fill finished and was kept: queue e for compression. Cheap, and
+ * a no-op when compression is off.                                   */
+void  codec_offer(cache_element* e);
+
+/* Once a byte of e is readable: 1 if it is stored in a coding the
+ * client (`accepted`, from codec_accepted()) doesn't take, so it must
+ * go through a codec_reader. Call once per response; it is counted. */
+int   codec_must_decode(const cache_element* e, unsigned accepted);
+
+/* A reader for e's coding (cache_source()). -1 when out of memory.   */
+int   codec_reader_open(codec_reader* r, const cache_element* e);
+
+/* Up to `cap` bytes of the decoded response into buf: the identity
+ * head, then the body. 0 → nothing for now, and *state says why:
+ * COMPLETE – all of it is out; FILLING – wait for e past r->in_off;
+ * ABORTED – e was cut short. -1 → the stored bytes are corrupt.      */
+ssize_t codec_reader_read(codec_reader* r, cache_element* e, char* buf, size_t cap,
+                          cache_state* state);
+void  codec_reader_close(codec_reader* r);
+
+void  codec_get_stats(codec_stats* out);
+
+#endif /* PROXY_CODEC_H */
@@ -0,0 +1,269 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_config.c      –  config file, overrides, snapshot publication
+ *
+ *  Every setting is a row of `keys`: where it lives in proxy_config,
+ *  how its value is written, its bounds, and whether a reload may
+ *  change it. Loading is defaults → file → overrides into a private
+ *  copy, which is only published once every line has parsed.
+ *
+ *  Only config_load() and config_reload() write `current`, and they
+ *  are serialised by publish_lock; readers just load the pointer.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_config.h"
+
+#include "proxy_cache.h"
+#include "proxy_metrics.h"
+#include "proxy_pool.h"
+#include "proxy_tunnel.h"
+#include "proxy_upstream.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_OVERRIDES   16
+
+static const proxy_config defaults = {
+    .port               = 8080,
+    .mode               = MODE_EPOLL,
+    .workers            = 0,
+    .max_clients        = 1000,
+    .cache_shards       = CACHE_SHARDS,
+    .cache_bytes        = MAX_SIZE,
+    .max_object         = 0,
+    .upstream_max_idle  = UPSTREAM_MAX_IDLE,
+    .upstream_per_host  = UPSTREAM_MAX_PER_HOST,
+    .upstream_idle_secs = UPSTREAM_IDLE_TIMEOUT,
+    .tunnel_idle_secs   = TUNNEL_IDLE_SECS,
+    .relay_buffer       = 16 * 1024,
+};
+
+static _Atomic(const proxy_config*) current = &defaults;
+
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static char*           file_path;              /* NULL → flags only     */
+
+static struct { const char* key; const char* value; } overrides[MAX_OVERRIDES];
+static unsigned override_count;
+
+
+/*──────────────────── Keys ─────────────────────────────────────────*/
+
+typedef enum { KEY_UINT, KEY_SIZE, KEY_SECS, KEY_MODE } key_type;
+
+#define FIELD(f)    offsetof(proxy_config, f), sizeof ((proxy_config*)0)->f
+
+static const struct config_key {
+    const char* name;
+    size_t      offset, size;
+    key_type    type;
+    uint64_t    min, max;
+    int         live;
+} keys[] = {
+    { "port",                  FIELD(port),               KEY_UINT, 1, 65535,            0 },
+    { "mode",                  FIELD(mode),               KEY_MODE, 0, 0,                0 },
+    { "workers",               FIELD(workers),            KEY_UINT, 0, POOL_MAX_THREADS, 0 },
+    { "max_clients",           FIELD(max_clients),        KEY_UINT, 1, 1 << 20,          0 },
+    { "cache_shards",          FIELD(cache_shards),       KEY_UINT, 1, 1024,             0 },
+    { "cache_size",            FIELD(cache_bytes),        KEY_SIZE, 64 * 1024, SIZE_MAX / 2, 1 },
+    { "max_object",            FIELD(max_object),         KEY_SIZE, 0, MAX_ELEMENT_SIZE, 1 },
+    { "upstream_idle_max",     FIELD(upstream_max_idle),  KEY_UINT, 0, 1 << 20,          1 },
+    { "upstream_per_host",     FIELD(upstream_per_host),  KEY_UINT, 0, 1 << 16,          1 },
+    { "upstream_idle_timeout", FIELD(upstream_idle_secs), KEY_SECS, 0, 86400,            1 },
+    { "tunnel_idle_timeout",   FIELD(tunnel_idle_secs),   KEY_SECS, 1, 86400,            1 },
+    { "relay_buffer",          FIELD(relay_buffer),       KEY_SIZE, 1024, 1 << 20,       1 },
+};
+
+static const char* const mode_names[] = { "epoll", "uring", "threaded" };
+
+static const struct config_key* key_find(const char* name)
+{
+    for (size_t i = 0; i < sizeof keys / sizeof keys[0]; ++i)
+        if (strcmp(keys[i].name, name) == 0) return &keys[i];
+    return NULL;
+}
+
+/* Decimal, with a K/M/G (×1024) suffix for sizes or s/m/h for
+ * durations. -1 if anything else trails the digits.                  */
+static int parse_number(const char* s, key_type type, uint64_t* out)
+{
+    if (!isdigit((unsigned char)*s)) return -1;
+    errno = 0;
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno) return -1;
+
+    uint64_t scale = 1;
+    if (*end && !end[1]) {
+        int c = tolower((unsigned char)*end);
+        if (type == KEY_SIZE)
+            scale = c == 'k' ? 1u << 10 : c == 'm' ? 1u << 20 : c == 'g' ? 1u << 30 : 0;
+        else if (type == KEY_SECS)
+            scale = c == 's' ? 1 : c == 'm' ? 60 : c == 'h' ? 3600 : 0;
+        else
+            scale = 0;
+        ++end;
+    }
+    if (*end || !scale || v > UINT64_MAX / scale) return -1;
+    *out = (uint64_t)v * scale;
+    return 0;
+}
+
+/* Set one key in cfg. NULL on success, else what was wrong.         */
+static const char* config_set(proxy_config* cfg, const char* name, const char* value)
+{
+    const struct config_key* k = key_find(name);
+    if (!k) return "unknown key";
+    char* field = (char*)cfg + k->offset;
+
+    if (k->type == KEY_MODE) {
+        for (unsigned i = 0; i < sizeof mode_names / sizeof mode_names[0]; ++i) {
+            if (strcmp(value, mode_names[i]) == 0) {
+                *(proxy_mode*)field = (proxy_mode)i;
+                return NULL;
+            }
+        }
+        return "expected epoll, uring or threaded";
+    }
+
+    uint64_t v;
+    if (parse_number(value, k->type, &v) < 0) return "not a number";
+    if (v < k->min || v > k->max) return "out of range";
+    if (k->size == sizeof(unsigned)) *(unsigned*)field = (unsigned)v;
+    else                             *(size_t*)field = (size_t)v;
+    return NULL;
+}
+
+
+/*──────────────────── File ─────────────────────────────────────────*/
+
+static char* trim(char* s)
+{
+    while (isspace((unsigned char)*s)) ++s;
+    size_t n = strlen(s);
+    while (n && isspace((unsigned char)s[n - 1])) s[--n] = '\0';
+    return s;
+}
+
+/* `key = value` lines over cfg; blank lines and '#' comments are
+ * skipped. -1 after reporting the first bad line.                    */
+static int parse_file(const char* path, proxy_config* cfg)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "config: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char* line = NULL;
+    size_t cap = 0;
+    unsigned lineno = 0;
+    int rc = 0;
+    while (rc == 0 && getline(&line, &cap, f) >= 0) {
+        ++lineno;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char* s = trim(line);
+        if (!*s) continue;
+
+        char* eq = strchr(s, '=');
+        const char* why = "expected key = value";
+        if (eq) {
+            *eq = '\0';
+            why = config_set(cfg, trim(s), trim(eq + 1));
+        }
+        if (why) {
+            fprintf(stderr, "config: %s:%u: %s: %s\n", path, lineno, trim(s), why);
+            rc = -1;
+        }
+    }
+    free(line);
+    fclose(f);
+    return rc;
+}
+
+/* defaults → file → overrides. -1 if the file didn't parse.         */
+static int build(proxy_config* cfg)
+{
+    *cfg = defaults;
+    if (file_path && parse_file(file_path, cfg) < 0) return -1;
+    for (unsigned i = 0; i < override_count; ++i)
+        config_set(cfg, overrides[i].key, overrides[i].value);
+    return 0;
+}
+
+
+/*──────────────────── Public API ───────────────────────────────────*/
+
+const proxy_config* config_get(void)
+{
+    return atomic_load_explicit(&current, memory_order_acquire);
+}
+
+int config_override(const char* key, const char* value)
+{
+    proxy_config scratch = defaults;
+    if (override_count == MAX_OVERRIDES || config_set(&scratch, key, value)) {
+        errno = EINVAL;
+        return -1;
+    }
+    overrides[override_count].key = key;
+    overrides[override_count].value = value;
+    ++override_count;
+    return 0;
+}
+
+int config_load(const char* path)
+{
+    proxy_config* cfg = (proxy_config*)malloc(sizeof *cfg);
+    if (!cfg) return -1;
+
+    pthread_mutex_lock(&publish_lock);
+    free(file_path);
+    file_path = path ? strdup(path) : NULL;
+    int rc = (path && !file_path) ? -1 : build(cfg);
+    if (rc == 0) {
+        cfg->generation = config_get()->generation + 1;
+        atomic_store_explicit(&current, cfg, memory_order_release);
+    }
+    pthread_mutex_unlock(&publish_lock);
+    if (rc < 0) free(cfg);
+    return rc;
+}
+
+int config_reload(void)
+{
+    proxy_config* cfg = (proxy_config*)malloc(sizeof *cfg);
+    if (!cfg) return -1;
+
+    pthread_mutex_lock(&publish_lock);
+    const proxy_config* old = config_get();
+    int rc = build(cfg);
+    if (rc == 0) {
+        for (size_t i = 0; i < sizeof keys / sizeof keys[0]; ++i) {
+            const struct config_key* k = &keys[i];
+            char* field = (char*)cfg + k->offset;
+            const char* was = (const char*)old + k->offset;
+            if (k->live || memcmp(field, was, k->size) == 0) continue;
+            fprintf(stderr, "config: %s: takes a restart, keeping the running value\n", k->name);
+            memcpy(field, was, k->size);
+        }
+        cfg->generation = old->generation + 1;
+        atomic_store_explicit(&current, cfg, memory_order_release);
+        fprintf(stderr, "config: %s reloaded (generation %u)\n",
+                file_path ? file_path : "flags", cfg->generation);
+    }
+    pthread_mutex_unlock(&publish_lock);
+
+    if (rc < 0) free(cfg);
+    metric_inc(rc == 0 ? M_CONFIG_RELOADS : M_CONFIG_REJECTED);
+    return rc;
+}
@@ -0,0 +1,71 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_config.h
+ *
+ *  Runtime settings: built-in defaults, overlaid by a config file
+ *  (--config=FILE, `key = value` per line), overlaid by command-line
+ *  flags. SIGHUP rereads the file; the flags still win after a reload.
+ *
+ *  The settings in force are one immutable proxy_config snapshot. A
+ *  reload builds a complete new one and publishes it with a single
+ *  release store, and config_get() is an acquire load, so a hot path
+ *  reads a consistent set without a lock and never sees half a file.
+ *  Snapshots are never freed: a reader may be holding the old one, and
+ *  at a couple of hundred bytes per SIGHUP that is cheaper than the
+ *  grace periods RCU would need to know when nobody is.
+ *
+ *  Live settings apply to the next operation that reads them: cache
+ *  budget and max object (a smaller budget is trimmed incrementally,
+ *  see cache_trim()), origin pool limits, idle timeouts, and the relay
+ *  buffer of new connections. Startup settings are sized into threads
+ *  and tables once; a reload that changes one keeps the running value
+ *  and says a restart is needed.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_CONFIG_H
+#define PROXY_CONFIG_H
+
+#include <stddef.h>
+
+typedef enum proxy_mode {
+    MODE_EPOLL,
+    MODE_URING,
+    MODE_THREADED,
+} proxy_mode;
+
+typedef struct proxy_config {
+    unsigned   generation;          /* 0: defaults, 1: as started, +1 per reload */
+
+    /* Startup only */
+    unsigned   port;
+    proxy_mode mode;
+    unsigned   workers;             /* 0 → per core / elastic pool        */
+    unsigned   max_clients;         /* threaded front end's semaphore     */
+    unsigned   cache_shards;
+
+    /* Live */
+    size_t     cache_bytes;
+    size_t     max_object;          /* 0 → MAX_ELEMENT_SIZE               */
+    size_t     upstream_max_idle;   /* idle origin sockets, all origins   */
+    size_t     upstream_per_host;   /*   …per origin                      */
+    unsigned   upstream_idle_secs;
+    unsigned   tunnel_idle_secs;
+    size_t     relay_buffer;        /* epoll/uring staging chunk per conn */
+} proxy_config;
+
+/* The snapshot in force; never NULL, never freed, never changes.     */
+const proxy_config* config_get(void);
+
+/* A command-line setting, applied over the file now and on every
+ * reload. -1 (EINVAL) for an unknown key or a bad value.             */
+int  config_override(const char* key, const char* value);
+
+/* Build and publish the first snapshot from `path` (NULL → no file).
+ * -1 with the offending line reported on stderr.                     */
+int  config_load(const char* path);
+
+/* Reread the file given to config_load() and publish the result.
+ * On any error the running snapshot stays and -1 is returned; each
+ * startup setting that changed is reported and left as it was.       */
+int  config_reload(void);
+
+#endif /* PROXY_CONFIG_H */
@@ -0,0 +1,492 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_disk.c      –  mmap'ed segment files behind the RAM cache
+ *
+ *      segments  oldest → … → active; only the writer thread appends,
+ *                to `active`. Each is ftruncate'd to DISK_SEGMENT_SIZE
+ *                up front (sparse) and mapped whole, so a mapping never
+ *                changes size under a reader.
+ *      slots[]   open-addressing index {hash → segment, offset, length},
+ *                linear probing as in the RAM cache's shards. Entries
+ *                only ever leave a whole segment at a time, so removal
+ *                is a rehash that skips that segment.
+ *
+ *  Segments are refcounted: the tier holds one reference and every
+ *  disk_ref another, so recycling a segment only unlinks it; the unmap
+ *  happens when the last reader lets go.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_disk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DISK_RECORD_MAGIC   0x32444350u         /* "PCD2", little-endian     */
+#define DISK_URL_MAX        (8 * 1024)          /* = MAX_REQUEST_BYTES       */
+#define DISK_INDEX_MIN      1024                /* slots, power of two       */
+#define DISK_PATH_MAX       4096
+
+typedef struct disk_record {
+    uint32_t magic;
+    uint32_t url_len;
+    uint64_t body_len;
+    uint64_t hash;                          /* cache_hash(url)           */
+    uint64_t check;                         /* cache_hash(body)          */
+    uint32_t coding;                        /* cache_element.coding      */
+    uint32_t decoded_len;                   /*   …and decoded_len        */
+} disk_record;
+
+struct disk_segment {
+    uint32_t      id;                       /* seg-<id>.dat              */
+    int           fd;
+    char*         map;                      /* DISK_SEGMENT_SIZE bytes   */
+    size_t        used;                     /* append offset             */
+    atomic_int    refs;                     /* the tier + disk_refs      */
+    disk_segment* next;                     /* towards newer             */
+};
+
+typedef struct disk_slot {
+    uint64_t      hash;
+    disk_segment* segment;                  /* NULL → empty slot         */
+    size_t        offset;                   /* of the disk_record        */
+    size_t        len;                      /* response bytes            */
+    size_t        url_len;
+} disk_slot;
+
+static pthread_mutex_t tier_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queue_cond = PTHREAD_COND_INITIALIZER;
+static int             enabled;
+static char            tier_dir[DISK_PATH_MAX - 32];   /* room for /seg-… */
+static size_t          capacity;
+
+static disk_slot*      slots;
+static size_t          mask, count;
+
+static disk_segment*   oldest;              /* list head                 */
+static disk_segment*   active;              /* list tail, writer-owned   */
+static unsigned        segment_count;
+static uint32_t        next_id;
+
+static cache_element*  queue[DISK_QUEUE_MAX];
+static unsigned        queue_head, queue_len;
+
+static uint64_t        hits, misses, demoted, dropped, recovered;
+
+
+/*──────────────────── Records ──────────────────────────────────────*/
+
+static inline size_t record_size(size_t url_len, size_t body_len)
+{
+    return (sizeof(disk_record) + url_len + body_len + 7) & ~(size_t)7;
+}
+
+static inline const char* record_url(const disk_segment* s, size_t offset)
+{
+    return s->map + offset + sizeof(disk_record);
+}
+
+static int pwrite_all(int fd, const void* data, size_t n, size_t offset)
+{
+    const char* p = (const char*)data;
+    while (n > 0) {
+        ssize_t k = pwrite(fd, p, n, (off_t)offset);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += k;
+        n -= (size_t)k;
+        offset += (size_t)k;
+    }
+    return 0;
+}
+
+
+/*──────────────────── Index (tier_lock held) ───────────────────────*/
+
+static disk_slot* index_lookup(const char* url, size_t len, uint64_t hash)
+{
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        disk_slot* slot = &slots[i];
+        if (!slot->segment) return NULL;
+        if (slot->hash == hash && slot->url_len == len
+            && memcmp(record_url(slot->segment, slot->offset), url, len) == 0)
+            return slot;
+    }
+}
+
+static void index_place(disk_slot* table, size_t table_mask, const disk_slot* from)
+{
+    size_t i = from->hash & table_mask;
+    while (table[i].segment) i = (i + 1) & table_mask;
+    table[i] = *from;
+}
+
+/* Rehash into `new_mask + 1` slots, leaving out entries of `skip`.  */
+static int index_rebuild(size_t new_mask, const disk_segment* skip)
+{
+    disk_slot* table = (disk_slot*)calloc(new_mask + 1, sizeof(disk_slot));
+    if (!table) return -1;
+
+    size_t kept = 0;
+    for (size_t i = 0; i <= mask; ++i) {
+        if (slots[i].segment && slots[i].segment != skip) {
+            index_place(table, new_mask, &slots[i]);
+            ++kept;
+        }
+    }
+    free(slots);
+    slots = table;
+    mask = new_mask;
+    count = kept;
+    return 0;
+}
+
+static void index_insert(uint64_t hash, disk_segment* s, size_t offset,
+                         size_t len, size_t url_len)
+{
+    disk_slot* slot = index_lookup(record_url(s, offset), url_len, hash);
+    if (!slot) {
+        if ((count + 1) * 4 > (mask + 1) * 3 && index_rebuild((mask << 1) | 1, NULL) < 0)
+            return;
+        disk_slot fresh = { hash, s, offset, len, url_len };
+        index_place(slots, mask, &fresh);
+        ++count;
+        return;
+    }
+    slot->segment = s;                      /* newer copy of the same URL */
+    slot->offset = offset;
+    slot->len = len;
+}
+
+
+/*──────────────────── Segments ─────────────────────────────────────*/
+
+static void segment_path(char* dst, uint32_t id)
+{
+    snprintf(dst, DISK_PATH_MAX, "%s/seg-%08u.dat", tier_dir, id);
+}
+
+static disk_segment* segment_open(uint32_t id, int create)
+{
+    char path[DISK_PATH_MAX];
+    segment_path(path, id);
+
+    disk_segment* s = (disk_segment*)calloc(1, sizeof *s);
+    if (!s) return NULL;
+    s->id = id;
+    s->fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (s->fd < 0) { free(s); return NULL; }
+
+    /* Full size up front: holes read as zeros, which ends a scan.   */
+    struct stat st;
+    if (fstat(s->fd, &st) < 0
+        || (st.st_size != DISK_SEGMENT_SIZE && ftruncate(s->fd, DISK_SEGMENT_SIZE) < 0)) {
+        close(s->fd);
+        free(s);
+        return NULL;
+    }
+    s->map = (char*)mmap(NULL, DISK_SEGMENT_SIZE, PROT_READ, MAP_SHARED, s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        close(s->fd);
+        free(s);
+        return NULL;
+    }
+    atomic_init(&s->refs, 1);
+    return s;
+}
+
+static void segment_put(disk_segment* s)
+{
+    if (s && atomic_fetch_sub(&s->refs, 1) == 1) {
+        munmap(s->map, DISK_SEGMENT_SIZE);
+        close(s->fd);
+        free(s);
+    }
+}
+
+static void segment_link(disk_segment* s)
+{
+    if (active) active->next = s;
+    else        oldest = s;
+    active = s;
+    ++segment_count;
+}
+
+/* Unlink the oldest segments while over budget (tier_lock held); they
+ * are returned chained through `next` for unlink() + put unlocked.  */
+static disk_segment* segments_over_budget(void)
+{
+    disk_segment* victims = NULL;
+    while (segment_count > 1 && (size_t)segment_count * DISK_SEGMENT_SIZE > capacity) {
+        disk_segment* s = oldest;
+        if (index_rebuild(mask, s) < 0) break;
+        oldest = s->next;
+        --segment_count;
+        s->next = victims;
+        victims = s;
+    }
+    return victims;
+}
+
+static void segments_retire(disk_segment* victims)
+{
+    while (victims) {
+        disk_segment* next = victims->next;
+        char path[DISK_PATH_MAX];
+        segment_path(path, victims->id);
+        unlink(path);
+        segment_put(victims);
+        victims = next;
+    }
+}
+
+/* Seal `active` and start a new segment. Writer thread only.        */
+static int segment_roll(void)
+{
+    if (active) fdatasync(active->fd);
+
+    disk_segment* s = segment_open(next_id, 1);
+    if (!s) return -1;
+
+    pthread_mutex_lock(&tier_lock);
+    ++next_id;
+    segment_link(s);
+    disk_segment* victims = segments_over_budget();
+    pthread_mutex_unlock(&tier_lock);
+
+    segments_retire(victims);
+    return 0;
+}
+
+
+/*──────────────────── Recovery ─────────────────────────────────────*/
+
+/* Index every well-formed record of s; stops at the first bad one.  */
+static void segment_scan(disk_segment* s, int verify)
+{
+    size_t off = 0;
+    while (off + sizeof(disk_record) <= DISK_SEGMENT_SIZE) {
+        disk_record rec;
+        memcpy(&rec, s->map + off, sizeof rec);
+        if (rec.magic != DISK_RECORD_MAGIC || rec.url_len == 0 || rec.url_len > DISK_URL_MAX
+            || rec.body_len > MAX_ELEMENT_SIZE)
+            break;
+        size_t size = record_size(rec.url_len, (size_t)rec.body_len);
+        if (off + size > DISK_SEGMENT_SIZE) break;
+
+        const char* url = record_url(s, off);
+        if (cache_hash(url, rec.url_len) != rec.hash) break;
+        if (verify && cache_hash(url + rec.url_len, (size_t)rec.body_len) != rec.check) break;
+
+        index_insert(rec.hash, s, off, (size_t)rec.body_len, rec.url_len);
+        ++recovered;
+        off += size;
+    }
+    s->used = off;
+}
+
+static int id_order(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void recover(void)
+{
+    DIR* d = opendir(tier_dir);
+    if (!d) return;
+
+    uint32_t* ids = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        unsigned id;
+        int end = 0;
+        if (sscanf(de->d_name, "seg-%8u.dat%n", &id, &end) != 1 || de->d_name[end] != '\0')
+            continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            uint32_t* tmp = (uint32_t*)realloc(ids, cap * sizeof *ids);
+            if (!tmp) break;
+            ids = tmp;
+        }
+        ids[n++] = id;
+    }
+    closedir(d);
+    if (n) qsort(ids, n, sizeof *ids, id_order);
+
+    /* Oldest first, so a newer copy of a URL wins. Only the last
+     * segment may have a torn tail; the others were synced.         */
+    for (size_t i = 0; i < n; ++i) {
+        disk_segment* s = segment_open(ids[i], 0);
+        if (!s) continue;
+        segment_scan(s, i + 1 == n);
+        segment_link(s);
+        next_id = ids[i] + 1;
+    }
+    free(ids);
+
+    /* Drop whatever follows the last good record, so later appends
+     * can't run into stale records that would resurface on restart. */
+    if (active && (ftruncate(active->fd, (off_t)active->used) < 0
+                   || ftruncate(active->fd, DISK_SEGMENT_SIZE) < 0))
+        active->used = DISK_SEGMENT_SIZE;           /* force a roll */
+
+    segments_retire(segments_over_budget());
+}
+
+
+/*──────────────────── Writer ───────────────────────────────────────*/
+
+static void write_record(cache_element* e)
+{
+    size_t body = (size_t)e->len;
+    size_t size = record_size(e->url_len, body);
+    if (size > DISK_SEGMENT_SIZE) return;
+    if ((!active || active->used + size > DISK_SEGMENT_SIZE) && segment_roll() < 0) return;
+
+    disk_segment* s = active;
+    size_t off = s->used;
+    size_t pos = off + sizeof(disk_record);
+    if (pwrite_all(s->fd, e->url, e->url_len, pos) < 0) return;
+    pos += e->url_len;
+
+    for (size_t done = 0; done < body;) {
+        const char* p;
+        size_t n = cache_peek(e, done, &p, NULL);
+        if (n == 0 || pwrite_all(s->fd, p, n, pos + done) < 0) return;
+        done += n;
+    }
+
+    /* Header last: a record is only ever found once its bytes are. */
+    disk_record rec = { DISK_RECORD_MAGIC, (uint32_t)e->url_len, body, e->hash,
+                        cache_hash(s->map + pos, body), e->coding, (uint32_t)e->decoded_len };
+    if (pwrite_all(s->fd, &rec, sizeof rec, off) < 0) return;
+
+    pthread_mutex_lock(&tier_lock);
+    s->used = off + size;
+    index_insert(e->hash, s, off, body, e->url_len);
+    ++demoted;
+    pthread_mutex_unlock(&tier_lock);
+}
+
+static void* writer_main(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&tier_lock);
+        while (queue_len == 0) pthread_cond_wait(&queue_cond, &tier_lock);
+        cache_element* e = queue[queue_head];
+        queue_head = (queue_head + 1) % DISK_QUEUE_MAX;
+        --queue_len;
+        disk_slot* slot = index_lookup(e->url, e->url_len, e->hash);
+        int present = slot && slot->len == (size_t)e->len;   /* promoted back, unchanged */
+        pthread_mutex_unlock(&tier_lock);
+
+        if (!present) write_record(e);
+        cache_release(e);
+    }
+    return NULL;
+}
+
+
+/*──────────────────── Public API ───────────────────────────────────*/
+
+int disk_init(const char* dir, size_t capacity_bytes)
+{
+    if (enabled) return 0;
+    if (strlen(dir) >= sizeof tier_dir) { errno = ENAMETOOLONG; return -1; }
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return -1;
+
+    strcpy(tier_dir, dir);
+    capacity = capacity_bytes ? capacity_bytes : DISK_MAX_SIZE;
+    mask = DISK_INDEX_MIN - 1;
+    slots = (disk_slot*)calloc(mask + 1, sizeof(disk_slot));
+    if (!slots) return -1;
+
+    recover();
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) return -1;
+    pthread_detach(writer);
+    enabled = 1;
+    return 0;
+}
+
+int disk_enabled(void)
+{
+    return enabled;
+}
+
+void disk_demote(cache_element* e)
+{
+    if (!enabled || atomic_load(&e->state) != CACHE_COMPLETE) return;
+
+    pthread_mutex_lock(&tier_lock);
+    if (queue_len == DISK_QUEUE_MAX) {
+        ++dropped;
+    }
+    else {
+        cache_retain(e);
+        queue[(queue_head + queue_len) % DISK_QUEUE_MAX] = e;
+        ++queue_len;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&tier_lock);
+}
+
+int disk_lookup(const char* url, size_t url_len, uint64_t hash, disk_ref* ref)
+{
+    if (!enabled) return 0;
+
+    pthread_mutex_lock(&tier_lock);
+    disk_slot* slot = index_lookup(url, url_len, hash);
+    if (slot) {
+        ref->segment = slot->segment;
+        ref->data = record_url(slot->segment, slot->offset) + url_len;
+        ref->len = slot->len;
+
+        disk_record rec;
+        memcpy(&rec, slot->segment->map + slot->offset, sizeof rec);
+        ref->coding = rec.coding;
+        ref->decoded_len = rec.decoded_len;
+        atomic_fetch_add(&slot->segment->refs, 1);
+        ++hits;
+    }
+    else {
+        ++misses;
+    }
+    pthread_mutex_unlock(&tier_lock);
+    return slot != NULL;
+}
+
+void disk_ref_release(disk_ref* ref)
+{
+    segment_put(ref->segment);
+    ref->segment = NULL;
+    ref->data = NULL;
+}
+
+void disk_get_stats(disk_stats* out)
+{
+    memset(out, 0, sizeof *out);
+    pthread_mutex_lock(&tier_lock);
+    out->hits = hits;
+    out->misses = misses;
+    out->demoted = demoted;
+    out->dropped = dropped;
+    out->recovered = recovered;
+    out->entries = count;
+    out->segments = segment_count;
+    for (disk_segment* s = oldest; s; s = s->next) out->bytes += s->used;
+    pthread_mutex_unlock(&tier_lock);
+}
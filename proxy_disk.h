@@ -0,0 +1,78 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_disk.h
+ *
+ *  Second cache tier on disk, behind the in-memory cache.
+ *
+ *      • Objects evicted from RAM are demoted: a writer thread appends
+ *        them to large segment files (DISK_SEGMENT_SIZE each) in the
+ *        cache directory. Demotion never blocks the evicting thread; a
+ *        full queue just drops the object.
+ *      • A compact in-memory index maps URL hash → (segment, offset,
+ *        length). Segments are mmap'ed read-only, so a disk hit is a
+ *        pointer into the page cache.
+ *      • A disk hit is promoted: the front end copies it into a fresh
+ *        RAM entry (see proxy_cache_open() in proxy_server.h).
+ *      • Segments are recycled oldest first once the tier exceeds its
+ *        byte budget, FIFO-style – no per-object bookkeeping.
+ *      • On startup the index is rebuilt by walking the record headers
+ *        of every segment, so a restart doesn't mean a cold cache.
+ *
+ *  On-disk record, 8-byte aligned:
+ *
+ *      disk_record (40 B) │ url (url_len) │ response (body_len) │ pad
+ *
+ *  A compressed entry (proxy_codec.h) is written as it is stored; the
+ *  record keeps its coding, so it comes back compressed.
+ *
+ *  The header is written after the bytes it describes. Segments are
+ *  fdatasync'ed when sealed; only the segment that was still being
+ *  appended to is checksummed on recovery.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_DISK_H
+#define PROXY_DISK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "proxy_cache.h"
+
+#define DISK_SEGMENT_SIZE   (64 * (1 << 20))    /* per file, > MAX_ELEMENT_SIZE */
+#define DISK_MAX_SIZE       (1024 * (size_t)(1 << 20))  /* default budget   */
+#define DISK_QUEUE_MAX      256                 /* pending demotions         */
+
+typedef struct disk_segment disk_segment;
+
+/* A disk hit: `data` stays mapped until disk_ref_release().          */
+typedef struct disk_ref {
+    const char*   data;
+    size_t        len;
+    unsigned      coding;           /* as stored: cache_element.coding */
+    size_t        decoded_len;
+    disk_segment* segment;
+} disk_ref;
+
+typedef struct disk_stats {
+    uint64_t hits, misses;
+    uint64_t demoted;               /* objects written                    */
+    uint64_t dropped;               /* demotions lost to a full queue     */
+    uint64_t recovered;             /* objects found at startup           */
+    size_t   entries, bytes, segments;
+} disk_stats;
+
+/* Open (or create) the tier in `dir` with a byte budget (0 → default)
+ * and rebuild the index from existing segments. Starts the writer.
+ * Returns 0, or -1 with errno set; the proxy then runs RAM-only.     */
+int   disk_init(const char* dir, size_t capacity_bytes);
+int   disk_enabled(void);
+
+/* cache_set_evict_hook() target: queue e for write-behind.           */
+void  disk_demote(cache_element* e);
+
+/* 1 and *ref filled on a hit, else 0.                                 */
+int   disk_lookup(const char* url, size_t url_len, uint64_t hash, disk_ref* ref);
+void  disk_ref_release(disk_ref* ref);
+
+void  disk_get_stats(disk_stats* out);
+
+#endif /* PROXY_DISK_H */
@@ -0,0 +1,752 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_dns.c      –  resolver threads behind a sharded answer cache
+ *
+ *  Per shard:
+ *      buckets[]  chained table of names (lower-cased, no trailing dot)
+ *      mru..lru   every entry but the hosts-file ones, for the
+ *                 DNS_MAX_ENTRIES limit
+ *
+ *  An entry is either answered (result + expiry) or pending: queued
+ *  for, or owned by, a resolver thread, with its waiting queries
+ *  chained on it. A pending entry is never evicted, so the thread can
+ *  read its name without the lock; it publishes the answer and wakes
+ *  the waiters in one critical section.
+ *
+ *  Stub backend (dns_init(…, server)): one UDP socket per lookup,
+ *  connected to the server, so replies from anywhere else are dropped
+ *  by the kernel and the source port is fresh each time. A and AAAA go
+ *  out together; a reply is matched by ID and question type.
+ *  Negative answers take their TTL from the SOA in the authority
+ *  section (RFC 2308). Truncated replies are used for what they hold;
+ *  there is no TCP fallback.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_dns.h"
+#include "proxy_cache.h"                    /* cache_hash()              */
+#include "proxy_metrics.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define DNS_BUCKETS     128                 /* per shard, power of two   */
+#define DNS_NAME_MAX    254                 /* 253 + NUL                 */
+#define DNS_QUERY_MAX   (12 + 255 + 4)      /* header, qname, qtype/class */
+#define DNS_PACKET_MAX  1500
+
+#define QTYPE_A         1
+#define QTYPE_SOA       6
+#define QTYPE_AAAA      28
+
+typedef struct dns_entry dns_entry;
+
+struct dns_entry {
+    char*      name;
+    uint64_t   hash;
+    dns_result result;
+    time_t     expires;                     /* monotonic seconds         */
+    int        pinned;                      /* hosts file: never expires */
+    int        pending;                     /* a resolver owns it        */
+    dns_query* waiters;
+    dns_entry* next;                        /* bucket chain              */
+    dns_entry* lru_prev;                    /* newer                     */
+    dns_entry* lru_next;                    /* older                     */
+    dns_entry* job_next;                    /* resolver queue            */
+};
+
+typedef struct dns_shard {
+    _Alignas(64) pthread_mutex_t lock;
+    dns_entry* buckets[DNS_BUCKETS];
+    dns_entry* mru;
+    dns_entry* lru;
+    size_t     count;                       /* on the LRU list           */
+    uint64_t   hits, negative_hits, coalesced, misses, failures;
+} dns_shard;
+
+static dns_shard*      shards;
+static size_t          shard_max;
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_cond = PTHREAD_COND_INITIALIZER;
+static dns_entry*      job_head;
+static dns_entry*      job_tail;
+
+static struct sockaddr_storage server;      /* stub backend              */
+static socklen_t       server_len;          /* 0 → system resolver       */
+
+static pthread_once_t  init_once = PTHREAD_ONCE_INIT;
+
+static void* resolver_main(void* arg);
+
+
+/*──────────────────── Setup ────────────────────────────────────────*/
+
+static void dns_setup(void)
+{
+    shard_max = DNS_MAX_ENTRIES / DNS_SHARDS ? DNS_MAX_ENTRIES / DNS_SHARDS : 1;
+    shards = (dns_shard*)aligned_alloc(64, DNS_SHARDS * sizeof(dns_shard));
+    if (!shards) abort();
+    memset(shards, 0, DNS_SHARDS * sizeof(dns_shard));
+    for (unsigned i = 0; i < DNS_SHARDS; ++i)
+        pthread_mutex_init(&shards[i].lock, NULL);
+
+    unsigned started = 0;
+    for (unsigned i = 0; i < DNS_THREADS; ++i) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, resolver_main, NULL) == 0) {
+            pthread_detach(t);
+            ++started;
+        }
+    }
+    if (!started) abort();                  /* lookups would never finish */
+}
+
+static time_t now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static unsigned shard_index(uint64_t hash)
+{
+    return (unsigned)(hash >> 58) & (DNS_SHARDS - 1);
+}
+
+static dns_entry** bucket_for(dns_shard* s, uint64_t hash)
+{
+    return &s->buckets[hash & (DNS_BUCKETS - 1)];
+}
+
+/* Lower-cased copy of host without a trailing dot; 0 if it is too
+ * long or empty to be a name.                                       */
+static size_t dns_name(char* dst, const char* host)
+{
+    size_t n = strlen(host);
+    if (n && host[n - 1] == '.') --n;
+    if (n == 0 || n >= DNS_NAME_MAX) return 0;
+    for (size_t i = 0; i < n; ++i) dst[i] = (char)tolower((unsigned char)host[i]);
+    dst[n] = '\0';
+    return n;
+}
+
+static void result_add(dns_result* r, int family, const void* ip)
+{
+    size_t len = family == AF_INET ? 4 : 16;
+    for (unsigned i = 0; i < r->count; ++i)
+        if (r->addr[i].family == family && memcmp(r->addr[i].ip, ip, len) == 0) return;
+    if (r->count == DNS_MAX_ADDRS) return;
+    dns_addr* a = &r->addr[r->count++];
+    memset(a, 0, sizeof *a);
+    a->family = family;
+    memcpy(a->ip, ip, len);
+}
+
+/* An address literal ("10.0.0.1", "::1", "[::1]") as a final answer. */
+static int dns_numeric(const char* host, dns_result* r)
+{
+    char buf[INET6_ADDRSTRLEN + 2];
+    size_t n = strlen(host);
+    if (n >= 2 && host[0] == '[' && host[n - 1] == ']' && n - 2 < sizeof buf) {
+        memcpy(buf, host + 1, n - 2);
+        buf[n - 2] = '\0';
+        host = buf;
+    }
+
+    unsigned char ip[16];
+    int family = inet_pton(AF_INET, host, ip) == 1  ? AF_INET
+               : inet_pton(AF_INET6, host, ip) == 1 ? AF_INET6 : 0;
+    if (!family) return 0;
+    r->count = 0;
+    result_add(r, family, ip);
+    r->status = DNS_OK;
+    return 1;
+}
+
+
+/*──────────────────── Entries (shard lock held) ────────────────────*/
+
+static dns_entry* entry_lookup(dns_shard* s, const char* name, uint64_t hash)
+{
+    for (dns_entry* e = *bucket_for(s, hash); e; e = e->next)
+        if (e->hash == hash && strcmp(e->name, name) == 0) return e;
+    return NULL;
+}
+
+static void lru_unlink(dns_shard* s, dns_entry* e)
+{
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next; else s->mru = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev; else s->lru = e->lru_prev;
+}
+
+static void lru_push(dns_shard* s, dns_entry* e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = s->mru;
+    if (s->mru) s->mru->lru_prev = e; else s->lru = e;
+    s->mru = e;
+}
+
+static void entry_drop(dns_shard* s, dns_entry* e)
+{
+    dns_entry** pp = bucket_for(s, e->hash);
+    while (*pp != e) pp = &(*pp)->next;
+    *pp = e->next;
+    if (!e->pinned) {
+        lru_unlink(s, e);
+        --s->count;
+    }
+    free(e->name);
+    free(e);
+}
+
+/* A new, empty entry for name. Unpinned ones go on the LRU list and
+ * may push the least recently used settled entry out.               */
+static dns_entry* entry_insert(dns_shard* s, const char* name, uint64_t hash, int pinned)
+{
+    dns_entry* e = (dns_entry*)calloc(1, sizeof *e);
+    if (!e || !(e->name = strdup(name))) {
+        free(e);
+        return NULL;
+    }
+    e->hash = hash;
+    e->pinned = pinned;
+    dns_entry** bucket = bucket_for(s, hash);
+    e->next = *bucket;
+    *bucket = e;
+    if (pinned) return e;
+
+    lru_push(s, e);
+    if (++s->count > shard_max) {
+        dns_entry* old = s->lru;
+        while (old && old->pending) old = old->lru_prev;
+        if (old && old != e) entry_drop(s, old);
+    }
+    return e;
+}
+
+
+/*──────────────────── Lookups ──────────────────────────────────────*/
+
+static void job_push(dns_entry* e)
+{
+    pthread_mutex_lock(&job_lock);
+    e->job_next = NULL;
+    if (job_tail) job_tail->job_next = e; else job_head = e;
+    job_tail = e;
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&job_lock);
+}
+
+int dns_resolve(const char* host, dns_query* q)
+{
+    pthread_once(&init_once, dns_setup);
+    q->entry = NULL;
+    q->shard = 0;
+    q->next = NULL;
+    if (dns_numeric(host, &q->result)) return DNS_OK;
+
+    char name[DNS_NAME_MAX];
+    size_t n = dns_name(name, host);
+    if (!n) {
+        q->result.status = DNS_FAILED;
+        q->result.count = 0;
+        return DNS_FAILED;
+    }
+    uint64_t hash = cache_hash(name, n);
+    q->shard = shard_index(hash);
+    dns_shard* s = &shards[q->shard];
+    time_t now = now_sec();
+    dns_entry* job = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    dns_entry* e = entry_lookup(s, name, hash);
+    if (e && !e->pending && (e->pinned || e->expires > now)) {
+        q->result = e->result;
+        if (e->result.status == DNS_OK) ++s->hits; else ++s->negative_hits;
+        if (!e->pinned) {
+            lru_unlink(s, e);
+            lru_push(s, e);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return q->result.status;
+    }
+
+    if (e && e->pending) {
+        ++s->coalesced;
+    }
+    else {
+        if (!e && !(e = entry_insert(s, name, hash, 0))) {
+            pthread_mutex_unlock(&s->lock);
+            q->result.status = DNS_FAILED;
+            q->result.count = 0;
+            return DNS_FAILED;
+        }
+        e->pending = 1;                          /* expired, or new    */
+        job = e;
+        ++s->misses;
+    }
+    q->entry = e;
+    q->next = e->waiters;
+    e->waiters = q;
+    pthread_mutex_unlock(&s->lock);
+
+    if (job) job_push(job);
+    return DNS_PENDING;
+}
+
+int dns_poll(dns_query* q)
+{
+    dns_shard* s = &shards[q->shard];
+    pthread_mutex_lock(&s->lock);
+    int done = q->entry == NULL;
+    pthread_mutex_unlock(&s->lock);
+    return done;
+}
+
+void dns_cancel(dns_query* q)
+{
+    dns_shard* s = &shards[q->shard];
+    pthread_mutex_lock(&s->lock);
+    if (q->entry) {
+        dns_query** pp = &q->entry->waiters;
+        while (*pp != q) pp = &(*pp)->next;
+        *pp = q->next;
+        q->entry = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+typedef struct sync_query {
+    dns_query      q;
+    pthread_cond_t cond;                    /* waited on with the shard lock */
+} sync_query;
+
+static void sync_wake(dns_query* q)
+{
+    pthread_cond_signal(&((sync_query*)q)->cond);
+}
+
+int dns_resolve_wait(const char* host, dns_result* out)
+{
+    sync_query w;
+    w.q.wake = sync_wake;
+    pthread_cond_init(&w.cond, NULL);
+    if (dns_resolve(host, &w.q) == DNS_PENDING) {
+        dns_shard* s = &shards[w.q.shard];
+        pthread_mutex_lock(&s->lock);
+        while (w.q.entry) pthread_cond_wait(&w.cond, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_cond_destroy(&w.cond);
+    *out = w.q.result;
+    return out->status;
+}
+
+socklen_t dns_sockaddr(const dns_addr* a, int port, struct sockaddr_storage* out)
+{
+    memset(out, 0, sizeof *out);
+    if (a->family == AF_INET) {
+        struct sockaddr_in* sin = (struct sockaddr_in*)out;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons((uint16_t)port);
+        memcpy(&sin->sin_addr, a->ip, 4);
+        return sizeof *sin;
+    }
+    struct sockaddr_in6* sin6 = (struct sockaddr_in6*)out;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons((uint16_t)port);
+    memcpy(&sin6->sin6_addr, a->ip, 16);
+    return sizeof *sin6;
+}
+
+
+/*──────────────────── Backends ─────────────────────────────────────*/
+
+/* getaddrinfo(); returns the TTL to cache r for.                    */
+static unsigned system_resolve(const char* name, dns_result* r)
+{
+    struct addrinfo hints = { 0 }, * res = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int rc = getaddrinfo(name, NULL, &hints, &res);
+    if (rc != 0) {
+        r->status = DNS_FAILED;
+        return rc == EAI_NONAME || rc == EAI_NODATA ? DNS_NEG_TTL : DNS_ERROR_TTL;
+    }
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET)
+            result_add(r, AF_INET, &((struct sockaddr_in*)ai->ai_addr)->sin_addr);
+        else if (ai->ai_family == AF_INET6)
+            result_add(r, AF_INET6, &((struct sockaddr_in6*)ai->ai_addr)->sin6_addr);
+    }
+    freeaddrinfo(res);
+    r->status = r->count ? DNS_OK : DNS_FAILED;
+    return r->count ? DNS_TTL : DNS_NEG_TTL;
+}
+
+static unsigned get16(const unsigned char* p) { return (unsigned)p[0] << 8 | p[1]; }
+
+static uint32_t get32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static unsigned char* put16(unsigned char* p, unsigned v)
+{
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+    return p + 2;
+}
+
+/* A recursive query for name/qtype; its length, 0 if a label is empty
+ * or longer than 63 bytes.                                          */
+static size_t stub_query(unsigned char* buf, unsigned id, const char* name, unsigned qtype)
+{
+    unsigned char* p = buf;
+    p = put16(p, id);
+    p = put16(p, 0x0100);                           /* RD              */
+    p = put16(p, 1);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    for (const char* label = name;;) {
+        const char* dot = strchr(label, '.');
+        size_t len = dot ? (size_t)(dot - label) : strlen(label);
+        if (len == 0 || len > 63) return 0;
+        *p++ = (unsigned char)len;
+        memcpy(p, label, len);
+        p += len;
+        if (!dot) break;
+        label = dot + 1;
+    }
+    *p++ = 0;
+    p = put16(p, qtype);
+    p = put16(p, 1);                                /* IN              */
+    return (size_t)(p - buf);
+}
+
+/* Past a (possibly compressed) name; NULL if it runs off the end.    */
+static const unsigned char* skip_name(const unsigned char* p, const unsigned char* end)
+{
+    while (p < end) {
+        if (*p == 0) return p + 1;
+        if ((*p & 0xC0) == 0xC0) return p + 2 <= end ? p + 2 : NULL;
+        if (*p & 0xC0) return NULL;
+        p += 1 + *p;
+    }
+    return NULL;
+}
+
+enum { STUB_WAITING = -1, STUB_ANSWER, STUB_NONE, STUB_ERROR };
+
+/* One reply to a qtype question: its addresses go into r and *ttl is
+ * how long to keep them (or, for STUB_NONE – NXDOMAIN or no record of
+ * that type – the negative TTL).                                     */
+static int stub_parse(const unsigned char* msg, size_t len, unsigned qtype,
+                      dns_result* r, uint32_t* ttl)
+{
+    const unsigned char* end = msg + len;
+    if (len < 12 || !(msg[2] & 0x80) || get16(msg + 4) != 1) return STUB_ERROR;
+    unsigned rcode = msg[3] & 0x0F;
+    if (rcode != 0 && rcode != 3) return STUB_ERROR;           /* not NXDOMAIN */
+
+    const unsigned char* p = skip_name(msg + 12, end);
+    if (!p || p + 4 > end || get16(p) != qtype) return STUB_ERROR;
+    p += 4;
+
+    unsigned an = get16(msg + 6), records = an + get16(msg + 8);
+    size_t alen = qtype == QTYPE_A ? 4 : 16;
+    uint32_t answer_ttl = UINT32_MAX, neg_ttl = DNS_NEG_TTL;
+    int found = 0, intact = 1;
+    for (unsigned i = 0; i < records; ++i) {
+        p = skip_name(p, end);
+        if (!p || p + 10 > end || p + 10 + get16(p + 8) > end) { intact = 0; break; }
+        unsigned type = get16(p), klass = get16(p + 2), rdlen = get16(p + 8);
+        uint32_t rr_ttl = get32(p + 4);
+        const unsigned char* rdata = p + 10;
+        p = rdata + rdlen;
+
+        if (i < an) {
+            if (type != qtype || klass != 1 || rdlen != alen) continue;  /* CNAME… */
+            result_add(r, qtype == QTYPE_A ? AF_INET : AF_INET6, rdata);
+            if (rr_ttl < answer_ttl) answer_ttl = rr_ttl;
+            found = 1;
+        }
+        else if (type == QTYPE_SOA) {
+            const unsigned char* q = skip_name(rdata, p);          /* mname */
+            q = q ? skip_name(q, p) : NULL;                        /* rname */
+            if (q && q + 20 <= p) {
+                uint32_t minimum = get32(q + 16);
+                neg_ttl = rr_ttl < minimum ? rr_ttl : minimum;
+            }
+        }
+    }
+    if (found) {
+        *ttl = answer_ttl;
+        return STUB_ANSWER;
+    }
+    if (!intact) return STUB_ERROR;
+    *ttl = neg_ttl;
+    return STUB_NONE;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static unsigned clamp_ttl(uint32_t ttl)
+{
+    return ttl < DNS_MIN_TTL ? DNS_MIN_TTL : ttl > DNS_MAX_TTL ? DNS_MAX_TTL : (unsigned)ttl;
+}
+
+/* Ask the configured server for A and AAAA; returns the TTL to cache
+ * r for. Addresses are IPv4 first.                                   */
+static unsigned stub_resolve(const char* name, dns_result* r, uint64_t* rng)
+{
+    static const unsigned qtypes[2] = { QTYPE_A, QTYPE_AAAA };
+    unsigned char query[2][DNS_QUERY_MAX];
+    size_t qlen[2];
+    unsigned id[2];
+    int outcome[2] = { STUB_WAITING, STUB_WAITING };
+    uint32_t ttl[2] = { 0, 0 };
+    dns_result part[2];
+
+    r->status = DNS_FAILED;
+    for (int k = 0; k < 2; ++k) {
+        *rng ^= *rng << 13;                     /* xorshift64           */
+        *rng ^= *rng >> 7;
+        *rng ^= *rng << 17;
+        id[k] = (unsigned)(*rng >> 48);
+        part[k].count = 0;
+        if (!(qlen[k] = stub_query(query[k], id[k], name, qtypes[k]))) return DNS_NEG_TTL;
+    }
+
+    int fd = socket(server.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return DNS_ERROR_TTL;
+    if (connect(fd, (const struct sockaddr*)&server, server_len) < 0) {
+        close(fd);
+        return DNS_ERROR_TTL;
+    }
+
+    for (int attempt = 0; attempt < DNS_TRIES; ++attempt) {
+        if (outcome[0] == STUB_ANSWER || outcome[1] == STUB_ANSWER) break;
+        for (int k = 0; k < 2; ++k) {
+            if (outcome[k] == STUB_ERROR) outcome[k] = STUB_WAITING;
+            if (outcome[k] == STUB_WAITING) send(fd, query[k], qlen[k], MSG_NOSIGNAL);
+        }
+        uint64_t deadline = now_ms() + DNS_TIMEOUT_MS;
+        while (outcome[0] == STUB_WAITING || outcome[1] == STUB_WAITING) {
+            uint64_t t = now_ms();
+            if (t >= deadline) break;
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int rc = poll(&pfd, 1, (int)(deadline - t));
+            if (rc < 0 && errno == EINTR) continue;
+            if (rc <= 0) break;
+
+            unsigned char msg[DNS_PACKET_MAX];
+            ssize_t n = recv(fd, msg, sizeof msg, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) goto done;                   /* ICMP: nobody there */
+            if (n < 12) continue;
+            for (int k = 0; k < 2; ++k)
+                if (outcome[k] == STUB_WAITING && get16(msg) == id[k])
+                    outcome[k] = stub_parse(msg, (size_t)n, qtypes[k], &part[k], &ttl[k]);
+        }
+    }
+done:
+    close(fd);
+
+    uint32_t answer_ttl = UINT32_MAX, neg_ttl = UINT32_MAX;
+    int negative = 1;
+    for (int k = 0; k < 2; ++k) {
+        if (outcome[k] == STUB_ANSWER) {
+            for (unsigned i = 0; i < part[k].count; ++i)
+                result_add(r, part[k].addr[i].family, part[k].addr[i].ip);
+            if (ttl[k] < answer_ttl) answer_ttl = ttl[k];
+        }
+        else if (outcome[k] == STUB_NONE) {
+            if (ttl[k] < neg_ttl) neg_ttl = ttl[k];
+        }
+        else {
+            negative = 0;                           /* no word on it    */
+        }
+    }
+    if (r->count) {
+        r->status = DNS_OK;
+        return clamp_ttl(answer_ttl);
+    }
+    return negative ? clamp_ttl(neg_ttl) : DNS_ERROR_TTL;
+}
+
+/* Publish e's answer and wake everyone waiting on it.               */
+static void entry_complete(dns_entry* e, const dns_result* r, unsigned ttl)
+{
+    dns_shard* s = &shards[shard_index(e->hash)];
+    pthread_mutex_lock(&s->lock);
+    e->result = *r;
+    e->expires = now_sec() + (time_t)ttl;
+    e->pending = 0;
+    if (r->status != DNS_OK) ++s->failures;
+
+    dns_query* q = e->waiters;
+    e->waiters = NULL;
+    while (q) {
+        dns_query* next = q->next;
+        q->result = *r;
+        q->entry = NULL;
+        q->wake(q);
+        q = next;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void* resolver_main(void* arg)
+{
+    (void)arg;
+    uint64_t rng = now_ms() ^ (uint64_t)(uintptr_t)&rng;
+    if (!rng) rng = 0x9E3779B97F4A7C15ULL;
+
+    for (;;) {
+        pthread_mutex_lock(&job_lock);
+        while (!job_head) pthread_cond_wait(&job_cond, &job_lock);
+        dns_entry* e = job_head;
+        job_head = e->job_next;
+        if (!job_head) job_tail = NULL;
+        pthread_mutex_unlock(&job_lock);
+
+        dns_result r;
+        r.count = 0;
+        uint64_t t0 = metric_now();
+        unsigned ttl = server_len ? stub_resolve(e->name, &r, &rng)
+                                  : system_resolve(e->name, &r);
+        metric_since(H_DNS_RESOLVE, t0);
+        entry_complete(e, &r, ttl);
+    }
+    return NULL;
+}
+
+
+/*──────────────────── Configuration ────────────────────────────────*/
+
+static int parse_server(const char* spec)
+{
+    char host[INET6_ADDRSTRLEN];
+    const char* port = NULL;
+    size_t n;
+    if (spec[0] == '[') {
+        const char* close = strchr(spec, ']');
+        if (!close) return -1;
+        n = (size_t)(close - spec - 1);
+        spec += 1;
+        if (close[1] == ':') port = close + 2;
+        else if (close[1]) return -1;
+    }
+    else {
+        const char* colon = strchr(spec, ':');
+        n = colon ? (size_t)(colon - spec) : strlen(spec);
+        if (colon) port = colon + 1;
+    }
+    if (n >= sizeof host) return -1;
+    memcpy(host, spec, n);
+    host[n] = '\0';
+
+    long p = 53;
+    if (port) {
+        char* end;
+        p = strtol(port, &end, 10);
+        if (end == port || *end) return -1;
+    }
+    if (p <= 0 || p > 65535) return -1;
+    dns_result r;
+    if (!dns_numeric(host, &r)) return -1;
+    server_len = dns_sockaddr(&r.addr[0], (int)p, &server);
+    return 0;
+}
+
+/* Pin addr under host; several lines may add to one name.            */
+static void hosts_add(const char* host, const dns_addr* a)
+{
+    char name[DNS_NAME_MAX];
+    size_t n = dns_name(name, host);
+    if (!n) return;
+    uint64_t hash = cache_hash(name, n);
+    dns_shard* s = &shards[shard_index(hash)];
+
+    pthread_mutex_lock(&s->lock);
+    dns_entry* e = entry_lookup(s, name, hash);
+    if (e && !e->pinned) {
+        if (e->pending) {                           /* lookup already out */
+            pthread_mutex_unlock(&s->lock);
+            return;
+        }
+        entry_drop(s, e);
+        e = NULL;
+    }
+    if (e || (e = entry_insert(s, name, hash, 1))) {
+        result_add(&e->result, a->family, a->ip);
+        e->result.status = DNS_OK;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int hosts_load(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[1024];
+    while (fgets(line, sizeof line, f)) {
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char* save;
+        char* addr = strtok_r(line, " \t\r\n", &save);
+        dns_result r;
+        if (!addr || !dns_numeric(addr, &r)) continue;
+        for (char* name; (name = strtok_r(NULL, " \t\r\n", &save)); )
+            hosts_add(name, &r.addr[0]);
+    }
+    fclose(f);
+    return 0;
+}
+
+int dns_init(const char* hosts_file, const char* server_spec)
+{
+    if (server_spec && parse_server(server_spec) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_once(&init_once, dns_setup);
+    return hosts_file ? hosts_load(hosts_file) : 0;
+}
+
+void dns_get_stats(dns_stats* out)
+{
+    pthread_once(&init_once, dns_setup);
+    memset(out, 0, sizeof *out);
+    for (unsigned i = 0; i < DNS_SHARDS; ++i) {
+        dns_shard* s = &shards[i];
+        pthread_mutex_lock(&s->lock);
+        out->hits += s->hits;
+        out->negative_hits += s->negative_hits;
+        out->coalesced += s->coalesced;
+        out->misses += s->misses;
+        out->failures += s->failures;
+        out->entries += s->count;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
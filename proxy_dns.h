@@ -0,0 +1,109 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_dns.h
+ *
+ *  Origin name resolution that never blocks the caller, behind a
+ *  cache of answers.
+ *
+ *      • dns_resolve() answers from the cache when it can: positive
+ *        answers until their TTL runs out, failures (NXDOMAIN, no
+ *        address) for a shorter negative TTL. Numeric hosts never
+ *        reach the cache.
+ *      • Otherwise the name goes to a small pool of resolver threads
+ *        and the caller is woken when the answer is in – the same
+ *        hand-off as a cache_waiter. Concurrent lookups of one name
+ *        share one query.
+ *      • Backends: the system resolver (getaddrinfo(); it doesn't
+ *        expose TTLs, so answers live DNS_TTL seconds), or with
+ *        dns_init(…, server) a built-in stub that asks that server for
+ *        A and AAAA records over UDP and honours the TTLs it returns.
+ *        A hosts file given to dns_init() is consulted first; its
+ *        names never expire and never reach a backend.
+ *
+ *  Sharded like the cache: the name's hash picks a shard, and each
+ *  shard has its own lock, chained table and LRU list.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_DNS_H
+#define PROXY_DNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define DNS_SHARDS          16              /* power of two              */
+#define DNS_MAX_ENTRIES     4096            /* cached names, all shards  */
+#define DNS_THREADS         4               /* resolver threads          */
+#define DNS_MAX_ADDRS       8               /* kept per name             */
+#define DNS_TTL             60              /* s, system resolver answers */
+#define DNS_MIN_TTL         1               /* s, clamp on server TTLs   */
+#define DNS_MAX_TTL         3600
+#define DNS_NEG_TTL         10              /* s, name has no address    */
+#define DNS_ERROR_TTL       2               /* s, timeout / server failure */
+#define DNS_TIMEOUT_MS      1000            /* stub: per attempt         */
+#define DNS_TRIES           2
+
+enum { DNS_OK, DNS_PENDING, DNS_FAILED };
+
+typedef struct dns_addr {
+    int           family;                   /* AF_INET or AF_INET6       */
+    unsigned char ip[16];                   /* network order             */
+} dns_addr;
+
+typedef struct dns_result {
+    int      status;                        /* DNS_OK or DNS_FAILED      */
+    unsigned count;
+    dns_addr addr[DNS_MAX_ADDRS];           /* in connect order          */
+} dns_result;
+
+typedef struct dns_query dns_query;
+
+/* One lookup in flight. wake() runs on a resolver thread once
+ * `result` is filled in, with the name's shard lock held: like
+ * cache_waiter.wake it must only hand off (queue + signal), never
+ * block or call back into the resolver.                              */
+struct dns_query {
+    void        (*wake)(dns_query* q);
+    dns_result  result;
+
+    /* ───────── Resolver bookkeeping (under the shard lock)            */
+    struct dns_entry* entry;                /* waited on; NULL → final   */
+    unsigned    shard;
+    dns_query*  next;
+};
+
+typedef struct dns_stats {
+    uint64_t hits;                          /* answered from the cache   */
+    uint64_t negative_hits;                 /*   …with a cached failure  */
+    uint64_t coalesced;                     /* joined a lookup in flight */
+    uint64_t misses;                        /* sent to the backend       */
+    uint64_t failures;                      /* backend found no address  */
+    size_t   entries;                       /* cached names, hosts excluded */
+} dns_stats;
+
+/* Optional, before first use: a hosts file ("address name…" lines) to
+ * answer from, and a server ("ip[:port]", "[ip6]:port") for the stub
+ * backend instead of the system resolver. Either may be NULL. -1 if
+ * the file can't be read or the server doesn't parse.                */
+int  dns_init(const char* hosts_file, const char* server);
+
+/* Resolve host. DNS_OK / DNS_FAILED: q->result is final now.
+ * DNS_PENDING: q->wake(q) runs once it is.                           */
+int  dns_resolve(const char* host, dns_query* q);
+
+/* 1 once q->result is final. wake() has then returned, so q may be
+ * reused or freed; a bare flag set by wake() would not promise that. */
+int  dns_poll(dns_query* q);
+
+/* Withdraw a pending q. Once this returns, wake() has either run or
+ * never will; the lookup itself carries on for the cache.            */
+void dns_cancel(dns_query* q);
+
+/* Blocking dns_resolve(), for the threaded front end.                */
+int  dns_resolve_wait(const char* host, dns_result* out);
+
+/* a with `port` as a sockaddr for connect(); returns its length.     */
+socklen_t dns_sockaddr(const dns_addr* a, int port, struct sockaddr_storage* out);
+
+void dns_get_stats(dns_stats* out);
+
+#endif /* PROXY_DNS_H */
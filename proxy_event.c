@@ -0,0 +1,1723 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_event.c      –  epoll reactor front end
+ *
+ *  One event_loop per worker thread. A connection walks through:
+ *
+ *      READ_REQUEST ──hit / fill in progress──► STREAM_HIT ─► next request
+ *           │ miss                                   │ filler gave up
+ *           ▼                                        ▼ before byte 0
+ *      RESOLVING ─► CONNECTING ─► SEND_REQUEST ─► RELAY (origin → entry
+ *           ▲                          ▲                  → client)
+ *           └─ name not cached         └─ idle socket      │
+ *              (else straight on)         from the pool    ▼
+ *                                                     next request
+ *
+ *  A miss makes the connection the URL's filler (cache_open()): the
+ *  relay appends origin bytes to the cache entry and serves its own
+ *  client out of that entry, exactly like the followers that joined
+ *  the fill. The origin is read at its own pace, not the slowest
+ *  client's; origin bytes are received straight into the entry, so
+ *  there is no staging copy. When the response can't be cached (too
+ *  big, unframed) the relay falls back to staging one chunk at a time,
+ *  and splices any body it doesn't need to look at (Content-Length or
+ *  close-delimited) origin → pipe → client without touching it.
+ *
+ *  A stale entry is revalidated rather than refetched: the filler of
+ *  its successor (proxy_cache.h) sends a conditional request, and its
+ *  client – served from the entry like everyone else – sees nothing
+ *  until the head says 304 (the stale entry's bytes, fresh again) or a
+ *  new response. Within stale-while-revalidate the stale entry is
+ *  served at once and a fetcher revalidates it behind the client.
+ *
+ *  A follower that catches up parks a cache_waiter on the entry. The
+ *  filler may live on another loop, so its wakeup queues the conn on
+ *  loop->wakeups and pokes the loop's eventfd. An origin name that
+ *  isn't in the resolver cache (proxy_dns.h) is looked up on a
+ *  resolver thread, which wakes the conn the same way.
+ *
+ *  The relay frames the response (proxy_http.h) as it goes; once the
+ *  last byte is in hand the origin socket goes back to the pool, even
+ *  while the client is still draining.
+ *
+ *  Client connections are persistent. When a response is out and both
+ *  the client and the response allow it (proxy_http.h), the conn goes
+ *  on with the next request, else it closes. Requests pipelined behind
+ *  the one being answered are parsed from the same buffer as they
+ *  arrive and looked up at once, up to PIPELINE_DEPTH of them: a hit
+ *  pins its entry, a miss gets a fetcher – a conn with no client that
+ *  fills the entry, as a filler whose client left would. Responses
+ *  still go out in request order, but a hit queued behind a miss goes
+ *  the moment the miss is done, and pipelined misses overlap upstream.
+ *
+ *  Sockets are registered once for IN|OUT with EPOLLET, so every wakeup
+ *  simply re-runs conn_drive(), which keeps doing whatever the current
+ *  state allows until the kernel says EAGAIN.
+ *
+ *  Connections closed mid-batch are parked on loop->dead and freed only
+ *  after the batch, so a stale epoll_event never touches freed memory.
+ *
+ *  --mode=uring swaps the client side of that for io_uring
+ *  (proxy_uring.h), one ring per loop, and waits in io_uring_enter()
+ *  instead of epoll_wait(): new connections come from a multishot
+ *  accept; a client read is a recv submitted with the next batch, which
+ *  takes one of the loop's provided buffers only once data is there, and
+ *  the parser works on that buffer as it is (what is left of a request
+ *  moves to the conn's own buffer when the batch is done); a complete
+ *  hit goes out as a chain of linked sends. Origin sockets, blocked
+ *  client sends and the wakeup eventfd stay on the epoll set, which the
+ *  ring polls like any other fd, so one enter both submits a batch and
+ *  collects whatever finished. A conn whose ops are still in flight when
+ *  it closes is freed by their last completion, not the reaper.
+ *
+ *  A CONNECT walks RESOLVING ─► CONNECTING like a miss (never on a
+ *  pooled socket), then becomes a TUNNEL: proxy_tunnel.h relays bytes
+ *  both ways through two fixed rings, and the conn gives up its arena
+ *  and parser, so a long-lived tunnel is the conn plus 8 KB. Tunnels
+ *  sit on the loop's idle list; a timerfd ticks while there are any and
+ *  closes those silent for the configured tunnel idle timeout.
+ *
+ *  A connection's scratch memory – request bytes, the staging chunk,
+ *  the pipeline queue, error pages, the buffer for decoding a compressed
+ *  entry – comes from its own slab_arena and is dropped in one go when
+ *  it closes. None of it grows per request, so a long-lived connection
+ *  stays the same size.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_event.h"
+
+#ifdef __linux__
+
+#include "proxy_codec.h"
+#include "proxy_config.h"
+#include "proxy_dns.h"
+#include "proxy_http.h"
+#include "proxy_metrics.h"
+#include "proxy_parse.h"
+#include "proxy_server.h"
+#include "proxy_slab.h"
+#include "proxy_splice.h"
+#include "proxy_tunnel.h"
+#include "proxy_upstream.h"
+#include "proxy_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#define EVENT_BATCH   256               /* epoll_wait() batch size         */
+#define PIPELINE_DEPTH 16               /* requests queued behind the current */
+#define URING_ENTRIES 512               /* SQ size of each loop's ring     */
+#define URING_BUFS    256               /* provided recv buffers per loop  */
+#define URING_LINK_MAX 16               /* sends chained for one hit       */
+
+typedef enum conn_state {
+    CONN_READ_REQUEST,      /* accumulating the client's header block    */
+    CONN_RESOLVING,         /* origin name lookup on a resolver thread   */
+    CONN_CONNECTING,        /* non-blocking connect() to origin pending  */
+    CONN_SEND_REQUEST,      /* writing the rewritten request upstream    */
+    CONN_RELAY,             /* origin → cache entry / client             */
+    CONN_STREAM_HIT,        /* serving a cache entry, possibly filling   */
+    CONN_SEND_BUFFER,       /* writing a prepared page (error, /stats)   */
+    CONN_SEND_LINKED,       /* ring: a hit's chained sends in flight     */
+    CONN_TUNNEL,            /* CONNECT established: opaque byte relay    */
+} conn_state;
+
+/* What a ring completion was for: the low bits of its user_data, the
+ * rest is the conn (or the loop, for the multishot ops).             */
+enum { OP_ACCEPT, OP_EPOLL, OP_RECV, OP_SEND, OP_MASK = 3 };
+
+/* What a drive step wants next. */
+enum { STEP_WAIT, STEP_NEXT, STEP_CLOSE };
+
+typedef struct conn conn;
+typedef struct event_loop event_loop;
+
+/* A request pipelined behind the one being answered, already looked
+ * up. Everything in it is owned (malloc'd / a reference).            */
+typedef struct pending {
+    cache_element* entry;           /* a hit, or a fill to follow        */
+    int         filler;             /* entry is ours to fill             */
+    char*       key;
+    char*       upstream;           /* rewritten request; NULL for a hit */
+    size_t      upstream_len;
+    char*       origin_host;
+    int         origin_port;
+    char*       page;               /* error / local page instead        */
+    size_t      page_len;
+    int         keep_alive;         /* client keeps the connection after */
+    int         tunnel;             /* a CONNECT to origin_host:port     */
+    unsigned    codings;            /* codec_accepted()                  */
+    uint64_t    received_at;
+} pending;
+
+/* epoll_event.data.ptr points at one of these, so we know which side woke. */
+typedef struct endpoint {
+    conn* owner;
+    int   fd;
+} endpoint;
+
+struct conn {
+    endpoint    client, origin;
+    conn_state  state;
+    int         closed;
+
+    char*       in;                 /* request bytes, MAX_REQUEST_BYTES+1 */
+    size_t      in_len;             /* the next request starts at in[0]   */
+    int         in_ready;           /* client readable since last EAGAIN  */
+    int         client_eof;         /* client shut its side: finish, close */
+    int         intake_done;        /* no further requests will be read   */
+    ParsedRequest* req;             /* parsed incrementally from `in`     */
+    http_framer body;               /* request body being skipped         */
+    int         skipping;
+    pending*    queue;              /* PIPELINE_DEPTH ring, from arena    */
+    unsigned    q_head, q_len;
+    int         keep_alive;         /* client wants more after this one   */
+    unsigned    codings;            /* …and the stored codings it takes   */
+    unsigned    requests;           /* read on this connection            */
+    uint64_t    parse_ns;           /* spent in the parser so far         */
+    uint64_t    accepted_at;        /* metric_now() at accept             */
+    uint64_t    request_at;         /* current request received, 0: none  */
+    uint64_t    connect_at;         /* fresh origin connect() started     */
+
+    const char* out;                /* bytes waiting to go out            */
+    size_t      out_len, out_off;
+    char*       stage;              /* `chunk` bytes for direct relays    */
+    size_t      chunk;              /* relay_buffer when accepted         */
+    slab_arena  arena;              /* in, stage, queue, pages            */
+
+    char*       key;                /* cache key of a miss being relayed  */
+    char*       origin_host;        /* pool key of the origin socket      */
+    int         origin_port;
+    char*       upstream;           /* rewritten request, kept for retry  */
+    size_t      upstream_len;
+    int         reused;             /* origin socket came from the pool   */
+    int         started;            /* first response byte seen           */
+    int         unframed;           /* framing failed: relay until EOF    */
+    int         origin_done;        /* response complete, origin released */
+    http_framer framer;
+    splice_pipe pipe;               /* direct relay of opaque body bytes  */
+    int         no_splice;          /* pipe2() failed once; don't retry   */
+
+    cache_element* entry;           /* ref: entry served (and filled)     */
+    size_t      served;             /* entry bytes the client has         */
+    int         decoding;           /* 1: via reader, -1: as stored, 0: tbd */
+    codec_reader reader;            /* entry in a coding the client lacks */
+    char*       decoded;            /* `chunk` of its output, arena       */
+    size_t      decoded_len, decoded_off;
+    int         filling;            /* we are entry's filler              */
+    int         validating;         /* …of a successor, head not in yet   */
+    int         not_modified;       /* origin said 304: entry is the reply */
+    int         reserved;           /* size hint given to the fill        */
+    cache_waiter waiter;            /* parked on a FILLING entry          */
+    int         waiting;
+    dns_query   dns;                /* origin_host lookup                 */
+    int         resolving;          /* dns is pending or unpolled         */
+    int         fetcher;            /* no client: fills a queued request  */
+    int         tunneling;          /* a CONNECT: no request to send      */
+    tunnel      tun;                /* its relay, once established        */
+
+    int         recv_armed;         /* ring: a client recv is in flight   */
+    int         recv_plain;         /*   …into `in`; the loop ran out     */
+    char*       lent;               /* ring: loop buffer serving as `in`  */
+    char*       in_own;             /*   …and `in` meanwhile              */
+    unsigned    sends;              /* ring: linked sends in flight       */
+    int         send_failed;
+    int         no_link;            /* sends would block: use send()      */
+    cache_element* send_pin;        /* ref: the entry they read from      */
+    int         orphaned;           /* reaped; the last completion frees  */
+
+    event_loop* loop;
+    conn*       next_wakeup;        /* loop->wakeups, under wakeup_lock   */
+    int         wakeup_queued;
+    conn*       next_dead;
+};
+
+struct event_loop {
+    int       epfd;
+    int       listen_fd;
+    pthread_t thread;
+    size_t    active;               /* live connections on this loop     */
+    conn*     dead;                 /* closed this batch, freed after    */
+
+    int       wakeup_fd;            /* eventfd: fills on other threads   */
+    endpoint  wakeup;               /* owner NULL, tags wakeup_fd        */
+    pthread_mutex_t wakeup_lock;
+    conn*     wakeups;              /* parked conns whose entry moved    */
+
+    int       tick_fd;              /* timerfd, armed while tunnels open */
+    endpoint  tick;                 /* owner NULL, tags tick_fd          */
+    tunnel_list tunnels;            /* idle order                        */
+
+    event_engine engine;
+    uring     ring;                 /* fd -1 unless running on io_uring  */
+    uring_bufs bufs;
+};
+
+static int ring_mode(const event_loop* loop)
+{
+    return loop->ring.fd >= 0;
+}
+
+static uint64_t ring_tag(void* p, int op)
+{
+    return (uint64_t)(uintptr_t)p | (uint64_t)op;
+}
+
+
+/*──────────────────── Connection lifecycle ─────────────────────────*/
+
+static void conn_set_out(conn* c, const char* data, size_t len)
+{
+    c->out = data;
+    c->out_len = len;
+    c->out_off = 0;
+}
+
+/* Queue c for loop_wakeups() on its own loop; any thread.           */
+static void conn_notify(conn* c)
+{
+    event_loop* loop = c->loop;
+
+    pthread_mutex_lock(&loop->wakeup_lock);
+    if (!c->wakeup_queued) {
+        c->wakeup_queued = 1;
+        c->next_wakeup = loop->wakeups;
+        loop->wakeups = c;
+    }
+    pthread_mutex_unlock(&loop->wakeup_lock);
+
+    uint64_t one = 1;
+    ssize_t n = write(loop->wakeup_fd, &one, sizeof one);
+    (void)n;                             /* EAGAIN: already signalled */
+}
+
+/* cache_waiter.wake: runs on the filler's thread, fill lock held.   */
+static void conn_wakeup(cache_waiter* w)
+{
+    conn_notify((conn*)((char*)w - offsetof(conn, waiter)));
+}
+
+/* dns_query.wake: runs on a resolver thread, shard lock held.       */
+static void conn_resolved(dns_query* q)
+{
+    conn_notify((conn*)((char*)q - offsetof(conn, dns)));
+}
+
+static void conn_release_entry(conn* c)
+{
+    if (!c->entry) return;
+    if (c->waiting) cache_unwait(c->entry, &c->waiter);
+    if (c->filling) cache_fill_abort(c->entry);
+    if (c->decoding > 0) codec_reader_close(&c->reader);
+    cache_release(c->entry);
+    c->entry = NULL;
+    c->waiting = 0;
+    c->filling = 0;
+    c->decoding = 0;
+    c->decoded_len = c->decoded_off = 0;
+}
+
+/* Drop c's entry, its origin lookup and any wakeup they queued, so a
+ * wakeup can't be taken for whatever c waits on next.                */
+static void conn_detach_entry(conn* c)
+{
+    event_loop* loop = c->loop;
+
+    /* After unwait / cancel nobody can queue us again; then leave the
+     * queue.                                                         */
+    conn_release_entry(c);
+    if (c->resolving) {
+        dns_cancel(&c->dns);
+        c->resolving = 0;
+    }
+    pthread_mutex_lock(&loop->wakeup_lock);
+    if (c->wakeup_queued) {
+        conn** pp = &loop->wakeups;
+        while (*pp != c) pp = &(*pp)->next_wakeup;
+        *pp = c->next_wakeup;
+        c->wakeup_queued = 0;
+    }
+    pthread_mutex_unlock(&loop->wakeup_lock);
+}
+
+static void pending_free(pending* p)
+{
+    if (p->entry) {
+        if (p->filler) cache_fill_abort(p->entry);
+        cache_release(p->entry);
+    }
+    free(p->key);
+    free(p->upstream);
+    free(p->origin_host);
+    free(p->page);
+    memset(p, 0, sizeof *p);
+}
+
+/* Forget the answered request; the connection's buffers stay.       */
+static void request_clear(conn* c)
+{
+    conn_detach_entry(c);
+    free(c->key);
+    free(c->upstream);
+    free(c->origin_host);
+    c->key = c->upstream = c->origin_host = NULL;
+    c->upstream_len = 0;
+    c->reused = c->started = c->unframed = c->origin_done = c->reserved = 0;
+    c->validating = c->not_modified = 0;
+    c->served = 0;
+    c->no_link = 0;
+    http_framer_free(&c->framer);
+    http_framer_init(&c->framer);
+    conn_set_out(c, NULL, 0);
+}
+
+/* A ring op holds its own reference to the socket, so close() alone
+ * would leave it – and the conn – waiting; shutdown() completes it.  */
+static void client_close_fd(conn* c)
+{
+    if (c->recv_armed || c->sends) shutdown(c->client.fd, SHUT_RDWR);
+    close(c->client.fd);
+    c->client.fd = -1;
+}
+
+static void conn_close(event_loop* loop, conn* c)
+{
+    if (c->closed) return;
+    c->closed = 1;
+
+    conn_detach_entry(c);
+
+    if (!c->fetcher) metric_inc(M_CONN_CLOSED);
+    if (c->request_at) metric_since(H_REQUEST, c->request_at);
+    tunnel_unlist(&loop->tunnels, &c->tun);
+    tunnel_release(&c->tun);
+    if (c->client.fd >= 0) client_close_fd(c);      /* also leaves epoll */
+    if (c->origin.fd >= 0) close(c->origin.fd);
+    ParsedRequest_destroy(c->req);
+    for (; c->q_len; --c->q_len, c->q_head = (c->q_head + 1) % PIPELINE_DEPTH)
+        pending_free(&c->queue[c->q_head]);
+    free(c->key);
+    free(c->upstream);
+    free(c->origin_host);
+    http_framer_free(&c->framer);
+    http_framer_free(&c->body);
+    splice_pipe_close(&c->pipe);
+
+    c->next_dead = loop->dead;
+    loop->dead = c;
+    --loop->active;
+}
+
+/* The arena goes last: a ring recv may still be writing into `in`. */
+static void conn_free(conn* c)
+{
+    arena_release(&c->arena);
+    free(c);
+}
+
+static void loop_reap(event_loop* loop)
+{
+    while (loop->dead) {
+        conn* c = loop->dead;
+        loop->dead = c->next_dead;
+        if (c->recv_armed || c->sends) c->orphaned = 1;
+        else conn_free(c);
+    }
+}
+
+static int watch(event_loop* loop, endpoint* ep)
+{
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    if (ring_mode(loop) && ep == &ep->owner->client)
+        ev.events = EPOLLOUT | EPOLLET;             /* reads go through the ring */
+    ev.data.ptr = ep;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, ep->fd, &ev);
+}
+
+/* Switch to writing a prepared page (malloc'd; we take it). Pages say
+ * "Connection: close", so nothing after it is read.                  */
+static int conn_page(conn* c, char* page, size_t len)
+{
+    char* copy = page ? (char*)arena_alloc(&c->arena, len) : NULL;
+    if (copy) memcpy(copy, page, len);
+    free(page);
+    c->intake_done = 1;
+    if (!copy) return STEP_CLOSE;
+    conn_set_out(c, copy, len);
+    c->state = CONN_SEND_BUFFER;
+    return STEP_NEXT;
+}
+
+static char* error_page(int status_code, size_t* len)
+{
+    char* page = (char*)malloc(512);
+    int n = page ? proxy_error_response(status_code, page, 512) : -1;
+    if (n < 0) { free(page); return NULL; }
+    *len = (size_t)n;
+    return page;
+}
+
+/* Queue a canned error page and switch to writing it. */
+static int conn_fail(conn* c, int status_code)
+{
+    if (c->filling) {                   /* followers must not wait on us */
+        cache_fill_abort(c->entry);
+        c->filling = 0;
+    }
+    if (c->client.fd < 0) return STEP_CLOSE;        /* fetcher, or gone */
+    size_t len = 0;
+    char* page = error_page(status_code, &len);
+    return conn_page(c, page, len);
+}
+
+
+/*──────────────────── Origin connect ───────────────────────────────*/
+
+/* Non-blocking connect() to the addresses in c->dns.result, in
+ * order, on c->origin_port.                                          */
+static int origin_connect(event_loop* loop, conn* c)
+{
+    const dns_result* r = &c->dns.result;
+    int fd = -1, in_progress = 0;
+    c->connect_at = metric_now();
+    for (unsigned i = 0; i < r->count; ++i) {
+        struct sockaddr_storage sa;
+        socklen_t sa_len = dns_sockaddr(&r->addr[i], c->origin_port, &sa);
+        fd = socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) continue;
+        if (connect(fd, (struct sockaddr*)&sa, sa_len) == 0) break;
+        if (errno == EINPROGRESS) { in_progress = 1; break; }
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        metric_inc(M_UPSTREAM_FAILURES);
+        return -1;
+    }
+
+    c->origin.fd = fd;
+    if (watch(loop, &c->origin) < 0) return -1;
+    if (in_progress) {
+        c->state = CONN_CONNECTING;
+    }
+    else {
+        metric_since(H_UPSTREAM_CONNECT, c->connect_at);
+        metric_inc(M_UPSTREAM_CONNECTS);
+        c->state = CONN_SEND_REQUEST;
+    }
+    return 0;
+}
+
+/* Pooled socket if one is idle (unless `fresh`), else resolve
+ * c->origin_host – from the resolver cache, or parked in RESOLVING
+ * until a resolver thread has it – and connect.                     */
+static int origin_open(event_loop* loop, conn* c, int fresh)
+{
+    int fd = fresh ? -1 : upstream_checkout(c->origin_host, c->origin_port, 1);
+    if (fd >= 0) {
+        metric_inc(M_UPSTREAM_REUSES);
+        c->origin.fd = fd;
+        c->reused = 1;
+        c->state = CONN_SEND_REQUEST;
+        return watch(loop, &c->origin);
+    }
+    c->reused = 0;
+
+    switch (dns_resolve(c->origin_host, &c->dns)) {
+    case DNS_OK:
+        return origin_connect(loop, c);
+    case DNS_PENDING:
+        c->resolving = 1;
+        c->state = CONN_RESOLVING;
+        return 0;
+    default:
+        metric_inc(M_UPSTREAM_FAILURES);
+        return -1;
+    }
+}
+
+/* A pooled socket failed before the origin said anything – it was
+ * closed under us. Resend once on a fresh connection.               */
+static int origin_retry(event_loop* loop, conn* c)
+{
+    if (!c->reused || c->started) return c->started ? STEP_CLOSE : conn_fail(c, 502);
+
+    close(c->origin.fd);                             /* also leaves epoll */
+    c->origin.fd = -1;
+    conn_set_out(c, c->upstream, c->upstream_len);
+    return origin_open(loop, c, 1) == 0 ? STEP_NEXT : conn_fail(c, 502);
+}
+
+/* The whole response is in hand: cache it and release the origin,
+ * back to the pool when it was framed and the origin keeps it open. */
+static void origin_finish(event_loop* loop, conn* c)
+{
+    if (c->filling) {
+        proxy_fill_finish(c->entry);
+        c->filling = 0;
+    }
+
+    if (!c->unframed && c->framer.keep_alive
+        && epoll_ctl(loop->epfd, EPOLL_CTL_DEL, c->origin.fd, NULL) == 0)
+        upstream_checkin(c->origin_host, c->origin_port, c->origin.fd, 1);
+    else
+        close(c->origin.fd);
+    c->origin.fd = -1;
+    c->origin_done = 1;
+}
+
+
+/*──────────────────── State handlers ───────────────────────────────*/
+
+static void conn_drive(event_loop* loop, conn* c);
+
+static conn* conn_new(event_loop* loop, int client_fd)
+{
+    conn* c = (conn*)calloc(1, sizeof *c);
+    if (!c) return NULL;
+    c->loop = loop;
+    splice_pipe_init(&c->pipe);
+    c->waiter.wake = conn_wakeup;
+    c->dns.wake = conn_resolved;
+    c->client.owner = c;
+    c->client.fd = client_fd;
+    c->origin.owner = c;
+    c->origin.fd = -1;
+    c->state = CONN_READ_REQUEST;
+    c->chunk = config_get()->relay_buffer;
+    ++loop->active;
+    return c;
+}
+
+/* A conn with no client that fills p->entry for a queued request, so
+ * the fetch overlaps whatever is answered before it.                 */
+static int fetcher_spawn(event_loop* loop, const pending* p)
+{
+    conn* f = conn_new(loop, -1);
+    if (!f) return -1;
+    f->fetcher = 1;
+    f->upstream = (char*)malloc(p->upstream_len);
+    f->origin_host = strdup(p->origin_host);
+    if (!f->upstream || !f->origin_host) {
+        conn_close(loop, f);
+        return -1;
+    }
+    memcpy(f->upstream, p->upstream, p->upstream_len);
+    f->upstream_len = p->upstream_len;
+    f->origin_port = p->origin_port;
+    conn_set_out(f, f->upstream, f->upstream_len);
+
+    cache_retain(p->entry);
+    f->entry = p->entry;
+    f->filling = 1;
+    f->validating = p->entry->prior != NULL;
+    if (origin_open(loop, f, 0) < 0) {
+        conn_close(loop, f);                        /* aborts the fill */
+        return -1;
+    }
+    conn_drive(loop, f);
+    return 0;
+}
+
+/* Stale-while-revalidate: a fetcher fills the successor `fill` with a
+ * conditional request while the stale entry is served.              */
+static void revalidate_spawn(event_loop* loop, ParsedRequest* pr, cache_element* fill)
+{
+    pending p;
+    memset(&p, 0, sizeof p);
+    p.entry = fill;
+    p.filler = 1;
+    p.origin_port = proxy_request_port(pr);
+    int n = proxy_build_upstream_request(pr, fill, &p.upstream);
+    if (n >= 0 && (p.origin_host = strdup(pr->host))) {
+        p.upstream_len = (size_t)n;
+        if (fetcher_spawn(loop, &p) == 0) p.filler = 0;
+    }
+    pending_free(&p);                       /* aborts the fill if unspawned */
+}
+
+/* Everything needed to answer pr later: an error or local page, or the
+ * cache lookup plus – unless it is a plain hit – the rewritten request
+ * for the origin, kept so a follower can still fetch on its own if the
+ * filler gives up before sending anything. -1 when out of memory.   */
+static int request_prepare(conn* c, ParsedRequest* pr, pending* p)
+{
+    int status = 0;
+    memset(p, 0, sizeof *p);
+    p->received_at = c->requests++ ? metric_now() : c->accepted_at;
+
+    /* Everything after a CONNECT head is the tunnel's: read no further. */
+    if (strcmp(pr->method, "CONNECT") == 0) {
+        if (!(status = proxy_connect_status(pr))) {
+            if (!(p->origin_host = strdup(pr->host))) return -1;
+            p->origin_port = proxy_request_port(pr);
+            p->tunnel = 1;
+            return 0;
+        }
+    }
+    else if (strcmp(pr->method, "GET") != 0)
+        status = 501;
+    else if (strcmp(pr->version, "HTTP/1.0") != 0 && strcmp(pr->version, "HTTP/1.1") != 0)
+        status = 505;
+    else if (http_request_body(pr, &c->body) < 0)
+        status = 400;
+
+    if (status) {
+        p->page = error_page(status, &p->page_len);
+    }
+    else if (!pr->host) {                           /* addressed to us */
+        p->page = proxy_local_response(c->client.fd, pr, &p->page_len);
+    }
+    else {
+        cache_element* revalidate = NULL;
+        c->skipping = !c->body.done;
+        p->keep_alive = http_request_keep_alive(pr);
+        p->codings = codec_accepted(pr);
+        if (!(p->key = proxy_cache_key(pr))) return -1;
+        p->entry = proxy_cache_open(p->key, &p->filler, &revalidate);
+        if (revalidate) revalidate_spawn(c->loop, pr, revalidate);
+        if (p->entry && !p->filler && atomic_load(&p->entry->state) == CACHE_COMPLETE)
+            return 0;
+
+        int n = proxy_build_upstream_request(pr, p->filler ? p->entry : NULL, &p->upstream);
+        if (n < 0 || !(p->origin_host = strdup(pr->host))) return -1;
+        p->upstream_len = (size_t)n;
+        p->origin_port = proxy_request_port(pr);
+        return 0;
+    }
+    return p->page ? 0 : -1;
+}
+
+/* Make p the request being answered, taking over what it holds.     */
+static int request_start(event_loop* loop, conn* c, pending* p)
+{
+    char* page = p->page;
+    size_t page_len = p->page_len;
+
+    c->keep_alive = p->keep_alive;
+    c->codings = p->codings;
+    c->request_at = p->received_at;
+    c->entry = p->entry;
+    c->filling = p->filler;
+    c->key = p->key;
+    c->upstream = p->upstream;
+    c->upstream_len = p->upstream_len;
+    c->origin_host = p->origin_host;
+    c->origin_port = p->origin_port;
+    c->tunneling = p->tunnel;
+    memset(p, 0, sizeof *p);
+
+    if (page) return conn_page(c, page, page_len);
+    if (c->tunneling) return origin_open(loop, c, 1) == 0 ? STEP_NEXT : conn_fail(c, 502);
+    conn_set_out(c, c->upstream, c->upstream_len);
+    c->validating = c->filling && c->entry->prior;
+    if (c->entry && !c->filling) {                  /* hit, or join the fill */
+        c->state = CONN_STREAM_HIT;
+        return STEP_NEXT;
+    }
+    return origin_open(loop, c, 0) == 0 ? STEP_NEXT : conn_fail(c, 502);
+}
+
+/* Start p, or queue it behind the request in flight; a queued miss
+ * hands its fill to a fetcher.                                       */
+static int request_submit(event_loop* loop, conn* c, pending* p)
+{
+    if (!p->keep_alive) c->intake_done = 1;
+    if (c->state == CONN_READ_REQUEST) return request_start(loop, c, p);
+
+    if (!c->queue && !(c->queue = (pending*)arena_alloc(&c->arena,
+                                                        PIPELINE_DEPTH * sizeof(pending)))) {
+        pending_free(p);
+        return STEP_CLOSE;
+    }
+    if (p->filler) {
+        /* A conditional request is the fetcher's; should the fill fail
+         * we must not send it for a client that didn't ask for a 304. */
+        int conditional = p->entry->prior != NULL;
+        if (fetcher_spawn(loop, p) < 0)
+            cache_fill_abort(p->entry);             /* we fetch it in turn */
+        if (conditional) {
+            free(p->upstream);
+            p->upstream = NULL;
+        }
+    }
+    p->filler = 0;
+    c->queue[(c->q_head + c->q_len++) % PIPELINE_DEPTH] = *p;
+    return STEP_NEXT;
+}
+
+/* A request we can't parse or frame: answer it in turn, then close. */
+static int request_error(event_loop* loop, conn* c, int status_code)
+{
+    pending p = { 0 };
+    p.received_at = metric_now();
+    p.page = error_page(status_code, &p.page_len);
+    c->intake_done = 1;
+    return p.page ? request_submit(loop, c, &p) : STEP_CLOSE;
+}
+
+/* The current response is out. Go on with the next request if the
+ * client and the response allow it, else close.                      */
+static int response_done(event_loop* loop, conn* c, int reusable)
+{
+    metric_since(H_REQUEST, c->request_at);
+    c->request_at = 0;
+    if (!reusable || !c->keep_alive) return STEP_CLOSE;
+
+    request_clear(c);
+    if (c->q_len) {
+        pending* p = &c->queue[c->q_head];
+        c->q_head = (c->q_head + 1) % PIPELINE_DEPTH;
+        --c->q_len;
+        return request_start(loop, c, p);
+    }
+    c->state = CONN_READ_REQUEST;
+    return STEP_NEXT;
+}
+
+/* Drop the first n bytes of c->in; the next request starts after.   */
+static void in_consume(conn* c, size_t n)
+{
+    c->in_len -= n;
+    memmove(c->in, c->in + n, c->in_len);
+    c->in[c->in_len] = '\0';
+}
+
+/* Ring mode: `in` is a loop buffer the last recv landed in. Move
+ * what is left of it – a partial request, parsed so far in place – to
+ * the conn's own buffer, and have the parser follow.                 */
+static int client_unlend(conn* c)
+{
+    char* own = c->in_own;
+    if (c->in_len) {
+        if (!own && !(own = (char*)arena_alloc(&c->arena, MAX_REQUEST_BYTES + 1))) return -1;
+        memcpy(own, c->in, c->in_len + 1);
+        ParsedRequest_rebase(c->req, own);
+    }
+    c->in = own;
+    c->lent = c->in_own = NULL;
+    return 0;
+}
+
+/* Ring mode's recv(): submitted with the next batch, and its completion
+ * drives c again. With nothing buffered it picks a loop buffer when
+ * data arrives, so a conn waiting for its next request holds none.   */
+static int client_recv_arm(event_loop* loop, conn* c)
+{
+    if (c->recv_armed) return STEP_WAIT;
+    if (c->lent && client_unlend(c) < 0) return STEP_CLOSE;
+
+    int plain = c->in_len || c->recv_plain;
+    if (plain && !c->in && !(c->in = (char*)arena_alloc(&c->arena, MAX_REQUEST_BYTES + 1)))
+        return STEP_CLOSE;
+    struct io_uring_sqe* sqe = uring_sqe(&loop->ring);
+    if (!sqe) return STEP_CLOSE;
+    if (plain)
+        uring_prep_recv(sqe, c->client.fd, c->in + c->in_len, MAX_REQUEST_BYTES - c->in_len,
+                        ring_tag(c, OP_RECV));
+    else
+        uring_prep_recv_select(sqe, c->client.fd, &loop->bufs, ring_tag(c, OP_RECV));
+    c->recv_armed = 1;
+    return STEP_WAIT;
+}
+
+/* Turn what the client sent into requests, reading while the socket
+ * has more. With nothing in flight the first complete request starts
+ * (its step is returned); later ones queue behind it, up to
+ * PIPELINE_DEPTH. A request body is skipped: only GETs are served, and
+ * a GET body has no meaning we could forward.                        */
+static int client_intake(event_loop* loop, conn* c)
+{
+    if (!c->in && !ring_mode(loop)
+        && !(c->in = (char*)arena_alloc(&c->arena, MAX_REQUEST_BYTES + 1)))
+        return STEP_CLOSE;
+    if (!c->req) c->req = ParsedRequest_create();
+
+    for (;;) {
+        int idle = c->state == CONN_READ_REQUEST;
+
+        while (c->in_len && !c->intake_done) {
+            if (!idle && c->q_len == PIPELINE_DEPTH) return STEP_WAIT;
+            if (c->skipping) {
+                size_t used;
+                if (http_framer_feed(&c->body, c->in, c->in_len, &used) == HTTP_FRAME_ERROR)
+                    return request_error(loop, c, 400);
+                in_consume(c, used);
+                c->skipping = !c->body.done;
+                continue;
+            }
+
+            /* Resumes where the last read stopped; no rescans. */
+            size_t head_len = 0;
+            uint64_t t0 = metric_now();
+            int rc = ParsedRequest_feed_inplace(c->req, c->in, c->in_len, &head_len);
+            c->parse_ns += metric_now() - t0;
+            if (rc == PARSE_ERROR) return request_error(loop, c, 400);
+            if (rc == PARSE_NEED_MORE) {
+                if (c->in_len == MAX_REQUEST_BYTES) return request_error(loop, c, 400);
+                break;
+            }
+            metric_inc(M_REQUESTS);
+            metric_observe(H_PARSE, c->parse_ns);
+            c->parse_ns = 0;
+
+            pending p;
+            int ok = request_prepare(c, c->req, &p);
+            ParsedRequest_reset(c->req);                /* views into c->in */
+            in_consume(c, head_len);
+            if (ok < 0) {
+                pending_free(&p);
+                return STEP_CLOSE;
+            }
+            int step = request_submit(loop, c, &p);
+            if (idle || step != STEP_NEXT) return step;
+        }
+
+        if (c->intake_done || c->client_eof) return idle ? STEP_CLOSE : STEP_WAIT;
+        if (!idle && c->q_len == PIPELINE_DEPTH) return STEP_WAIT;
+        if (ring_mode(loop)) return client_recv_arm(loop, c);
+        if (!c->in_ready) return STEP_WAIT;
+
+        ssize_t n = recv(c->client.fd, c->in + c->in_len, MAX_REQUEST_BYTES - c->in_len, 0);
+        if (n > 0) {
+            c->in_len += (size_t)n;
+            c->in[c->in_len] = '\0';
+            continue;
+        }
+        if (n == 0) { c->client_eof = 1; continue; }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) return STEP_CLOSE;
+        c->in_ready = 0;
+        return STEP_WAIT;
+    }
+}
+
+/* Any wakeup re-drives us, so check the lookup is really done.     */
+static int do_resolving(event_loop* loop, conn* c)
+{
+    if (!dns_poll(&c->dns)) return STEP_WAIT;
+    c->resolving = 0;
+    if (c->dns.result.status != DNS_OK) {
+        metric_inc(M_UPSTREAM_FAILURES);
+        return conn_fail(c, 502);
+    }
+    return origin_connect(loop, c) == 0 ? STEP_NEXT : conn_fail(c, 502);
+}
+
+static int do_connecting(conn* c)
+{
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(c->origin.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        metric_inc(M_UPSTREAM_FAILURES);
+        return conn_fail(c, 502);
+    }
+
+    struct sockaddr_storage peer;
+    socklen_t peer_len = sizeof peer;
+    if (getpeername(c->origin.fd, (struct sockaddr*)&peer, &peer_len) < 0) {
+        if (errno == ENOTCONN) return STEP_WAIT;
+        metric_inc(M_UPSTREAM_FAILURES);
+        return conn_fail(c, 502);
+    }
+
+    metric_since(H_UPSTREAM_CONNECT, c->connect_at);
+    metric_inc(M_UPSTREAM_CONNECTS);
+    c->state = CONN_SEND_REQUEST;
+    return STEP_NEXT;
+}
+
+/* Flush c->out to fd. STEP_NEXT once empty. */
+static int flush_out(conn* c, int fd)
+{
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->out_off += (size_t)n;
+            if (fd == c->client.fd) metric_add(M_BYTES_CLIENT, (uint64_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return (n < 0 && errno == EAGAIN) ? STEP_WAIT : STEP_CLOSE;
+    }
+    return STEP_NEXT;
+}
+
+/* Keep the idle sweep ticking while the loop has tunnels.          */
+static void tick_arm(event_loop* loop, int on)
+{
+    struct itimerspec its = { 0 };
+    if (on) {
+        its.it_interval.tv_sec = TUNNEL_TICK_MS / 1000;
+        its.it_interval.tv_nsec = (long)(TUNNEL_TICK_MS % 1000) * 1000000;
+        its.it_value = its.it_interval;
+    }
+    timerfd_settime(loop->tick_fd, 0, &its, NULL);
+}
+
+/* The origin is connected: from here on c is a tunnel. What it held
+ * for requests – arena, parser – goes; bytes the client sent past the
+ * CONNECT head are the first to go upstream.                         */
+static int tunnel_begin(event_loop* loop, conn* c)
+{
+    if (tunnel_init(&c->tun, c->client.fd, c->origin.fd, c->in, c->in_len) < 0)
+        return errno == E2BIG ? conn_fail(c, 400) : STEP_CLOSE;
+
+    /* On a ring, client reads move to plain recv() like the origin's.  */
+    if (ring_mode(loop)) {
+        struct epoll_event ev = { 0 };
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = &c->client;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, c->client.fd, &ev) < 0) return STEP_CLOSE;
+    }
+    c->in_len = 0;
+    c->in = c->lent = c->in_own = NULL;     /* a lent buffer is recycled as usual */
+    c->stage = c->decoded = NULL;
+    c->queue = NULL;
+    arena_release(&c->arena);
+    ParsedRequest_destroy(c->req);
+    c->req = NULL;
+
+    metric_since(H_REQUEST, c->request_at);
+    c->request_at = 0;
+    if (!loop->tunnels.count) tick_arm(loop, 1);
+    tunnel_touch(&loop->tunnels, &c->tun, metric_now());
+    c->state = CONN_TUNNEL;
+    return STEP_NEXT;
+}
+
+static int do_tunnel(event_loop* loop, conn* c)
+{
+    tunnel_touch(&loop->tunnels, &c->tun, metric_now());
+    return tunnel_pump(&c->tun) == TUNNEL_OPEN ? STEP_WAIT : STEP_CLOSE;
+}
+
+static int do_send_request(event_loop* loop, conn* c)
+{
+    if (c->tunneling) return tunnel_begin(loop, c);
+
+    int step = flush_out(c, c->origin.fd);
+    if (step == STEP_CLOSE) return origin_retry(loop, c);
+    if (step != STEP_NEXT) return step;
+
+    if (!c->stage && !(c->stage = (char*)arena_alloc(&c->arena, c->chunk)))
+        return STEP_CLOSE;
+    conn_set_out(c, c->stage, 0);
+    c->state = CONN_RELAY;
+    return STEP_NEXT;
+}
+
+/* serve_entry() for a client that doesn't take the entry's stored
+ * coding: the reader's output goes out a chunk at a time, and
+ * c->served follows the entry bytes it has consumed.                 */
+static int serve_decoded(conn* c, cache_state* state)
+{
+    for (;;) {
+        if (c->decoded_off < c->decoded_len) {
+            ssize_t n = send(c->client.fd, c->decoded + c->decoded_off,
+                             c->decoded_len - c->decoded_off, MSG_NOSIGNAL);
+            if (n > 0) {
+                c->decoded_off += (size_t)n;
+                metric_add(M_BYTES_CLIENT, (uint64_t)n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            return (n < 0 && errno == EAGAIN) ? STEP_WAIT : STEP_CLOSE;
+        }
+        ssize_t n = codec_reader_read(&c->reader, c->entry, c->decoded, c->chunk, state);
+        if (n < 0) return STEP_CLOSE;                   /* corrupt      */
+        c->served = c->reader.in_off;
+        if (n == 0) return STEP_NEXT;
+        c->decoded_len = (size_t)n;
+        c->decoded_off = 0;
+    }
+}
+
+/* At the entry's first byte: does this client need it decoded?      */
+static int decode_decide(conn* c)
+{
+    if (!codec_must_decode(c->entry, c->codings)) {
+        c->decoding = -1;
+        return 0;
+    }
+    if ((!c->decoded && !(c->decoded = (char*)arena_alloc(&c->arena, c->chunk)))
+        || codec_reader_open(&c->reader, c->entry) < 0) {
+        codec_reader_close(&c->reader);
+        return -1;
+    }
+    c->decoding = 1;
+    return 0;
+}
+
+/* Send the client whatever the entry holds past c->served. STEP_NEXT
+ * once caught up, with the entry's state at that point in *state.   */
+static int serve_entry(conn* c, cache_state* state)
+{
+    for (;;) {
+        if (c->decoding > 0) return serve_decoded(c, state);
+
+        const char* p;
+        size_t avail = cache_peek(c->entry, c->served, &p, state);
+        if (avail == 0) return STEP_NEXT;
+        if (!c->decoding) {
+            if (decode_decide(c) < 0) return STEP_CLOSE;
+            continue;
+        }
+
+        ssize_t n = send(c->client.fd, p, avail, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->served += (size_t)n;
+            metric_add(M_BYTES_CLIENT, (uint64_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return (n < 0 && errno == EAGAIN) ? STEP_WAIT : STEP_CLOSE;
+    }
+}
+
+/* A stored response can be followed by another if its head says so. */
+static int entry_reusable(conn* c)
+{
+    const char* head;
+    size_t n = cache_peek(c->entry, 0, &head, NULL);
+    return http_response_reusable(head, n);
+}
+
+/* Ring mode, a complete entry the client takes as stored: queue the
+ * rest of it, up to URING_LINK_MAX runs, as sends chained to go out
+ * in order with the next batch. The entry stays pinned until the last
+ * one completes. STEP_NEXT: serve it with send() instead.            */
+static int stream_linked(event_loop* loop, conn* c)
+{
+    if (!ring_mode(loop) || c->no_link || atomic_load(&c->entry->state) != CACHE_COMPLETE)
+        return STEP_NEXT;
+    if (!c->decoding && decode_decide(c) < 0) return STEP_CLOSE;
+    if (c->decoding > 0) return STEP_NEXT;
+
+    const char* run[URING_LINK_MAX];
+    size_t len[URING_LINK_MAX];
+    unsigned n = 0;
+    for (size_t off = c->served; n < URING_LINK_MAX; off += len[n++])
+        if (!(len[n] = cache_peek(c->entry, off, &run[n], NULL))) break;
+    if (!n || uring_reserve(&loop->ring, n) < 0) return STEP_NEXT;
+
+    for (unsigned i = 0; i < n; ++i) {
+        struct io_uring_sqe* sqe = uring_sqe(&loop->ring);
+        uring_prep_send(sqe, c->client.fd, run[i], len[i], MSG_WAITALL | MSG_NOSIGNAL,
+                        ring_tag(c, OP_SEND));
+        if (i + 1 < n) uring_sqe_link(sqe);
+    }
+    cache_retain(c->entry);
+    c->send_pin = c->entry;
+    c->sends = n;
+    c->state = CONN_SEND_LINKED;
+    return STEP_WAIT;
+}
+
+static int do_stream_hit(event_loop* loop, conn* c)
+{
+    for (;;) {
+        cache_state state;
+        int step = stream_linked(loop, c);
+        if (step == STEP_NEXT) step = serve_entry(c, &state);
+        if (step != STEP_NEXT) return step;
+        if (state == CACHE_COMPLETE) return response_done(loop, c, entry_reusable(c));
+
+        if (state == CACHE_ABORTED) {
+            /* Nothing sent yet: fetch it ourselves, uncached.         */
+            if (c->served) return STEP_CLOSE;
+            if (!c->upstream) return conn_fail(c, 502);
+            conn_release_entry(c);
+            return origin_open(loop, c, 0) == 0 ? STEP_NEXT : conn_fail(c, 502);
+        }
+        if (!cache_wait(c->entry, c->served, &c->waiter)) {
+            c->waiting = 1;
+            return STEP_WAIT;
+        }
+    }
+}
+
+/* Where the next origin bytes go: straight into the fill (the client
+ * is served from there), else the staging chunk.                    */
+static char* relay_space(conn* c, size_t* room)
+{
+    if (c->filling) {
+        char* p = cache_fill_space(c->entry, room);
+        if (*room > c->chunk) *room = c->chunk;         /* fits the stage */
+        if (p) return p;
+        c->filling = 0;                     /* too big: aborted, go direct */
+    }
+    *room = c->chunk;
+    return c->stage;
+}
+
+/* The client went away. A filler carries on for its followers.     */
+static int client_lost(conn* c)
+{
+    if (!c->filling) return STEP_CLOSE;
+    client_close_fd(c);                              /* also leaves epoll */
+    return STEP_NEXT;
+}
+
+/* Direct relay of a body the framer doesn't need to see: origin →
+ * pipe → client with splice(). STEP_NEXT once the framer wants bytes
+ * again (or the response is done and the pipe empty).              */
+static int relay_splice(event_loop* loop, conn* c)
+{
+    for (;;) {
+        if (c->pipe.held) {
+            ssize_t k = splice_drain(&c->pipe, c->client.fd);
+            if (k < 0) return errno == EAGAIN ? STEP_WAIT : STEP_CLOSE;
+            metric_add(M_BYTES_CLIENT, (uint64_t)k);
+            if (c->pipe.held) return STEP_WAIT;
+        }
+        uint64_t left = c->origin_done ? 0 : http_framer_opaque_left(&c->framer);
+        if (!left) return STEP_NEXT;
+
+        ssize_t n = splice_fill(&c->pipe, c->origin.fd, left < SIZE_MAX ? (size_t)left : SIZE_MAX);
+        if (n > 0) {
+            metric_add(M_BYTES_ORIGIN, (uint64_t)n);
+            if (http_framer_skip(&c->framer, (uint64_t)n) == HTTP_FRAME_DONE)
+                origin_finish(loop, c);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return STEP_WAIT;
+        if (n == 0 && http_framer_eof(&c->framer) == HTTP_FRAME_DONE) {
+            origin_finish(loop, c);
+            continue;
+        }
+        return STEP_CLOSE;                              /* truncated   */
+    }
+}
+
+static int do_relay(event_loop* loop, conn* c)
+{
+    for (;;) {
+        /* Entry bytes first (the fill, or what preceded an abort), then
+         * the staged chunk of a direct relay.                           */
+        cache_state state;
+        int step = STEP_NEXT;
+        if (c->client.fd < 0) {
+            if (!c->filling) return STEP_CLOSE;
+        }
+        else {
+            if (c->entry) step = serve_entry(c, &state);
+            if (step == STEP_NEXT) step = flush_out(c, c->client.fd);
+            if (step == STEP_NEXT && (c->pipe.held || (!c->filling && !c->unframed
+                                                      && http_framer_opaque_left(&c->framer)))) {
+                if (c->pipe.rd >= 0 || (!c->no_splice && splice_pipe_open(&c->pipe, 1) == 0))
+                    step = relay_splice(loop, c);
+                else
+                    c->no_splice = 1;
+            }
+            if (step == STEP_CLOSE && client_lost(c) == STEP_CLOSE) return STEP_CLOSE;
+        }
+        if (c->origin_done) {
+            if (step == STEP_WAIT) return STEP_WAIT;
+            if (c->client.fd < 0) return STEP_CLOSE;
+            return response_done(loop, c, c->not_modified ? entry_reusable(c)
+                                        : !c->unframed && c->framer.keep_alive);
+        }
+
+        /* A filler keeps reading; a direct relay has one staged chunk. */
+        if (step == STEP_WAIT && !c->filling) return STEP_WAIT;
+
+        size_t room;
+        char* dst = relay_space(c, &room);
+        ssize_t n = recv(c->origin.fd, dst, room, 0);
+        if (n > 0) {
+            c->started = 1;
+            metric_add(M_BYTES_ORIGIN, (uint64_t)n);
+            size_t used = (size_t)n;
+            int rc = c->unframed ? HTTP_FRAME_NEED_MORE
+                                 : http_framer_feed(&c->framer, dst, (size_t)n, &used);
+            if (rc == HTTP_FRAME_ERROR) {               /* relay until EOF */
+                c->unframed = 1;
+                used = (size_t)n;
+            }
+            /* Revalidating: the head decides what the client reads. */
+            if (c->validating && c->filling
+                && (c->framer.body != HTTP_BODY_UNKNOWN || c->unframed)) {
+                c->validating = 0;
+                if (proxy_fill_validated(c->entry, &c->framer)) {
+                    c->filling = 0;
+                    c->not_modified = 1;
+                }
+            }
+            /* Too big to cache: give up before followers see a byte. */
+            if (c->filling && c->framer.expected && !c->reserved) {
+                c->reserved = 1;
+                if (cache_fill_reserve(c->entry, (size_t)c->framer.expected) < 0) {
+                    c->filling = 0;
+                    memcpy(c->stage, dst, used);
+                }
+            }
+            if (c->filling) {
+                cache_fill_commit(c->entry, used);     /* client reads it there */
+                if (c->unframed) {
+                    cache_fill_abort(c->entry);
+                    c->filling = 0;
+                }
+            }
+            else if (!c->not_modified) {
+                c->out_len = used;
+                c->out_off = 0;
+            }
+            if (rc == HTTP_FRAME_DONE) origin_finish(loop, c);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return STEP_WAIT;
+        if (!c->started) return origin_retry(loop, c);
+
+        if (n == 0 && (c->unframed || http_framer_eof(&c->framer) == HTTP_FRAME_DONE)) {
+            origin_finish(loop, c);
+            continue;
+        }
+        return STEP_CLOSE;                              /* truncated   */
+    }
+}
+
+static void conn_drive(event_loop* loop, conn* c)
+{
+    int step;
+    do {
+        switch (c->state) {
+        case CONN_READ_REQUEST: step = client_intake(loop, c);        break;
+        case CONN_RESOLVING:    step = do_resolving(loop, c);         break;
+        case CONN_CONNECTING:   step = do_connecting(c);              break;
+        case CONN_SEND_REQUEST: step = do_send_request(loop, c);      break;
+        case CONN_RELAY:        step = do_relay(loop, c);             break;
+        case CONN_STREAM_HIT:   step = do_stream_hit(loop, c);        break;
+        case CONN_SEND_BUFFER:
+            step = flush_out(c, c->client.fd);
+            if (step == STEP_NEXT) step = STEP_CLOSE;
+            break;
+        case CONN_SEND_LINKED:  step = STEP_WAIT;                     break;
+        case CONN_TUNNEL:       step = do_tunnel(loop, c);            break;
+        default:                step = STEP_CLOSE;                    break;
+        }
+    } while (step == STEP_NEXT);
+
+    /* Read ahead while a response is in flight; that only ever queues. */
+    if (step == STEP_WAIT && c->state != CONN_READ_REQUEST && c->client.fd >= 0
+        && !c->intake_done && client_intake(loop, c) == STEP_CLOSE)
+        step = STEP_CLOSE;
+    if (step == STEP_CLOSE) conn_close(loop, c);
+}
+
+
+/*──────────────────── Accept + loop ────────────────────────────────*/
+
+/* Re-drive every conn a filler or resolver woke since the last time. A conn woken
+ * again while it is being driven is simply queued again.            */
+static void loop_wakeups(event_loop* loop)
+{
+    uint64_t count;
+    ssize_t n = read(loop->wakeup_fd, &count, sizeof count);
+    (void)n;
+
+    for (;;) {
+        pthread_mutex_lock(&loop->wakeup_lock);
+        conn* c = loop->wakeups;
+        if (c) {
+            loop->wakeups = c->next_wakeup;
+            c->wakeup_queued = 0;
+        }
+        pthread_mutex_unlock(&loop->wakeup_lock);
+        if (!c) return;
+
+        c->waiting = 0;                     /* the filler dropped the waiter */
+        if (!c->closed) conn_drive(loop, c);
+    }
+}
+
+/* Close the tunnels that have sat idle too long; stop ticking once
+ * there are none left.                                               */
+static void loop_tick(event_loop* loop)
+{
+    uint64_t count;
+    ssize_t n = read(loop->tick_fd, &count, sizeof count);
+    (void)n;
+
+    tunnel* t;
+    uint64_t now = metric_now();
+    while ((t = tunnel_expired(&loop->tunnels, now))) {
+        metric_inc(M_TUNNEL_TIMEOUTS);
+        conn_close(loop, (conn*)((char*)t - offsetof(conn, tun)));
+    }
+    if (!loop->tunnels.count) tick_arm(loop, 0);
+}
+
+static void client_accept(event_loop* loop, int fd)
+{
+    conn* c = conn_new(loop, fd);
+    if (!c) { close(fd); return; }
+    c->accepted_at = metric_now();
+    c->in_ready = 1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if (watch(loop, &c->client) < 0) {
+        close(fd);
+        free(c);
+        --loop->active;
+        return;
+    }
+    metric_inc(M_CONN_OPENED);
+    if (ring_mode(loop)) conn_drive(loop, c);       /* arms the first recv */
+}
+
+static void loop_accept(event_loop* loop)
+{
+    for (;;) {
+        int fd = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN) perror("accept4");
+            return;
+        }
+        client_accept(loop, fd);
+    }
+}
+
+static void loop_dispatch(event_loop* loop, const struct epoll_event* events, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        endpoint* ep = (endpoint*)events[i].data.ptr;
+        if (!ep) { loop_accept(loop); continue; }
+        if (ep == &loop->wakeup) { loop_wakeups(loop); continue; }
+        if (ep == &loop->tick) { loop_tick(loop); continue; }
+
+        conn* c = ep->owner;
+        if (c->closed) continue;
+        if (ep == &c->client && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            c->in_ready = 1;
+        if (ep == &c->client && (events[i].events & (EPOLLERR | EPOLLHUP))) {
+            if (client_lost(c) == STEP_CLOSE) conn_close(loop, c);
+            else conn_drive(loop, c);
+        }
+        else
+            conn_drive(loop, c);
+    }
+}
+
+static void loop_run_epoll(event_loop* loop)
+{
+    struct epoll_event events[EVENT_BATCH];
+
+    for (;;) {
+        int n = epoll_wait(loop->epfd, events, EVENT_BATCH, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        loop_dispatch(loop, events, n);
+        loop_reap(loop);
+    }
+}
+
+
+/*──────────────────── io_uring engine ──────────────────────────────*/
+
+static void ring_arm_accept(event_loop* loop)
+{
+    struct io_uring_sqe* sqe = uring_sqe(&loop->ring);
+    if (sqe)
+        uring_prep_accept_multishot(sqe, loop->listen_fd, SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                    ring_tag(loop, OP_ACCEPT));
+    else
+        perror("io_uring accept");
+}
+
+static void ring_arm_epoll(event_loop* loop)
+{
+    struct io_uring_sqe* sqe = uring_sqe(&loop->ring);
+    if (sqe) uring_prep_poll_multishot(sqe, loop->epfd, EPOLLIN, ring_tag(loop, OP_EPOLL));
+    else perror("io_uring poll");
+}
+
+/* The last op of a conn reaped while they were in flight frees it.  */
+static void ring_op_done(conn* c)
+{
+    if (c->orphaned && !c->recv_armed && !c->sends) conn_free(c);
+}
+
+static void ring_recv_done(event_loop* loop, conn* c, const uring_cqe* cqe)
+{
+    c->recv_armed = 0;
+    if (!c->closed && c->client.fd >= 0) {
+        if (cqe->res > 0) {
+            if (cqe->buffer >= 0) {                 /* in_len was 0 */
+                c->in_own = c->in;
+                c->in = c->lent = uring_buf(&loop->bufs, (unsigned)cqe->buffer);
+            }
+            c->in_len += (size_t)cqe->res;
+            c->in[c->in_len] = '\0';
+            c->recv_plain = 0;
+            conn_drive(loop, c);
+        }
+        else if (cqe->res == 0 || cqe->res == -ENOBUFS || cqe->res == -EINTR
+                 || cqe->res == -EAGAIN) {
+            c->client_eof = cqe->res == 0;
+            c->recv_plain = cqe->res == -ENOBUFS;
+            conn_drive(loop, c);
+        }
+        else if (client_lost(c) == STEP_CLOSE)
+            conn_close(loop, c);
+        else
+            conn_drive(loop, c);
+    }
+    if (c->lent && (c->closed || client_unlend(c) < 0)) {
+        c->in = c->in_own;
+        c->lent = c->in_own = NULL;
+        conn_close(loop, c);
+    }
+    if (cqe->buffer >= 0) uring_buf_recycle(&loop->bufs, (unsigned)cqe->buffer);
+    ring_op_done(c);
+}
+
+/* A send of a linked chain. A short one cancels the rest, and the
+ * hit goes on from wherever it stopped.                              */
+static void ring_send_done(event_loop* loop, conn* c, const uring_cqe* cqe)
+{
+    if (cqe->res > 0) {
+        c->served += (size_t)cqe->res;
+        metric_add(M_BYTES_CLIENT, (uint64_t)cqe->res);
+    }
+    else if (cqe->res == -EAGAIN)
+        c->no_link = 1;
+    else if (cqe->res != -ECANCELED && cqe->res != -EINTR)
+        c->send_failed = 1;
+    if (--c->sends) return;
+
+    cache_release(c->send_pin);
+    c->send_pin = NULL;
+    if (c->closed)
+        ring_op_done(c);
+    else if (c->send_failed)
+        conn_close(loop, c);
+    else {
+        c->state = CONN_STREAM_HIT;
+        conn_drive(loop, c);
+    }
+}
+
+/* Everything ready on the epoll set; the ring only said there is some. */
+static void ring_epoll_ready(event_loop* loop)
+{
+    struct epoll_event events[EVENT_BATCH];
+    int n;
+    do {
+        n = epoll_wait(loop->epfd, events, EVENT_BATCH, 0);
+        if (n > 0) loop_dispatch(loop, events, n);
+    } while (n == EVENT_BATCH);
+}
+
+static void ring_complete(event_loop* loop, const uring_cqe* cqe)
+{
+    void* p = (void*)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+
+    switch ((int)(cqe->user_data & OP_MASK)) {
+    case OP_ACCEPT:
+        if (cqe->res >= 0)
+            client_accept(loop, cqe->res);
+        else if (cqe->res != -ECONNABORTED && cqe->res != -EINTR) {
+            errno = -cqe->res;
+            perror("io_uring accept");
+        }
+        if (!cqe->more) ring_arm_accept(loop);
+        break;
+    case OP_EPOLL:
+        ring_epoll_ready(loop);
+        if (!cqe->more) ring_arm_epoll(loop);
+        break;
+    case OP_RECV:
+        ring_recv_done(loop, (conn*)p, cqe);
+        break;
+    case OP_SEND:
+        ring_send_done(loop, (conn*)p, cqe);
+        break;
+    }
+}
+
+/* On the loop's own thread: a ring is only ever entered by the
+ * thread that set it up.                                             */
+static int loop_ring_start(event_loop* loop)
+{
+    if (uring_init(&loop->ring, URING_ENTRIES) < 0) return -1;
+    if (uring_bufs_init(&loop->ring, &loop->bufs, 0, URING_BUFS, MAX_REQUEST_BYTES) < 0) {
+        int err = errno;
+        uring_exit(&loop->ring);
+        errno = err;
+        return -1;
+    }
+    ring_arm_accept(loop);
+    ring_arm_epoll(loop);
+    return 0;
+}
+
+static void loop_run_ring(event_loop* loop)
+{
+    for (;;) {
+        if (uring_enter(&loop->ring, 1) < 0 && errno != EINTR && errno != EBUSY
+            && errno != EAGAIN) {
+            perror("io_uring_enter");
+            break;
+        }
+        uring_cqe cqe;
+        while (uring_next(&loop->ring, &cqe)) ring_complete(loop, &cqe);
+        loop_reap(loop);
+    }
+}
+
+static int watch_listener(event_loop* loop)
+{
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;                          /* NULL tags the listener */
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->listen_fd, &ev);
+}
+
+static void* loop_main(void* arg)
+{
+    event_loop* loop = (event_loop*)arg;
+
+    if (loop->engine == EVENT_URING) {
+        if (loop_ring_start(loop) == 0) {
+            loop_run_ring(loop);
+            return NULL;
+        }
+        perror("io_uring setup, this loop uses epoll");
+    }
+    if (watch_listener(loop) < 0) {
+        perror("epoll_ctl");
+        return NULL;
+    }
+    loop_run_epoll(loop);
+    return NULL;
+}
+
+static int open_listener(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof addr) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* The listener joins the epoll set in loop_main(), unless the ring
+ * accepts for it.                                                    */
+static int loop_init(event_loop* loop, int port, event_engine engine)
+{
+    memset(loop, 0, sizeof *loop);
+    loop->engine = engine;
+    loop->ring.fd = -1;
+    pthread_mutex_init(&loop->wakeup_lock, NULL);
+    loop->listen_fd = open_listener(port);
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->listen_fd < 0 || loop->epfd < 0 || loop->wakeup_fd < 0 || loop->tick_fd < 0)
+        return -1;
+
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN | EPOLLET;
+    loop->wakeup.fd = loop->wakeup_fd;
+    ev.data.ptr = &loop->wakeup;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakeup_fd, &ev) < 0) return -1;
+
+    loop->tick.fd = loop->tick_fd;
+    ev.data.ptr = &loop->tick;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->tick_fd, &ev);
+}
+
+/* Can this kernel run the ring engine at all? Once, up front, so a
+ * refusal is one message rather than one per loop.                   */
+static int uring_usable(void)
+{
+    uring r;
+    uring_bufs b;
+    if (uring_init(&r, URING_ENTRIES) < 0) return 0;
+    int ok = uring_bufs_init(&r, &b, 0, URING_BUFS, MAX_REQUEST_BYTES) == 0;
+    uring_bufs_free(&r, &b);
+    uring_exit(&r);
+    return ok;
+}
+
+int proxy_event_run(int port, int workers, event_engine engine)
+{
+    if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0) workers = 1;
+    if (engine == EVENT_URING && !uring_usable()) {
+        perror("io_uring unavailable, using epoll");
+        engine = EVENT_EPOLL;
+    }
+
+    event_loop* loops = (event_loop*)calloc((size_t)workers, sizeof *loops);
+    if (!loops) return -1;
+
+    for (int i = 0; i < workers; ++i) {
+        if (loop_init(&loops[i], port, engine) < 0) {
+            perror("event loop setup");
+            for (int j = 0; j <= i; ++j) {
+                if (loops[j].listen_fd > 0) close(loops[j].listen_fd);
+                if (loops[j].epfd > 0) close(loops[j].epfd);
+                if (loops[j].wakeup_fd > 0) close(loops[j].wakeup_fd);
+                if (loops[j].tick_fd > 0) close(loops[j].tick_fd);
+            }
+            free(loops);
+            return -1;
+        }
+    }
+
+    printf("Proxy listening on port %d (%s, %d workers)\n", port,
+           engine == EVENT_URING ? "io_uring" : "epoll", workers);
+    for (int i = 1; i < workers; ++i)
+        pthread_create(&loops[i].thread, NULL, loop_main, &loops[i]);
+    loop_main(&loops[0]);
+    return -1;
+}
+
+#else  /* !__linux__ */
+
+#include <stdio.h>
+
+int proxy_event_run(int port, int workers, event_engine engine)
+{
+    (void)port; (void)workers; (void)engine;
+    fprintf(stderr, "epoll front end requires Linux\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_event.h
+ *
+ *  Edge-triggered epoll front end. Each worker owns one SO_REUSEPORT
+ *  listener, one epoll instance and every connection it accepts, so the
+ *  loops never share connection state. Client and origin sockets are
+ *  non-blocking and driven by a small per-connection state machine, which
+ *  keeps an idle connection down to one struct instead of one thread.
+ *
+ *  The client side runs on one of two engines: readiness (epoll_wait(),
+ *  then recv() / send() until EAGAIN), or completions through an
+ *  io_uring per loop, which batches a loop's socket calls into one
+ *  io_uring_enter() – see proxy_event.c.
+ *
+ *  Linux only; elsewhere proxy_event_run() reports failure and the
+ *  caller falls back to the threaded front end. Without io_uring (old
+ *  kernel or headers, or seccomp) EVENT_URING runs as EVENT_EPOLL.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_EVENT_H
+#define PROXY_EVENT_H
+
+typedef enum event_engine {
+    EVENT_EPOLL,            /* --mode=epoll                              */
+    EVENT_URING,            /* --mode=uring                              */
+} event_engine;
+
+/* Run `workers` reactor loops on `port` (<= 0 → one per online CPU).
+ * Blocks for the life of the server; returns -1 if setup fails.      */
+int proxy_event_run(int port, int workers, event_engine engine);
+
+#endif /* PROXY_EVENT_H */
@@ -0,0 +1,159 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_headers.c
+ *
+ *  GENERATED by tools/gen_headers.py – edit the list there and run
+ *  `make headers`.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#include "proxy_headers.h"
+
+const char* const http_header_names[HDR__COUNT] = {
+    [HDR_UNKNOWN] = "",
+    [HDR_HOST] = "Host",
+    [HDR_CONNECTION] = "Connection",
+    [HDR_KEEP_ALIVE] = "Keep-Alive",
+    [HDR_PROXY_CONNECTION] = "Proxy-Connection",
+    [HDR_PROXY_AUTHORIZATION] = "Proxy-Authorization",
+    [HDR_PROXY_AUTHENTICATE] = "Proxy-Authenticate",
+    [HDR_TE] = "TE",
+    [HDR_TRAILER] = "Trailer",
+    [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [HDR_UPGRADE] = "Upgrade",
+    [HDR_CONTENT_LENGTH] = "Content-Length",
+    [HDR_CONTENT_TYPE] = "Content-Type",
+    [HDR_CONTENT_ENCODING] = "Content-Encoding",
+    [HDR_ACCEPT] = "Accept",
+    [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+    [HDR_ACCEPT_LANGUAGE] = "Accept-Language",
+    [HDR_ACCEPT_CHARSET] = "Accept-Charset",
+    [HDR_USER_AGENT] = "User-Agent",
+    [HDR_REFERER] = "Referer",
+    [HDR_COOKIE] = "Cookie",
+    [HDR_AUTHORIZATION] = "Authorization",
+    [HDR_CACHE_CONTROL] = "Cache-Control",
+    [HDR_PRAGMA] = "Pragma",
+    [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+    [HDR_IF_NONE_MATCH] = "If-None-Match",
+    [HDR_IF_MATCH] = "If-Match",
+    [HDR_IF_UNMODIFIED_SINCE] = "If-Unmodified-Since",
+    [HDR_IF_RANGE] = "If-Range",
+    [HDR_RANGE] = "Range",
+    [HDR_ORIGIN] = "Origin",
+    [HDR_EXPECT] = "Expect",
+    [HDR_VIA] = "Via",
+    [HDR_FORWARDED] = "Forwarded",
+    [HDR_X_FORWARDED_FOR] = "X-Forwarded-For",
+    [HDR_X_FORWARDED_PROTO] = "X-Forwarded-Proto",
+    [HDR_X_FORWARDED_HOST] = "X-Forwarded-Host",
+    [HDR_DNT] = "DNT",
+    [HDR_UPGRADE_INSECURE_REQUESTS] = "Upgrade-Insecure-Requests",
+    [HDR_SEC_FETCH_SITE] = "Sec-Fetch-Site",
+    [HDR_SEC_FETCH_MODE] = "Sec-Fetch-Mode",
+    [HDR_SEC_FETCH_USER] = "Sec-Fetch-User",
+    [HDR_SEC_FETCH_DEST] = "Sec-Fetch-Dest",
+    [HDR_DATE] = "Date",
+    [HDR_MAX_FORWARDS] = "Max-Forwards",
+};
+
+const uint8_t http_header_lengths[HDR__COUNT] = {
+    [HDR_HOST] = 4,
+    [HDR_CONNECTION] = 10,
+    [HDR_KEEP_ALIVE] = 10,
+    [HDR_PROXY_CONNECTION] = 16,
+    [HDR_PROXY_AUTHORIZATION] = 19,
+    [HDR_PROXY_AUTHENTICATE] = 18,
+    [HDR_TE] = 2,
+    [HDR_TRAILER] = 7,
+    [HDR_TRANSFER_ENCODING] = 17,
+    [HDR_UPGRADE] = 7,
+    [HDR_CONTENT_LENGTH] = 14,
+    [HDR_CONTENT_TYPE] = 12,
+    [HDR_CONTENT_ENCODING] = 16,
+    [HDR_ACCEPT] = 6,
+    [HDR_ACCEPT_ENCODING] = 15,
+    [HDR_ACCEPT_LANGUAGE] = 15,
+    [HDR_ACCEPT_CHARSET] = 14,
+    [HDR_USER_AGENT] = 10,
+    [HDR_REFERER] = 7,
+    [HDR_COOKIE] = 6,
+    [HDR_AUTHORIZATION] = 13,
+    [HDR_CACHE_CONTROL] = 13,
+    [HDR_PRAGMA] = 6,
+    [HDR_IF_MODIFIED_SINCE] = 17,
+    [HDR_IF_NONE_MATCH] = 13,
+    [HDR_IF_MATCH] = 8,
+    [HDR_IF_UNMODIFIED_SINCE] = 19,
+    [HDR_IF_RANGE] = 8,
+    [HDR_RANGE] = 5,
+    [HDR_ORIGIN] = 6,
+    [HDR_EXPECT] = 6,
+    [HDR_VIA] = 3,
+    [HDR_FORWARDED] = 9,
+    [HDR_X_FORWARDED_FOR] = 15,
+    [HDR_X_FORWARDED_PROTO] = 17,
+    [HDR_X_FORWARDED_HOST] = 16,
+    [HDR_DNT] = 3,
+    [HDR_UPGRADE_INSECURE_REQUESTS] = 25,
+    [HDR_SEC_FETCH_SITE] = 14,
+    [HDR_SEC_FETCH_MODE] = 14,
+    [HDR_SEC_FETCH_USER] = 14,
+    [HDR_SEC_FETCH_DEST] = 14,
+    [HDR_DATE] = 4,
+    [HDR_MAX_FORWARDS] = 12,
+};
+
+/* Hash slot → id; HDR_UNKNOWN where no well-known name lands.        */
+static const uint8_t slots[1u << HDR_TABLE_BITS] = {
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_TE, HDR_IF_MATCH,
+    HDR_UNKNOWN, HDR_ORIGIN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_ACCEPT_LANGUAGE, HDR_UNKNOWN, HDR_DNT,
+    HDR_PROXY_AUTHORIZATION, HDR_UNKNOWN, HDR_CONTENT_LENGTH, HDR_DATE,
+    HDR_MAX_FORWARDS, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UPGRADE, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_VIA, HDR_UNKNOWN, HDR_ACCEPT,
+    HDR_CACHE_CONTROL, HDR_SEC_FETCH_SITE, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_EXPECT, HDR_SEC_FETCH_MODE, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_IF_NONE_MATCH, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_IF_MODIFIED_SINCE, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_ACCEPT_CHARSET, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_PROXY_CONNECTION, HDR_PRAGMA, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_COOKIE, HDR_UNKNOWN, HDR_X_FORWARDED_HOST,
+    HDR_PROXY_AUTHENTICATE, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_AUTHORIZATION, HDR_UNKNOWN, HDR_UNKNOWN, HDR_TRANSFER_ENCODING,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_REFERER, HDR_CONTENT_ENCODING,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_CONTENT_TYPE, HDR_CONNECTION, HDR_UNKNOWN, HDR_RANGE,
+    HDR_FORWARDED, HDR_UNKNOWN, HDR_SEC_FETCH_DEST, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_SEC_FETCH_USER, HDR_UNKNOWN,
+    HDR_ACCEPT_ENCODING, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_TRAILER, HDR_UNKNOWN, HDR_X_FORWARDED_PROTO, HDR_HOST,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_KEEP_ALIVE, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UPGRADE_INSECURE_REQUESTS,
+    HDR_UNKNOWN, HDR_X_FORWARDED_FOR, HDR_UNKNOWN, HDR_IF_UNMODIFIED_SINCE,
+    HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN, HDR_UNKNOWN,
+    HDR_USER_AGENT, HDR_UNKNOWN, HDR_UNKNOWN, HDR_IF_RANGE,
+};
+
+http_header_id http_header_lookup(const char* name, size_t len)
+{
+    if (len < 2 || len > 255) return HDR_UNKNOWN;
+
+    const unsigned char* p = (const unsigned char*)name;
+    uint64_t key = (uint64_t)len
+                 | (uint64_t)(p[0] | 0x20) << 8
+                 | (uint64_t)(p[len - 1] | 0x20) << 16
+                 | (uint64_t)(p[len - 2] | 0x20) << 24
+                 | (uint64_t)(p[len / 2] | 0x20) << 32;
+    http_header_id id = (http_header_id)slots[(key * HDR_HASH_SEED) >> (64 - HDR_TABLE_BITS)];
+    if (id == HDR_UNKNOWN || http_header_lengths[id] != len) return HDR_UNKNOWN;
+
+    /* Confirm: names are tokens, so |0x20 folds case and nothing else. */
+    const unsigned char* c = (const unsigned char*)http_header_names[id];
+    for (size_t i = 0; i < len; ++i)
+        if ((p[i] | 0x20) != (c[i] | 0x20)) return HDR_UNKNOWN;
+    return id;
+}
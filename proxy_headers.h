@@ -0,0 +1,74 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_headers.h
+ *
+ *  GENERATED by tools/gen_headers.py – edit the list there and run
+ *  `make headers`.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_HEADERS_H
+#define PROXY_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Well-known header names. HDR_UNKNOWN is every other name.          */
+typedef enum http_header_id {
+    HDR_UNKNOWN = 0,
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_KEEP_ALIVE,
+    HDR_PROXY_CONNECTION,
+    HDR_PROXY_AUTHORIZATION,
+    HDR_PROXY_AUTHENTICATE,
+    HDR_TE,
+    HDR_TRAILER,
+    HDR_TRANSFER_ENCODING,
+    HDR_UPGRADE,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_CONTENT_ENCODING,
+    HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_ACCEPT_CHARSET,
+    HDR_USER_AGENT,
+    HDR_REFERER,
+    HDR_COOKIE,
+    HDR_AUTHORIZATION,
+    HDR_CACHE_CONTROL,
+    HDR_PRAGMA,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MATCH,
+    HDR_IF_UNMODIFIED_SINCE,
+    HDR_IF_RANGE,
+    HDR_RANGE,
+    HDR_ORIGIN,
+    HDR_EXPECT,
+    HDR_VIA,
+    HDR_FORWARDED,
+    HDR_X_FORWARDED_FOR,
+    HDR_X_FORWARDED_PROTO,
+    HDR_X_FORWARDED_HOST,
+    HDR_DNT,
+    HDR_UPGRADE_INSECURE_REQUESTS,
+    HDR_SEC_FETCH_SITE,
+    HDR_SEC_FETCH_MODE,
+    HDR_SEC_FETCH_USER,
+    HDR_SEC_FETCH_DEST,
+    HDR_DATE,
+    HDR_MAX_FORWARDS,
+    HDR__COUNT
+} http_header_id;
+
+#define HDR_TABLE_BITS  7
+#define HDR_HASH_SEED   0x7CACEC6F76E18EABULL
+
+/* Canonical spelling of each id ("" for HDR_UNKNOWN).                */
+extern const char* const http_header_names[HDR__COUNT];
+extern const uint8_t     http_header_lengths[HDR__COUNT];
+
+/* Case-insensitive classification of name[0..len).                   */
+http_header_id http_header_lookup(const char* name, size_t len);
+
+#endif /* PROXY_HEADERS_H */
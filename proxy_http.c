@@ -0,0 +1,844 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_http.c      –  response framing + upstream header rewriting
+ *
+ *  The framer copies only the response's header block (bounded by
+ *  HTTP_MAX_RESPONSE_HEAD); body bytes are counted, never copied. A
+ *  head that outgrows the bound is relayed as close-delimited rather
+ *  than rejected – the client still gets it, we just can't reuse the
+ *  origin connection afterwards.
+ *
+ *  Freshness is read from heads the cache already stores, so nothing
+ *  extra is kept per entry; the dates in them are parsed with
+ *  strptime() in the three forms RFC 9110 §5.6.7 requires.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_http.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+enum { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER };
+
+void http_framer_init(http_framer* f)
+{
+    memset(f, 0, sizeof *f);
+}
+
+void http_framer_free(http_framer* f)
+{
+    free(f->head);
+    f->head = NULL;
+    f->head_len = f->head_cap = 0;
+}
+
+/*──────────────────── Header block ─────────────────────────────────*/
+
+/* Case-insensitive token match inside a comma-separated header value. */
+static int has_token(const char* v, size_t len, const char* token)
+{
+    size_t tlen = strlen(token);
+    const char* end = v + len;
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) ++v;
+        const char* t = v;
+        while (v < end && *v != ',') ++v;
+        const char* te = v;
+        while (te > t && (te[-1] == ' ' || te[-1] == '\t')) --te;
+        if ((size_t)(te - t) == tlen && strncasecmp(t, token, tlen) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Transfer-Encoding is chunked only if chunked is the final coding. */
+static int ends_with_chunked(const char* v, size_t len)
+{
+    while (len && (v[len - 1] == ' ' || v[len - 1] == '\t')) --len;
+    size_t start = len;
+    while (start && v[start - 1] != ',') --start;
+    while (start < len && (v[start] == ' ' || v[start] == '\t')) ++start;
+    return len - start == 7 && strncasecmp(v + start, "chunked", 7) == 0;
+}
+
+/* Decide framing from a complete head [head, head + len). */
+static int parse_head(http_framer* f, const char* head, size_t len)
+{
+    const char* end = head + len;
+    const char* eol = memchr(head, '\n', len);
+    if (!eol || len < 12 || strncmp(head, "HTTP/1.", 7) != 0) return -1;
+    if (!isdigit((unsigned char)head[9]) || !isdigit((unsigned char)head[10])
+        || !isdigit((unsigned char)head[11])) return -1;
+
+    int minor = head[7] - '0';
+    f->status = (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+    f->keep_alive = minor >= 1;
+
+    int chunked = 0, te = 0, have_length = 0;
+    uint64_t length = 0;
+
+    for (const char* line = eol + 1; line < end; ) {
+        const char* nl = memchr(line, '\n', (size_t)(end - line));
+        const char* le = nl ? nl : end;
+        const char* next = nl ? nl + 1 : end;
+        if (le > line && le[-1] == '\r') --le;
+
+        const char* colon = memchr(line, ':', (size_t)(le - line));
+        if (colon) {
+            size_t klen = (size_t)(colon - line);
+            const char* v = colon + 1;
+            while (v < le && (*v == ' ' || *v == '\t')) ++v;
+            size_t vlen = (size_t)(le - v);
+
+            if (klen == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                uint64_t n = 0;
+                size_t i = 0;
+                for (; i < vlen && isdigit((unsigned char)v[i]); ++i) {
+                    if (n > (UINT64_MAX - 9) / 10) return -1;
+                    n = n * 10 + (uint64_t)(v[i] - '0');
+                }
+                while (i < vlen && (v[i] == ' ' || v[i] == '\t')) ++i;
+                if (i == 0 || i != vlen) return -1;
+                if (have_length && n != length) return -1;
+                have_length = 1;
+                length = n;
+            }
+            else if (klen == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                te = 1;
+                chunked = ends_with_chunked(v, vlen);
+            }
+            else if (klen == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                if (has_token(v, vlen, "close")) f->keep_alive = 0;
+                else if (has_token(v, vlen, "keep-alive")) f->keep_alive = 1;
+            }
+        }
+        line = next;
+    }
+
+    if ((f->status >= 100 && f->status < 200) || f->status == 204 || f->status == 304) {
+        f->body = HTTP_BODY_NONE;
+        if (f->status == 101) { f->body = HTTP_BODY_CLOSE; f->keep_alive = 0; }
+    }
+    else if (te) {
+        f->body = chunked ? HTTP_BODY_CHUNKED : HTTP_BODY_CLOSE;
+        if (!chunked) f->keep_alive = 0;
+        f->chunk_state = CHUNK_SIZE;
+    }
+    else if (have_length) {
+        f->body = HTTP_BODY_LENGTH;
+        f->remaining = length;
+    }
+    else {
+        f->body = HTTP_BODY_CLOSE;
+        f->keep_alive = 0;
+    }
+    return 0;
+}
+
+/* Collect head bytes from data; *used is how many were head. Returns
+ * 1 once the head is complete, 0 if more is needed, -1 on error.     */
+static int take_head(http_framer* f, const char* data, size_t len, size_t* used)
+{
+    *used = 0;
+    if (f->head_len + len > f->head_cap) {
+        size_t cap = f->head_cap ? f->head_cap * 2 : 1024;
+        while (cap < f->head_len + len && cap < HTTP_MAX_RESPONSE_HEAD) cap *= 2;
+        if (cap > HTTP_MAX_RESPONSE_HEAD) cap = HTTP_MAX_RESPONSE_HEAD;
+        if (cap > f->head_cap) {
+            char* tmp = (char*)realloc(f->head, cap);
+            if (!tmp) return -1;
+            f->head = tmp;
+            f->head_cap = cap;
+        }
+    }
+    size_t take = f->head_cap - f->head_len < len ? f->head_cap - f->head_len : len;
+    memcpy(f->head + f->head_len, data, take);
+    f->head_len += take;
+
+    /* Blank line: "\n\r\n" or "\n\n", resuming where we stopped.      */
+    size_t from = f->head_checked;
+    for (size_t i = from; i < f->head_len; ++i) {
+        if (f->head[i] != '\n' || i == 0) continue;
+        size_t end = 0;
+        if (f->head[i - 1] == '\n') end = i + 1;
+        else if (i >= 2 && f->head[i - 1] == '\r' && f->head[i - 2] == '\n') end = i + 1;
+        if (!end) continue;
+
+        size_t before = f->head_len - take;     /* head bytes from earlier calls */
+        *used = end - before;
+        if (parse_head(f, f->head, end) < 0) return -1;
+        return 1;
+    }
+    f->head_checked = f->head_len;
+    *used = take;
+
+    if (f->head_len == HTTP_MAX_RESPONSE_HEAD) {    /* give up framing */
+        f->body = HTTP_BODY_CLOSE;
+        f->keep_alive = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/*──────────────────── Body ─────────────────────────────────────────*/
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void chunk_size_done(http_framer* f)
+{
+    f->chunk_state = f->remaining ? CHUNK_DATA : CHUNK_TRAILER;
+    f->line_empty = 1;
+}
+
+/* Advance over chunked body bytes; sets f->done at the final CRLF.  */
+static int take_chunked(http_framer* f, const char* p, size_t len, size_t* used)
+{
+    size_t i = 0;
+    while (i < len && !f->done) {
+        switch (f->chunk_state) {
+        case CHUNK_SIZE: {
+            char c = p[i++];
+            int v = hex_value(c);
+            if (v >= 0) {
+                if (f->remaining >> 59) return -1;
+                f->remaining = f->remaining * 16 + (uint64_t)v;
+                ++f->chunk_digits;
+            }
+            else if (!f->chunk_digits) {
+                return -1;
+            }
+            else if (c == '\n') {
+                chunk_size_done(f);
+            }
+            else if (c == '\r' || c == ';' || c == ' ' || c == '\t') {
+                f->chunk_state = CHUNK_EXT;
+            }
+            else {
+                return -1;
+            }
+            break;
+        }
+        case CHUNK_EXT:
+            if (p[i++] == '\n') chunk_size_done(f);
+            break;
+        case CHUNK_DATA: {
+            size_t take = len - i;
+            if (f->remaining < take) take = (size_t)f->remaining;
+            i += take;
+            f->remaining -= take;
+            if (!f->remaining) f->chunk_state = CHUNK_DATA_END;
+            break;
+        }
+        case CHUNK_DATA_END: {
+            char c = p[i++];
+            if (c == '\n') { f->chunk_state = CHUNK_SIZE; f->chunk_digits = 0; }
+            else if (c != '\r') return -1;
+            break;
+        }
+        case CHUNK_TRAILER: {
+            char c = p[i++];
+            if (c == '\n') {
+                if (f->line_empty) f->done = 1;
+                f->line_empty = 1;
+            }
+            else if (c != '\r') {
+                f->line_empty = 0;
+            }
+            break;
+        }
+        }
+    }
+    *used = i;
+    return 0;
+}
+
+int http_framer_feed(http_framer* f, const char* data, size_t len, size_t* used)
+{
+    size_t off = 0;
+    if (used) *used = 0;
+
+    while (off < len && !f->done) {
+        size_t n = 0;
+        if (f->body == HTTP_BODY_UNKNOWN) {
+            int rc = take_head(f, data + off, len - off, &n);
+            if (rc < 0) return HTTP_FRAME_ERROR;
+            off += n;
+            if (rc == 0) break;
+            if (f->body == HTTP_BODY_NONE && f->status < 200) {
+                f->body = HTTP_BODY_UNKNOWN;        /* interim: next head */
+                f->head_len = f->head_checked = 0;
+                f->status = 0;
+                continue;
+            }
+            if (f->body == HTTP_BODY_NONE || f->body == HTTP_BODY_LENGTH)
+                f->expected = f->consumed + off + f->remaining;
+            if (f->body == HTTP_BODY_NONE ||
+                (f->body == HTTP_BODY_LENGTH && f->remaining == 0))
+                f->done = 1;
+            continue;
+        }
+
+        switch (f->body) {
+        case HTTP_BODY_LENGTH:
+            n = len - off;
+            if (f->remaining < n) n = (size_t)f->remaining;
+            f->remaining -= n;
+            if (!f->remaining) f->done = 1;
+            break;
+        case HTTP_BODY_CHUNKED:
+            if (take_chunked(f, data + off, len - off, &n) < 0) return HTTP_FRAME_ERROR;
+            break;
+        default:                                    /* CLOSE: everything */
+            n = len - off;
+            break;
+        }
+        off += n;
+    }
+
+    f->consumed += off;
+    if (used) *used = off;
+    return f->done ? HTTP_FRAME_DONE : HTTP_FRAME_NEED_MORE;
+}
+
+uint64_t http_framer_opaque_left(const http_framer* f)
+{
+    if (f->done) return 0;
+    if (f->body == HTTP_BODY_LENGTH) return f->remaining;
+    if (f->body == HTTP_BODY_CLOSE) return UINT64_MAX;
+    return 0;
+}
+
+int http_framer_skip(http_framer* f, uint64_t n)
+{
+    f->consumed += n;
+    if (f->body == HTTP_BODY_LENGTH) {
+        f->remaining -= n < f->remaining ? n : f->remaining;
+        if (!f->remaining) f->done = 1;
+    }
+    return f->done ? HTTP_FRAME_DONE : HTTP_FRAME_NEED_MORE;
+}
+
+int http_framer_eof(http_framer* f)
+{
+    if (f->done) return HTTP_FRAME_DONE;
+    if (f->body == HTTP_BODY_CLOSE) {
+        f->done = 1;
+        f->keep_alive = 0;
+        return HTTP_FRAME_DONE;
+    }
+    return HTTP_FRAME_ERROR;
+}
+
+/*──────────────────── Cache freshness ──────────────────────────────*/
+
+/* Next field of a head, from *pos (past the status line); value
+ * trimmed. 0 at the blank line or the end.                           */
+static int next_field(const char** pos, const char* end, const char** name, size_t* name_len,
+                      const char** value, size_t* value_len)
+{
+    while (*pos < end) {
+        const char* line = *pos;
+        const char* nl = memchr(line, '\n', (size_t)(end - line));
+        const char* le = nl ? nl : end;
+        *pos = nl ? nl + 1 : end;
+        if (le > line && le[-1] == '\r') --le;
+        if (le == line) return 0;
+
+        const char* colon = memchr(line, ':', (size_t)(le - line));
+        if (!colon) continue;
+        const char* v = colon + 1;
+        while (v < le && (*v == ' ' || *v == '\t')) ++v;
+        while (le > v && (le[-1] == ' ' || le[-1] == '\t')) --le;
+        *name = line;
+        *name_len = (size_t)(colon - line);
+        *value = v;
+        *value_len = (size_t)(le - v);
+        return 1;
+    }
+    return 0;
+}
+
+/* Where the fields of a response head start; NULL if it isn't one.  */
+static const char* first_field(const char* head, size_t len)
+{
+    if (len < 12 || strncmp(head, "HTTP/1.", 7) != 0) return NULL;
+    const char* eol = memchr(head, '\n', len);
+    return eol ? eol + 1 : NULL;
+}
+
+int http_response_header(const char* head, size_t len, const char* name,
+                         const char** value, size_t* value_len)
+{
+    const char* pos = first_field(head, len);
+    const char* end = head + len;
+    const char* k;
+    size_t klen, want = strlen(name);
+    if (!pos) return 0;
+    while (next_field(&pos, end, &k, &klen, value, value_len))
+        if (klen == want && strncasecmp(k, name, want) == 0) return 1;
+    return 0;
+}
+
+/* IMF-fixdate, RFC 850 or asctime(), always GMT.                     */
+static int parse_http_date(const char* v, size_t len, time_t* out)
+{
+    static const char* const formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",
+        "%A, %d-%b-%y %H:%M:%S GMT",
+        "%a %b %e %H:%M:%S %Y",
+    };
+    char buf[64];
+    if (len >= sizeof buf) return -1;
+    memcpy(buf, v, len);
+    buf[len] = '\0';
+
+    for (size_t i = 0; i < sizeof formats / sizeof formats[0]; ++i) {
+        struct tm tm;
+        memset(&tm, 0, sizeof tm);
+        const char* end = strptime(buf, formats[i], &tm);
+        if (end && *end == '\0') {
+            *out = timegm(&tm);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* delta-seconds, saturating at 2^31 (RFC 9111 §1.2.2); -1 if invalid. */
+static long long parse_delta(const char* v, size_t len)
+{
+    long long n = 0;
+    size_t i = 0;
+    if (len >= 2 && v[0] == '"' && v[len - 1] == '"') { ++v; len -= 2; }
+    for (; i < len && isdigit((unsigned char)v[i]); ++i)
+        if ((n = n * 10 + (v[i] - '0')) > 2147483648LL) n = 2147483648LL;
+    return i && i == len ? n : -1;
+}
+
+/* The fields freshness depends on. -1 → absent for the numbers.     */
+typedef struct cache_fields {
+    int       cache_control;        /* a Cache-Control field was seen   */
+    int       no_store, no_cache, must_revalidate;
+    long long max_age, s_maxage, swr;
+    int       has_expires, has_date, has_age, has_last_modified;
+    time_t    expires, date, last_modified;
+    long long age;
+} cache_fields;
+
+static void read_cache_control(cache_fields* c, const char* v, size_t len)
+{
+    const char* end = v + len;
+    c->cache_control = 1;
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) ++v;
+        const char* d = v;
+        while (v < end && *v != ',' && *v != '=') ++v;
+        size_t dlen = (size_t)(v - d);
+        while (dlen && (d[dlen - 1] == ' ' || d[dlen - 1] == '\t')) --dlen;
+
+        const char* arg = NULL;
+        size_t arg_len = 0;
+        if (v < end && *v == '=') {
+            arg = ++v;
+            if (v < end && *v == '"') {                 /* quoted-string */
+                ++v;
+                while (v < end && *v != '"') v += (*v == '\\' && v + 1 < end) ? 2 : 1;
+                if (v < end) ++v;
+            }
+            while (v < end && *v != ',') ++v;
+            arg_len = (size_t)(v - arg);
+            while (arg_len && (arg[arg_len - 1] == ' ' || arg[arg_len - 1] == '\t')) --arg_len;
+        }
+
+#define IS(name) (dlen == sizeof name - 1 && strncasecmp(d, name, dlen) == 0)
+        /* A shared cache treats "private" like "no-store"; the
+         * field-qualified forms of both are taken unqualified.      */
+        if (IS("no-store") || IS("private"))            c->no_store = 1;
+        else if (IS("no-cache"))                        c->no_cache = 1;
+        else if (IS("must-revalidate") || IS("proxy-revalidate"))
+                                                        c->must_revalidate = 1;
+        else if (IS("max-age")) {                       /* malformed → stale, §4.2.1 */
+            c->max_age = arg ? parse_delta(arg, arg_len) : -1;
+            if (c->max_age < 0) c->max_age = 0;
+        }
+        else if (IS("s-maxage"))                        c->s_maxage = arg ? parse_delta(arg, arg_len) : -1;
+        else if (IS("stale-while-revalidate"))          c->swr = arg ? parse_delta(arg, arg_len) : -1;
+#undef IS
+    }
+}
+
+static int read_cache_fields(const char* head, size_t len, cache_fields* c)
+{
+    const char* pos = first_field(head, len);
+    const char* end = head + len;
+    const char* k;
+    const char* v;
+    size_t klen, vlen;
+
+    memset(c, 0, sizeof *c);
+    c->max_age = c->s_maxage = c->swr = -1;
+    if (!pos) return -1;
+
+    while (next_field(&pos, end, &k, &klen, &v, &vlen)) {
+        if (klen == 13 && strncasecmp(k, "Cache-Control", 13) == 0) {
+            read_cache_control(c, v, vlen);
+        }
+        else if (klen == 7 && strncasecmp(k, "Expires", 7) == 0) {
+            c->has_expires = 1;                         /* invalid → past */
+            if (parse_http_date(v, vlen, &c->expires) < 0) c->expires = 0;
+        }
+        else if (klen == 4 && strncasecmp(k, "Date", 4) == 0) {
+            c->has_date = parse_http_date(v, vlen, &c->date) == 0;
+        }
+        else if (klen == 3 && strncasecmp(k, "Age", 3) == 0) {
+            c->age = parse_delta(v, vlen);
+            c->has_age = c->age >= 0;
+        }
+        else if (klen == 13 && strncasecmp(k, "Last-Modified", 13) == 0) {
+            c->has_last_modified = parse_http_date(v, vlen, &c->last_modified) == 0;
+        }
+        else if (klen == 4 && strncasecmp(k, "Vary", 4) == 0) {
+            if (has_token(v, vlen, "*")) c->no_store = 1;
+        }
+    }
+    return 0;
+}
+
+int http_response_freshness(const char* head, size_t len,
+                            const char* update, size_t update_len,
+                            time_t now, http_freshness* out)
+{
+    cache_fields f, u;
+    memset(out, 0, sizeof *out);
+    if (read_cache_fields(head, len, &f) < 0) return -1;
+
+    /* A 304 replaces what it carries. Its Age, present or not, is the
+     * only one that counts: the stored one dated the old response.  */
+    if (update && read_cache_fields(update, update_len, &u) == 0) {
+        if (u.cache_control) {
+            f.cache_control = 1;
+            f.no_store = u.no_store;
+            f.no_cache = u.no_cache;
+            f.must_revalidate = u.must_revalidate;
+            f.max_age = u.max_age;
+            f.s_maxage = u.s_maxage;
+            f.swr = u.swr;
+        }
+        if (u.has_expires) { f.has_expires = 1; f.expires = u.expires; }
+        if (u.has_date) { f.has_date = 1; f.date = u.date; }
+        if (u.has_last_modified) { f.has_last_modified = 1; f.last_modified = u.last_modified; }
+        f.has_age = u.has_age;
+        f.age = u.age;
+    }
+
+    /* Freshness lifetime, RFC 9111 §4.2.1 / §4.2.2.                  */
+    time_t date = f.has_date ? f.date : now;
+    long long lifetime;
+    if (f.s_maxage >= 0)           lifetime = f.s_maxage;
+    else if (f.max_age >= 0)       lifetime = f.max_age;
+    else if (f.has_expires)        lifetime = (long long)f.expires - (long long)date;
+    else if (f.has_last_modified) {
+        lifetime = ((long long)date - (long long)f.last_modified) / 10;
+        if (lifetime > HTTP_HEURISTIC_MAX) lifetime = HTTP_HEURISTIC_MAX;
+    }
+    else                           lifetime = HTTP_DEFAULT_TTL;
+    if (f.no_cache || lifetime < 0) lifetime = 0;
+
+    /* Age on arrival, §4.2.3 (no response delay: we don't time it). */
+    long long age = f.has_date && now > date ? (long long)(now - date) : 0;
+    if (f.has_age && f.age > age) age = f.age;
+
+    /* s-maxage implies proxy-revalidate: no serving stale.          */
+    long long window = f.swr > 0 && !f.no_cache && !f.must_revalidate && f.s_maxage < 0
+                     ? f.swr : 0;
+
+    long long fresh = (long long)now + lifetime - age;
+    if (fresh < 1) fresh = 1;                           /* 0 is "never" */
+    out->store = !f.no_store;
+    out->fresh_until = (time_t)fresh;
+    out->stale_until = (time_t)(fresh + window);
+    return 0;
+}
+
+/*──────────────────── Client side ──────────────────────────────────*/
+
+int http_request_keep_alive(ParsedRequest* pr)
+{
+    ParsedHeader* conn = ParsedHeader_get_id(pr, HDR_CONNECTION);
+    if (strcmp(pr->version, "HTTP/1.0") == 0)
+        return conn && has_token(conn->value, conn->value_length, "keep-alive");
+    return !conn || !has_token(conn->value, conn->value_length, "close");
+}
+
+int http_request_body(ParsedRequest* pr, http_framer* f)
+{
+    ParsedHeader* te = ParsedHeader_get_id(pr, HDR_TRANSFER_ENCODING);
+    ParsedHeader* cl = ParsedHeader_get_id(pr, HDR_CONTENT_LENGTH);
+
+    http_framer_init(f);
+    if (te) {
+        if (cl || !ends_with_chunked(te->value, te->value_length)) return -1;
+        f->body = HTTP_BODY_CHUNKED;
+        f->chunk_state = CHUNK_SIZE;
+        return 0;
+    }
+    if (cl) {
+        uint64_t n = 0;
+        size_t i = 0;
+        for (; i < cl->value_length && isdigit((unsigned char)cl->value[i]); ++i) {
+            if (n > (UINT64_MAX - 9) / 10) return -1;
+            n = n * 10 + (uint64_t)(cl->value[i] - '0');
+        }
+        size_t end = i;
+        while (end < cl->value_length && (cl->value[end] == ' ' || cl->value[end] == '\t')) ++end;
+        if (i == 0 || end != cl->value_length) return -1;
+        f->body = HTTP_BODY_LENGTH;
+        f->remaining = n;
+        f->done = n == 0;
+        return 0;
+    }
+    f->body = HTTP_BODY_NONE;
+    f->done = 1;
+    return 0;
+}
+
+size_t http_head_length(const char* data, size_t len)
+{
+    for (size_t i = 1; i < len; ++i) {
+        if (data[i] != '\n') continue;
+        if (data[i - 1] == '\n' || (i >= 2 && data[i - 1] == '\r' && data[i - 2] == '\n'))
+            return i + 1;
+    }
+    return 0;
+}
+
+int http_response_reusable(const char* data, size_t len)
+{
+    /* An interim (1xx) head or one that doesn't fit is "unsure".     */
+    size_t head = http_head_length(data, len);
+    if (!head) return 0;
+
+    http_framer f;
+    http_framer_init(&f);
+    if (parse_head(&f, data, head) < 0 || f.status < 200) return 0;
+    return f.keep_alive && f.body != HTTP_BODY_CLOSE;
+}
+
+/*──────────────────── Stored codings ───────────────────────────────*/
+
+/* Media types worth compressing: text, and the structured formats
+ * that are text in all but name.                                     */
+static int textual_type(const char* v, size_t len)
+{
+    static const char* const types[] = {
+        "application/javascript", "application/x-javascript", "application/ecmascript",
+        "application/json", "application/xml", "image/svg+xml",
+    };
+    size_t n = 0;
+    while (n < len && v[n] != ';' && v[n] != ' ' && v[n] != '\t') ++n;
+
+    if (n > 5 && strncasecmp(v, "text/", 5) == 0) return 1;
+    if (n > 5 && strncasecmp(v + n - 5, "+json", 5) == 0) return 1;
+    if (n > 4 && strncasecmp(v + n - 4, "+xml", 4) == 0) return 1;
+    for (size_t i = 0; i < sizeof types / sizeof types[0]; ++i)
+        if (strlen(types[i]) == n && strncasecmp(v, types[i], n) == 0) return 1;
+    return 0;
+}
+
+int http_response_encodable(const char* data, size_t len, size_t* head_len)
+{
+    size_t head = http_head_length(data, len);
+    http_framer f;
+    http_framer_init(&f);
+    if (!head || parse_head(&f, data, head) < 0 || f.status != 200) return 0;
+    if (f.body == HTTP_BODY_LENGTH && f.remaining != len - head) return 0;
+
+    const char* pos = first_field(data, head);
+    const char* end = data + head;
+    const char* k;
+    const char* v;
+    size_t klen, vlen;
+    int textual = 0;
+    while (next_field(&pos, end, &k, &klen, &v, &vlen)) {
+#define IS(name) (klen == sizeof name - 1 && strncasecmp(k, name, klen) == 0)
+        if (IS("Content-Type"))                 textual = textual_type(v, vlen);
+        else if (IS("Content-Encoding"))        { if (!has_token(v, vlen, "identity")) return 0; }
+        else if (IS("Transfer-Encoding") || IS("Content-Range")) return 0;
+        else if (IS("Cache-Control"))           { if (has_token(v, vlen, "no-transform")) return 0; }
+#undef IS
+    }
+    *head_len = head;
+    return textual;
+}
+
+/* Append n bytes at out + *at, or only count them when out is NULL. */
+static void put(char* out, size_t* at, const char* s, size_t n)
+{
+    if (out) memcpy(out + *at, s, n);
+    *at += n;
+}
+
+/* The recoded head from its first field on, written to out (NULL →
+ * just measured). Returns its length.                                */
+static size_t recode_fields(char* out, const char* pos, const char* end,
+                            const char* coding, size_t body_len)
+{
+    const char* k;
+    const char* v;
+    size_t klen, vlen, o = 0;
+    int vary = 0;
+    while (next_field(&pos, end, &k, &klen, &v, &vlen)) {
+#define IS(name) (klen == sizeof name - 1 && strncasecmp(k, name, klen) == 0)
+        if (IS("Content-Length") || IS("Content-Encoding")) continue;
+        put(out, &o, k, klen);
+        put(out, &o, ": ", 2);
+        if (coding && IS("ETag") && !(vlen >= 2 && v[0] == 'W' && v[1] == '/'))
+            put(out, &o, "W/", 2);
+        put(out, &o, v, vlen);
+        if (coding && IS("Vary")) {
+            vary = 1;
+            if (!has_token(v, vlen, "Accept-Encoding") && !has_token(v, vlen, "*"))
+                put(out, &o, ", Accept-Encoding", 17);
+        }
+        put(out, &o, "\r\n", 2);
+#undef IS
+    }
+    if (coding) {
+        put(out, &o, "Content-Encoding: ", 18);
+        put(out, &o, coding, strlen(coding));
+        put(out, &o, "\r\n", 2);
+        if (!vary) put(out, &o, "Vary: Accept-Encoding\r\n", 23);
+    }
+    char length[48];
+    int n = snprintf(length, sizeof length, "Content-Length: %zu\r\n\r\n", body_len);
+    put(out, &o, length, (size_t)n);
+    return o;
+}
+
+/* Two passes over the fields: one sizes the output exactly (every
+ * Vary may grow by ", Accept-Encoding", every strong ETag by "W/"),
+ * the other writes it.                                               */
+char* http_recode_head(const char* head, size_t len, const char* coding,
+                       size_t body_len, size_t* out_len)
+{
+    const char* pos = first_field(head, len);
+    if (!pos) return NULL;
+
+    size_t status = (size_t)(pos - head);
+    size_t fields = recode_fields(NULL, pos, head + len, coding, body_len);
+    char* out = (char*)malloc(status + fields);
+    if (!out) return NULL;
+
+    memcpy(out, head, status);
+    recode_fields(out + status, pos, head + len, coding, body_len);
+    *out_len = status + fields;
+    return out;
+}
+
+/* Does a member's parameter list [p, end) say q=0 (or 0.0…)?         */
+static int q_zero(const char* p, const char* end)
+{
+    while (p < end) {
+        while (p < end && (*p == ';' || *p == ' ' || *p == '\t')) ++p;
+        if (end - p >= 2 && (*p == 'q' || *p == 'Q') && p[1] == '=') {
+            p += 2;
+            if (p == end || *p != '0') return 0;
+            for (++p; p < end && (*p == '.' || *p == '0'); ++p) {}
+            return p == end || *p == ';' || *p == ' ' || *p == '\t';
+        }
+        while (p < end && *p != ';') ++p;
+    }
+    return 0;
+}
+
+int http_accepts_coding(ParsedRequest* pr, const char* coding)
+{
+    ParsedHeader* h = ParsedHeader_get_id(pr, HDR_ACCEPT_ENCODING);
+    if (!h) return 0;
+
+    size_t clen = strlen(coding);
+    int named = -1, any = -1;                   /* -1 → not listed      */
+    const char* v = h->value;
+    const char* end = v + h->value_length;
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) ++v;
+        const char* t = v;
+        while (v < end && *v != ',' && *v != ';' && *v != ' ' && *v != '\t') ++v;
+        size_t tlen = (size_t)(v - t);
+        const char* params = v;
+        while (v < end && *v != ',') ++v;
+
+        int ok = !q_zero(params, v);
+        if (tlen == clen && strncasecmp(t, coding, clen) == 0) named = ok;
+        else if (tlen == 1 && *t == '*') any = ok;
+    }
+    return named >= 0 ? named : any > 0;
+}
+
+/*──────────────────── Upstream request headers ─────────────────────*/
+
+static void remove_all(ParsedRequest* pr, const char* key)
+{
+    while (ParsedHeader_remove(pr, key) == 0) {}
+}
+
+int http_prepare_upstream_headers(ParsedRequest* pr)
+{
+    static const http_header_id hop_by_hop[] = {
+        HDR_CONNECTION, HDR_PROXY_CONNECTION, HDR_KEEP_ALIVE, HDR_TE, HDR_TRAILER, HDR_UPGRADE,
+        HDR_CONTENT_LENGTH, HDR_TRANSFER_ENCODING,      /* the body stays behind */
+    };
+
+    /* Headers the client marked as hop-by-hop go first.               */
+    ParsedHeader* conn = ParsedHeader_get_id(pr, HDR_CONNECTION);
+    if (conn) {
+        char* names = strndup(conn->value, conn->value_length);
+        if (!names) return -1;
+        char* save = NULL;
+        for (char* tok = strtok_r(names, ", \t", &save); tok; tok = strtok_r(NULL, ", \t", &save)) {
+            if (strcasecmp(tok, "close") != 0 && strcasecmp(tok, "keep-alive") != 0)
+                remove_all(pr, tok);
+        }
+        free(names);
+    }
+    for (size_t i = 0; i < sizeof hop_by_hop / sizeof hop_by_hop[0]; ++i)
+        while (ParsedHeader_remove_id(pr, hop_by_hop[i]) == 0) {}
+
+    return ParsedHeader_set_id(pr, HDR_CONNECTION, "keep-alive");
+}
+
+int http_prepare_fill_headers(ParsedRequest* pr, const char* stored, size_t stored_len)
+{
+    static const http_header_id preconditions[] = {
+        HDR_IF_MODIFIED_SINCE, HDR_IF_NONE_MATCH, HDR_IF_MATCH, HDR_IF_UNMODIFIED_SINCE,
+        HDR_IF_RANGE, HDR_RANGE,
+    };
+    static const struct { const char* field; http_header_id as; } validators[] = {
+        { "ETag",          HDR_IF_NONE_MATCH },
+        { "Last-Modified", HDR_IF_MODIFIED_SINCE },
+    };
+
+    for (size_t i = 0; i < sizeof preconditions / sizeof preconditions[0]; ++i)
+        while (ParsedHeader_remove_id(pr, preconditions[i]) == 0) {}
+    if (!stored) return 0;
+
+    for (size_t i = 0; i < sizeof validators / sizeof validators[0]; ++i) {
+        const char* v;
+        size_t n;
+        if (!http_response_header(stored, stored_len, validators[i].field, &v, &n)) continue;
+        char* value = strndup(v, n);
+        int rc = value ? ParsedHeader_set_id(pr, validators[i].as, value) : -1;
+        free(value);
+        if (rc < 0) return -1;
+    }
+    return 0;
+}
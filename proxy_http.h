@@ -0,0 +1,185 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_http.h
+ *
+ *  HTTP/1.x message framing for the upstream side.
+ *
+ *  Once origin connections are kept alive, "read until EOF" no longer
+ *  tells us where a response ends. http_framer follows the rules of
+ *  RFC 9112 §6.3 over the bytes as they are relayed:
+ *
+ *      • 1xx (bar 101), 204, 304        no body
+ *      • Transfer-Encoding: …chunked    chunk sizes, then trailers
+ *      • Content-Length: N              exactly N bytes
+ *      • anything else                  until the origin closes
+ *
+ *  and records whether the origin will keep the connection open
+ *  afterwards, so the socket can go back to the upstream pool.
+ *
+ *  The framer only observes; it never rewrites the bytes, so what the
+ *  client receives and what the cache stores is exactly what the origin
+ *  sent – until the cache chooses to compress an entry, below.
+ *
+ *  The same framer skips request bodies on persistent client
+ *  connections (http_request_body), and http_response_reusable() tells
+ *  from a stored head whether the client can expect another response on
+ *  the connection afterwards.
+ *
+ *  For the cache, http_response_freshness() reads how long a stored
+ *  response may be served (RFC 9111 §4.2: Cache-Control s-maxage /
+ *  max-age, else Expires, else a heuristic from Last-Modified), less
+ *  the age it arrived with, plus any stale-while-revalidate window
+ *  (RFC 5861). http_prepare_fill_headers() turns the request that fills
+ *  an entry into an unconditional one, or a conditional one carrying
+ *  the stale entry's validators (ETag, Last-Modified).
+ *
+ *  When the cache stores a response compressed (proxy_codec.h),
+ *  http_response_encodable() picks the responses that may be, and
+ *  http_recode_head() rewrites the stored head for the coded body and
+ *  back to identity for clients that don't take it.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_HTTP_H
+#define PROXY_HTTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "proxy_parse.h"
+
+#define HTTP_MAX_RESPONSE_HEAD  (32 * 1024)     /* status line + headers     */
+#define HTTP_DEFAULT_TTL        300             /* s, no freshness info at all */
+#define HTTP_HEURISTIC_MAX      (24 * 3600)     /* s, cap on 10 % of the age
+                                                   Last-Modified implies    */
+
+/* Same convention as ParsedRequest_feed().                            */
+#define HTTP_FRAME_ERROR      (-1)
+#define HTTP_FRAME_DONE         0
+#define HTTP_FRAME_NEED_MORE    1
+
+typedef enum http_body {
+    HTTP_BODY_UNKNOWN,              /* still reading the header block     */
+    HTTP_BODY_NONE,
+    HTTP_BODY_LENGTH,
+    HTTP_BODY_CHUNKED,
+    HTTP_BODY_CLOSE,                /* delimited by EOF, never reusable   */
+} http_body;
+
+typedef struct http_framer {
+    http_body body;
+    int       status;               /* final status code, 0 until known   */
+    int       keep_alive;           /* origin may be reused afterwards    */
+    int       done;
+
+    char*     head;                 /* header block collected so far      */
+    size_t    head_len, head_cap;
+    size_t    head_checked;         /* bytes already searched for CRLFCRLF */
+
+    uint64_t  consumed;             /* response bytes observed so far     */
+    uint64_t  expected;             /* whole response length once known
+                                       (Content-Length / no body), else 0 */
+    uint64_t  remaining;            /* LENGTH body / current chunk bytes  */
+    int       chunk_state;
+    int       chunk_digits;         /* hex digits seen in this size line  */
+    int       line_empty;           /* trailer line has no bytes yet      */
+} http_framer;
+
+void http_framer_init(http_framer* f);
+void http_framer_free(http_framer* f);
+
+/* Observe `len` response bytes. *used is how many belong to this
+ * response (all of them until the last). A close-delimited body is
+ * finished by http_framer_eof().                                      */
+int  http_framer_feed(http_framer* f, const char* data, size_t len, size_t* used);
+
+/* Body bytes that may be relayed unseen (e.g. spliced): what is left
+ * of a Content-Length body, UINT64_MAX for a close-delimited one, 0
+ * while the framer needs to look at the bytes itself.                */
+uint64_t http_framer_opaque_left(const http_framer* f);
+
+/* Account for n such bytes. HTTP_FRAME_DONE once the response ends.  */
+int  http_framer_skip(http_framer* f, uint64_t n);
+
+/* The origin closed. HTTP_FRAME_DONE if that legitimately ended the
+ * response, HTTP_FRAME_ERROR if it was cut short.                     */
+int  http_framer_eof(http_framer* f);
+
+/*──────── Cache freshness ────────*/
+
+typedef struct http_freshness {
+    int     store;                  /* a shared cache may keep it        */
+    time_t  fresh_until;            /* serve without asking until then   */
+    time_t  stale_until;            /* ≥ fresh_until: serve stale while
+                                       revalidating until then          */
+} http_freshness;
+
+/* Freshness of a response whose head starts [head, head + len),
+ * received at `now`. `update` (NULL → none) is the head of a 304 that
+ * revalidated it: its Cache-Control, Expires, Date and Age replace the
+ * stored ones (RFC 9111 §4.3.4). -1 if head isn't a response head.   */
+int  http_response_freshness(const char* head, size_t len,
+                             const char* update, size_t update_len,
+                             time_t now, http_freshness* out);
+
+/* First `name` field in a response head, value trimmed. 1 if found.  */
+int  http_response_header(const char* head, size_t len, const char* name,
+                          const char** value, size_t* value_len);
+
+/*──────── Client side ────────*/
+
+/* Whether the client wants the connection kept after this exchange:
+ * HTTP/1.1 unless "Connection: close", HTTP/1.0 only with keep-alive. */
+int  http_request_keep_alive(ParsedRequest* pr);
+
+/* Set f up to frame pr's body (Content-Length or chunked) so it can be
+ * skipped with http_framer_feed(); f->done when there is none. -1 when
+ * the framing is unusable (bad Content-Length, a coding other than
+ * chunked last, or both headers): answer 400 and close, RFC 9112 §6.3. */
+int  http_request_body(ParsedRequest* pr, http_framer* f);
+
+/* 1 if a complete response whose head is at the start of [data, data +
+ * len) lets the client connection carry another one: it delimits its
+ * own body and doesn't ask to close. 0 (close after) when unsure.     */
+int  http_response_reusable(const char* data, size_t len);
+
+/*──────── Stored codings (proxy_codec.h) ────────*/
+
+/* Length of the head at the start of [data, data + len), through the
+ * blank line; 0 if it doesn't end in there.                          */
+size_t http_head_length(const char* data, size_t len);
+
+/* 1 if the complete response [data, data + len) may be stored in a
+ * content-coding of the proxy's choosing: a 200 with a textual
+ * Content-Type, no Content-Encoding, Transfer-Encoding or Content-Range,
+ * no Cache-Control: no-transform, and a Content-Length that matches
+ * the body if it has one. *head_len is where the body starts.        */
+int  http_response_encodable(const char* data, size_t len, size_t* head_len);
+
+/* The head [head, head + len) re-framed for a body of body_len bytes
+ * in `coding` (NULL → identity): Content-Length set, Content-Encoding
+ * replaced and, for a coding, Accept-Encoding added to Vary and a
+ * strong ETag weakened (RFC 9110 §8.8.1). malloc'd, *out_len bytes;
+ * NULL when out of memory or head isn't a response head.             */
+char* http_recode_head(const char* head, size_t len, const char* coding,
+                       size_t body_len, size_t* out_len);
+
+/* Whether pr's Accept-Encoding takes `coding`, by name or through
+ * "*", with a q-value above 0 (RFC 9110 §12.5.3).                    */
+int  http_accepts_coding(ParsedRequest* pr, const char* coding);
+
+/*──────── Upstream request ────────*/
+
+/* Strip hop-by-hop headers (Connection and everything it names,
+ * Proxy-Connection, Keep-Alive, TE, Upgrade…) and ask the origin to
+ * keep the connection: Connection: keep-alive. The body is not sent,
+ * so Content-Length and Transfer-Encoding go too. Returns 0 or -1.    */
+int  http_prepare_upstream_headers(ParsedRequest* pr);
+
+/* The request will fill the cache, so the origin must send the whole
+ * entity: the client's own preconditions and Range go. With `stored`
+ * (the head of the stale entry being revalidated) its validators are
+ * sent instead: If-None-Match for an ETag, If-Modified-Since for a
+ * Last-Modified. Returns 0 or -1.                                     */
+int  http_prepare_fill_headers(ParsedRequest* pr, const char* stored, size_t stored_len);
+
+#endif /* PROXY_HTTP_H */
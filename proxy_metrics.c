@@ -0,0 +1,448 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_metrics.c      –  per-thread counters, histograms, /stats text
+ *
+ *  Writers: the calling thread's block (thread-local pointer), found or
+ *  made on its first record. Each slot has exactly one writer, so an
+ *  update is a relaxed load + store – no lock prefix, no contention.
+ *
+ *  Readers: walk `blocks` (push-only, so no lock) and sum. Retired
+ *  blocks stay on the list and keep their counts; a new thread takes
+ *  one over from the free list (which is the only lock, and only on a
+ *  thread's first record or its exit).
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_metrics.h"
+#include "proxy_cache.h"
+#include "proxy_codec.h"
+#include "proxy_config.h"
+#include "proxy_disk.h"
+#include "proxy_dns.h"
+#include "proxy_pool.h"
+#include "proxy_slab.h"
+#include "proxy_upstream.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIST_SUB_BITS   4
+#define HIST_SUB        (1u << HIST_SUB_BITS)   /* linear steps per octave */
+#define HIST_BUCKETS    608                     /* up to 2^41 ns           */
+
+typedef struct hist_data {
+    _Atomic uint64_t count, sum;
+    _Atomic uint64_t bucket[HIST_BUCKETS];
+} hist_data;
+
+typedef struct metrics_block {
+    _Alignas(64) _Atomic uint64_t counter[METRIC_COUNTERS];
+    hist_data hist[METRIC_HISTS];
+    struct metrics_block* next;                 /* every block ever made */
+    struct metrics_block* next_free;
+} metrics_block;
+
+static _Atomic(metrics_block*) blocks;
+static metrics_block*  free_blocks;
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   block_key;
+static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
+
+static __thread metrics_block* mine;
+
+
+/*──────────────────── Blocks ───────────────────────────────────────*/
+
+static void block_retire(void* arg)
+{
+    metrics_block* b = (metrics_block*)arg;
+    pthread_mutex_lock(&free_lock);
+    b->next_free = free_blocks;
+    free_blocks = b;
+    pthread_mutex_unlock(&free_lock);
+}
+
+static void key_setup(void)
+{
+    pthread_key_create(&block_key, block_retire);
+}
+
+static metrics_block* block_slow(void)
+{
+    pthread_once(&key_once, key_setup);
+
+    pthread_mutex_lock(&free_lock);
+    metrics_block* b = free_blocks;
+    if (b) free_blocks = b->next_free;
+    pthread_mutex_unlock(&free_lock);
+
+    if (!b) {
+        b = (metrics_block*)aligned_alloc(64, sizeof *b);
+        if (!b) return NULL;
+        memset(b, 0, sizeof *b);
+        b->next = atomic_load(&blocks);
+        while (!atomic_compare_exchange_weak(&blocks, &b->next, b)) {}
+    }
+    pthread_setspecific(block_key, b);
+    mine = b;
+    return b;
+}
+
+static inline metrics_block* block(void)
+{
+    return mine ? mine : block_slow();
+}
+
+/* Single writer per slot: no read-modify-write needed.              */
+static inline void bump(_Atomic uint64_t* slot, uint64_t n)
+{
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+
+/*──────────────────── Recording ────────────────────────────────────*/
+
+static unsigned hist_index(uint64_t v)
+{
+    if (v < HIST_SUB) return (unsigned)v;
+    unsigned b = 63 - (unsigned)__builtin_clzll(v);
+    unsigned i = (b - HIST_SUB_BITS + 1) * HIST_SUB
+               + (unsigned)(v >> (b - HIST_SUB_BITS)) - HIST_SUB;
+    return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+/* Midpoint of bucket i, the value quantiles report.                 */
+static uint64_t hist_value(unsigned i)
+{
+    if (i < 2 * HIST_SUB) return i;
+    unsigned shift = i / HIST_SUB - 1;
+    uint64_t low = (uint64_t)(i % HIST_SUB + HIST_SUB) << shift;
+    return low + ((uint64_t)1 << shift) / 2;
+}
+
+void metric_add(metric_counter c, uint64_t n)
+{
+    metrics_block* b = block();
+    if (b) bump(&b->counter[c], n);
+}
+
+void metric_observe(metric_hist h, uint64_t ns)
+{
+    metrics_block* b = block();
+    if (!b) return;
+    hist_data* d = &b->hist[h];
+    bump(&d->count, 1);
+    bump(&d->sum, ns);
+    bump(&d->bucket[hist_index(ns)], 1);
+}
+
+uint64_t metric_total(metric_counter c)
+{
+    uint64_t sum = 0;
+    for (metrics_block* b = atomic_load(&blocks); b; b = b->next)
+        sum += atomic_load_explicit(&b->counter[c], memory_order_relaxed);
+    return sum;
+}
+
+
+/*──────────────────── Text output ──────────────────────────────────*/
+
+typedef struct text {
+    char*  buf;
+    size_t len, cap;
+    int    failed;
+} text;
+
+static void emit(text* t, const char* fmt, ...)
+{
+    for (;;) {
+        if (t->failed) return;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->buf + t->len, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) { t->failed = 1; return; }
+        if ((size_t)n < t->cap - t->len) { t->len += (size_t)n; return; }
+
+        size_t cap = t->cap * 2 > t->len + (size_t)n + 1 ? t->cap * 2 : t->len + (size_t)n + 1;
+        char* buf = (char*)realloc(t->buf, cap);
+        if (!buf) { t->failed = 1; return; }
+        t->buf = buf;
+        t->cap = cap;
+    }
+}
+
+static void emit_family(text* t, const char* name, const char* type, const char* help)
+{
+    emit(t, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void emit_value(text* t, const char* name, const char* type, const char* help,
+                       uint64_t value)
+{
+    emit_family(t, name, type, help);
+    emit(t, "%s %llu\n", name, (unsigned long long)value);
+}
+
+/* Counters that share a family are adjacent, told apart by label.    */
+static const struct counter_desc {
+    metric_counter c;
+    const char*    name;
+    const char*    label;           /* NULL → unlabelled                 */
+    const char*    help;
+} counter_descs[] = {
+    { M_CONN_OPENED,       "proxy_connections_total",    NULL,                  "Client connections accepted." },
+    { M_REQUESTS,          "proxy_requests_total",       NULL,                  "Request header blocks parsed." },
+    { M_CACHE_HITS,        "proxy_cache_lookups_total",  "result=\"hit\"",      "Cache lookups by outcome." },
+    { M_CACHE_STALE,       "proxy_cache_lookups_total",  "result=\"stale\"",    NULL },
+    { M_CACHE_COALESCED,   "proxy_cache_lookups_total",  "result=\"coalesced\"", NULL },
+    { M_CACHE_DISK_HITS,   "proxy_cache_lookups_total",  "result=\"disk\"",     NULL },
+    { M_CACHE_MISSES,      "proxy_cache_lookups_total",  "result=\"miss\"",     NULL },
+    { M_CACHE_REVALIDATE,  "proxy_cache_lookups_total",  "result=\"revalidate\"", NULL },
+    { M_REVALIDATED,       "proxy_cache_revalidations_total", "result=\"not_modified\"", "Stale entries revalidated, by origin answer." },
+    { M_REFETCHED,         "proxy_cache_revalidations_total", "result=\"modified\"", NULL },
+    { M_BYTES_CLIENT,      "proxy_relayed_bytes_total",  "direction=\"to_client\"", "Response bytes moved." },
+    { M_BYTES_ORIGIN,      "proxy_relayed_bytes_total",  "direction=\"from_origin\"", NULL },
+    { M_UPSTREAM_CONNECTS, "proxy_upstream_connects_total", NULL,               "Fresh origin connections." },
+    { M_UPSTREAM_REUSES,   "proxy_upstream_reuses_total",   NULL,               "Requests sent on a pooled origin socket." },
+    { M_UPSTREAM_FAILURES, "proxy_upstream_failures_total", NULL,               "Origin resolve or connect failures." },
+    { M_ERROR_RESPONSES,   "proxy_error_responses_total",   NULL,               "Error pages generated by the proxy." },
+    { M_TUNNELS_OPENED,    "proxy_tunnels_total",           NULL,               "CONNECT tunnels established." },
+    { M_TUNNEL_TIMEOUTS,   "proxy_tunnel_timeouts_total",   NULL,               "CONNECT tunnels closed for sitting idle." },
+    { M_BYTES_TUNNEL_UP,   "proxy_tunnel_bytes_total",   "direction=\"to_origin\"", "Bytes relayed through CONNECT tunnels." },
+    { M_BYTES_TUNNEL_DOWN, "proxy_tunnel_bytes_total",   "direction=\"to_client\"", NULL },
+    { M_CONFIG_RELOADS,    "proxy_config_reloads_total", "result=\"applied\"",  "Config reloads, by outcome." },
+    { M_CONFIG_REJECTED,   "proxy_config_reloads_total", "result=\"rejected\"", NULL },
+};
+
+static const struct hist_desc {
+    const char* name;
+    const char* help;
+} hist_descs[METRIC_HISTS] = {
+    [H_PARSE]            = { "proxy_parse_seconds",            "Request header parse time." },
+    [H_CACHE_LOOKUP]     = { "proxy_cache_lookup_seconds",     "Cache lookup time, disk tier included." },
+    [H_UPSTREAM_CONNECT] = { "proxy_upstream_connect_seconds", "Fresh origin connect time, after DNS." },
+    [H_DNS_RESOLVE]      = { "proxy_dns_resolve_seconds",      "Resolver backend time per lookup." },
+    [H_REQUEST]          = { "proxy_request_seconds",          "Request latency, request received to last byte sent." },
+};
+
+static void emit_summary(text* t, const struct hist_desc* d, const uint64_t* bucket,
+                         uint64_t count, uint64_t sum)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    emit_family(t, d->name, "summary", d->help);
+    unsigned i = 0;
+    uint64_t seen = 0;
+    for (size_t q = 0; q < sizeof quantiles / sizeof quantiles[0]; ++q) {
+        uint64_t rank = (uint64_t)(quantiles[q] * (double)count + 0.5);
+        if (rank == 0) rank = 1;
+        while (i < HIST_BUCKETS && seen + bucket[i] < rank) seen += bucket[i++];
+        double v = count && i < HIST_BUCKETS ? (double)hist_value(i) * 1e-9 : 0;
+        emit(t, "%s{quantile=\"%g\"} %.9g\n", d->name, quantiles[q], v);
+    }
+    emit(t, "%s_sum %.9g\n%s_count %llu\n", d->name, (double)sum * 1e-9,
+         d->name, (unsigned long long)count);
+}
+
+static void emit_metrics(text* t)
+{
+    uint64_t counter[METRIC_COUNTERS] = { 0 };
+    uint64_t* bucket = (uint64_t*)calloc((size_t)METRIC_HISTS * HIST_BUCKETS, sizeof *bucket);
+    uint64_t count[METRIC_HISTS] = { 0 }, sum[METRIC_HISTS] = { 0 };
+    if (!bucket) { t->failed = 1; return; }
+
+    for (metrics_block* b = atomic_load(&blocks); b; b = b->next) {
+        for (unsigned c = 0; c < METRIC_COUNTERS; ++c)
+            counter[c] += atomic_load_explicit(&b->counter[c], memory_order_relaxed);
+        for (unsigned h = 0; h < METRIC_HISTS; ++h) {
+            hist_data* d = &b->hist[h];
+            count[h] += atomic_load_explicit(&d->count, memory_order_relaxed);
+            sum[h] += atomic_load_explicit(&d->sum, memory_order_relaxed);
+            for (unsigned i = 0; i < HIST_BUCKETS; ++i)
+                bucket[h * HIST_BUCKETS + i] += atomic_load_explicit(&d->bucket[i],
+                                                                     memory_order_relaxed);
+        }
+    }
+
+    uint64_t closed = counter[M_CONN_CLOSED];
+    emit_value(t, "proxy_connections_active", "gauge", "Client connections open now.",
+               counter[M_CONN_OPENED] > closed ? counter[M_CONN_OPENED] - closed : 0);
+    closed = counter[M_TUNNELS_CLOSED];
+    emit_value(t, "proxy_tunnels_active", "gauge", "CONNECT tunnels open now.",
+               counter[M_TUNNELS_OPENED] > closed ? counter[M_TUNNELS_OPENED] - closed : 0);
+
+    for (size_t i = 0; i < sizeof counter_descs / sizeof counter_descs[0]; ++i) {
+        const struct counter_desc* d = &counter_descs[i];
+        if (d->help) emit_family(t, d->name, "counter", d->help);
+        if (d->label) emit(t, "%s{%s} %llu\n", d->name, d->label, (unsigned long long)counter[d->c]);
+        else          emit(t, "%s %llu\n", d->name, (unsigned long long)counter[d->c]);
+    }
+
+    for (unsigned h = 0; h < METRIC_HISTS; ++h)
+        emit_summary(t, &hist_descs[h], bucket + (size_t)h * HIST_BUCKETS, count[h], sum[h]);
+    free(bucket);
+}
+
+/* The modules' own statistics, as gauges and counters.              */
+static void emit_module_stats(text* t)
+{
+    emit_value(t, "proxy_config_generation", "gauge", "Config snapshot in force.",
+               config_get()->generation);
+
+    cache_stats cs;
+    cache_get_stats(&cs);
+    emit_value(t, "proxy_cache_entries", "gauge", "Entries in the RAM cache.", cs.entries);
+    emit_value(t, "proxy_cache_bytes", "gauge", "Bytes charged to the RAM cache.", cs.bytes);
+    emit_value(t, "proxy_cache_capacity_bytes", "gauge", "RAM cache budget.", cs.capacity);
+    emit_value(t, "proxy_cache_evictions_total", "counter", "Entries evicted for space.", cs.evictions);
+    emit_family(t, "proxy_cache_admission_rejected_total", "counter",
+                "New entries not kept, by why.");
+    emit(t, "proxy_cache_admission_rejected_total{reason=\"frequency\"} %llu\n",
+         (unsigned long long)cs.rejected);
+    emit(t, "proxy_cache_admission_rejected_total{reason=\"size\"} %llu\n",
+         (unsigned long long)cs.oversize);
+    if (cs.admission != CACHE_ADMIT_LRU)
+        emit_value(t, "proxy_cache_sketch_agings_total", "counter",
+                   "Halvings of the admission frequency sketch.", cs.agings);
+
+    if (codec_enabled()) {
+        codec_stats cd;
+        codec_get_stats(&cd);
+        emit_value(t, "proxy_cache_coded_entries", "gauge", "RAM cache entries stored compressed.",
+                   cs.coded);
+        emit_family(t, "proxy_cache_coded_bytes", "gauge",
+                    "Compressed entries: stored response bytes, and their bodies decoded.");
+        emit(t, "proxy_cache_coded_bytes{form=\"stored\"} %zu\n", cs.coded_bytes);
+        emit(t, "proxy_cache_coded_bytes{form=\"decoded\"} %zu\n", cs.decoded_bytes);
+
+        emit_family(t, "proxy_codec_offers_total", "counter", "Finished fills offered for compression.");
+        emit(t, "proxy_codec_offers_total{result=\"compressed\"} %llu\n",
+             (unsigned long long)cd.compressed);
+        emit(t, "proxy_codec_offers_total{result=\"skipped\"} %llu\n",
+             (unsigned long long)cd.skipped);
+        emit(t, "proxy_codec_offers_total{result=\"dropped\"} %llu\n",
+             (unsigned long long)cd.dropped);
+        emit_family(t, "proxy_codec_served_total", "counter",
+                    "Responses from compressed entries, by what the client got.");
+        emit(t, "proxy_codec_served_total{form=\"stored\"} %llu\n",
+             (unsigned long long)cd.served_coded);
+        emit(t, "proxy_codec_served_total{form=\"decoded\"} %llu\n",
+             (unsigned long long)cd.served_decoded);
+
+        /* Per-entry ratio, body before / after, as a histogram.      */
+        emit_family(t, "proxy_codec_ratio", "histogram", "Compression ratio of each entry compressed.");
+        uint64_t seen = 0;
+        for (unsigned b = 0; b < CODEC_RATIO_BUCKETS; ++b) {
+            seen += cd.ratio[b];
+            if (b < CODEC_RATIO_BUCKETS - 1)
+                emit(t, "proxy_codec_ratio_bucket{le=\"%g\"} %llu\n", codec_ratio_bounds[b],
+                     (unsigned long long)seen);
+            else
+                emit(t, "proxy_codec_ratio_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)seen);
+        }
+        emit(t, "proxy_codec_ratio_sum %.6g\nproxy_codec_ratio_count %llu\n", cd.ratio_sum,
+             (unsigned long long)cd.compressed);
+        emit_family(t, "proxy_codec_body_bytes_total", "counter",
+                    "Bodies compressed, before and after.");
+        emit(t, "proxy_codec_body_bytes_total{form=\"decoded\"} %llu\n",
+             (unsigned long long)cd.body_in);
+        emit(t, "proxy_codec_body_bytes_total{form=\"stored\"} %llu\n",
+             (unsigned long long)cd.body_out);
+    }
+
+    slab_stats ss;
+    slab_get_stats(&ss);
+    emit_value(t, "proxy_slab_footprint_bytes", "gauge", "Resident slab memory.", ss.footprint);
+    emit_value(t, "proxy_slab_allocated_bytes", "gauge", "Slab bytes handed out.", ss.allocated);
+    emit_value(t, "proxy_slab_requested_bytes", "gauge", "Bytes callers asked for.", ss.requested);
+    emit_value(t, "proxy_slab_pages", "gauge", "Mapped slab pages, spares included.", ss.pages);
+    emit_value(t, "proxy_slab_large_objects", "gauge", "Objects with their own mapping.", ss.large);
+
+    upstream_stats us;
+    upstream_get_stats(&us);
+    emit_value(t, "proxy_upstream_idle", "gauge", "Idle pooled origin sockets.", us.idle);
+    emit_value(t, "proxy_upstream_stale_total", "counter", "Pooled sockets found dead.", us.stale);
+    emit_value(t, "proxy_upstream_evicted_total", "counter", "Pooled sockets closed for the limits.",
+               us.evicted);
+
+    dns_stats dn;
+    dns_get_stats(&dn);
+    emit_value(t, "proxy_dns_entries", "gauge", "Names in the resolver cache.", dn.entries);
+    emit_family(t, "proxy_dns_lookups_total", "counter", "Name lookups by outcome.");
+    emit(t, "proxy_dns_lookups_total{result=\"hit\"} %llu\n", (unsigned long long)dn.hits);
+    emit(t, "proxy_dns_lookups_total{result=\"negative\"} %llu\n",
+         (unsigned long long)dn.negative_hits);
+    emit(t, "proxy_dns_lookups_total{result=\"coalesced\"} %llu\n",
+         (unsigned long long)dn.coalesced);
+    emit(t, "proxy_dns_lookups_total{result=\"miss\"} %llu\n", (unsigned long long)dn.misses);
+    emit_value(t, "proxy_dns_failures_total", "counter", "Backend lookups that found no address.",
+               dn.failures);
+
+    pool_stats ps;
+    pool_get_stats(&ps);
+    if (ps.workers) {
+        emit_value(t, "proxy_pool_workers", "gauge", "Worker threads (threaded front end).",
+                   ps.workers);
+        emit_value(t, "proxy_pool_queued", "gauge", "Tasks waiting for a worker.",
+                   (uint64_t)ps.queued);
+        emit_value(t, "proxy_pool_tasks_total", "counter", "Tasks run.", ps.executed);
+        emit_value(t, "proxy_pool_injected_total", "counter",
+                   "Tasks submitted from outside the pool.", ps.injected);
+        emit_value(t, "proxy_pool_steals_total", "counter",
+                   "Tasks taken from another worker's deque.", ps.stolen);
+        emit_value(t, "proxy_pool_helped_total", "counter",
+                   "Tasks run by a worker waiting on a cache fill.", ps.helped);
+    }
+
+    if (disk_enabled()) {
+        disk_stats ds;
+        disk_get_stats(&ds);
+        emit_value(t, "proxy_disk_entries", "gauge", "Objects in the disk tier.", ds.entries);
+        emit_value(t, "proxy_disk_bytes", "gauge", "Bytes in the disk tier.", ds.bytes);
+        emit_value(t, "proxy_disk_segments", "gauge", "Disk tier segment files.", ds.segments);
+        emit_value(t, "proxy_disk_demoted_total", "counter", "Objects written behind.", ds.demoted);
+        emit_value(t, "proxy_disk_dropped_total", "counter", "Demotions lost to a full queue.",
+                   ds.dropped);
+    }
+}
+
+char* metrics_render(size_t* len)
+{
+    text t = { (char*)malloc(8192), 0, 8192, 0 };
+    if (!t.buf) return NULL;
+    emit_metrics(&t);
+    emit_module_stats(&t);
+    if (t.failed) { free(t.buf); return NULL; }
+    *len = t.len;
+    return t.buf;
+}
+
+char* metrics_response(size_t* len)
+{
+    size_t body_len;
+    char* body = metrics_render(&body_len);
+    if (!body) return NULL;
+
+    text t = { (char*)malloc(body_len + 256), 0, body_len + 256, 0 };
+    if (t.buf) {
+        emit(&t, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 "Content-Length: %zu\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n",
+             body_len);
+        if (!t.failed && t.cap - t.len >= body_len) {
+            memcpy(t.buf + t.len, body, body_len);
+            t.len += body_len;
+        }
+        else {
+            t.failed = 1;
+        }
+    }
+    free(body);
+    if (!t.buf || t.failed) { free(t.buf); return NULL; }
+    *len = t.len;
+    return t.buf;
+}
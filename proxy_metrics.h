@@ -0,0 +1,100 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_metrics.h
+ *
+ *  Hot-path counters and latency histograms, and the /stats page that
+ *  shows them.
+ *
+ *  Every thread that records gets its own cache-line aligned block, so
+ *  a record is a plain load + store on memory no other thread writes –
+ *  no lock, no atomic read-modify-write, no false sharing. Blocks are
+ *  never freed: a thread that exits hands its block to the next one,
+ *  counts and all, so totals stay monotonic. A reader walks the block
+ *  list and sums with relaxed loads; it may see a record half a beat
+ *  late, never a torn or lost one.
+ *
+ *  Histograms are HDR-style: 16 linear sub-buckets per power of two of
+ *  nanoseconds, i.e. any value is known to within 6.25 %, from 1 ns to
+ *  about 18 minutes, in 608 fixed buckets per histogram.
+ *
+ *  metrics_render() produces Prometheus text format, together with the
+ *  cache, compression, slab, upstream pool, resolver, worker pool and
+ *  disk tier statistics. The front ends serve it for "GET /stats" (origin-form,
+ *  i.e. the proxy itself is the server) from loopback clients.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_METRICS_H
+#define PROXY_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define PROXY_STATS_PATH    "/stats"
+
+typedef enum metric_counter {
+    M_CONN_OPENED,                  /* client connections accepted       */
+    M_CONN_CLOSED,
+    M_REQUESTS,                     /* header blocks parsed              */
+    M_CACHE_HITS,                   /* COMPLETE entry in RAM             */
+    M_CACHE_STALE,                  /* stale one, revalidating behind it */
+    M_CACHE_COALESCED,              /* joined a fill in progress         */
+    M_CACHE_DISK_HITS,              /* promoted from the disk tier       */
+    M_CACHE_MISSES,                 /* became the filler, or uncached    */
+    M_CACHE_REVALIDATE,             /* stale: asking the origin first    */
+    M_REVALIDATED,                  /* origin answered 304               */
+    M_REFETCHED,                    /* origin sent a new response        */
+    M_BYTES_CLIENT,                 /* response bytes sent to clients    */
+    M_BYTES_ORIGIN,                 /* response bytes read from origins  */
+    M_UPSTREAM_CONNECTS,            /* fresh origin connections          */
+    M_UPSTREAM_REUSES,              /* requests sent on a pooled socket  */
+    M_UPSTREAM_FAILURES,            /* resolve / connect failed          */
+    M_ERROR_RESPONSES,              /* canned 4xx/5xx pages sent         */
+    M_TUNNELS_OPENED,               /* CONNECT tunnels established       */
+    M_TUNNELS_CLOSED,
+    M_TUNNEL_TIMEOUTS,              /* …closed for sitting idle          */
+    M_BYTES_TUNNEL_UP,              /* tunnelled client → origin bytes   */
+    M_BYTES_TUNNEL_DOWN,            /* tunnelled origin → client bytes   */
+    M_CONFIG_RELOADS,               /* SIGHUP: new snapshot published    */
+    M_CONFIG_REJECTED,              /*   …file bad, old snapshot kept    */
+    METRIC_COUNTERS
+} metric_counter;
+
+typedef enum metric_hist {
+    H_PARSE,                        /* header block, summed over feeds   */
+    H_CACHE_LOOKUP,                 /* proxy_cache_open(), disk included */
+    H_UPSTREAM_CONNECT,             /* fresh connect: start → established */
+    H_DNS_RESOLVE,                  /* resolver backend, per lookup      */
+    H_REQUEST,                      /* request received → last byte out  */
+    METRIC_HISTS
+} metric_hist;
+
+/* Monotonic nanoseconds, for the start/end pairs fed to observe().   */
+static inline uint64_t metric_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void   metric_add(metric_counter c, uint64_t n);
+void   metric_observe(metric_hist h, uint64_t ns);
+
+static inline void metric_inc(metric_counter c)  { metric_add(c, 1); }
+
+/* Latency from `start` (metric_now()) to now.                        */
+static inline void metric_since(metric_hist h, uint64_t start)
+{
+    metric_observe(h, metric_now() - start);
+}
+
+/* Sum of a counter over all threads.                                 */
+uint64_t metric_total(metric_counter c);
+
+/* Whole /stats body in a malloc'd buffer; *len is its length.        */
+char*  metrics_render(size_t* len);
+
+/* The HTTP response for GET /stats (malloc'd, headers included), or
+ * NULL when out of memory.                                           */
+char*  metrics_response(size_t* len);
+
+#endif /* PROXY_METRICS_H */
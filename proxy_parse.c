@@ -2,8 +2,9 @@
  *  proxy_parse.c      –  *implementation* of the light HTTP parser
  *
  *  Design goals:
- *      • Tiny – <300 LOC.
- *      • No libc extensions – only ISO C17 + <ctype.h>.
+ *      • Tiny – one pass, views instead of copies: a request parses
+ *        with one allocation (arena) or none (in place).
+ *      • No libc extensions – only ISO C17 + <ctype.h> (+ POSIX names).
  *      • Forgiving – skips malformed headers instead of aborting.
  *
  *  Windows quirks:
@@ -12,17 +13,24 @@
 
 #define _CRT_SECURE_NO_WARNINGS      /* allow sscanf/strcpy on MSVC   */
 #include "proxy_parse.h"
+#include "proxy_scan.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <limits.h>
 
  /*──────────────────── Cross-platform helpers ───────────────────────*/
 #ifdef _WIN32
 #   define strncasecmp _strnicmp
 #   define strcasecmp  _stricmp
+#else
+#   include <strings.h>
+#   define _strdup     strdup
+#   define strtok_s    strtok_r
 #endif
 
 /* malloc wrapper that *exits* on OOM so callers stay clean. */
@@ -33,14 +41,37 @@ static void* xcalloc(size_t count, size_t bytes_each)
     return ptr;
 }
 
-/* Grow header array if needed. */
+/* Path used when the URL has none (“http://host”). Never freed.      */
+static char default_path[] = "/";
+
+/* 1 if p is a view into the backing buffer (or a static), i.e. NOT
+ * something destroy/set/remove should free.                         */
+static int is_view(const ParsedRequest* pr, const char* p)
+{
+    if (p == default_path) return 1;
+    return pr->buf && p >= pr->buf && p <= pr->buf + pr->buf_length;
+}
+
+static void free_owned(const ParsedRequest* pr, char* p)
+{
+    if (p && !is_view(pr, p)) free(p);
+}
+
+/* Grow header array if needed (inline slots first, then the heap). */
 static int ensure_header_capacity(ParsedRequest* req, size_t want)
 {
     if (want <= req->headers_capacity) return 0;
     size_t new_cap = req->headers_capacity ? req->headers_capacity * 2 : 4;
     while (new_cap < want) new_cap *= 2;
 
-    ParsedHeader* tmp = realloc(req->headers, new_cap * sizeof * tmp);
+    ParsedHeader* tmp;
+    if (req->headers == req->inline_headers) {
+        tmp = malloc(new_cap * sizeof * tmp);
+        if (tmp) memcpy(tmp, req->inline_headers, req->headers_in_use * sizeof * tmp);
+    }
+    else {
+        tmp = realloc(req->headers, new_cap * sizeof * tmp);
+    }
     if (!tmp) return -1;
 
     req->headers = tmp;
@@ -48,111 +79,421 @@ static int ensure_header_capacity(ParsedRequest* req, size_t want)
     return 0;
 }
 
-/*──────────────────── Public API implementation ────────────────────*/
-ParsedRequest* ParsedRequest_create(void)
+/*──────────────────── Line tokenisers (work in place) ──────────────*/
+
+/* CONNECT's authority-form target, “host:port” or “[v6]:port”, from
+ * url up to end (a NUL). The port is required; there is no path.    */
+static int parse_authority(ParsedRequest* pr, char* url, char* end)
 {
-    return (ParsedRequest*)xcalloc(1, sizeof(ParsedRequest));
+    char* colon;
+    char* host = url;
+    size_t host_len;
+    if (*url == '[') {
+        char* close = memchr(url, ']', (size_t)(end - url));
+        if (!close || close[1] != ':') return -1;
+        host = url + 1;
+        host_len = (size_t)(close - host);
+        colon = close + 1;
+    }
+    else {
+        colon = end;
+        while (colon > url && *--colon != ':') {}
+        if (*colon != ':') return -1;
+        host_len = (size_t)(colon - url);
+    }
+
+    char* port = colon + 1;
+    size_t port_len = (size_t)(end - port);
+    if (host_len == 0 || port_len == 0 || port_len > 5) return -1;
+    for (size_t i = 0; i < port_len; ++i)
+        if (port[i] < '0' || port[i] > '9') return -1;
+    if (atoi(port) == 0 || atoi(port) > 65535) return -1;
+
+    host[host_len] = '\0';                       /* the ':' or ']'    */
+    pr->protocol = NULL;        pr->protocol_length = 0;
+    pr->host = host;            pr->host_length = host_len;
+    pr->port = port;            pr->port_length = port_len;
+    pr->path = NULL;            pr->path_length = 0;
+    return 0;
 }
 
-void ParsedRequest_destroy(ParsedRequest* pr)
+/* “METHOD SP http://host[:port][/path] SP VERSION”, line[len] is the
+ * CR/LF that ends it and sp1/sp2 are its first two spaces. Inserts
+ * NULs; shifts host/port one byte left into the “//” so every token
+ * can be terminated without copying. An origin-form target (“/path”,
+ * a request for the proxy itself) leaves protocol/host/port NULL; a
+ * CONNECT takes “host:port” instead (parse_authority()).            */
+static int parse_request_line(ParsedRequest* pr, char* line, size_t len,
+                              char* sp1, char* sp2)
 {
-    if (!pr) return;
+    char* end = line + len;
+    if (sp1 == line || sp2 == sp1 + 1 || sp2 + 1 >= end) return -1;
+    char* url = sp1 + 1;
+
+    pr->raw_request_line = line;
+    pr->raw_request_line_length = len;
+
+    *sp1 = '\0';
+    *sp2 = '\0';
+    *end = '\0';
+    pr->method = line;          pr->method_length = (size_t)(sp1 - line);
+    pr->version = sp2 + 1;      pr->version_length = (size_t)(end - sp2 - 1);
+
+    if (pr->method_length == 7 && memcmp(line, "CONNECT", 7) == 0)
+        return parse_authority(pr, url, sp2);
+
+    if (*url == '/') {
+        pr->protocol = pr->host = pr->port = NULL;
+        pr->protocol_length = pr->host_length = pr->port_length = 0;
+        pr->path = url;         pr->path_length = (size_t)(sp2 - url);
+        return 0;
+    }
 
-    for (size_t i = 0; i < pr->headers_in_use; ++i) {
-        free(pr->headers[i].key);
-        free(pr->headers[i].value);
+    /*─────────────────── Decompose absolute URL ───────────────────*/
+    if (sp2 - url < 7 || strncasecmp(url, "http://", 7) != 0) return -1;
+    url[4] = '\0';                               /* “http”           */
+    pr->protocol = url;         pr->protocol_length = 4;
+
+    char* hostport = url + 7;
+    char* path_start = memchr(hostport, '/', (size_t)(sp2 - hostport));
+    char* hp_end = path_start ? path_start : sp2;
+    char* colon = memchr(hostport, ':', (size_t)(hp_end - hostport));
+
+    size_t host_len = (size_t)((colon ? colon : hp_end) - hostport);
+    if (host_len == 0) return -1;
+    memmove(url + 6, hostport, host_len);        /* over the 2nd '/' */
+    pr->host = url + 6;         pr->host_length = host_len;
+    pr->host[host_len] = '\0';
+
+    if (colon) {
+        size_t port_len = (size_t)(hp_end - colon - 1);
+        memmove(colon, colon + 1, port_len);
+        colon[port_len] = '\0';
+        pr->port = colon;       pr->port_length = port_len;
+    }
+    else {
+        pr->port = NULL;                         /* implies :80      */
+        pr->port_length = 0;
     }
-    free(pr->headers);
 
-    free(pr->method);
-    free(pr->protocol);
-    free(pr->host);
-    free(pr->port);
-    free(pr->path);
-    free(pr->version);
-    free(pr->raw_request_line);
+    if (path_start) {
+        pr->path = path_start;  pr->path_length = (size_t)(sp2 - path_start);
+    }
+    else {
+        pr->path = default_path; pr->path_length = 1;
+    }
+    return 0;
+}
 
-    free(pr);
+/* Classify pr->headers[i] and index it if it is the first of its id. */
+static void index_header(ParsedRequest* pr, size_t i)
+{
+    ParsedHeader* hdr = &pr->headers[i];
+    hdr->id = http_header_lookup(hdr->key, hdr->key_length);
+    if (hdr->id != HDR_UNKNOWN && !pr->header_index[hdr->id] && i < USHRT_MAX)
+        pr->header_index[hdr->id] = (unsigned short)(i + 1);
 }
 
-int ParsedRequest_parse(ParsedRequest* pr, const char* buf, int buflen)
+/* “Key: value”, line[len] is the CR/LF that ends it, colon its first ':'. */
+static int parse_header_line(ParsedRequest* pr, char* line, size_t len, char* colon)
 {
-    if (!pr || !buf || buflen <= 0) return -1;
+    char* value = colon + 1;
+    char* end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) ++value;
+
+    if (ensure_header_capacity(pr, pr->headers_in_use + 1) < 0) return -1;
+    ParsedHeader* hdr = &pr->headers[pr->headers_in_use++];
+
+    *colon = '\0';
+    *end = '\0';
+    hdr->key = line;            hdr->key_length = (size_t)(colon - line);
+    hdr->value = value;         hdr->value_length = (size_t)(end - value);
+    index_header(pr, pr->headers_in_use - 1);
+    return 0;
+}
 
-    /*─────────────────── 1) Slice out request-line ─────────────────*/
-    const char* eol = strstr(buf, "\r\n");
-    if (!eol) return -1;                         /* must end in CRLF */
+/*──────────────────── Structural walk ──────────────────────────────*/
+/*
+ *  The scanner (proxy_scan.c) marks line ends and delimiters in two
+ *  bitmaps. We hop from LF to LF; for each line we pull from the
+ *  delimiter map only what it still needs – the request line's two
+ *  spaces or a header's first colon – and stop there, so the spaces
+ *  inside header values are never visited. Text between marked bytes
+ *  is never looked at at all.
+ *
+ *  Everything the walk needs to resume lives in pr->cursor, so bytes
+ *  that arrive later are scanned from cursor.scanned onwards and the
+ *  walk picks up mid-line exactly where it stopped.
+ */
+#define SCAN_WINDOW  4096           /* bytes per stack bitmap pair     */
+#define NO_OFFSET    ((size_t)-1)
+
+static void cursor_init(ParseCursor* pc)
+{
+    memset(pc, 0, sizeof *pc);
+    pc->colon = NO_OFFSET;
+}
 
-    pr->raw_request_line_length = (size_t)(eol - buf);
-    pr->raw_request_line = (char*)xcalloc(1, pr->raw_request_line_length + 1);
-    memcpy(pr->raw_request_line, buf, pr->raw_request_line_length);
+/* First set bit of map in [from, to) (window-relative), else `to`.  */
+static size_t next_bit(const uint64_t* map, size_t from, size_t to)
+{
+    while (from < to) {
+        uint64_t m = map[from >> 6] & (~0ull << (from & 63));
+        if (m) {
+            size_t p = (from & ~(size_t)63) + scan_ctz64(m);
+            return p < to ? p : to;
+        }
+        from = (from | 63) + 1;
+    }
+    return to;
+}
 
-    /* Tokenise: METHOD  SP  URL  SP  VERSION */
-    char* saveptr = NULL;
-    char* token = strtok_s(pr->raw_request_line, " ", &saveptr);
-    if (!token) return -1;
-    pr->method = _strdup(token);
+/* Note the delimiters the current line still needs from [from, to). */
+static void take_delims(const char* buf, const uint64_t* delims, size_t base,
+                        ParseCursor* pc, size_t from, size_t to)
+{
+    if (pc->lines == 0 ? pc->spaces == 2 : pc->colon != NO_OFFSET) return;
 
-    token = strtok_s(NULL, " ", &saveptr);
-    if (!token) return -1;
-    char* full_url = token;                      /* still holds scheme */
+    for (size_t i = next_bit(delims, from, to); i < to; i = next_bit(delims, i + 1, to)) {
+        char c = buf[base + i];
+        if (pc->lines == 0) {
+            if (c == ' ' && (pc->sp[pc->spaces++] = base + i, pc->spaces == 2)) return;
+        }
+        else if (c == ':') {
+            pc->colon = base + i;
+            return;
+        }
+    }
+}
 
-    token = strtok_s(NULL, "\r", &saveptr);
-    if (!token) return -1;
-    pr->version = _strdup(token);
+/* LF at offset p closes the current line: 1 → blank line (end of
+ * headers), -1 → malformed, 0 → keep going.                         */
+static int end_line(ParsedRequest* pr, char* buf, ParseCursor* pc, size_t p)
+{
+    size_t end = (p > pc->line_start && buf[p - 1] == '\r') ? p - 1 : p;
+    char*  line = buf + pc->line_start;
+    size_t len = end - pc->line_start;
+    int    rc = 0;
+
+    if (pc->lines == 0) {
+        if (len == 0) { pc->line_start = p + 1; return 0; }   /* stray CRLF */
+        rc = pc->spaces == 2
+            ? parse_request_line(pr, line, len, buf + pc->sp[0], buf + pc->sp[1])
+            : -1;
+    }
+    else if (len == 0) {
+        rc = 1;
+    }
+    else if (pc->colon != NO_OFFSET) {
+        rc = parse_header_line(pr, line, len, buf + pc->colon);
+    }                                            /* else skip junk   */
+
+    ++pc->lines;
+    pc->line_start = p + 1;
+    pc->colon = NO_OFFSET;
+    pc->spaces = 0;
+    return rc;
+}
 
-    /*─────────────────── 2) Decompose absolute URL ─────────────────*/
-    if (strncasecmp(full_url, "http://", 7) != 0) return -1;
-    full_url += 7;                               /* skip 'http://'   */
+/* Walk pr->buf[cursor.scanned, buf_length). On PARSE_DONE
+ * cursor.scanned is the length of the header block.                 */
+static int parse_advance(ParsedRequest* pr)
+{
+    uint64_t lines[SCAN_WINDOW / 64], delims[SCAN_WINDOW / 64];
+    ParseCursor* pc = &pr->cursor;
+    char* buf = pr->buf;
+
+    if (pc->done) return PARSE_DONE;
+
+    while (pc->scanned < pr->buf_length) {
+        size_t base = pc->scanned;
+        size_t left = pr->buf_length - base;
+        size_t n = left < SCAN_WINDOW ? left : SCAN_WINDOW;
+        scan_structural(buf + base, n, lines, delims);
+
+        for (size_t p = next_bit(lines, 0, n); p < n; p = next_bit(lines, p + 1, n)) {
+            if (buf[base + p] != '\n') continue;                /* CR */
+            take_delims(buf, delims, base, pc,
+                        pc->line_start > base ? pc->line_start - base : 0, p);
+            int rc = end_line(pr, buf, pc, base + p);
+            if (rc < 0) return PARSE_ERROR;
+            if (rc > 0) {
+                pc->scanned = base + p + 1;
+                pc->done = 1;
+                return PARSE_DONE;
+            }
+        }
+        if (pc->line_start < base + n)            /* line runs on    */
+            take_delims(buf, delims, base, pc,
+                        pc->line_start > base ? pc->line_start - base : 0, n);
+        pc->scanned = base + n;
+    }
+    return PARSE_NEED_MORE;
+}
 
-    char* path_start = strchr(full_url, '/');   /* host[:port]/path */
-    char* colon_in_hp = strchr(full_url, ':');
+/* Move the views that point into `old` over to `fresh` (same layout). */
+static char* rebase(char* p, const char* old, size_t len, char* fresh)
+{
+    return (p && p >= old && p <= old + len) ? fresh + (p - old) : p;
+}
 
-    if (colon_in_hp && (!path_start || colon_in_hp < path_start)) {
-        *colon_in_hp = '\0';
-        pr->host = _strdup(full_url);
-        pr->port = _strdup(colon_in_hp + 1);
+/* Point every view into pr->buf at the same offset in `fresh`.      */
+static void rebase_views(ParsedRequest* pr, char* fresh)
+{
+    const char* old = pr->buf;
+    size_t len = pr->buf_length;
+    pr->method = rebase(pr->method, old, len, fresh);
+    pr->protocol = rebase(pr->protocol, old, len, fresh);
+    pr->host = rebase(pr->host, old, len, fresh);
+    pr->port = rebase(pr->port, old, len, fresh);
+    pr->path = rebase(pr->path, old, len, fresh);
+    pr->version = rebase(pr->version, old, len, fresh);
+    pr->raw_request_line = rebase(pr->raw_request_line, old, len, fresh);
+    for (size_t i = 0; i < pr->headers_in_use; ++i) {
+        pr->headers[i].key = rebase(pr->headers[i].key, old, len, fresh);
+        pr->headers[i].value = rebase(pr->headers[i].value, old, len, fresh);
     }
-    else {
-        pr->host = _strdup(full_url);
-        pr->port = NULL;                         /* implies :80      */
+}
+
+/* Make room for `more` bytes in pr's arena, keeping every view valid. */
+static int arena_reserve(ParsedRequest* pr, size_t more)
+{
+    size_t want = pr->buf_length + more + 1;                 /* + NUL */
+    if (want <= pr->buf_capacity) return 0;
+
+    size_t cap = pr->buf_capacity ? pr->buf_capacity * 2 : 1024;
+    while (cap < want) cap *= 2;
+    char* fresh = (char*)malloc(cap);
+    if (!fresh) return -1;
+
+    char* old = pr->buf;
+    if (old) {
+        memcpy(fresh, old, pr->buf_length);
+        rebase_views(pr, fresh);
+        free(old);
     }
-    pr->path = _strdup(path_start ? path_start : "/");
-    pr->protocol = _strdup("http");
+    pr->buf = fresh;
+    pr->buf_capacity = cap;
+    pr->buf_owned = 1;
+    return 0;
+}
 
-    /*─────────────────── 3) Parse headers one by one ───────────────*/
-    const char* cursor = eol + 2;                /* skip first CRLF  */
-    while (cursor < buf + buflen &&
-        !(cursor[0] == '\r' && cursor[1] == '\n')) {
+/*──────────────────── Public API implementation ────────────────────*/
+ParsedRequest* ParsedRequest_create(void)
+{
+    ParsedRequest* pr = (ParsedRequest*)xcalloc(1, sizeof(ParsedRequest));
+    pr->headers = pr->inline_headers;
+    pr->headers_capacity = PARSED_INLINE_HEADERS;
+    cursor_init(&pr->cursor);
+    return pr;
+}
 
-        const char* line_end = strstr(cursor, "\r\n");
-        if (!line_end) break;                    /* malformed, bail  */
+void ParsedRequest_reset(ParsedRequest* pr)
+{
+    if (!pr) return;
 
-        const char* colon = memchr(cursor, ':', line_end - cursor);
-        if (!colon) { cursor = line_end + 2; continue; } /* skip junk */
+    for (size_t i = 0; i < pr->headers_in_use; ++i) {
+        free_owned(pr, pr->headers[i].key);
+        free_owned(pr, pr->headers[i].value);
+    }
+    if (pr->headers != pr->inline_headers) free(pr->headers);
+
+    free_owned(pr, pr->method);
+    free_owned(pr, pr->protocol);
+    free_owned(pr, pr->host);
+    free_owned(pr, pr->port);
+    free_owned(pr, pr->path);
+    free_owned(pr, pr->version);
+    if (pr->buf_owned) free(pr->buf);
+
+    memset(pr, 0, offsetof(ParsedRequest, inline_headers));
+    pr->headers = pr->inline_headers;
+    pr->headers_capacity = PARSED_INLINE_HEADERS;
+    cursor_init(&pr->cursor);
+}
 
-        size_t key_len = (size_t)(colon - cursor);
-        size_t val_len = (size_t)(line_end - colon - 1);
+void ParsedRequest_destroy(ParsedRequest* pr)
+{
+    if (!pr) return;
+    ParsedRequest_reset(pr);
+    free(pr);
+}
 
-        ensure_header_capacity(pr, pr->headers_in_use + 1);
-        ParsedHeader* hdr = &pr->headers[pr->headers_in_use++];
+/* Whole-buffer parses: NEED_MORE is fine as long as the request line
+ * made it (callers may hand us a block without its final CRLF).      */
+static int parse_whole(ParsedRequest* pr)
+{
+    int rc = parse_advance(pr);
+    if (rc == PARSE_ERROR) return -1;
+    return pr->cursor.lines ? 0 : -1;
+}
+
+int ParsedRequest_parse_inplace(ParsedRequest* pr, char* buf, int buflen)
+{
+    if (!pr || !buf || buflen <= 0) return -1;
 
-        hdr->key = (char*)xcalloc(1, key_len + 1);
-        hdr->value = (char*)xcalloc(1, val_len + 1);
-        memcpy(hdr->key, cursor, key_len);
-        memcpy(hdr->value, colon + 1, val_len);
+    ParsedRequest_reset(pr);
+    pr->buf = buf;
+    pr->buf_length = (size_t)buflen;
+    pr->buf_owned = 0;
+    return parse_whole(pr);
+}
+
+int ParsedRequest_parse(ParsedRequest* pr, const char* buf, int buflen)
+{
+    if (!pr || !buf || buflen <= 0) return -1;
 
-        /* Trim leading whitespace in value */
-        while (*hdr->value && isspace((unsigned char)*hdr->value))
-            memmove(hdr->value, hdr->value + 1, --val_len + 1);
+    ParsedRequest_reset(pr);
+    if (arena_reserve(pr, (size_t)buflen) < 0) return -1;   /* the one arena */
+    memcpy(pr->buf, buf, (size_t)buflen);
+    pr->buf[buflen] = '\0';
+    pr->buf_length = (size_t)buflen;
+    return parse_whole(pr);
+}
 
-        hdr->key_length = strlen(hdr->key);
-        hdr->value_length = strlen(hdr->value);
+int ParsedRequest_feed(ParsedRequest* pr, const char* chunk, size_t chunk_len,
+                       size_t* consumed)
+{
+    if (consumed) *consumed = 0;
+    if (!pr || (!chunk && chunk_len) || (pr->buf && !pr->buf_owned)) return PARSE_ERROR;
+    if (pr->cursor.done) return PARSE_DONE;
+
+    size_t before = pr->buf_length;
+    if (arena_reserve(pr, chunk_len) < 0) return PARSE_ERROR;
+    memcpy(pr->buf + before, chunk, chunk_len);
+    pr->buf_length += chunk_len;
+    pr->buf[pr->buf_length] = '\0';
+
+    int rc = parse_advance(pr);
+    if (consumed)
+        *consumed = rc == PARSE_DONE ? pr->cursor.scanned - before : chunk_len;
+    return rc;
+}
 
-        cursor = line_end + 2;
+int ParsedRequest_feed_inplace(ParsedRequest* pr, char* buf, size_t buflen,
+                               size_t* consumed)
+{
+    if (consumed) *consumed = 0;
+    if (!pr || !buf) return PARSE_ERROR;
+    if (!pr->buf) {
+        pr->buf = buf;
+        pr->buf_owned = 0;
+    }
+    else if (pr->buf != buf || buflen < pr->buf_length) {
+        return PARSE_ERROR;                      /* not the same stream */
     }
+    pr->buf_length = buflen;
 
-    return 0;
+    int rc = parse_advance(pr);
+    if (consumed) *consumed = rc == PARSE_DONE ? pr->cursor.scanned : buflen;
+    return rc;
+}
+
+void ParsedRequest_rebase(ParsedRequest* pr, char* buf)
+{
+    if (!pr || !pr->buf || pr->buf_owned) return;
+    rebase_views(pr, buf);
+    pr->buf = buf;
 }
 
 /* ───── Helpers that rebuild text from ParsedRequest ───────────────*/
@@ -162,22 +503,34 @@ int ParsedRequest_unparse_headers(ParsedRequest* pr, char* dst, size_t dst_len)
 
     for (size_t i = 0; i < pr->headers_in_use; ++i) {
         ParsedHeader* h = &pr->headers[i];
-        int n = snprintf(dst + written, dst_len - written,
-            "%s:%s\r\n", h->key, h->value);
-        if (n < 0 || (size_t)n >= dst_len - written) return -1;
-        written += (size_t)n;
+        size_t need = h->key_length + 1 + h->value_length + 2;
+        if (written + need > dst_len) return -1;
+        memcpy(dst + written, h->key, h->key_length);
+        written += h->key_length;
+        dst[written++] = ':';
+        memcpy(dst + written, h->value, h->value_length);
+        written += h->value_length;
+        dst[written++] = '\r'; dst[written++] = '\n';
     }
     if (written + 2 > dst_len) return -1;
     dst[written++] = '\r'; dst[written++] = '\n';
+    if (written < dst_len) dst[written] = '\0';
     return (int)written;
 }
 
 int ParsedRequest_unparse(ParsedRequest* pr, char* dst, size_t dst_len)
 {
-    int n = snprintf(dst, dst_len, "%s %s %s\r\n",
-        pr->method, pr->path, pr->version);
-    if (n < 0 || (size_t)n >= dst_len) return -1;
-    return n + ParsedRequest_unparse_headers(pr, dst + n, dst_len - n);
+    size_t n = pr->method_length + 1 + pr->path_length + 1 + pr->version_length + 2;
+    if (n > dst_len) return -1;
+
+    char* p = dst;
+    memcpy(p, pr->method, pr->method_length);   p += pr->method_length;   *p++ = ' ';
+    memcpy(p, pr->path, pr->path_length);       p += pr->path_length;     *p++ = ' ';
+    memcpy(p, pr->version, pr->version_length); p += pr->version_length;
+    *p++ = '\r'; *p++ = '\n';
+
+    int h = ParsedRequest_unparse_headers(pr, dst + n, dst_len - n);
+    return h < 0 ? -1 : (int)n + h;
 }
 
 /* ───── Tiny length helpers (avoid recomputation) ──────────────────*/
@@ -191,51 +544,101 @@ size_t ParsedHeader_headersLen(ParsedRequest* pr)
 }
 size_t ParsedRequest_totalLen(ParsedRequest* pr)
 {
-    return strlen(pr->method) + 1 /* SP */
-        + strlen(pr->path) + 1 /* SP */
-        + strlen(pr->version) + 2 /* CRLF */
+    return pr->method_length + 1 /* SP */
+        + pr->path_length + 1 /* SP */
+        + pr->version_length + 2 /* CRLF */
         + ParsedHeader_headersLen(pr);
 }
 
 /* ───── Header CRUD helpers (case-insensitive keys) ───────────────*/
-ParsedHeader* ParsedHeader_get(ParsedRequest* pr, const char* key)
+/* A name outside the well-known table: scan the unclassified ones.  */
+static ParsedHeader* find_unknown(ParsedRequest* pr, const char* key)
 {
     for (size_t i = 0; i < pr->headers_in_use; ++i)
-        if (strcasecmp(pr->headers[i].key, key) == 0)
+        if (pr->headers[i].id == HDR_UNKNOWN && strcasecmp(pr->headers[i].key, key) == 0)
             return &pr->headers[i];
     return NULL;
 }
 
-int ParsedHeader_set(ParsedRequest* pr, const char* key, const char* val)
+ParsedHeader* ParsedHeader_get(ParsedRequest* pr, const char* key)
+{
+    http_header_id id = http_header_lookup(key, strlen(key));
+    return id != HDR_UNKNOWN ? ParsedHeader_get_id(pr, id) : find_unknown(pr, key);
+}
+
+static int set_header(ParsedRequest* pr, ParsedHeader* hdr, const char* key, const char* val)
 {
-    ParsedHeader* hdr = ParsedHeader_get(pr, key);
+    char* value = _strdup(val);
+    if (!value) return -1;
+
     if (!hdr) {                                             /* new   */
-        ensure_header_capacity(pr, pr->headers_in_use + 1);
+        char* k = _strdup(key);
+        if (!k || ensure_header_capacity(pr, pr->headers_in_use + 1) < 0) {
+            free(k);
+            free(value);
+            return -1;
+        }
         hdr = &pr->headers[pr->headers_in_use++];
-        hdr->key = _strdup(key);
+        hdr->key = k;
+        hdr->key_length = strlen(k);
+        index_header(pr, pr->headers_in_use - 1);
     }
     else {
-        free(hdr->value);
+        free_owned(pr, hdr->value);
     }
-    hdr->value = _strdup(val);
-    hdr->key_length = strlen(hdr->key);
-    hdr->value_length = strlen(hdr->value);
+    hdr->value = value;
+    hdr->value_length = strlen(value);
     return 0;
 }
 
-int ParsedHeader_remove(ParsedRequest* pr, const char* key)
+int ParsedHeader_set(ParsedRequest* pr, const char* key, const char* val)
 {
-    for (size_t i = 0; i < pr->headers_in_use; ++i) {
-        if (strcasecmp(pr->headers[i].key, key) == 0) {
-            free(pr->headers[i].key);
-            free(pr->headers[i].value);
-            memmove(&pr->headers[i], &pr->headers[i + 1],
-                (pr->headers_in_use - i - 1) * sizeof(ParsedHeader));
-            --pr->headers_in_use;
-            return 0;
-        }
+    return set_header(pr, ParsedHeader_get(pr, key), key, val);
+}
+
+int ParsedHeader_set_id(ParsedRequest* pr, http_header_id id, const char* val)
+{
+    return set_header(pr, ParsedHeader_get_id(pr, id), http_header_names[id], val);
+}
+
+/* Drop pr->headers[i]. Only slots after i move, so only their index
+ * entries (and the removed id's, which passes to its next occurrence)
+ * change – found by id, without touching the names.                  */
+static void remove_at(ParsedRequest* pr, size_t i)
+{
+    http_header_id gone = pr->headers[i].id;
+    free_owned(pr, pr->headers[i].key);
+    free_owned(pr, pr->headers[i].value);
+    memmove(&pr->headers[i], &pr->headers[i + 1],
+        (pr->headers_in_use - i - 1) * sizeof(ParsedHeader));
+    --pr->headers_in_use;
+
+    if (gone != HDR_UNKNOWN) pr->header_index[gone] = 0;
+    for (size_t j = i; j < pr->headers_in_use && j + 1 < USHRT_MAX; ++j) {
+        http_header_id id = pr->headers[j].id;
+        if (id == HDR_UNKNOWN) continue;
+        if (pr->header_index[id] == j + 2 || (id == gone && !pr->header_index[id]))
+            pr->header_index[id] = (unsigned short)(j + 1);
     }
-    return -1;
+}
+
+int ParsedHeader_remove(ParsedRequest* pr, const char* key)
+{
+    http_header_id id = http_header_lookup(key, strlen(key));
+    if (id != HDR_UNKNOWN) return ParsedHeader_remove_id(pr, id);
+
+    ParsedHeader* hdr = find_unknown(pr, key);
+    if (!hdr) return -1;
+    remove_at(pr, (size_t)(hdr - pr->headers));
+    return 0;
+}
+
+int ParsedHeader_remove_id(ParsedRequest* pr, http_header_id id)
+{
+    unsigned slot = pr->header_index[id];
+    if (!slot) return -1;
+    remove_at(pr, slot - 1);
+    return 0;
 }
 
 /*──────────────────── Debug printf helper ─────────────────────────*/
@@ -3,7 +3,7 @@
  *
  *  A *minimal but sufficient* HTTP request parser used by our proxy.
  *  – Pure ISO-C17  →  works on Windows / Linux / macOS unchanged
- *  – Only understands absolute-URI GET lines (enough for a teaching proxy)
+ *  – Absolute-URI and origin-form targets, plus CONNECT's “host:port”
  *
  *  Copyright notes:
  *      Skeleton was written for Princeton COS-518 (Matvey Arye).
@@ -14,6 +14,7 @@
 #define PROXY_PARSE_H
 
 #include <stddef.h>     /* size_t */
+#include "proxy_headers.h"
 
  /* Toggle noisy stdout debugging by flipping this to 1. */
 #define DEBUG_PROXY_PARSE  0
@@ -26,6 +27,7 @@
 typedef struct ParsedHeader {
     char* key;            size_t key_length;
     char* value;          size_t value_length;
+    http_header_id id;    /* well-known name, or HDR_UNKNOWN        */
 } ParsedHeader;
 
 /*──────────────────────────────────────────────────────────────────────
@@ -44,28 +46,75 @@ typedef struct ParsedHeader {
  *      port     = "8080"
  *      path     = "/index.html"
  *      version  = "HTTP/1.1"
- *      headers  = {{"Host"," example.com"}, {"Connection"," close"}}
+ *      headers  = {{"Host","example.com"}, {"Connection","close"}}
  *
- *  raw_request_line keeps a *copy* of “GET http://… HTTP/1.1”.
+ *  Every token is a NUL-terminated *view* (pointer + length) into one
+ *  backing buffer: either an arena copy owned by the request
+ *  (ParsedRequest_parse – one allocation) or the caller's own receive
+ *  buffer, split in place (ParsedRequest_parse_inplace – none). Only
+ *  strings later added through ParsedHeader_set() live on the heap.
+ *
+ *  raw_request_line points at “GET http://… HTTP/1.1” inside the backing
+ *  buffer; after tokenising, only raw_request_line_length spans it all.
+ *
+ *  Header names are classified once, as each line is parsed, against
+ *  the well-known names in proxy_headers.h (a generated perfect hash).
+ *  header_index maps each id to its first occurrence, so the *_id
+ *  calls below never compare strings; names outside the table fall
+ *  back to a case-insensitive scan of the unclassified headers only.
  *──────────────────────────────────────────────────────────────────────*/
+#define PARSED_INLINE_HEADERS  32   /* header slots before we malloc   */
+
+/* Results of the resumable parsers (ParsedRequest_feed*).            */
+#define PARSE_ERROR      (-1)
+#define PARSE_DONE         0        /* blank line seen, pr is complete */
+#define PARSE_NEED_MORE    1        /* header block still incomplete   */
+
+/* Where a resumable parse stopped. Private to proxy_parse.c; offsets
+ * are relative to ParsedRequest.buf so they survive arena growth.    */
+typedef struct ParseCursor {
+    size_t scanned;                 /* bytes already classified        */
+    size_t line_start;              /* offset of the current line      */
+    size_t colon;                   /* its first ':' (header lines)    */
+    size_t sp[2];                   /* its first two spaces (req-line) */
+    int    spaces;
+    int    lines;                   /* complete lines consumed         */
+    int    done;
+} ParseCursor;
+
 typedef struct ParsedRequest {
 
     /* ───────── Tokens from the request-line */
     char* method;          /* GET / POST / CONNECT …                */
-    char* protocol;        /* always “http” for this proxy          */
-    char* host;            /* hostname part of URL                  */
+    char* protocol;        /* “http”; NULL for origin-form “/path”  */
+    char* host;            /* hostname part of URL; NULL likewise   */
     char* port;            /* NULL → default 80                     */
-    char* path;            /* resource path, starts with “/”        */
+    char* path;            /* resource path, starts with “/”;
+                              NULL for CONNECT host:port            */
     char* version;         /* “HTTP/1.0” or “HTTP/1.1”              */
 
+    size_t method_length,  protocol_length, host_length,
+           port_length,    path_length,     version_length;
+
     /* ───────── Original request-line (for cheap substring copies)   */
     char* raw_request_line;
     size_t  raw_request_line_length;
 
     /* ───────── Dynamic header array                                 */
-    ParsedHeader* headers;           /* malloc-grown list             */
+    ParsedHeader* headers;           /* inline_headers, or malloc'd   */
     size_t        headers_in_use;    /* number of valid entries       */
     size_t        headers_capacity;  /* slots currently allocated     */
+    unsigned short header_index[HDR__COUNT];  /* id → slot + 1, 0: none */
+
+    /* ───────── Backing store the views above point into             */
+    char*         buf;               /* arena copy or caller's buffer */
+    size_t        buf_length;
+    size_t        buf_capacity;      /* arena bytes (feed grows it)   */
+    int           buf_owned;         /* 1 → arena, freed on destroy   */
+
+    ParseCursor   cursor;            /* resume point for feed()       */
+
+    ParsedHeader  inline_headers[PARSED_INLINE_HEADERS];
 
 } ParsedRequest;
 
@@ -74,12 +123,47 @@ typedef struct ParsedRequest {
 /* Memory lifecycle */
 ParsedRequest* ParsedRequest_create(void);
 void            ParsedRequest_destroy(ParsedRequest* pr);
+void            ParsedRequest_reset(ParsedRequest* pr);   /* reuse pr */
 
-/* From wire-format to struct – returns 0 on success, -1 otherwise. */
+/* From wire-format to struct – returns 0 on success, -1 otherwise.
+ * Copies buffer into a single arena owned by pr.                     */
 int             ParsedRequest_parse(ParsedRequest* pr,
     const char* buffer,
     int           buffer_len);
 
+/* Zero-allocation variant: splits `buffer` in place (writes NULs into
+ * it) and leaves pr pointing into it, so the buffer must outlive pr.  */
+int             ParsedRequest_parse_inplace(ParsedRequest* pr,
+    char* buffer,
+    int           buffer_len);
+
+/* Resumable parsing for header blocks that arrive in pieces. Each
+ * call classifies only the bytes it has not seen before and returns
+ * PARSE_NEED_MORE, PARSE_DONE or PARSE_ERROR. On PARSE_DONE *consumed
+ * says how much of the input belonged to the header block; anything
+ * after it (a body, a pipelined request) is left to the caller.
+ *
+ *  feed          appends `chunk` to an arena owned by pr, grown
+ *                geometrically; *consumed counts bytes of this chunk.
+ *  feed_inplace  `buffer` holds everything received so far and only
+ *                ever grows at the end (same address every call);
+ *                *consumed is the header block length within it.
+ *
+ * Start from a fresh or ParsedRequest_reset() request.               */
+int             ParsedRequest_feed(ParsedRequest* pr,
+    const char* chunk,
+    size_t        chunk_len,
+    size_t* consumed);
+int             ParsedRequest_feed_inplace(ParsedRequest* pr,
+    char* buffer,
+    size_t        buffer_len,
+    size_t* consumed);
+
+/* feed_inplace's buffer moved: its bytes so far, NULs and all, were
+ * copied to `buffer`, and parsing goes on there.                      */
+void            ParsedRequest_rebase(ParsedRequest* pr,
+    char* buffer);
+
 /* Struct  →  wire-format (complete request or headers-only)         */
 int             ParsedRequest_unparse(ParsedRequest* pr,
     char* dst,
@@ -101,6 +185,19 @@ ParsedHeader* ParsedHeader_get(ParsedRequest* pr,
 int             ParsedHeader_remove(ParsedRequest* pr,
     const char* key);
 
+/* The same for a well-known name: O(1), no string compares.
+ * set/remove act on the first occurrence, as above.                  */
+static inline ParsedHeader* ParsedHeader_get_id(ParsedRequest* pr, http_header_id id)
+{
+    unsigned slot = pr->header_index[id];
+    return slot ? &pr->headers[slot - 1] : NULL;
+}
+int             ParsedHeader_set_id(ParsedRequest* pr,
+    http_header_id id,
+    const char* value);
+int             ParsedHeader_remove_id(ParsedRequest* pr,
+    http_header_id id);
+
 /* printf-style debug helper (only prints when DEBUG_PROXY_PARSE=1). */
 void            debug_proxy_parse(const char* fmt, ...);
 
@@ -0,0 +1,364 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_pool.c      –  work-stealing worker pool
+ *
+ *  Deques are Chase–Lev (Lê et al., "Correct and Efficient
+ *  Work-Stealing for Weak Memory Models", PPoPP 2013) over a fixed
+ *  ring of task pointers: the owner pushes and pops at bottom, thieves
+ *  CAS top. The only race is for the last task, settled by the CAS on
+ *  top. A full ring spills to the injection queue rather than grow.
+ *
+ *  Tasks are malloc'd nodes; the injection queue chains them.
+ *
+ *  `pending` counts tasks queued anywhere. A worker about to sleep
+ *  announces itself in `idle` and then rechecks `pending`; a submitter
+ *  bumps `pending` and then checks `idle`. Both are seq_cst, so one of
+ *  the two always sees the other and no wakeup is lost.
+ *
+ *  Growth: workers live in slots[0, worker_count). A new one is set up
+ *  in full before worker_count is bumped (release), so a thief that
+ *  sees the count (acquire) sees the worker. Slots are never freed –
+ *  workers don't retire – so thieves need no lock to walk them.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct pool_task pool_task;
+
+struct pool_task {
+    pool_fn    fn;
+    void*      arg;
+    pool_task* next;                        /* injection queue           */
+};
+
+typedef struct pool_worker {
+    _Alignas(64) _Atomic int64_t top;       /* thieves                   */
+    _Alignas(64) _Atomic int64_t bottom;    /* owner                     */
+    unsigned   id;
+    uint64_t   rng;                         /* victim choice             */
+    /* Written by the owner only (relaxed), summed by pool_get_stats(). */
+    _Atomic uint64_t submitted, executed, stolen, helped;
+    _Atomic(pool_task*) ring[POOL_DEQUE_SIZE];
+} pool_worker;
+
+static pool_worker*    slots[POOL_MAX_THREADS];
+static _Atomic unsigned worker_count;
+static unsigned        worker_limit;
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_task*      inject_head;
+static pool_task*      inject_tail;
+static _Atomic uint64_t inject_count;       /* queued there; lock-free peek */
+static _Atomic uint64_t injected;           /* submitted from outside    */
+
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sleep_cond = PTHREAD_COND_INITIALIZER;
+static _Atomic int64_t pending;
+static _Atomic int     idle;
+
+static _Thread_local pool_worker* self;
+static _Thread_local int          help_depth;
+
+
+/*──────────────────── Deque ────────────────────────────────────────*/
+
+/* Owner only. 0 when the ring is full.                              */
+static int deque_push(pool_worker* w, pool_task* t)
+{
+    int64_t b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&w->top, memory_order_acquire);
+    if (b - top >= POOL_DEQUE_SIZE) return 0;
+    atomic_store_explicit(&w->ring[b & (POOL_DEQUE_SIZE - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    return 1;
+}
+
+/* Owner only: newest task first.                                    */
+static pool_task* deque_pop(pool_worker* w)
+{
+    int64_t b = atomic_load_explicit(&w->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&w->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&w->top, memory_order_relaxed);
+
+    if (t > b) {                            /* empty                     */
+        atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    pool_task* task = atomic_load_explicit(&w->ring[b & (POOL_DEQUE_SIZE - 1)],
+                                           memory_order_relaxed);
+    if (t == b) {                           /* last one: race the thieves */
+        if (!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            task = NULL;
+        atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/* Any thread: oldest task first. *lost set when another thief (or the
+ * owner) won the race, i.e. the deque may still hold work.          */
+static pool_task* deque_steal(pool_worker* w, int* lost)
+{
+    int64_t t = atomic_load_explicit(&w->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&w->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    pool_task* task = atomic_load_explicit(&w->ring[t & (POOL_DEQUE_SIZE - 1)],
+                                           memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        *lost = 1;
+        return NULL;
+    }
+    return task;
+}
+
+
+/*──────────────────── Injection queue ──────────────────────────────*/
+
+static void inject_push(pool_task* t)
+{
+    t->next = NULL;
+    pthread_mutex_lock(&inject_lock);
+    if (inject_tail) inject_tail->next = t;
+    else inject_head = t;
+    inject_tail = t;
+    atomic_fetch_add_explicit(&inject_count, 1, memory_order_release);
+    pthread_mutex_unlock(&inject_lock);
+}
+
+static pool_task* inject_take(void)
+{
+    if (!atomic_load_explicit(&inject_count, memory_order_acquire)) return NULL;
+
+    pthread_mutex_lock(&inject_lock);
+    pool_task* t = inject_head;
+    if (t) {
+        inject_head = t->next;
+        if (!inject_head) inject_tail = NULL;
+        atomic_fetch_sub_explicit(&inject_count, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&inject_lock);
+    return t;
+}
+
+
+/*──────────────────── Workers ──────────────────────────────────────*/
+
+static void count(_Atomic uint64_t* c)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+/* Next task for w: its own deque, then the injection queue, then the
+ * other deques from a random starting point. *lost as deque_steal(). */
+static pool_task* take(pool_worker* w, int* lost)
+{
+    pool_task* t = deque_pop(w);
+    if (!t) t = inject_take();
+    unsigned n = atomic_load_explicit(&worker_count, memory_order_acquire);
+    if (!t && n > 1) {
+        w->rng ^= w->rng >> 12; w->rng ^= w->rng << 25; w->rng ^= w->rng >> 27;
+        unsigned start = (unsigned)((w->rng * 2685821657736338717ULL) >> 32) % n;
+        for (unsigned i = 0; i < n && !t; ++i) {
+            pool_worker* v = slots[(start + i) % n];
+            if (v != w && (t = deque_steal(v, lost))) count(&w->stolen);
+        }
+    }
+    if (t) atomic_fetch_sub(&pending, 1);
+    return t;
+}
+
+static void run(pool_worker* w, pool_task* t)
+{
+    pool_fn fn = t->fn;
+    void* arg = t->arg;
+    free(t);
+    count(&w->executed);
+    fn(arg);
+}
+
+static void pin(unsigned id)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) return;
+    int n = CPU_COUNT(&allowed);
+    if (n <= 1) return;
+
+    /* The (id mod n)-th CPU we may run on, not CPU id mod n: under a
+     * cpuset those need not be the same.                             */
+    int want = (int)(id % (unsigned)n);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed) || want--) continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        pthread_setaffinity_np(pthread_self(), sizeof one, &one);
+        return;
+    }
+#else
+    (void)id;
+#endif
+}
+
+static void* worker_main(void* arg)
+{
+    pool_worker* w = (pool_worker*)arg;
+    self = w;
+    pin(w->id);
+
+    for (;;) {
+        int lost = 0;
+        pool_task* t = take(w, &lost);
+        if (t) {
+            run(w, t);
+            continue;
+        }
+        if (lost) continue;                 /* somebody else's race; retry */
+
+        pthread_mutex_lock(&sleep_lock);
+        atomic_fetch_add(&idle, 1);
+        while (atomic_load(&pending) <= 0) pthread_cond_wait(&sleep_cond, &sleep_lock);
+        atomic_fetch_sub(&idle, 1);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+    return NULL;
+}
+
+
+/* Start up to n more workers, within worker_limit. Returns how many. */
+static unsigned grow(unsigned n)
+{
+    unsigned added = 0;
+    pthread_mutex_lock(&grow_lock);
+    unsigned count = atomic_load_explicit(&worker_count, memory_order_relaxed);
+    for (; added < n && count < worker_limit; ++added, ++count) {
+        pool_worker* w = (pool_worker*)aligned_alloc(64, sizeof *w);
+        if (!w) break;
+        memset(w, 0, sizeof *w);
+        w->id = count;
+        w->rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(count + 1);
+        slots[count] = w;
+
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, w) != 0) {
+            slots[count] = NULL;
+            free(w);
+            break;
+        }
+        pthread_detach(t);
+        atomic_store_explicit(&worker_count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&grow_lock);
+    return added;
+}
+
+/* Tasks block on sockets, so a full pool can be all waiting on slow
+ * origins while work queues behind it. Every POOL_STARVE_MS, if
+ * nobody is idle and something is queued, start a worker per queued
+ * task. Workers are kept once started: the pool settles at the peak
+ * number of requests in flight, not one thread per connection.       */
+static void* monitor_main(void* arg)
+{
+    (void)arg;
+    struct timespec tick = { 0, POOL_STARVE_MS * 1000000L };
+    for (;;) {
+        nanosleep(&tick, NULL);
+        int64_t queued = atomic_load(&pending);
+        if (queued > 0 && atomic_load(&idle) == 0) grow((unsigned)queued);
+    }
+    return NULL;
+}
+
+
+/*──────────────────── API ──────────────────────────────────────────*/
+
+int pool_init(int threads)
+{
+    if (worker_limit) return 0;
+
+    int elastic = threads <= 0;
+    if (elastic) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (int)(cpus > 0 ? cpus : 1) * POOL_THREADS_PER_CPU;
+    }
+    if (threads > POOL_MAX_THREADS) threads = POOL_MAX_THREADS;
+    worker_limit = elastic ? POOL_MAX_THREADS : (unsigned)threads;
+
+    if (!grow((unsigned)threads)) return -1;
+    if (elastic && worker_count < worker_limit) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, monitor_main, NULL) == 0) pthread_detach(t);
+    }
+    return 0;
+}
+
+int pool_submit(pool_fn fn, void* arg)
+{
+    pool_task* t = (pool_task*)malloc(sizeof *t);
+    if (!t) return -1;
+    t->fn = fn;
+    t->arg = arg;
+
+    if (self) count(&self->submitted);
+    else atomic_fetch_add_explicit(&injected, 1, memory_order_relaxed);
+    if (!self || !deque_push(self, t)) inject_push(t);
+
+    atomic_fetch_add(&pending, 1);
+    if (atomic_load(&idle) > 0) {
+        pthread_mutex_lock(&sleep_lock);
+        pthread_cond_signal(&sleep_cond);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+    return 0;
+}
+
+int pool_help(void)
+{
+    /* A sleeping worker will take whatever is queued; helping only
+     * matters when every worker is busy.                             */
+    if (!self || help_depth >= POOL_HELP_DEPTH || atomic_load(&idle) > 0) return 0;
+
+    int lost = 0;
+    pool_task* t = take(self, &lost);
+    if (!t) return 0;
+    count(&self->helped);
+    ++help_depth;
+    run(self, t);
+    --help_depth;
+    return 1;
+}
+
+void pool_get_stats(pool_stats* out)
+{
+    memset(out, 0, sizeof *out);
+    unsigned n = atomic_load_explicit(&worker_count, memory_order_acquire);
+    out->workers = n;
+    out->injected = atomic_load_explicit(&injected, memory_order_relaxed);
+    out->submitted = out->injected;
+    for (unsigned i = 0; i < n; ++i) {
+        pool_worker* w = slots[i];
+        out->submitted += atomic_load_explicit(&w->submitted, memory_order_relaxed);
+        out->executed += atomic_load_explicit(&w->executed, memory_order_relaxed);
+        out->stolen += atomic_load_explicit(&w->stolen, memory_order_relaxed);
+        out->helped += atomic_load_explicit(&w->helped, memory_order_relaxed);
+    }
+    int64_t q = atomic_load(&pending);
+    out->queued = q > 0 ? q : 0;
+}
@@ -0,0 +1,63 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_pool.h
+ *
+ *  Fixed pool of worker threads for the threaded front end, so a client
+ *  connection costs a queued task instead of a pthread_create().
+ *
+ *      • Each worker owns a Chase–Lev deque. A task submitted from a
+ *        worker goes on that worker's deque, which it pops LIFO; idle
+ *        workers steal from the other end, so work queued behind a
+ *        worker stuck on a slow origin moves to one that is free.
+ *      • Tasks submitted from outside the pool (the accept loop) go on
+ *        one locked injection queue, which every worker polls before
+ *        stealing.
+ *      • Worker i is pinned to CPU i mod the online count.
+ *      • A worker with nothing to run sleeps on a condition variable;
+ *        pool_submit() wakes one only when somebody sleeps.
+ *
+ *  Tasks may block – they do socket I/O – so the pool starts at a few
+ *  threads per CPU and grows while work queues with every worker busy,
+ *  up to POOL_MAX_THREADS. A task that waits on another task's progress
+ *  (a cache reader behind its filler) calls pool_help() first, so it
+ *  never waits on work that is stuck in a queue behind it.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_POOL_H
+#define PROXY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POOL_THREADS_PER_CPU    8           /* initial size, elastic pool */
+#define POOL_MAX_THREADS        1024
+#define POOL_STARVE_MS          10          /* growth check interval     */
+#define POOL_DEQUE_SIZE         1024        /* per worker, power of two  */
+#define POOL_HELP_DEPTH         4           /* nested pool_help() runs   */
+
+typedef void (*pool_fn)(void* arg);
+
+typedef struct pool_stats {
+    unsigned workers;                       /* 0 → pool not started      */
+    uint64_t submitted;
+    uint64_t injected;                      /*   …from outside the pool  */
+    uint64_t executed;
+    uint64_t stolen;                        /*   …taken from another deque */
+    uint64_t helped;                        /*   …by a waiting task      */
+    int64_t  queued;                        /* submitted, not yet taken  */
+} pool_stats;
+
+/* Start `threads` workers, a fixed pool. <= 0 → elastic: start with
+ * POOL_THREADS_PER_CPU per online CPU and grow as above. Once only;
+ * -1 if no worker could be started.                                  */
+int  pool_init(int threads);
+
+/* Queue fn(arg). -1 only when out of memory; fn has not run then.   */
+int  pool_submit(pool_fn fn, void* arg);
+
+/* On a worker: run one queued task, if there is one and the nesting
+ * limit allows. 1 if a task ran. Elsewhere always 0.                */
+int  pool_help(void);
+
+void pool_get_stats(pool_stats* out);
+
+#endif /* PROXY_POOL_H */
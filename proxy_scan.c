@@ -0,0 +1,204 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_scan.c      –  CR/LF and ':'/' ' bitmap kernels
+ *
+ *  Every kernel handles whole 64-byte blocks and leaves the ragged tail
+ *  to scan_tail(), so the bitmap layout is identical across kernels.
+ *  The active kernel lives behind an atomic function pointer that starts
+ *  out pointing at the resolver (a poor man's ifunc).
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#include "proxy_scan.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define SCAN_X86 1
+#   define SCAN_TARGET(isa) __attribute__((target(isa)))
+#   include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#   define SCAN_X86 1
+#   define SCAN_TARGET(isa)
+#   include <immintrin.h>
+#endif
+
+typedef void (*scan_fn)(const char*, size_t, uint64_t*, uint64_t*);
+
+/* Bytes [from, len) – always less than one block for the SIMD kernels. */
+static void scan_tail(const char* buf, size_t from, size_t len,
+                      uint64_t* lines, uint64_t* delims)
+{
+    if (from >= len) return;
+    uint64_t l = 0, d = 0;
+    for (size_t i = from; i < len; ++i) {
+        char c = buf[i];
+        l |= (uint64_t)((c == '\r') | (c == '\n')) << (i & 63);
+        d |= (uint64_t)((c == ':') | (c == ' ')) << (i & 63);
+    }
+    lines[from >> 6] = l;
+    delims[from >> 6] = d;
+}
+
+/* SWAR: high bit of each byte of w that is zero, exact (no carries).  */
+static inline uint64_t swar_zero(uint64_t w)
+{
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7full;
+    return ~(((w & low7) + low7) | w | low7);
+}
+
+/* Gather those 8 high bits into bits 0..7, byte 0 → bit 0.           */
+static inline uint64_t swar_pack(uint64_t hi)
+{
+    return ((hi >> 7) * 0x0102040810204080ull) >> 56;
+}
+
+static uint64_t swar_eq2(uint64_t w, uint64_t a, uint64_t b)
+{
+    return swar_pack(swar_zero(w ^ a) | swar_zero(w ^ b));
+}
+
+/* Eight bytes at a time in a general-purpose register.               */
+static void scan_scalar(const char* buf, size_t len, uint64_t* lines, uint64_t* delims)
+{
+    const uint64_t ones = 0x0101010101010101ull;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        uint64_t l = 0, d = 0;
+        for (unsigned k = 0; k < 64; k += 8) {
+            uint64_t w;
+            memcpy(&w, buf + i + k, sizeof w);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            w = __builtin_bswap64(w);
+#endif
+            l |= swar_eq2(w, ones * '\r', ones * '\n') << k;
+            d |= swar_eq2(w, ones * ':', ones * ' ') << k;
+        }
+        lines[i >> 6] = l;
+        delims[i >> 6] = d;
+    }
+    scan_tail(buf, i, len, lines, delims);
+}
+
+#ifdef SCAN_X86
+
+/* PCMPESTRM: bit k set when byte k equals any byte of the set.       */
+#define ANY_BYTE (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK)
+
+SCAN_TARGET("sse4.2")
+static void scan_sse42(const char* buf, size_t len, uint64_t* lines, uint64_t* delims)
+{
+    const __m128i eol = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i sep = _mm_setr_epi8(':', ' ', 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0);
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        uint64_t l = 0, d = 0;
+        for (unsigned k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(buf + i + 16 * k));
+            __m128i ml = _mm_cmpestrm(eol, 2, v, 16, ANY_BYTE);
+            __m128i md = _mm_cmpestrm(sep, 2, v, 16, ANY_BYTE);
+            l |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(ml) << (16 * k);
+            d |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(md) << (16 * k);
+        }
+        lines[i >> 6] = l;
+        delims[i >> 6] = d;
+    }
+    scan_tail(buf, i, len, lines, delims);
+}
+
+SCAN_TARGET("avx2")
+static inline void avx2_masks32(const char* p, uint32_t* l, uint32_t* d)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i ml = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    __m256i md = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    *l = (uint32_t)_mm256_movemask_epi8(ml);
+    *d = (uint32_t)_mm256_movemask_epi8(md);
+}
+
+SCAN_TARGET("avx2")
+static void scan_avx2(const char* buf, size_t len, uint64_t* lines, uint64_t* delims)
+{
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        uint32_t l0, d0, l1, d1;
+        avx2_masks32(buf + i, &l0, &d0);
+        avx2_masks32(buf + i + 32, &l1, &d1);
+        lines[i >> 6] = (uint64_t)l0 | (uint64_t)l1 << 32;
+        delims[i >> 6] = (uint64_t)d0 | (uint64_t)d1 << 32;
+    }
+    scan_tail(buf, i, len, lines, delims);
+}
+
+static int cpu_has(scan_impl impl)
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (impl == SCAN_IMPL_AVX2)  return __builtin_cpu_supports("avx2");
+    if (impl == SCAN_IMPL_SSE42) return __builtin_cpu_supports("sse4.2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    int osxsave = (info[2] >> 27) & 1;
+    if (impl == SCAN_IMPL_SSE42) return (info[2] >> 20) & 1;
+    if (impl == SCAN_IMPL_AVX2) {
+        if (!osxsave || (_xgetbv(0) & 6) != 6) return 0;
+        __cpuidex(info, 7, 0);
+        return (info[1] >> 5) & 1;
+    }
+#endif
+    return impl == SCAN_IMPL_SCALAR;
+}
+
+#else  /* !SCAN_X86 */
+
+static int cpu_has(scan_impl impl) { return impl == SCAN_IMPL_SCALAR; }
+
+#endif
+
+static void scan_resolve(const char* buf, size_t len, uint64_t* lines, uint64_t* delims);
+
+static _Atomic(scan_fn) active = scan_resolve;
+static const char* active_name = "scalar";
+
+int scan_set_impl(scan_impl impl)
+{
+    if (impl == SCAN_IMPL_AUTO) {
+        if (scan_set_impl(SCAN_IMPL_AVX2) == 0) return 0;
+        if (scan_set_impl(SCAN_IMPL_SSE42) == 0) return 0;
+        return scan_set_impl(SCAN_IMPL_SCALAR);
+    }
+    if (!cpu_has(impl)) return -1;
+
+    scan_fn fn = scan_scalar;
+    const char* name = "scalar";
+#ifdef SCAN_X86
+    if (impl == SCAN_IMPL_AVX2)  { fn = scan_avx2;  name = "avx2"; }
+    if (impl == SCAN_IMPL_SSE42) { fn = scan_sse42; name = "sse4.2"; }
+#endif
+    active_name = name;
+    atomic_store(&active, fn);
+    return 0;
+}
+
+static void scan_resolve(const char* buf, size_t len, uint64_t* lines, uint64_t* delims)
+{
+    scan_set_impl(SCAN_IMPL_AUTO);
+    atomic_load_explicit(&active, memory_order_relaxed)(buf, len, lines, delims);
+}
+
+const char* scan_impl_name(void)
+{
+    if (atomic_load(&active) == scan_resolve) scan_set_impl(SCAN_IMPL_AUTO);
+    return active_name;
+}
+
+void scan_structural(const char* buf, size_t len, uint64_t* lines, uint64_t* delims)
+{
+    if (len == 0) return;
+    atomic_load_explicit(&active, memory_order_relaxed)(buf, len, lines, delims);
+}
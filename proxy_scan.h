@@ -0,0 +1,59 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_scan.h
+ *
+ *  One-pass structural scanner for HTTP header blocks.
+ *
+ *  scan_structural() classifies every byte in one pass into two bitmaps
+ *  (bit i of word i / 64 ↔ buf[i]):
+ *      lines   CR or LF
+ *      delims  ':' or ' '
+ *  – the only bytes the request parser ever branches on. The parser then
+ *  hops between set bits instead of re-reading the text with strstr and
+ *  memchr, and never depends on NUL termination. Keeping line ends apart
+ *  from delimiters lets it skip the spaces inside header values.
+ *
+ *  Kernels: AVX2 (64 B/iter), SSE4.2 PCMPESTRM (16 B/op) and a SWAR
+ *  fallback (8 B/op). The best one the CPU supports is picked on first use.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_SCAN_H
+#define PROXY_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+typedef enum scan_impl {
+    SCAN_IMPL_AUTO,         /* best supported (default)             */
+    SCAN_IMPL_SCALAR,
+    SCAN_IMPL_SSE42,
+    SCAN_IMPL_AVX2,
+} scan_impl;
+
+/* Words of bitmap needed for len bytes.                              */
+static inline size_t scan_words(size_t len) { return (len + 63) / 64; }
+
+/* Fill both maps for words [0, scan_words(len)); bits past len are 0. */
+void        scan_structural(const char* buf, size_t len,
+                            uint64_t* lines, uint64_t* delims);
+
+/* Force a kernel (benchmarks). Returns -1 if the CPU lacks it.        */
+int         scan_set_impl(scan_impl impl);
+const char* scan_impl_name(void);
+
+/* Index of the lowest set bit; w must be non-zero.                    */
+static inline unsigned scan_ctz64(uint64_t w)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, w);
+    return (unsigned)idx;
+#else
+    return (unsigned)__builtin_ctzll(w);
+#endif
+}
+
+#endif /* PROXY_SCAN_H */
@@ -1,42 +1,1016 @@
-#include<stdio.h>;
-#include"proxy_parse.h";
-#include<string.h>;
-#include<time.h>;
-#include<Mspthrd.h>;
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_server.c
+ *
+ *  Entry point and the blocking request path. The cache itself lives in
+ *  proxy_cache.c (with an optional disk tier, proxy_disk.c), the origin
+ *  connection pool in proxy_upstream.c.
+ *
+ *  Two front ends share the helpers below:
+ *      --mode=threaded   blocking I/O on a work-stealing pool of
+ *                        workers (proxy_pool.h), admission gated by a
+ *                        counting semaphore
+ *      --mode=epoll      N edge-triggered reactor loops, see proxy_event.c
+ *      --mode=uring      the same loops, client I/O batched through
+ *                        io_uring (epoll if the kernel can't)
+ *
+ *  Settings come from proxy_config.h: defaults, --config=FILE, then the
+ *  flags below. With a config file, SIGHUP reloads it (see reload_main).
+ *
+ *  Usage:  ./proxy [port] [--mode=epoll|uring|threaded] [--workers=N] [--disk=DIR]
+ *                 [--compress=gzip] [--admission=tinylfu|tinylfu-bytes|lru]
+ *                 [--max-object=BYTES] [--connect-ports=443,…] [--config=FILE]
+ *───────────────────────────────────────────────────────────────────────────*/
 
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
-// Port
-const int port_number = 8080;
-//MAX_CLIENTS_ALLOWED
-const int MAX_CLIENTS = 1000;
-// global socket id, as we need sockets to connect to the webserver, although we will have multiple sockets
-int global_socketId;
+#include "proxy_parse.h"
+#include "proxy_server.h"
+#include "proxy_cache.h"
+#include "proxy_codec.h"
+#include "proxy_config.h"
+#include "proxy_disk.h"
+#include "proxy_dns.h"
+#include "proxy_event.h"
+#include "proxy_http.h"
+#include "proxy_metrics.h"
+#include "proxy_pool.h"
+#include "proxy_splice.h"
+#include "proxy_tunnel.h"
+#include "proxy_upstream.h"
 
-// The number of clients will be equal to the number of threads, init threads
-pthread_t tid[MAX_CLIENTS];
+#define TRIM_BYTES      (4 * 1024 * 1024)   /* cache excess shed per step   */
+#define TRIM_PAUSE_MS   10                  /*   …and the pause between     */
 
-//
+// Admission control for the threaded front end: open client connections
 sem_t semaphore;
 
+/*──────────────────── Request helpers ──────────────────────────────*/
 
-// Type Definitions
-typedef struct cache_element cache_element;
+int proxy_request_port(const ParsedRequest* pr)
+{
+    int port = pr->port ? atoi(pr->port) : 80;
+    return (port > 0 && port < 65536) ? port : 80;
+}
 
-// This will be the list of  cache elements
-struct cache_element {
-    char* data;
-    int len;
-    char* url;
-    time_t lru_time;
-    cache_element* element;
-};
-// Function definitions used in the Cache
-cache_element* find(char* url);
-int add_cache_element(char* data, int size, char* url);
-void remove_cache_element(char* url);
+char* proxy_cache_key(const ParsedRequest* pr)
+{
+    size_t len = strlen(pr->host) + strlen(pr->path) + 8;
+    char* key = (char*)malloc(len);
+    if (key) snprintf(key, len, "%s:%d%s", pr->host, proxy_request_port(pr), pr->path);
+    return key;
+}
 
-int main(int argc, char* argv[])
+int proxy_build_upstream_request(ParsedRequest* pr, const cache_element* fill, char** out)
+{
+    if (!ParsedHeader_get_id(pr, HDR_HOST)) {
+        size_t len = strlen(pr->host) + (pr->port ? strlen(pr->port) : 0) + 2;
+        char* host = (char*)malloc(len);
+        if (!host) return -1;
+        if (pr->port) snprintf(host, len, "%s:%s", pr->host, pr->port);
+        else          snprintf(host, len, "%s", pr->host);
+        int rc = ParsedHeader_set_id(pr, HDR_HOST, host);
+        free(host);
+        if (rc < 0) return -1;
+    }
+    if (http_prepare_upstream_headers(pr) < 0) return -1;
+    if (fill) {
+        const char* stored = NULL;
+        size_t n = fill->prior ? cache_peek(fill->prior, 0, &stored, NULL) : 0;
+        if (http_prepare_fill_headers(pr, stored, n) < 0) return -1;
+    }
+
+    size_t len = ParsedRequest_totalLen(pr);
+    char* buf = (char*)malloc(len + 1);              /* +1: snprintf NUL */
+    if (!buf) return -1;
+    int n = ParsedRequest_unparse(pr, buf, len + 1);
+    if (n < 0) { free(buf); return -1; }
+    *out = buf;
+    return n;
+}
+
+int proxy_error_response(int status_code, char* dst, size_t dst_len)
+{
+    const char* reason;
+    switch (status_code) {
+    case 400: reason = "Bad Request";                break;
+    case 403: reason = "Forbidden";                  break;
+    case 404: reason = "Not Found";                  break;
+    case 501: reason = "Not Implemented";            break;
+    case 502: reason = "Bad Gateway";                break;
+    case 505: reason = "HTTP Version Not Supported"; break;
+    default:  reason = "Internal Server Error"; status_code = 500; break;
+    }
+
+    char body[160];
+    int body_len = snprintf(body, sizeof body,
+        "<HTML><HEAD><TITLE>%d %s</TITLE></HEAD>\n<BODY><H1>%d %s</H1></BODY></HTML>\n",
+        status_code, reason, status_code, reason);
+
+    int n = snprintf(dst, dst_len,
+        "HTTP/1.1 %d %s\r\nContent-Length: %d\r\nConnection: close\r\n"
+        "Content-Type: text/html\r\nServer: Proxy_Server\r\n\r\n%s",
+        status_code, reason, body_len, body);
+    if (n < 0 || (size_t)n >= dst_len) return -1;
+    metric_inc(M_ERROR_RESPONSES);
+    return n;
+}
+
+int proxy_connect_status(const ParsedRequest* pr)
+{
+    if (strcmp(pr->version, "HTTP/1.0") != 0 && strcmp(pr->version, "HTTP/1.1") != 0)
+        return 505;
+    if (!pr->host || !pr->port) return 400;
+    return tunnel_port_allowed(proxy_request_port(pr)) ? 0 : 403;
+}
+
+/* Loopback peers only: /stats is for whoever runs the box.          */
+static int peer_is_local(int fd)
+{
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof ss;
+    if (getpeername(fd, (struct sockaddr*)&ss, &len) < 0) return 0;
+    if (ss.ss_family == AF_INET) {
+        const struct sockaddr_in* in = (const struct sockaddr_in*)&ss;
+        return (ntohl(in->sin_addr.s_addr) >> 24) == 127;
+    }
+    if (ss.ss_family == AF_INET6) {
+        const struct sockaddr_in6* in6 = (const struct sockaddr_in6*)&ss;
+        return IN6_IS_ADDR_LOOPBACK(&in6->sin6_addr)
+            || (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr) && in6->sin6_addr.s6_addr[12] == 127);
+    }
+    return 0;
+}
+
+char* proxy_local_response(int client_fd, const ParsedRequest* pr, size_t* len)
+{
+    int status = 404;
+    if (strcmp(pr->path, PROXY_STATS_PATH) == 0) {
+        if (peer_is_local(client_fd)) {
+            char* page = metrics_response(len);
+            if (page) return page;
+            status = 500;
+        }
+        else {
+            status = 403;
+        }
+    }
+
+    char* page = (char*)malloc(512);
+    int n = page ? proxy_error_response(status, page, 512) : -1;
+    if (n < 0) { free(page); return NULL; }
+    *len = (size_t)n;
+    return page;
+}
+
+int proxy_response_cacheable(const char* data, size_t len)
+{
+    return len >= 12 && strncmp(data, "HTTP/1.", 7) == 0
+        && strncmp(data + 8, " 200", 4) == 0;
+}
+
+/* Cacheable, and the expiry to give it; `now` is when it arrived.   */
+static int fill_expiry(const char* head, size_t n, time_t now, http_freshness* fr)
+{
+    return n > 0 && proxy_response_cacheable(head, n)
+        && http_response_freshness(head, n, NULL, 0, now, fr) == 0 && fr->store;
+}
+
+void proxy_fill_finish(cache_element* e)
+{
+    const char* head = NULL;
+    size_t n = cache_peek(e, 0, &head, NULL);
+    http_freshness fr;
+    int keep = fill_expiry(head, n, time(NULL), &fr);
+    if (keep) cache_set_expiry(e, fr.fresh_until, fr.stale_until);
+    cache_fill_finish(e, keep);
+    if (keep) codec_offer(e);
+}
+
+int proxy_fill_validated(cache_element* e, const http_framer* f)
+{
+    if (f->status == 304 && f->body == HTTP_BODY_NONE) {
+        const char* head = NULL;
+        size_t n = cache_peek(e->prior, 0, &head, NULL);
+        time_t now = time(NULL);
+        http_freshness fr;
+        /* A 304 that forbids storing still answers this request.    */
+        if (http_response_freshness(head, n, f->head, f->head_len, now, &fr) < 0 || !fr.store)
+            fr.fresh_until = fr.stale_until = now;
+        cache_fill_not_modified(e, fr.fresh_until, fr.stale_until);
+        metric_inc(M_REVALIDATED);
+        return 1;
+    }
+    cache_fill_publish(e);
+    metric_inc(M_REFETCHED);
+    return 0;
+}
+
+static metric_counter lookup_outcome(const cache_element* e, int filler,
+                                     const cache_element* revalidate)
+{
+    if (!e) return M_CACHE_MISSES;
+    if (filler) return e->prior ? M_CACHE_REVALIDATE : M_CACHE_MISSES;
+    if (revalidate) return M_CACHE_STALE;
+    return atomic_load(&e->state) == CACHE_COMPLETE ? M_CACHE_HITS : M_CACHE_COALESCED;
+}
+
+cache_element* proxy_cache_open(const char* key, int* filler, cache_element** revalidate)
+{
+    uint64_t t0 = metric_now();
+    size_t key_len = strlen(key);
+    uint64_t hash = cache_hash(key, key_len);
+    cache_element* e = cache_open(key, key_len, hash, filler, revalidate);
+    metric_counter outcome = lookup_outcome(e, *filler, revalidate ? *revalidate : NULL);
+
+    disk_ref ref;
+    if (e && *filler && !e->prior && disk_lookup(key, key_len, hash, &ref)) {
+        http_freshness fr;
+        int keep = fill_expiry(ref.data, ref.len, time(NULL), &fr);
+
+        cache_fill_coding(e, ref.coding, ref.decoded_len);
+        cache_fill_reserve(e, ref.len);
+        int ok = cache_fill_append(e, ref.data, ref.len) == 0;
+        disk_ref_release(&ref);
+        if (!ok) {                          /* aborted: followers refetch */
+            cache_release(e);               /*   …and so do we, uncached  */
+            e = NULL;
+            *filler = 0;
+        }
+        else {
+            if (keep) cache_set_expiry(e, fr.fresh_until, fr.stale_until);
+            cache_fill_finish(e, keep);
+            if (keep) codec_offer(e);
+            *filler = 0;
+            outcome = M_CACHE_DISK_HITS;
+
+            /* Stale on disk: promoted all the same, so it can be
+             * revalidated rather than refetched – open it again.    */
+            if (keep && time(NULL) >= fr.fresh_until) {
+                cache_release(e);
+                e = cache_open(key, key_len, hash, filler, revalidate);
+                outcome = lookup_outcome(e, *filler, revalidate ? *revalidate : NULL);
+            }
+        }
+    }
+    metric_since(H_CACHE_LOOKUP, t0);
+    metric_inc(outcome);
+    return e;
+}
+
+int connect_remote_server(const char* host_addr, int port_num)
+{
+    dns_result r;
+    if (dns_resolve_wait(host_addr, &r) != DNS_OK) return -1;
+
+    int fd = -1;
+    for (unsigned i = 0; i < r.count; ++i) {
+        struct sockaddr_storage sa;
+        socklen_t sa_len = dns_sockaddr(&r.addr[i], port_num, &sa);
+        fd = socket(sa.ss_family, SOCK_STREAM, 0);
+        if (fd < 0) continue;
+        if (connect(fd, (struct sockaddr*)&sa, sa_len) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+
+/*──────────────────── Threaded front end ───────────────────────────*/
+
+static int send_all(int socket, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(socket, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void sendErrorMessage(int socket, int status_code)
+{
+    char response[512];
+    int n = proxy_error_response(status_code, response, sizeof response);
+    if (n > 0) send_all(socket, response, (size_t)n);
+}
+
+enum { SPLICE_DONE, SPLICE_ORIGIN_EOF, SPLICE_ORIGIN_ERROR, SPLICE_CLIENT_GONE,
+       SPLICE_UNAVAILABLE };
+
+/* Relay the rest of an opaque body origin → pipe → client without it
+ * ever entering user space (blocking sockets, so a plain loop).     */
+static int splice_body(int from, int to, http_framer* f, splice_pipe* p)
+{
+    if (p->rd < 0 && splice_pipe_open(p, 0) < 0) return SPLICE_UNAVAILABLE;
+
+    for (;;) {
+        uint64_t left = http_framer_opaque_left(f);
+        if (!left) return SPLICE_DONE;
+        ssize_t n = splice_fill(p, from, left < SIZE_MAX ? (size_t)left : SIZE_MAX);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n == 0 ? SPLICE_ORIGIN_EOF : SPLICE_ORIGIN_ERROR;
+        metric_add(M_BYTES_ORIGIN, (uint64_t)n);
+        while (p->held) {
+            ssize_t k = splice_drain(p, to);
+            if (k > 0) metric_add(M_BYTES_CLIENT, (uint64_t)k);
+            else if (errno != EINTR) return SPLICE_CLIENT_GONE;
+        }
+        http_framer_skip(f, (uint64_t)n);
+    }
+}
+
+/* Send what e holds from `off` on, without waiting for more.         */
+static int send_filled(int socket, cache_element* e, size_t off)
+{
+    const char* p;
+    size_t n;
+    while ((n = cache_peek(e, off, &p, NULL)) > 0) {
+        if (send_all(socket, p, n) < 0) return -1;
+        metric_add(M_BYTES_CLIENT, n);
+        off += n;
+    }
+    return 0;
+}
+
+/* Cache miss: fetch from the origin and relay it to the client. With
+ * `fill` set we are the entry's filler: every framed byte is appended
+ * so coalesced followers can stream it while we are still relaying.
+ * A filler that revalidates a stale entry holds the client back until
+ * the origin's head is in: a 304 is answered from the stale entry, now
+ * fresh again, and anything else goes out as a miss would. With no
+ * client (socket < 0) it only fills.
+ *
+ * The origin socket comes from the upstream pool when one is idle and
+ * goes back to it if the response was framed and the origin keeps it
+ * open. A pooled socket that dies before the first response byte is
+ * retried once on a fresh connection.
+ *
+ * `accepted` (codec_accepted()) is for a 304 answered from a stored
+ * entry that may be compressed.
+ *
+ * 1 → relayed in full and the client may send another request on the
+ * connection, 0 → relayed but the connection must close, -1 → failed. */
+static int serve_entry(int socket, cache_element* e, unsigned accepted);
+
+static int relay_origin(int clientSocket, const char* host, int port,
+                        const char* upstream_request, size_t request_len, cache_element* fill,
+                        unsigned accepted)
+{
+    cache_element* entry = fill;
+    int remoteSocket = -1, reused = 0;
+    http_framer framer;
+    http_framer_init(&framer);
+
+    char buf[MAX_BYTES];
+    int complete = 0, client_gone = clientSocket < 0, unframed = 0, relayed = 0, reserved = 0;
+    int no_splice = 0;
+    int validating = fill && fill->prior, backlog = 0, not_modified = 0;
+    splice_pipe pipe;
+    splice_pipe_init(&pipe);
+
+    for (int attempt = 0; attempt < 2 && !complete; ++attempt) {
+        remoteSocket = upstream_checkout(host, port, 0);
+        reused = remoteSocket >= 0;
+        if (reused) {
+            metric_inc(M_UPSTREAM_REUSES);
+        }
+        else {
+            uint64_t t0 = metric_now();
+            remoteSocket = connect_remote_server(host, port);
+            if (remoteSocket < 0) {
+                metric_inc(M_UPSTREAM_FAILURES);
+                break;
+            }
+            metric_since(H_UPSTREAM_CONNECT, t0);
+            metric_inc(M_UPSTREAM_CONNECTS);
+        }
+
+        int started = 0;
+        if (send_all(remoteSocket, upstream_request, request_len) == 0) {
+            for (;;) {
+                /* A filler receives straight into the cache entry.   */
+                char* dst = buf;
+                size_t room = sizeof buf;
+                if (fill) {
+                    char* p = cache_fill_space(fill, &room);
+                    if (p) dst = p;
+                    else { fill = NULL; room = sizeof buf; }
+                }
+
+                ssize_t n = recv(remoteSocket, dst, room, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    complete = n == 0 && started
+                        && (unframed || http_framer_eof(&framer) == HTTP_FRAME_DONE);
+                    break;
+                }
+                started = 1;
+                metric_add(M_BYTES_ORIGIN, (uint64_t)n);
+
+                /* Unframable response: relay it until the origin closes. */
+                size_t used = (size_t)n;
+                int rc = unframed ? HTTP_FRAME_NEED_MORE
+                                  : http_framer_feed(&framer, dst, (size_t)n, &used);
+                if (rc == HTTP_FRAME_ERROR) {
+                    unframed = 1;
+                    used = (size_t)n;
+                }
+                /* Revalidating: the head decides between the stale entry
+                 * and what the fill has held back so far.               */
+                if (validating && fill && (framer.body != HTTP_BODY_UNKNOWN || unframed)) {
+                    validating = 0;
+                    if (proxy_fill_validated(fill, &framer)) {
+                        fill = NULL;
+                        not_modified = 1;
+                    }
+                    else {
+                        backlog = 1;
+                    }
+                }
+                /* Too big to cache: give up before followers see a byte. */
+                if (fill && framer.expected && !reserved) {
+                    reserved = 1;
+                    if (cache_fill_reserve(fill, (size_t)framer.expected) < 0) fill = NULL;
+                }
+                int committed = fill != NULL;
+                if (fill) {
+                    cache_fill_commit(fill, used);
+                    if (unframed) { cache_fill_abort(fill); fill = NULL; }
+                }
+                /* A filler whose client left keeps going for the followers. */
+                if (!client_gone && !validating && !not_modified) {
+                    int r = backlog ? send_filled(clientSocket, entry, 0) : 0;
+                    if (r == 0 && !(backlog && committed)) {
+                        r = send_all(clientSocket, dst, used);
+                        if (r == 0) metric_add(M_BYTES_CLIENT, used);
+                    }
+                    backlog = 0;
+                    if (r < 0) {
+                        client_gone = 1;
+                        if (!fill) break;
+                    }
+                }
+                if (!validating) relayed = 1;
+                if (rc == HTTP_FRAME_DONE) { complete = 1; break; }
+                if (client_gone && !fill) break;
+
+                /* Uncached body the framer needn't see: splice it.    */
+                if (!fill && !client_gone && !unframed && !no_splice
+                    && http_framer_opaque_left(&framer)) {
+                    int rs = splice_body(remoteSocket, clientSocket, &framer, &pipe);
+                    if (rs == SPLICE_UNAVAILABLE) { no_splice = 1; continue; }
+                    if (rs == SPLICE_CLIENT_GONE) client_gone = 1;
+                    complete = rs == SPLICE_DONE
+                        || (rs == SPLICE_ORIGIN_EOF && http_framer_eof(&framer) == HTTP_FRAME_DONE);
+                    break;
+                }
+            }
+        }
+
+        if (complete && !unframed && framer.keep_alive) {
+            upstream_checkin(host, port, remoteSocket, 0);
+            remoteSocket = -1;
+            break;
+        }
+        close(remoteSocket);
+        remoteSocket = -1;
+        if (started || client_gone || !reused) break;   /* only stale pool sockets retry */
+    }
+
+    /* Followers only need the origin's bytes, not our client.        */
+    if (fill) {
+        if (complete) proxy_fill_finish(fill);
+        else cache_fill_abort(fill);
+    }
+    if (!complete && !relayed && !client_gone)
+        sendErrorMessage(clientSocket, 502);
+
+    int reusable = !unframed && framer.keep_alive && !client_gone;
+    if (not_modified && !client_gone) {                 /* the stored copy */
+        const char* head;
+        size_t n = cache_peek(entry, 0, &head, NULL);
+        reusable = serve_entry(clientSocket, entry, accepted) == 0
+                && http_response_reusable(head, n);
+    }
+    http_framer_free(&framer);
+    splice_pipe_close(&pipe);
+    return complete ? reusable : -1;
+}
+
+static int handle_request(int clientSocket, ParsedRequest* request, cache_element* fill)
+{
+    char* upstream_request = NULL;
+    int request_len = proxy_build_upstream_request(request, fill, &upstream_request);
+    if (request_len < 0) {
+        if (fill) cache_fill_abort(fill);
+        return -1;
+    }
+    int rc = relay_origin(clientSocket, request->host, proxy_request_port(request),
+                          upstream_request, (size_t)request_len, fill, codec_accepted(request));
+    free(upstream_request);
+    return rc;
+}
+
+/* Stale-while-revalidate: the client gets the stale entry, and the
+ * conditional request for its successor runs as a pool task of its
+ * own, which an idle worker steals.                                  */
+typedef struct revalidation {
+    cache_element* fill;
+    char*  host;
+    int    port;
+    char*  request;
+    size_t request_len;
+} revalidation;
+
+static void revalidate_main(void* arg)
+{
+    revalidation* r = (revalidation*)arg;
+    relay_origin(-1, r->host, r->port, r->request, r->request_len, r->fill, 0);
+    cache_release(r->fill);
+    free(r->host);
+    free(r->request);
+    free(r);
+}
+
+static void revalidate_spawn(ParsedRequest* request, cache_element* fill)
+{
+    revalidation* r = (revalidation*)calloc(1, sizeof *r);
+    int n = r ? proxy_build_upstream_request(request, fill, &r->request) : -1;
+    if (n >= 0 && (r->host = strdup(request->host))) {
+        r->fill = fill;
+        r->port = proxy_request_port(request);
+        r->request_len = (size_t)n;
+        if (pool_submit(revalidate_main, r) == 0) return;
+    }
+    cache_fill_abort(fill);                 /* the next stale hit retries */
+    cache_release(fill);
+    if (r) {
+        free(r->host);
+        free(r->request);
+        free(r);
+    }
+}
+
+/* serve_entry() for a client that doesn't take e's stored coding.  */
+static int serve_decoded(int socket, cache_element* e)
+{
+    codec_reader r = { 0 };
+    char* buf = (char*)malloc(MAX_BYTES);
+    int rc = -1;
+    if (buf && codec_reader_open(&r, e) == 0) {
+        for (;;) {
+            cache_state state;
+            ssize_t n = codec_reader_read(&r, e, buf, MAX_BYTES, &state);
+            if (n > 0) {
+                if (send_all(socket, buf, (size_t)n) < 0) break;
+                metric_add(M_BYTES_CLIENT, (uint64_t)n);
+                continue;
+            }
+            if (n < 0) break;
+            if (state == CACHE_COMPLETE) { rc = 0; break; }
+            if (state == CACHE_ABORTED) { rc = r.head_sent ? -1 : 1; break; }
+            if (!pool_help()) cache_wait_blocking(e, r.in_off);
+        }
+    }
+    codec_reader_close(&r);
+    free(buf);
+    return rc;
+}
+
+/* Stream a cache entry, following its filler if it is still FILLING,
+ * decoded if it is stored in a coding the client doesn't take.
+ * 1 → the fill was aborted before we sent anything (fetch it
+ * ourselves), 0 → sent in full, -1 → client gone or truncated.
+ * The filler may be a queued pool task (a revalidation), so queued
+ * work is run before waiting on it.                                  */
+static int serve_entry(int socket, cache_element* e, unsigned accepted)
+{
+    size_t off = 0;
+    for (;;) {
+        const char* p;
+        cache_state state;
+        size_t n = cache_peek(e, off, &p, &state);
+        if (n > 0) {
+            if (off == 0 && codec_must_decode(e, accepted)) return serve_decoded(socket, e);
+            if (send_all(socket, p, n) < 0) return -1;
+            metric_add(M_BYTES_CLIENT, n);
+            off += n;
+            continue;
+        }
+        if (state == CACHE_COMPLETE) return 0;
+        if (state == CACHE_ABORTED) return off == 0 ? 1 : -1;
+        if (!pool_help()) cache_wait_blocking(e, off);
+    }
+}
+
+/* Answer one parsed request. 1 → the connection can carry another. */
+static int handle_one(int socket, ParsedRequest* request)
+{
+    if (strcmp(request->method, "GET") != 0) {
+        sendErrorMessage(socket, 501);
+        return 0;
+    }
+    if (strcmp(request->version, "HTTP/1.0") != 0 && strcmp(request->version, "HTTP/1.1") != 0) {
+        sendErrorMessage(socket, 505);
+        return 0;
+    }
+    if (!request->host) {                       /* addressed to us */
+        size_t len;
+        char* page = proxy_local_response(socket, request, &len);
+        if (page) send_all(socket, page, len);
+        free(page);
+        return 0;
+    }
+
+    int keep_alive = http_request_keep_alive(request);
+    char* key = proxy_cache_key(request);
+    int filler = 0, rc;
+    cache_element* revalidate = NULL;
+    cache_element* entry = key ? proxy_cache_open(key, &filler, &revalidate) : NULL;
+    if (revalidate) revalidate_spawn(request, revalidate);
+    if (!entry)
+        rc = handle_request(socket, request, NULL);
+    else if (filler)
+        rc = handle_request(socket, request, entry);
+    else if ((rc = serve_entry(socket, entry, codec_accepted(request))) == 1)
+        rc = handle_request(socket, request, NULL);
+    else if (rc == 0) {
+        const char* head;
+        size_t n = cache_peek(entry, 0, &head, NULL);
+        rc = http_response_reusable(head, n);
+    }
+    cache_release(entry);
+    free(key);
+    return keep_alive && rc == 1;
+}
+
+static void client_close(int socket);
+
+/* CONNECT: connect to the origin and hand both sockets to the tunnel
+ * relay thread, along with whatever the client sent past the head.
+ * 1 → handed off, the socket is no longer ours. Without the relay
+ * thread this worker relays until the tunnel ends.                   */
+static int handle_connect(int socket, ParsedRequest* request, const char* early, size_t early_len)
 {
-    printf("Hellow");
+    int status = proxy_connect_status(request);
+    if (!status && early_len > TUNNEL_CHUNK) status = 400;
+    if (status) {
+        sendErrorMessage(socket, status);
+        return 0;
+    }
+
+    uint64_t t0 = metric_now();
+    int origin = connect_remote_server(request->host, proxy_request_port(request));
+    if (origin < 0) {
+        metric_inc(M_UPSTREAM_FAILURES);
+        sendErrorMessage(socket, 502);
+        return 0;
+    }
+    metric_since(H_UPSTREAM_CONNECT, t0);
+    metric_inc(M_UPSTREAM_CONNECTS);
+
+    if (tunnel_hand_off(socket, origin, early, early_len, client_close) == 0) return 1;
+    tunnel_relay(socket, origin, early, early_len);
+    close(origin);
     return 0;
-}
\ No newline at end of file
+}
+
+/*──────────────────── Keep-alive parking ───────────────────────────*/
+
+/* A keep-alive client between requests holds no worker: its socket
+ * is parked on an epoll set, and one thread turns readiness back into
+ * a pool task. Elsewhere the worker just blocks in recv().           */
+static int park_fd = -1;
+
+static int park(int socket);
+
+/* Requests back to back on one connection, pipelined ones included:
+ * bytes past a header block (and its skipped body) stay in `chunk` for
+ * the next request. Each is answered before the next is read. 1 → the
+ * connection was parked with nothing buffered and is no longer ours;
+ * 0 → done with it, close.                                          */
+static int handle_client(int socket, uint64_t ready_at)
+{
+    ParsedRequest* request = ParsedRequest_create();
+    char chunk[MAX_BYTES];
+    size_t have = 0;                            /* unread bytes in chunk */
+    uint64_t start = ready_at;
+    int parked = 0;
+
+    for (;;) {
+        int rc = PARSE_NEED_MORE;
+        uint64_t parse_ns = 0;
+
+        /* Feed recv() chunks to the parser; it only looks at new bytes. */
+        while (rc == PARSE_NEED_MORE) {
+            if (request->buf_length >= MAX_REQUEST_BYTES) { rc = PARSE_ERROR; break; }
+            if (!have) {
+                ssize_t n = recv(socket, chunk, sizeof chunk, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) goto out;
+                have = (size_t)n;
+                if (!start) start = metric_now();
+            }
+            size_t used;
+            uint64_t t0 = metric_now();
+            rc = ParsedRequest_feed(request, chunk, have, &used);
+            parse_ns += metric_now() - t0;
+            memmove(chunk, chunk + used, have - used);
+            have -= used;
+        }
+        if (rc != PARSE_DONE) {
+            sendErrorMessage(socket, 400);
+            break;
+        }
+        metric_inc(M_REQUESTS);
+        metric_observe(H_PARSE, parse_ns);
+
+        /* Past a CONNECT head the bytes are the tunnel's.              */
+        if (strcmp(request->method, "CONNECT") == 0) {
+            parked = handle_connect(socket, request, chunk, have);
+            metric_since(H_REQUEST, start);
+            break;
+        }
+
+        /* Only GETs are served, so a body is read past and dropped.    */
+        http_framer body;
+        if (http_request_body(request, &body) < 0) {
+            sendErrorMessage(socket, 400);
+            break;
+        }
+        int again = handle_one(socket, request);
+        metric_since(H_REQUEST, start);
+        start = 0;
+        while (again && !body.done) {
+            if (!have) {
+                ssize_t n = recv(socket, chunk, sizeof chunk, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) goto out;
+                have = (size_t)n;
+            }
+            size_t used;
+            if (http_framer_feed(&body, chunk, have, &used) == HTTP_FRAME_ERROR) goto out;
+            memmove(chunk, chunk + used, have - used);
+            have -= used;
+        }
+        if (!again) break;
+        if (!have && (parked = park(socket))) break;
+        ParsedRequest_reset(request);
+        if (have) start = metric_now();
+    }
+out:
+    ParsedRequest_destroy(request);
+    return parked;
+}
+
+static void client_close(int socket)
+{
+    shutdown(socket, SHUT_RDWR);
+    close(socket);
+    metric_inc(M_CONN_CLOSED);
+    sem_post(&semaphore);
+}
+
+/* A connection with bytes to read: fresh from accept(), or unparked. */
+typedef struct client_job {
+    int      socket;
+    uint64_t ready_at;                          /* request latency start */
+} client_job;
+
+static void client_main(void* arg)
+{
+    client_job* job = (client_job*)arg;
+    int socket = job->socket;
+    uint64_t ready_at = job->ready_at;
+    free(job);
+    if (!handle_client(socket, ready_at)) client_close(socket);
+}
+
+static int client_submit(int socket)
+{
+    client_job* job = (client_job*)malloc(sizeof *job);
+    if (!job) return -1;
+    job->socket = socket;
+    job->ready_at = metric_now();
+    if (pool_submit(client_main, job) == 0) return 0;
+    free(job);
+    return -1;
+}
+
+#ifdef __linux__
+static int park(int socket)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT };
+    ev.data.fd = socket;
+    return park_fd >= 0 && epoll_ctl(park_fd, EPOLL_CTL_ADD, socket, &ev) == 0;
+}
+
+static void* parker_main(void* arg)
+{
+    (void)arg;
+    struct epoll_event ev[64];
+    for (;;) {
+        int n = epoll_wait(park_fd, ev, 64, -1);
+        for (int i = 0; i < n; ++i) {
+            int socket = ev[i].data.fd;
+            /* Off the set before anyone else owns it, so it can be
+             * parked again after its next response.                  */
+            epoll_ctl(park_fd, EPOLL_CTL_DEL, socket, NULL);
+            if (client_submit(socket) < 0) client_close(socket);
+        }
+    }
+    return NULL;
+}
+
+static void parker_start(void)
+{
+    pthread_t t;
+    if ((park_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) return;
+    if (pthread_create(&t, NULL, parker_main, NULL) == 0) {
+        pthread_detach(t);
+        return;
+    }
+    close(park_fd);
+    park_fd = -1;
+}
+#else
+static int  park(int socket) { (void)socket; return 0; }
+static void parker_start(void) {}
+#endif
+
+static int run_threaded(int port, int workers, unsigned max_clients)
+{
+    sem_init(&semaphore, 0, max_clients);
+    if (pool_init(workers) < 0) { perror("worker pool"); return 1; }
+    parker_start();
+
+    int proxy_socketId = socket(AF_INET, SOCK_STREAM, 0);
+    if (proxy_socketId < 0) { perror("socket"); return 1; }
+
+    int reuse = 1;
+    setsockopt(proxy_socketId, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse);
+
+    struct sockaddr_in server_addr = { 0 };
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons((uint16_t)port);
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(proxy_socketId, (struct sockaddr*)&server_addr, sizeof server_addr) < 0) {
+        perror("bind");
+        return 1;
+    }
+    if (listen(proxy_socketId, (int)max_clients) < 0) { perror("listen"); return 1; }
+
+    pool_stats ps;
+    pool_get_stats(&ps);
+    printf("Proxy listening on port %d (threaded, %u workers, %u clients max)\n",
+           port, ps.workers, max_clients);
+    for (;;) {
+        sem_wait(&semaphore);
+        int client_socketId = accept(proxy_socketId, NULL, NULL);
+        if (client_socketId < 0) {
+            sem_post(&semaphore);
+            continue;
+        }
+        /* Persistent connections: a response written in several sends
+         * must not wait out the client's delayed ACK.                   */
+        int one = 1;
+        setsockopt(client_socketId, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        metric_inc(M_CONN_OPENED);
+        if (client_submit(client_socketId) < 0) client_close(client_socketId);
+    }
+}
+
+/*──────────────────── Reload ───────────────────────────────────────*/
+
+static sigset_t reload_signals;
+
+/* SIGHUP is blocked in every thread and taken here synchronously, so
+ * a reload runs on an ordinary thread that may read files, allocate
+ * and print. Whatever the new snapshot says is read by the hot paths
+ * on their own; only the cache's budget is pushed. While the cache is
+ * over a budget that shrank, the wait times out every TRIM_PAUSE_MS
+ * and a TRIM_BYTES step of the excess is evicted.                   */
+static void* reload_main(void* arg)
+{
+    (void)arg;
+    size_t over = 0;
+    for (;;) {
+        struct timespec pause = { 0, TRIM_PAUSE_MS * 1000000L };
+        int sig = over ? sigtimedwait(&reload_signals, NULL, &pause)
+                       : sigwaitinfo(&reload_signals, NULL);
+        if (sig == SIGHUP && config_reload() == 0) {
+            const proxy_config* cfg = config_get();
+            cache_set_limits(cfg->cache_bytes, cfg->max_object);
+        }
+        over = cache_trim(TRIM_BYTES);
+    }
+    return NULL;
+}
+
+/* Before any other thread starts, so they all inherit the mask. A
+ * SIGHUP from here on waits, pending, for reload_start().           */
+static void reload_block(void)
+{
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
+}
+
+/* Once the cache and the modules it calls into are set up, so a
+ * reload never runs cache setup with the configured sizes unset.    */
+static void reload_start(void)
+{
+    pthread_t t;
+    if (pthread_create(&t, NULL, reload_main, NULL) == 0) pthread_detach(t);
+    else fprintf(stderr, "reload thread unavailable, SIGHUP is ignored\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* config_file = NULL;             /* NULL → flags only  */
+    const char* disk_dir = NULL;                /* NULL → RAM only    */
+    const char* hosts_file = NULL;
+    const char* dns_server = NULL;              /* NULL → getaddrinfo */
+    const char* compress = NULL;                /* NULL → stored as sent */
+    cache_admission admission = CACHE_ADMIT_TINYLFU;
+    int bad = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--mode=", 7) == 0)         bad = config_override("mode", argv[i] + 7) < 0;
+        else if (strncmp(argv[i], "--workers=", 10) == 0)
+            bad = config_override("workers", argv[i] + 10) < 0;
+        else if (strncmp(argv[i], "--config=", 9) == 0)  config_file = argv[i] + 9;
+        else if (strncmp(argv[i], "--disk=", 7) == 0)    disk_dir = argv[i] + 7;
+        else if (strncmp(argv[i], "--hosts=", 8) == 0)   hosts_file = argv[i] + 8;
+        else if (strncmp(argv[i], "--dns=", 6) == 0)     dns_server = argv[i] + 6;
+        else if (strncmp(argv[i], "--compress=", 11) == 0) compress = argv[i] + 11;
+        else if (strncmp(argv[i], "--admission=", 12) == 0)
+            bad = cache_admission_parse(argv[i] + 12, &admission) < 0;
+        else if (strncmp(argv[i], "--max-object=", 13) == 0)
+            bad = config_override("max_object", argv[i] + 13) < 0;
+        else if (strncmp(argv[i], "--connect-ports=", 16) == 0)
+            bad = tunnel_set_ports(argv[i] + 16) < 0;
+        else if (argv[i][0] != '-')                       bad = config_override("port", argv[i]) < 0;
+        else bad = 1;
+
+        if (bad) {
+            fprintf(stderr, "usage: %s [port] [--mode=epoll|uring|threaded] [--workers=N]"
+                            " [--disk=DIR] [--hosts=FILE] [--dns=IP[:PORT]]"
+                            " [--compress=gzip] [--admission=tinylfu|tinylfu-bytes|lru]"
+                            " [--max-object=BYTES] [--connect-ports=443,...]"
+                            " [--config=FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (config_load(config_file) < 0) return 2;
+    const proxy_config* cfg = config_get();     /* startup fields never change */
+    if (config_file) reload_block();
+
+    signal(SIGPIPE, SIG_IGN);
+    cache_set_admission(admission, cfg->max_object);
+    cache_init(cfg->cache_bytes, cfg->cache_shards);
+    if (dns_init(hosts_file, dns_server) < 0) {
+        perror(dns_server && errno == EINVAL ? dns_server : hosts_file);
+        return 2;
+    }
+    if (compress && codec_init(compress) < 0) {
+        perror(compress);
+        return 2;
+    }
+    if (disk_dir) {
+        if (disk_init(disk_dir, DISK_MAX_SIZE) == 0) cache_set_evict_hook(disk_demote);
+        else perror("disk cache");
+    }
+    if (config_file) reload_start();
+
+    if (cfg->mode != MODE_THREADED) {
+        event_engine engine = cfg->mode == MODE_URING ? EVENT_URING : EVENT_EPOLL;
+        if (proxy_event_run((int)cfg->port, (int)cfg->workers, engine) == 0) return 0;
+        fprintf(stderr, "epoll front end unavailable, falling back to threads\n");
+    }
+    return run_threaded((int)cfg->port, (int)cfg->workers, cfg->max_clients);
+}
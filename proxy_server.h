@@ -0,0 +1,73 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_server.h
+ *
+ *  Pieces of the proxy shared by every front end (threaded, epoll):
+ *  the request-rewriting helpers that turn a ParsedRequest into the
+ *  bytes we send upstream. The cache is declared in proxy_cache.h.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_SERVER_H
+#define PROXY_SERVER_H
+
+#include <stddef.h>
+
+#include "proxy_parse.h"
+#include "proxy_cache.h"
+#include "proxy_http.h"
+
+#define MAX_BYTES          4096                 /* recv() chunk size         */
+#define MAX_REQUEST_BYTES  (8 * 1024)           /* client header block cap   */
+
+/*──────────────────────── Request helpers (proxy_server.c) ───────────*/
+
+/* "host:port/path" – the cache key for a parsed GET. Caller frees.    */
+char* proxy_cache_key(const ParsedRequest* pr);
+
+/* Rewrite pr for the origin (origin-form path, Host, hop-by-hop headers
+ * stripped, Connection: keep-alive) and serialise it into a malloc'd
+ * buffer. With `fill` – the entry the response will fill – it asks
+ * for the whole entity, conditionally when fill revalidates a stale
+ * entry (http_prepare_fill_headers()). Returns length or -1.          */
+int   proxy_build_upstream_request(ParsedRequest* pr, const cache_element* fill, char** out);
+
+/* Canned error page for status_code into dst; returns length or -1.   */
+int   proxy_error_response(int status_code, char* dst, size_t dst_len);
+
+/* Response to an origin-form request (pr->host NULL), i.e. one for the
+ * proxy itself: the /stats page for loopback clients, else an error
+ * page. malloc'd, *len its length; NULL when out of memory.          */
+char* proxy_local_response(int client_fd, const ParsedRequest* pr, size_t* len);
+
+/* Can this CONNECT be tunnelled? 0, or the status to refuse it with:
+ * 505 for an unknown version, 400 without host:port, 403 for a port
+ * off the allow list (proxy_tunnel.h).                               */
+int   proxy_connect_status(const ParsedRequest* pr);
+
+/* Resolve host (via the resolver cache, proxy_dns.h) and connect to
+ * port; blocking. Returns fd or -1.                                  */
+int   connect_remote_server(const char* host_addr, int port_num);
+
+/* Numeric port from pr->port, defaulting to 80.                       */
+int   proxy_request_port(const ParsedRequest* pr);
+
+/* 1 if a response buffer starts with a cacheable "HTTP/1.x 200".      */
+int   proxy_response_cacheable(const char* data, size_t len);
+
+/* Complete a streamed fill; it stays indexed only if cacheable, with
+ * the expiry its head implies.                                       */
+void  proxy_fill_finish(cache_element* e);
+
+/* A revalidating filler (e->prior set) has the origin's final head in
+ * f, or f failed to frame it. 1 → a 304: the stale entry is fresh
+ * again and e now serves its bytes, so the fill is over. 0 → a new
+ * response, released to e's readers; fill on as usual.              */
+int   proxy_fill_validated(cache_element* e, const http_framer* f);
+
+/* cache_open() for key, falling back to the disk tier: a disk hit is
+ * promoted into the fresh entry, which comes back COMPLETE with
+ * *filler = 0. NULL, also with *filler = 0, means fetch uncached.
+ * *revalidate as for cache_open(): a successor to fill in the
+ * background while the stale entry returned is served.               */
+cache_element* proxy_cache_open(const char* key, int* filler, cache_element** revalidate);
+
+#endif /* PROXY_SERVER_H */
@@ -0,0 +1,88 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_sketch.c      –  count-min frequency sketch
+ *
+ *  Laid out as Caffeine's FrequencySketch: a power-of-two table of
+ *  64-bit words, each holding sixteen 4-bit counters. A key's row i
+ *  picks a word with its own seeded hash, and counter (start + i) in it,
+ *  where start ∈ {0, 4, 8, 12} comes from the key's low bits – so four
+ *  keys can share a word without sharing counters. One word per key
+ *  sized for gives 8 bytes of sketch per cached entry.
+ *
+ *  Aging halves every counter in one pass over the table, a shift and
+ *  a mask per word.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#include "proxy_sketch.h"
+
+#include <stdlib.h>
+
+static const uint64_t seeds[4] = {
+    0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull,
+    0x9ae16a3b2f90404full, 0xcbf29ce484222325ull,
+};
+
+static inline size_t word_of(const freq_sketch* s, uint64_t hash, unsigned row)
+{
+    uint64_t h = (hash + seeds[row]) * seeds[row];
+    h += h >> 32;
+    return (size_t)h & s->mask;
+}
+
+static void age(freq_sketch* s)
+{
+    for (size_t i = 0; i <= s->mask; ++i)
+        s->table[i] = (s->table[i] >> 1) & 0x7777777777777777ull;
+    s->recorded /= 2;
+    ++s->agings;
+}
+
+int sketch_init(freq_sketch* s, size_t keys)
+{
+    size_t words = SKETCH_MIN_KEYS;
+    while (words < keys) words <<= 1;
+
+    uint64_t* table = (uint64_t*)calloc(words, sizeof *table);
+    if (!table) return -1;
+    free(s->table);
+    s->table = table;
+    s->mask = words - 1;
+    s->keys = words;
+    s->sample = words * SKETCH_SAMPLE_MUL;
+    s->recorded = 0;
+    return 0;
+}
+
+void sketch_free(freq_sketch* s)
+{
+    free(s->table);
+    s->table = NULL;
+}
+
+void sketch_record(freq_sketch* s, uint64_t hash)
+{
+    unsigned start = (unsigned)(hash & 3) << 2;
+    int added = 0;
+
+    for (unsigned i = 0; i < 4; ++i) {
+        uint64_t* w = &s->table[word_of(s, hash, i)];
+        unsigned shift = (start + i) << 2;
+        if (((*w >> shift) & 0xF) != 0xF) {
+            *w += 1ull << shift;
+            added = 1;
+        }
+    }
+    if (added && ++s->recorded >= s->sample) age(s);
+}
+
+unsigned sketch_estimate(const freq_sketch* s, uint64_t hash)
+{
+    unsigned start = (unsigned)(hash & 3) << 2;
+    unsigned freq = 0xF;
+
+    for (unsigned i = 0; i < 4; ++i) {
+        uint64_t w = s->table[word_of(s, hash, i)];
+        unsigned c = (unsigned)(w >> ((start + i) << 2)) & 0xF;
+        if (c < freq) freq = c;
+    }
+    return freq;
+}
@@ -0,0 +1,50 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_sketch.h
+ *
+ *  Count-min frequency sketch with aging, the popularity estimate behind
+ *  the cache's TinyLFU admission policy (proxy_cache.h).
+ *
+ *      • Four 4-bit counters per key, one per row, each row hashed
+ *        differently; a key's estimate is the smallest of them, so
+ *        collisions can only overcount.
+ *      • Counters saturate at 15: admission only needs to tell popular
+ *        from unpopular, not how popular.
+ *      • After `sample` recorded accesses every counter is halved, so
+ *        the sketch follows a changing working set instead of counting
+ *        forever (Einziger et al., "TinyLFU: A Highly Efficient Cache
+ *        Admission Policy", 2017).
+ *
+ *  Not thread safe: the cache keeps one per shard, under its lock.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_SKETCH_H
+#define PROXY_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SKETCH_MIN_KEYS     64
+#define SKETCH_SAMPLE_MUL   10              /* age every 10 × keys accesses */
+
+typedef struct freq_sketch {
+    uint64_t* table;                        /* 16 counters per word      */
+    size_t    mask;                         /* words - 1                 */
+    size_t    keys;                         /* sized for this many       */
+    size_t    sample;                       /* accesses per aging period */
+    size_t    recorded;                     /*   …so far in this one     */
+    uint64_t  agings;
+} freq_sketch;
+
+/* Size s for about `keys` distinct keys (at least SKETCH_MIN_KEYS).
+ * -1 when out of memory; s is untouched then, so a resize can keep the
+ * old table.                                                          */
+int      sketch_init(freq_sketch* s, size_t keys);
+void     sketch_free(freq_sketch* s);
+
+/* One access to the key with this (well mixed) hash.                 */
+void     sketch_record(freq_sketch* s, uint64_t hash);
+
+/* Accesses to it in the recent past, 0…15.                           */
+unsigned sketch_estimate(const freq_sketch* s, uint64_t hash);
+
+#endif /* PROXY_SKETCH_H */
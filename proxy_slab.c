@@ -0,0 +1,323 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_slab.c      –  size-classed slabs + large mappings + arena
+ *
+ *  A page starts with its slab_page header; objects follow, carved
+ *  lazily from `bump` and recycled through an intrusive free list.
+ *  Pages are SLAB_PAGE_SIZE-aligned, so free() finds the header by
+ *  masking the pointer.
+ *
+ *  Per class (own lock):
+ *      partial   pages with at least one free object; a full page is
+ *                off the list until something in it is freed
+ *      spare     at most one empty page kept mapped (its memory given
+ *                back with MADV_DONTNEED), so a class that oscillates
+ *                around a page boundary doesn't mmap/munmap every call
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_slab.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SLAB_MIN_OBJECT   16
+#define SLAB_CLASSES      52                /* 16..64 by 16, then 4/octave */
+#define SLAB_HEADER       64                /* slab_page, rounded        */
+
+typedef struct slab_page slab_page;
+
+struct slab_page {
+    slab_page* prev;
+    slab_page* next;
+    void*      free;                        /* recycled objects          */
+    char*      bump;                        /* never handed out yet      */
+    unsigned   cls;
+    unsigned   used;
+    unsigned   capacity;
+    int        listed;                      /* on the partial list       */
+};
+
+typedef struct slab_class {
+    _Alignas(64) pthread_mutex_t lock;
+    size_t     size;
+    slab_page* partial;
+    slab_page* spare;
+    size_t     pages;                       /* mapped, spare included    */
+    size_t     objects;
+} slab_class;
+
+_Static_assert(sizeof(slab_page) <= SLAB_HEADER, "slab_page outgrew its header");
+
+static slab_class     classes[SLAB_CLASSES];
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static size_t         os_page;
+
+static atomic_size_t  large_count, large_bytes;
+static atomic_size_t  requested_bytes, allocated_bytes;
+
+
+/*──────────────────── Size classes ─────────────────────────────────*/
+
+static unsigned class_of(size_t n)
+{
+    if (n <= 64) return n <= SLAB_MIN_OBJECT ? 0 : (unsigned)((n + 15) / 16 - 1);
+
+    unsigned b = 63 - (unsigned)__builtin_clzll((unsigned long long)(n - 1));
+    size_t step = (size_t)1 << (b - 2);
+    return 4 + (b - 6) * 4 + (unsigned)((n - 1 - ((size_t)1 << b)) / step);
+}
+
+static void slab_setup(void)
+{
+    os_page = (size_t)sysconf(_SC_PAGESIZE);
+    for (unsigned c = 0; c < SLAB_CLASSES; ++c) {
+        pthread_mutex_init(&classes[c].lock, NULL);
+        if (c < 4) {
+            classes[c].size = (size_t)(c + 1) * 16;
+        }
+        else {
+            unsigned b = 6 + (c - 4) / 4;
+            classes[c].size = ((size_t)1 << b) + (size_t)((c - 4) % 4 + 1) * ((size_t)1 << (b - 2));
+        }
+    }
+}
+
+static inline void ensure_init(void)
+{
+    pthread_once(&init_once, slab_setup);
+}
+
+static size_t large_size(size_t n)
+{
+    return (n + os_page - 1) & ~(os_page - 1);
+}
+
+size_t slab_size(size_t n)
+{
+    ensure_init();
+    if (n == 0) n = 1;
+    return n > SLAB_MAX_OBJECT ? large_size(n) : classes[class_of(n)].size;
+}
+
+
+/*──────────────────── Pages (class lock held) ──────────────────────*/
+
+static slab_page* page_map(unsigned cls)
+{
+    /* Over-map, then trim to a SLAB_PAGE_SIZE boundary.             */
+    char* raw = (char*)mmap(NULL, 2 * (size_t)SLAB_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    uintptr_t base = ((uintptr_t)raw + SLAB_PAGE_SIZE - 1) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+    size_t head = base - (uintptr_t)raw;
+    if (head) munmap(raw, head);
+    munmap((char*)base + SLAB_PAGE_SIZE, SLAB_PAGE_SIZE - head);
+
+    slab_page* pg = (slab_page*)base;
+    pg->prev = pg->next = NULL;
+    pg->free = NULL;
+    pg->bump = (char*)base + SLAB_HEADER;
+    pg->cls = cls;
+    pg->used = 0;
+    pg->capacity = (unsigned)((SLAB_PAGE_SIZE - SLAB_HEADER) / classes[cls].size);
+    pg->listed = 0;
+    ++classes[cls].pages;
+    return pg;
+}
+
+static void list_push(slab_class* k, slab_page* pg)
+{
+    pg->prev = NULL;
+    pg->next = k->partial;
+    if (k->partial) k->partial->prev = pg;
+    k->partial = pg;
+    pg->listed = 1;
+}
+
+static void list_unlink(slab_class* k, slab_page* pg)
+{
+    if (pg->prev) pg->prev->next = pg->next; else k->partial = pg->next;
+    if (pg->next) pg->next->prev = pg->prev;
+    pg->prev = pg->next = NULL;
+    pg->listed = 0;
+}
+
+static int page_full(const slab_class* k, const slab_page* pg)
+{
+    return !pg->free && pg->bump + k->size > (const char*)pg + SLAB_PAGE_SIZE;
+}
+
+
+/*──────────────────── Public API ───────────────────────────────────*/
+
+void* slab_alloc(size_t n)
+{
+    ensure_init();
+    if (n == 0) n = 1;
+
+    if (n > SLAB_MAX_OBJECT) {
+        size_t len = large_size(n);
+        void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+        atomic_fetch_add(&large_count, 1);
+        atomic_fetch_add(&large_bytes, len);
+        atomic_fetch_add(&requested_bytes, n);
+        atomic_fetch_add(&allocated_bytes, len);
+        return p;
+    }
+
+    unsigned cls = class_of(n);
+    slab_class* k = &classes[cls];
+    pthread_mutex_lock(&k->lock);
+
+    slab_page* pg = k->partial;
+    if (!pg) {
+        pg = k->spare ? k->spare : page_map(cls);
+        k->spare = NULL;
+        if (!pg) { pthread_mutex_unlock(&k->lock); return NULL; }
+        list_push(k, pg);
+    }
+
+    void* p;
+    if (pg->free) {
+        p = pg->free;
+        pg->free = *(void**)p;
+    }
+    else {
+        p = pg->bump;
+        pg->bump += k->size;
+    }
+    ++pg->used;
+    ++k->objects;
+    if (page_full(k, pg)) list_unlink(k, pg);
+    pthread_mutex_unlock(&k->lock);
+
+    atomic_fetch_add(&requested_bytes, n);
+    atomic_fetch_add(&allocated_bytes, k->size);
+    return p;
+}
+
+void* slab_calloc(size_t n)
+{
+    void* p = slab_alloc(n);
+    if (p && n <= SLAB_MAX_OBJECT) memset(p, 0, n);    /* mmap is zeroed */
+    return p;
+}
+
+void slab_free(void* p, size_t n)
+{
+    if (!p) return;
+    if (n == 0) n = 1;
+
+    if (n > SLAB_MAX_OBJECT) {
+        size_t len = large_size(n);
+        munmap(p, len);
+        atomic_fetch_sub(&large_count, 1);
+        atomic_fetch_sub(&large_bytes, len);
+        atomic_fetch_sub(&requested_bytes, n);
+        atomic_fetch_sub(&allocated_bytes, len);
+        return;
+    }
+
+    slab_page* pg = (slab_page*)((uintptr_t)p & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+    slab_class* k = &classes[pg->cls];
+    slab_page* unmap = NULL;
+
+    pthread_mutex_lock(&k->lock);
+    *(void**)p = pg->free;
+    pg->free = p;
+    --pg->used;
+    --k->objects;
+    if (pg->used == 0) {
+        if (pg->listed) list_unlink(k, pg);
+        if (k->spare) {
+            unmap = pg;
+            --k->pages;
+        }
+        else {
+            /* Reset, so the spare is carved from the start again, and
+             * hand its memory back: only the header page stays resident. */
+            pg->free = NULL;
+            pg->bump = (char*)pg + SLAB_HEADER;
+            k->spare = pg;
+            madvise((char*)pg + os_page, SLAB_PAGE_SIZE - os_page, MADV_DONTNEED);
+        }
+    }
+    else if (!pg->listed) {
+        list_push(k, pg);
+    }
+    pthread_mutex_unlock(&k->lock);
+
+    if (unmap) munmap(unmap, SLAB_PAGE_SIZE);
+    atomic_fetch_sub(&requested_bytes, n);
+    atomic_fetch_sub(&allocated_bytes, k->size);
+}
+
+void slab_get_stats(slab_stats* out)
+{
+    ensure_init();
+    memset(out, 0, sizeof *out);
+    for (unsigned c = 0; c < SLAB_CLASSES; ++c) {
+        slab_class* k = &classes[c];
+        pthread_mutex_lock(&k->lock);
+        out->pages += k->pages;
+        out->spare_pages += k->spare ? 1 : 0;
+        out->objects += k->objects;
+        out->capacity += k->pages * ((SLAB_PAGE_SIZE - SLAB_HEADER) / k->size);
+        pthread_mutex_unlock(&k->lock);
+    }
+    out->large = atomic_load(&large_count);
+    out->footprint = (out->pages - out->spare_pages) * SLAB_PAGE_SIZE
+                   + out->spare_pages * os_page + atomic_load(&large_bytes);
+    out->allocated = atomic_load(&allocated_bytes);
+    out->requested = atomic_load(&requested_bytes);
+}
+
+
+/*──────────────────── Arena ────────────────────────────────────────*/
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t              used, cap;          /* bytes after the header    */
+} arena_block;
+
+#define ARENA_HEADER  ((sizeof(arena_block) + 15) & ~(size_t)15)
+
+void* arena_alloc(slab_arena* a, size_t n)
+{
+    n = (n + 15) & ~(size_t)15;
+    arena_block* b = a->head;
+    if (!b || b->cap - b->used < n) {
+        size_t want = slab_size(ARENA_HEADER + (n > SLAB_ARENA_BLOCK ? n : SLAB_ARENA_BLOCK));
+        b = (arena_block*)slab_alloc(want);     /* the class slack is ours */
+        if (!b) return NULL;
+        b->next = a->head;
+        b->used = 0;
+        b->cap = want - ARENA_HEADER;
+        a->head = b;
+    }
+    void* p = (char*)b + ARENA_HEADER + b->used;
+    b->used += n;
+    return p;
+}
+
+char* arena_strdup(slab_arena* a, const char* s)
+{
+    size_t n = strlen(s) + 1;
+    char* p = (char*)arena_alloc(a, n);
+    if (p) memcpy(p, s, n);
+    return p;
+}
+
+void arena_release(slab_arena* a)
+{
+    while (a->head) {
+        arena_block* b = a->head;
+        a->head = b->next;
+        slab_free(b, ARENA_HEADER + b->cap);
+    }
+}
@@ -0,0 +1,65 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_slab.h
+ *
+ *  Size-classed slab allocator for cache objects, and a bump arena for
+ *  per-connection scratch buffers.
+ *
+ *  Cache entries churn through every size from a 40-byte URL to a 10 MB
+ *  body. Left to malloc, that workload strands free memory between live
+ *  blocks and RSS drifts well above what the cache thinks it holds.
+ *  Here:
+ *
+ *      • Sizes up to SLAB_MAX_OBJECT round up to one of ~50 classes,
+ *        four per power of two, so internal waste stays under 20 %.
+ *      • Each class carves its objects out of SLAB_PAGE_SIZE pages that
+ *        hold that class only. A page that empties is unmapped (one
+ *        spare per class is kept), so memory returns to the OS instead
+ *        of lingering in a heap.
+ *      • Anything bigger gets its own page-rounded mmap.
+ *
+ *  slab_size(n) is exactly what an allocation of n costs, and the cache
+ *  charges that against its budget. slab_get_stats() adds what no
+ *  object pays for – the unused tail of partially filled pages – so
+ *  footprint tracks RSS.
+ *
+ *  Frees are sized: pass the n given to slab_alloc().
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_SLAB_H
+#define PROXY_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_PAGE_SIZE      (1 << 20)           /* per class page, aligned   */
+#define SLAB_MAX_OBJECT     (256 * 1024)        /* larger → own mapping      */
+#define SLAB_ARENA_BLOCK    (32 * 1024)         /* arena growth step         */
+
+typedef struct slab_stats {
+    size_t   footprint;             /* resident: pages in use + large     */
+    size_t   allocated;             /* slab_size() of live objects        */
+    size_t   requested;             /* what callers asked for             */
+    size_t   pages, spare_pages;    /* class pages (spares are empty)     */
+    size_t   large;                 /* objects with their own mapping     */
+    size_t   objects, capacity;     /* live vs carvable in mapped pages   */
+} slab_stats;
+
+void*  slab_alloc(size_t n);                    /* NULL when out of memory  */
+void*  slab_calloc(size_t n);
+void   slab_free(void* p, size_t n);
+size_t slab_size(size_t n);                     /* bytes actually granted   */
+
+void   slab_get_stats(slab_stats* out);
+
+/*──────── Arena ────────*/
+
+/* Bump allocator over slab blocks; everything goes in one release.    */
+typedef struct slab_arena {
+    struct arena_block* head;
+} slab_arena;
+
+void*  arena_alloc(slab_arena* a, size_t n);
+char*  arena_strdup(slab_arena* a, const char* s);
+void   arena_release(slab_arena* a);
+
+#endif /* PROXY_SLAB_H */
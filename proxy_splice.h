@@ -0,0 +1,45 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_splice.h
+ *
+ *  Zero-copy socket → socket forwarding through a pipe.
+ *
+ *  splice() moves page references from the origin socket into a pipe
+ *  and from the pipe into the client socket; the payload never crosses
+ *  into user space. The relays use it for response bodies they don't
+ *  need to look at (see http_framer_opaque_left()) and that are not
+ *  being copied into the cache – i.e. uncached downloads, which are
+ *  also the big ones.
+ *
+ *  Linux only; elsewhere splice_pipe_open() fails with ENOSYS and the
+ *  relays keep using recv()/send().
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_SPLICE_H
+#define PROXY_SPLICE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SPLICE_PIPE_SIZE    (256 * 1024)        /* requested pipe capacity   */
+
+typedef struct splice_pipe {
+    int    rd, wr;                  /* -1 when not open                   */
+    int    nonblocking;             /* SPLICE_F_NONBLOCK on both sides    */
+    size_t held;                    /* bytes in the pipe, not yet sent    */
+} splice_pipe;
+
+/* Mark p closed without opening it.                                   */
+void    splice_pipe_init(splice_pipe* p);
+
+/* 0, or -1 (errno) when pipes or splice() are unavailable.            */
+int     splice_pipe_open(splice_pipe* p, int nonblocking);
+void    splice_pipe_close(splice_pipe* p);
+
+/* Origin → pipe, at most `max` bytes. >0 moved, 0 EOF, -1 errno.      */
+ssize_t splice_fill(splice_pipe* p, int from, size_t max);
+
+/* Pipe → client until empty or the socket would block. Returns bytes
+ * moved, or -1 (errno) on error or EAGAIN with nothing moved.         */
+ssize_t splice_drain(splice_pipe* p, int to);
+
+#endif /* PROXY_SPLICE_H */
@@ -0,0 +1,354 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_tunnel.c      –  CONNECT byte relay, idle list, relay thread
+ *
+ *  A ring is filled by recv() into its free span and drained by send()
+ *  from its used span, at most two calls each per lap since a span may
+ *  wrap. tunnel_pump() laps both directions until neither moves a
+ *  byte, which is what edge-triggered readiness needs: any socket not
+ *  left at EAGAIN is a ring that is full or empty, and the other side's
+ *  next edge brings us back to it.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_tunnel.h"
+
+#include "proxy_config.h"
+#include "proxy_metrics.h"
+#include "proxy_slab.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+int tunnel_init(tunnel* t, int client_fd, int origin_fd, const char* early, size_t early_len)
+{
+    static const char established[] = TUNNEL_ESTABLISHED;
+
+    memset(t, 0, sizeof *t);
+    if (early_len > TUNNEL_CHUNK) {
+        errno = E2BIG;
+        return -1;
+    }
+    char* rings = (char*)slab_alloc(2 * TUNNEL_CHUNK);
+    if (!rings) {
+        errno = ENOMEM;
+        return -1;
+    }
+    t->client_fd = client_fd;
+    t->origin_fd = origin_fd;
+    t->up.data = rings;
+    t->down.data = rings + TUNNEL_CHUNK;
+
+    memcpy(t->up.data, early, early_len);
+    t->up.len = early_len;
+    memcpy(t->down.data, established, sizeof established - 1);
+    t->down.len = sizeof established - 1;
+    metric_inc(M_TUNNELS_OPENED);
+    return 0;
+}
+
+void tunnel_release(tunnel* t)
+{
+    if (!t->up.data) return;
+    slab_free(t->up.data, 2 * TUNNEL_CHUNK);
+    t->up.data = t->down.data = NULL;
+    metric_inc(M_TUNNELS_CLOSED);
+}
+
+/* One lap of one direction: send what r holds to `to`, then refill it
+ * from `from`. 1 if a byte moved (or EOF arrived), 0 if both would
+ * block, -1 on a socket error.                                       */
+static int ring_lap(tunnel_ring* r, int from, int to, metric_counter bytes)
+{
+    int moved = 0;
+
+    while (r->len) {
+        size_t span = TUNNEL_CHUNK - r->head;
+        if (span > r->len) span = r->len;
+        ssize_t n = send(to, r->data + r->head, span, MSG_NOSIGNAL);
+        if (n > 0) {
+            r->head = (r->head + (size_t)n) % TUNNEL_CHUNK;
+            r->len -= (size_t)n;
+            metric_add(bytes, (uint64_t)n);
+            moved = 1;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        return -1;
+    }
+    if (!r->len) r->head = 0;                   /* one span next time */
+
+    while (!r->eof && r->len < TUNNEL_CHUNK) {
+        size_t tail = (r->head + r->len) % TUNNEL_CHUNK;
+        size_t span = tail < r->head ? r->head - tail : TUNNEL_CHUNK - tail;
+        ssize_t n = recv(from, r->data + tail, span, 0);
+        if (n > 0) {
+            r->len += (size_t)n;
+            moved = 1;
+            continue;
+        }
+        if (n == 0) {
+            r->eof = 1;
+            moved = 1;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) break;
+        return -1;
+    }
+
+    if (r->eof && !r->len && !r->shut) {
+        shutdown(to, SHUT_WR);
+        r->shut = 1;
+    }
+    return moved;
+}
+
+int tunnel_pump(tunnel* t)
+{
+    for (;;) {
+        int up = ring_lap(&t->up, t->client_fd, t->origin_fd, M_BYTES_TUNNEL_UP);
+        int down = ring_lap(&t->down, t->origin_fd, t->client_fd, M_BYTES_TUNNEL_DOWN);
+        if (up < 0 || down < 0) return TUNNEL_ERROR;
+        if (t->up.shut && t->down.shut) return TUNNEL_DONE;
+        if (!up && !down) return TUNNEL_OPEN;
+    }
+}
+
+
+/*──────────────────── Idle list ────────────────────────────────────*/
+
+void tunnel_unlist(tunnel_list* l, tunnel* t)
+{
+    if (!t->listed) return;
+    if (t->prev) t->prev->next = t->next;
+    else         l->head = t->next;
+    if (t->next) t->next->prev = t->prev;
+    else         l->tail = t->prev;
+    t->prev = t->next = NULL;
+    t->listed = 0;
+    --l->count;
+}
+
+void tunnel_touch(tunnel_list* l, tunnel* t, uint64_t now)
+{
+    t->active_at = now;
+    if (t->listed && !t->next) return;          /* already the newest */
+    tunnel_unlist(l, t);
+    t->prev = l->tail;
+    t->next = NULL;
+    if (l->tail) l->tail->next = t;
+    else         l->head = t;
+    l->tail = t;
+    t->listed = 1;
+    ++l->count;
+}
+
+tunnel* tunnel_expired(const tunnel_list* l, uint64_t now)
+{
+    tunnel* t = l->head;
+    uint64_t idle_ns = (uint64_t)config_get()->tunnel_idle_secs * 1000000000u;
+    return t && now - t->active_at >= idle_ns ? t : NULL;
+}
+
+
+/*──────────────────── Port allow list ──────────────────────────────*/
+
+static unsigned char allowed[65536 / 8] = { [443 / 8] = 1u << (443 % 8) };
+
+int tunnel_set_ports(const char* list)
+{
+    unsigned char next[sizeof allowed] = { 0 };
+    const char* p = list;
+    for (;;) {
+        char* end;
+        long port = strtol(p, &end, 10);
+        if (end == p || port <= 0 || port > 65535 || (*end && *end != ',')) {
+            errno = EINVAL;
+            return -1;
+        }
+        next[port / 8] |= (unsigned char)(1u << (port % 8));
+        if (!*end) break;
+        p = end + 1;
+    }
+    memcpy(allowed, next, sizeof allowed);
+    return 0;
+}
+
+int tunnel_port_allowed(int port)
+{
+    return port > 0 && port < 65536 && (allowed[port / 8] >> (port % 8) & 1);
+}
+
+
+/*──────────────────── Blocking relay ───────────────────────────────*/
+
+static int set_nonblocking(int fd)
+{
+    int fl = fcntl(fd, F_GETFL);
+    return fl < 0 ? -1 : fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+static short wants(const tunnel_ring* out, const tunnel_ring* in)
+{
+    short ev = 0;
+    if (!in->eof && in->len < TUNNEL_CHUNK) ev |= POLLIN;
+    if (out->len) ev |= POLLOUT;
+    return ev;
+}
+
+void tunnel_relay(int client_fd, int origin_fd, const char* early, size_t early_len)
+{
+    tunnel t;
+    if (set_nonblocking(client_fd) < 0 || set_nonblocking(origin_fd) < 0
+        || tunnel_init(&t, client_fd, origin_fd, early, early_len) < 0)
+        return;
+
+    while (tunnel_pump(&t) == TUNNEL_OPEN) {
+        struct pollfd pfd[2] = {
+            { .fd = client_fd, .events = wants(&t.down, &t.up) },
+            { .fd = origin_fd, .events = wants(&t.up, &t.down) },
+        };
+        int n = poll(pfd, 2, (int)config_get()->tunnel_idle_secs * 1000);
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) metric_inc(M_TUNNEL_TIMEOUTS);
+        if (n <= 0) break;
+    }
+    tunnel_release(&t);
+}
+
+
+/*──────────────────── Relay thread (threaded front end) ────────────*/
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+typedef struct relayed {
+    tunnel  t;                      /* first: epoll data points here      */
+    void  (*closed)(int client_fd);
+    struct relayed* next_dead;
+} relayed;
+
+static pthread_once_t  relay_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t relay_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             relay_fd = -1;       /* epoll set; -1: no thread */
+static tunnel_list     relay_idle;          /* under relay_lock         */
+
+static void relay_close(relayed* r, relayed** dead)
+{
+    tunnel_unlist(&relay_idle, &r->t);
+    close(r->t.origin_fd);                      /* both leave the set */
+    r->closed(r->t.client_fd);
+    tunnel_release(&r->t);
+    r->next_dead = *dead;
+    *dead = r;
+}
+
+/* Batches are handled under relay_lock, so a hand-off never sees a
+ * half-closed tunnel; tunnels closed in one are freed after it, so a
+ * later event in the same batch never touches freed memory.         */
+static void* relay_main(void* arg)
+{
+    (void)arg;
+    struct epoll_event ev[64];
+    uint64_t swept = metric_now();
+
+    for (;;) {
+        int n = epoll_wait(relay_fd, ev, 64, TUNNEL_TICK_MS);
+        if (n < 0 && errno != EINTR) break;
+
+        relayed* dead = NULL;
+        uint64_t now = metric_now();
+        pthread_mutex_lock(&relay_lock);
+        for (int i = 0; i < n; ++i) {
+            relayed* r = (relayed*)ev[i].data.ptr;
+            if (!r->t.up.data) continue;                /* closed this batch */
+            tunnel_touch(&relay_idle, &r->t, now);
+            if (tunnel_pump(&r->t) != TUNNEL_OPEN) relay_close(r, &dead);
+        }
+        if (now - swept >= (uint64_t)TUNNEL_TICK_MS * 1000000u) {
+            swept = now;
+            tunnel* t;
+            while ((t = tunnel_expired(&relay_idle, now))) {
+                metric_inc(M_TUNNEL_TIMEOUTS);
+                relay_close((relayed*)t, &dead);
+            }
+        }
+        pthread_mutex_unlock(&relay_lock);
+
+        while (dead) {
+            relayed* r = dead;
+            dead = r->next_dead;
+            free(r);
+        }
+    }
+    return NULL;
+}
+
+static void relay_setup(void)
+{
+    pthread_t t;
+    if ((relay_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) return;
+    if (pthread_create(&t, NULL, relay_main, NULL) == 0) {
+        pthread_detach(t);
+        return;
+    }
+    close(relay_fd);
+    relay_fd = -1;
+}
+
+static int relay_watch(relayed* r, int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET };
+    ev.data.ptr = r;
+    return epoll_ctl(relay_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int tunnel_hand_off(int client_fd, int origin_fd, const char* early, size_t early_len,
+                    void (*closed)(int client_fd))
+{
+    pthread_once(&relay_once, relay_setup);
+    if (relay_fd < 0 || set_nonblocking(client_fd) < 0 || set_nonblocking(origin_fd) < 0)
+        return -1;
+
+    relayed* r = (relayed*)calloc(1, sizeof *r);
+    if (!r || tunnel_init(&r->t, client_fd, origin_fd, early, early_len) < 0) {
+        free(r);
+        return -1;
+    }
+    r->closed = closed;
+
+    /* Registering makes both sockets writable events at once, which
+     * sends the 200 and the early bytes.                             */
+    pthread_mutex_lock(&relay_lock);
+    int rc = relay_watch(r, client_fd) == 0 && relay_watch(r, origin_fd) == 0 ? 0 : -1;
+    if (rc == 0) {
+        tunnel_touch(&relay_idle, &r->t, metric_now());
+    }
+    else {
+        epoll_ctl(relay_fd, EPOLL_CTL_DEL, client_fd, NULL);
+        tunnel_release(&r->t);
+        free(r);
+    }
+    pthread_mutex_unlock(&relay_lock);
+    return rc;
+}
+
+#else
+
+int tunnel_hand_off(int client_fd, int origin_fd, const char* early, size_t early_len,
+                    void (*closed)(int client_fd))
+{
+    (void)client_fd; (void)origin_fd; (void)early; (void)early_len; (void)closed;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_tunnel.h
+ *
+ *  CONNECT tunnels. Once the origin is connected and the client has its
+ *  "200 Connection Established", a tunnel is an opaque byte relay – no
+ *  parsing, no cache. Each direction has one fixed TUNNEL_CHUNK ring, and
+ *  a side is only read while its ring has room, so a slow reader holds
+ *  the writer back through TCP rather than through our memory. A tunnel
+ *  costs its two rings (one slab object) and the struct below however
+ *  much it carries and however long it lives.
+ *
+ *      • tunnel_pump() is non-blocking and moves whatever both sockets
+ *        allow; the front ends call it on readiness.
+ *      • An idle list, least recently active first, finds tunnels that
+ *        have been silent for the configured idle timeout
+ *        (tunnel_idle_timeout, TUNNEL_IDLE_SECS by default).
+ *      • The threaded front end hands an established tunnel to a single
+ *        relay thread (tunnel_hand_off()), so it holds no worker.
+ *
+ *  Only ports on the allow list (--connect-ports, default 443) may be
+ *  tunnelled to; anything else would make us an open relay.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_TUNNEL_H
+#define PROXY_TUNNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TUNNEL_CHUNK        (4 * 1024)          /* ring per direction        */
+#define TUNNEL_IDLE_SECS    300                 /* default idle timeout      */
+#define TUNNEL_TICK_MS      1000                /* idle sweep period         */
+
+#define TUNNEL_ESTABLISHED  "HTTP/1.1 200 Connection Established\r\n\r\n"
+
+typedef struct tunnel_ring {
+    char*  data;                    /* TUNNEL_CHUNK bytes                 */
+    size_t head, len;
+    int    eof;                     /* the sending side shut its half     */
+    int    shut;                    /*   …and we passed that on           */
+} tunnel_ring;
+
+typedef struct tunnel tunnel;
+struct tunnel {
+    int         client_fd, origin_fd;   /* not owned                      */
+    tunnel_ring up;                     /* client → origin                */
+    tunnel_ring down;                   /* origin → client                */
+    uint64_t    active_at;              /* metric_now() of the last touch */
+    tunnel*     prev;                   /* idle list                      */
+    tunnel*     next;
+    int         listed;
+};
+
+enum { TUNNEL_OPEN, TUNNEL_DONE, TUNNEL_ERROR };
+
+/* Rings for a tunnel between two non-blocking sockets. `early` is
+ * what the client sent past the CONNECT head, for the origin; the
+ * client's first bytes are TUNNEL_ESTABLISHED. -1 with errno: ENOMEM,
+ * or E2BIG when `early` doesn't fit a ring.                          */
+int   tunnel_init(tunnel* t, int client_fd, int origin_fd, const char* early, size_t early_len);
+
+/* Free the rings; the sockets are the caller's. Harmless on a zeroed
+ * or already released tunnel.                                        */
+void  tunnel_release(tunnel* t);
+
+/* Move bytes both ways until every socket would block or every ring
+ * is full. A side that reached EOF is shut down on the other once its
+ * ring has drained. TUNNEL_DONE once both halves are closed.        */
+int   tunnel_pump(tunnel* t);
+
+/* Idle list: least recently touched first.                           */
+typedef struct tunnel_list {
+    tunnel* head;
+    tunnel* tail;
+    size_t  count;
+} tunnel_list;
+
+/* Mark t active at `now`, listing it if it isn't.                    */
+void    tunnel_touch(tunnel_list* l, tunnel* t, uint64_t now);
+void    tunnel_unlist(tunnel_list* l, tunnel* t);
+
+/* The least recently active tunnel if it has been idle for the
+ * configured timeout at `now`, else NULL. It stays listed.           */
+tunnel* tunnel_expired(const tunnel_list* l, uint64_t now);
+
+/* Ports CONNECT may reach, e.g. "443,8443". -1 (EINVAL) if malformed. */
+int   tunnel_set_ports(const char* list);
+int   tunnel_port_allowed(int port);
+
+/* Threaded front end: relay an established tunnel on the relay thread
+ * (started on first use). It takes both sockets, closes origin_fd when
+ * done and hands client_fd to `closed`. -1 when there is no relay
+ * thread (not Linux, or it failed to start): use tunnel_relay().     */
+int   tunnel_hand_off(int client_fd, int origin_fd, const char* early, size_t early_len,
+                      void (*closed)(int client_fd));
+
+/* Relay on the calling thread until the tunnel ends or idles out;
+ * the sockets stay open.                                             */
+void  tunnel_relay(int client_fd, int origin_fd, const char* early, size_t early_len);
+
+#endif /* PROXY_TUNNEL_H */
@@ -0,0 +1,291 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_upstream.c      –  per-origin pool of idle keep-alive sockets
+ *
+ *  Per shard:
+ *      buckets[]  chained table of origins ("host:port"); an origin only
+ *                 exists while it has idle sockets
+ *      origin     stack of idle sockets, most recently parked first
+ *      mru..lru   every idle socket in the shard, for the global limit
+ *                 and the idle timeout
+ *
+ *  Sockets are closed after the shard lock is dropped.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_upstream.h"
+#include "proxy_cache.h"                    /* cache_hash()              */
+#include "proxy_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define ORIGIN_BUCKETS  64                  /* per shard, power of two   */
+#define ORIGIN_KEY_MAX  300
+
+typedef struct origin origin;
+typedef struct idle_conn idle_conn;
+
+struct idle_conn {
+    int        fd;
+    int        nonblocking;
+    time_t     since;
+    origin*    owner;
+    idle_conn* up;                          /* origin stack: newer       */
+    idle_conn* down;                        /*               older       */
+    idle_conn* lru_prev;                    /* shard list: newer         */
+    idle_conn* lru_next;                    /*             older         */
+};
+
+struct origin {
+    char*      key;
+    uint64_t   hash;
+    idle_conn* top;                         /* most recently parked      */
+    idle_conn* bottom;
+    size_t     count;
+    origin*    next;                        /* bucket chain              */
+};
+
+typedef struct pool_shard {
+    _Alignas(64) pthread_mutex_t lock;
+    origin*    buckets[ORIGIN_BUCKETS];
+    idle_conn* mru;
+    idle_conn* lru;
+    size_t     idle;
+    uint64_t   reused, missed, stale, evicted;
+} pool_shard;
+
+static pool_shard*    shards;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+
+/*──────────────────── Setup ────────────────────────────────────────*/
+
+static void pool_setup(void)
+{
+    shards = (pool_shard*)aligned_alloc(64, UPSTREAM_SHARDS * sizeof(pool_shard));
+    if (!shards) abort();
+    memset(shards, 0, UPSTREAM_SHARDS * sizeof(pool_shard));
+    for (unsigned i = 0; i < UPSTREAM_SHARDS; ++i)
+        pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+static inline void ensure_init(void)
+{
+    pthread_once(&init_once, pool_setup);
+}
+
+static size_t origin_key(char* dst, const char* host, int port)
+{
+    int n = snprintf(dst, ORIGIN_KEY_MAX, "%s:%d", host, port);
+    return (n < 0 || n >= ORIGIN_KEY_MAX) ? 0 : (size_t)n;
+}
+
+static pool_shard* shard_for(uint64_t hash)
+{
+    return &shards[(hash >> 58) & (UPSTREAM_SHARDS - 1)];
+}
+
+static origin** bucket_for(pool_shard* s, uint64_t hash)
+{
+    return &s->buckets[hash & (ORIGIN_BUCKETS - 1)];
+}
+
+
+/*──────────────────── Lists (shard lock held) ──────────────────────*/
+
+static origin* origin_lookup(pool_shard* s, const char* key, uint64_t hash)
+{
+    for (origin* o = *bucket_for(s, hash); o; o = o->next)
+        if (o->hash == hash && strcmp(o->key, key) == 0) return o;
+    return NULL;
+}
+
+static void origin_drop(pool_shard* s, origin* o)
+{
+    origin** pp = bucket_for(s, o->hash);
+    while (*pp != o) pp = &(*pp)->next;
+    *pp = o->next;
+    free(o->key);
+    free(o);
+}
+
+/* Unlink ic from both lists; frees its origin once empty. */
+static void idle_detach(pool_shard* s, idle_conn* ic)
+{
+    origin* o = ic->owner;
+    if (ic->up) ic->up->down = ic->down; else o->top = ic->down;
+    if (ic->down) ic->down->up = ic->up; else o->bottom = ic->up;
+    if (--o->count == 0) origin_drop(s, o);
+
+    if (ic->lru_prev) ic->lru_prev->lru_next = ic->lru_next; else s->mru = ic->lru_next;
+    if (ic->lru_next) ic->lru_next->lru_prev = ic->lru_prev; else s->lru = ic->lru_prev;
+    --s->idle;
+}
+
+static void idle_push(pool_shard* s, origin* o, idle_conn* ic)
+{
+    ic->owner = o;
+    ic->up = NULL;
+    ic->down = o->top;
+    if (o->top) o->top->up = ic; else o->bottom = ic;
+    o->top = ic;
+    ++o->count;
+
+    ic->lru_prev = NULL;
+    ic->lru_next = s->mru;
+    if (s->mru) s->mru->lru_prev = ic; else s->lru = ic;
+    s->mru = ic;
+    ++s->idle;
+}
+
+
+/*──────────────────── Checkout / checkin ───────────────────────────*/
+
+/* Still usable? An idle HTTP connection must have nothing to read:
+ * EOF means the origin closed it, data means it is out of sync.     */
+static int idle_healthy(int fd)
+{
+    char b;
+    ssize_t n = recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static int set_nonblocking(int fd, int on)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return -1;
+    flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags);
+}
+
+int upstream_checkout(const char* host, int port, int nonblocking)
+{
+    ensure_init();
+
+    char key[ORIGIN_KEY_MAX];
+    size_t key_len = origin_key(key, host, port);
+    if (!key_len) return -1;
+    uint64_t hash = cache_hash(key, key_len);
+    pool_shard* s = shard_for(hash);
+    time_t now = time(NULL);
+    time_t max_age = (time_t)config_get()->upstream_idle_secs;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        origin* o = origin_lookup(s, key, hash);
+        idle_conn* ic = o ? o->top : NULL;
+        if (!ic) {
+            ++s->missed;
+            pthread_mutex_unlock(&s->lock);
+            return -1;
+        }
+        idle_detach(s, ic);
+        pthread_mutex_unlock(&s->lock);
+
+        int fd = ic->fd;
+        int ok = now - ic->since <= max_age && idle_healthy(fd)
+              && (ic->nonblocking == nonblocking || set_nonblocking(fd, nonblocking) == 0);
+        free(ic);
+
+        pthread_mutex_lock(&s->lock);
+        if (ok) ++s->reused; else ++s->stale;
+        pthread_mutex_unlock(&s->lock);
+
+        if (ok) return fd;
+        close(fd);                                   /* try the next one */
+    }
+}
+
+void upstream_checkin(const char* host, int port, int fd, int nonblocking)
+{
+    ensure_init();
+
+    char key[ORIGIN_KEY_MAX];
+    size_t key_len = origin_key(key, host, port);
+    idle_conn* ic = key_len ? (idle_conn*)calloc(1, sizeof *ic) : NULL;
+    if (!ic) { close(fd); return; }
+    ic->fd = fd;
+    ic->nonblocking = nonblocking;
+    ic->since = time(NULL);
+
+    uint64_t hash = cache_hash(key, key_len);
+    pool_shard* s = shard_for(hash);
+    idle_conn* victims = NULL;                  /* chained through `down` */
+
+    const proxy_config* cfg = config_get();
+    size_t shard_max_idle = cfg->upstream_max_idle / UPSTREAM_SHARDS;
+    if (!shard_max_idle && cfg->upstream_max_idle) shard_max_idle = 1;
+    time_t max_age = (time_t)cfg->upstream_idle_secs;
+
+    pthread_mutex_lock(&s->lock);
+    origin* o = origin_lookup(s, key, hash);
+    if (!o) {
+        o = (origin*)calloc(1, sizeof *o);
+        char* k = o ? strdup(key) : NULL;
+        if (!k) {
+            free(o);
+            pthread_mutex_unlock(&s->lock);
+            free(ic);
+            close(fd);
+            return;
+        }
+        o->key = k;
+        o->hash = hash;
+        origin** bucket = bucket_for(s, hash);
+        o->next = *bucket;
+        *bucket = o;
+    }
+
+    idle_push(s, o, ic);
+
+    /* Per-origin limit: the oldest sockets of this origin go (more
+     * than one when a reload has just lowered it). Counted up front:
+     * the last detach may drop o.                                    */
+    size_t excess = o->count > cfg->upstream_per_host ? o->count - cfg->upstream_per_host : 0;
+    for (; excess; --excess) {
+        idle_conn* old = o->bottom;
+        idle_detach(s, old);
+        old->down = victims; victims = old;
+        ++s->evicted;
+    }
+
+    /* Shard limit and idle timeout: trim from the old end.            */
+    while (s->lru && (s->idle > shard_max_idle
+                      || ic->since - s->lru->since > max_age)) {
+        idle_conn* old = s->lru;
+        idle_detach(s, old);
+        old->down = victims; victims = old;
+        ++s->evicted;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    while (victims) {
+        idle_conn* next = victims->down;
+        close(victims->fd);
+        free(victims);
+        victims = next;
+    }
+}
+
+void upstream_get_stats(upstream_stats* out)
+{
+    ensure_init();
+    memset(out, 0, sizeof *out);
+    for (unsigned i = 0; i < UPSTREAM_SHARDS; ++i) {
+        pool_shard* s = &shards[i];
+        pthread_mutex_lock(&s->lock);
+        out->reused += s->reused;
+        out->missed += s->missed;
+        out->stale += s->stale;
+        out->evicted += s->evicted;
+        out->idle += s->idle;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
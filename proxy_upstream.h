@@ -0,0 +1,53 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_upstream.h
+ *
+ *  Pool of idle keep-alive connections to origin servers, keyed by
+ *  (host, port) exactly as they appear in the ParsedRequest.
+ *
+ *      • Checkout pops the most recently parked socket for that origin
+ *        (warmest congestion window, least likely to have been reaped
+ *        by the server) after a non-blocking MSG_PEEK health check:
+ *        EOF, stray bytes or an error mean the origin gave up on it.
+ *      • Checkin parks a socket whose response was fully framed and
+ *        that the origin agreed to keep open (see proxy_http.h).
+ *      • Limits: so many idle sockets per origin, so many overall
+ *        (oldest closed first), none older than the idle timeout. They
+ *        come from the config snapshot (proxy_config.h) on every call,
+ *        so a reload applies at the next checkin; the macros below are
+ *        the defaults.
+ *
+ *  Sharded like the cache: the origin key's hash picks a shard, and
+ *  each shard has its own lock, origin table and idle LRU list.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_UPSTREAM_H
+#define PROXY_UPSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UPSTREAM_MAX_IDLE       256             /* idle sockets, all origins */
+#define UPSTREAM_MAX_PER_HOST   8               /* idle sockets per origin   */
+#define UPSTREAM_IDLE_TIMEOUT   30              /* seconds                   */
+#define UPSTREAM_SHARDS         16              /* power of two              */
+
+typedef struct upstream_stats {
+    uint64_t reused;                /* checkouts served from the pool     */
+    uint64_t missed;                /* checkouts that found nothing       */
+    uint64_t stale;                 /* failed the health check / expired  */
+    uint64_t evicted;               /* closed to honour the limits        */
+    size_t   idle;                  /* parked right now                   */
+} upstream_stats;
+
+/* A healthy idle socket to host:port, or -1. `nonblocking` is the
+ * O_NONBLOCK mode the caller wants; it is only changed (fcntl) when
+ * the socket was parked by a front end using the other mode.         */
+int  upstream_checkout(const char* host, int port, int nonblocking);
+
+/* Park fd (currently in `nonblocking` mode) for reuse, or close it if
+ * the limits say no.                                                 */
+void upstream_checkin(const char* host, int port, int fd, int nonblocking);
+
+void upstream_get_stats(upstream_stats* out);
+
+#endif /* PROXY_UPSTREAM_H */
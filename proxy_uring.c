@@ -0,0 +1,329 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_uring.c      –  io_uring rings over the raw syscalls
+ *
+ *  The SQ array is an identity map, set once: SQE i is always slot i,
+ *  so queueing is filling sqes[tail & mask] and bumping a local tail,
+ *  which uring_enter() publishes. Everything here runs on the ring's
+ *  own loop thread, so the only ordering that matters is against the
+ *  kernel: release when handing it a tail, acquire when reading its.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_uring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+/* Both 6.0/6.1 macros; buffer rings (5.19) are an enum, not testable. */
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_SETUP_DEFER_TASKRUN)
+#define PROXY_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#ifdef PROXY_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define URING_CQ_MUL  8                 /* CQ entries per SQ entry        */
+
+/* Tried in order: the first suits a ring only its loop thread touches
+ * (completion work runs when we enter, not on interrupts); the second
+ * is anything since 5.5.                                              */
+static const unsigned setup_flags[] = {
+    IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+    0,
+};
+
+static int ring_setup(unsigned entries, struct io_uring_params* p, unsigned flags)
+{
+    memset(p, 0, sizeof *p);
+    p->flags = flags | IORING_SETUP_CQSIZE;
+    p->cq_entries = entries * URING_CQ_MUL;
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+int uring_init(uring* r, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(r, 0, sizeof *r);
+    r->fd = -1;
+
+    for (unsigned i = 0; i < sizeof setup_flags / sizeof setup_flags[0] && r->fd < 0; ++i)
+        r->fd = ring_setup(entries, &p, setup_flags[i]);
+    if (r->fd < 0) return -1;
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = 0;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = !r->cq_map_len ? r->sq_map
+              : mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        int err = errno;
+        uring_exit(r);
+        errno = err;
+        return -1;
+    }
+
+    char* sq = (char*)r->sq_map;
+    char* cq = (char*)r->cq_map;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    r->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+
+    for (unsigned i = 0; i < r->sq_entries; ++i) r->sq_array[i] = i;
+    r->tail = *r->sq_tail;
+    return 0;
+}
+
+void uring_exit(uring* r)
+{
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_len);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof *r);
+    r->fd = -1;
+}
+
+static unsigned sq_free(const uring* r)
+{
+    return r->sq_entries - (r->tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE));
+}
+
+int uring_enter(uring* r, unsigned wait)
+{
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    int n = (int)syscall(__NR_io_uring_enter, r->fd, r->pending, wait,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+    if (n < 0) return -1;
+    r->pending -= (unsigned)n < r->pending ? (unsigned)n : r->pending;
+    return 0;
+}
+
+int uring_reserve(uring* r, unsigned n)
+{
+    if (n > r->sq_entries) return -1;
+    if (sq_free(r) < n && uring_enter(r, 0) < 0) return -1;
+    return sq_free(r) >= n ? 0 : -1;
+}
+
+struct io_uring_sqe* uring_sqe(uring* r)
+{
+    if (uring_reserve(r, 1) < 0) return NULL;
+    struct io_uring_sqe* sqe = &r->sqes[r->tail & r->sq_mask];
+    memset(sqe, 0, sizeof *sqe);
+    ++r->tail;
+    ++r->pending;
+    return sqe;
+}
+
+void uring_sqe_link(struct io_uring_sqe* sqe)
+{
+    sqe->flags |= IOSQE_IO_LINK;
+}
+
+int uring_next(uring* r, uring_cqe* out)
+{
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+
+    const struct io_uring_cqe* cqe = &r->cqes[head & r->cq_mask];
+    out->user_data = cqe->user_data;
+    out->res = cqe->res;
+    out->buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT)
+                                                     : -1;
+    out->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+/*──────────────────── Provided buffers ─────────────────────────────*/
+
+char* uring_buf(const uring_bufs* b, unsigned id)
+{
+    return b->base + (size_t)id * (b->size + 1);
+}
+
+void uring_buf_recycle(uring_bufs* b, unsigned id)
+{
+    struct io_uring_buf* buf = &b->ring->bufs[b->tail & (b->count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(b, id);
+    buf->len = b->size;
+    buf->bid = (uint16_t)id;
+    ++b->tail;
+    __atomic_store_n(&b->ring->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+int uring_bufs_init(uring* r, uring_bufs* b, uint16_t group, unsigned count, unsigned size)
+{
+    memset(b, 0, sizeof *b);
+    if (count == 0 || count > 32768 || (count & (count - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The ring itself must be page aligned; the kernel reads it.      */
+    size_t ring_len = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) return -1;
+    b->base = (char*)malloc((size_t)count * (size + 1));
+    if (!b->base) {
+        munmap(ring, ring_len);
+        return -1;
+    }
+    b->ring = (struct io_uring_buf_ring*)ring;
+    b->count = count;
+    b->size = size;
+    b->group = group;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int err = errno;
+        free(b->base);
+        munmap(ring, ring_len);
+        memset(b, 0, sizeof *b);
+        errno = err;
+        return -1;
+    }
+    for (unsigned i = 0; i < count; ++i) uring_buf_recycle(b, i);
+    return 0;
+}
+
+void uring_bufs_free(uring* r, uring_bufs* b)
+{
+    if (!b->ring) return;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.bgid = b->group;
+    if (r->fd >= 0) syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(b->ring, b->count * sizeof(struct io_uring_buf));
+    free(b->base);
+    memset(b, 0, sizeof *b);
+}
+
+
+/*──────────────────── Operations ───────────────────────────────────*/
+
+void uring_prep_accept_multishot(struct io_uring_sqe* sqe, int fd, int flags, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = (uint32_t)flags;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_poll_multishot(struct io_uring_sqe* sqe, int fd, unsigned events,
+                               uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_recv(struct io_uring_sqe* sqe, int fd, void* buf, size_t len, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_recv_select(struct io_uring_sqe* sqe, int fd, const uring_bufs* b,
+                            uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = b->size;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = b->group;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_send(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len, int flags,
+                     uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = (uint32_t)flags;
+    sqe->user_data = user_data;
+}
+
+#else  /* !PROXY_HAVE_URING */
+
+int uring_init(uring* r, unsigned entries)
+{
+    (void)entries;
+    memset(r, 0, sizeof *r);
+    r->fd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+void uring_exit(uring* r) { r->fd = -1; }
+struct io_uring_sqe* uring_sqe(uring* r) { (void)r; return NULL; }
+int   uring_reserve(uring* r, unsigned n) { (void)r; (void)n; return -1; }
+void  uring_sqe_link(struct io_uring_sqe* sqe) { (void)sqe; }
+int   uring_enter(uring* r, unsigned wait) { (void)r; (void)wait; errno = ENOSYS; return -1; }
+int   uring_next(uring* r, uring_cqe* cqe) { (void)r; (void)cqe; return 0; }
+
+int uring_bufs_init(uring* r, uring_bufs* b, uint16_t group, unsigned count, unsigned size)
+{
+    (void)r; (void)group; (void)count; (void)size;
+    memset(b, 0, sizeof *b);
+    errno = ENOSYS;
+    return -1;
+}
+
+void  uring_bufs_free(uring* r, uring_bufs* b) { (void)r; (void)b; }
+char* uring_buf(const uring_bufs* b, unsigned id) { (void)b; (void)id; return NULL; }
+void  uring_buf_recycle(uring_bufs* b, unsigned id) { (void)b; (void)id; }
+
+void uring_prep_accept_multishot(struct io_uring_sqe* sqe, int fd, int flags, uint64_t user_data)
+{ (void)sqe; (void)fd; (void)flags; (void)user_data; }
+void uring_prep_poll_multishot(struct io_uring_sqe* sqe, int fd, unsigned events,
+                               uint64_t user_data)
+{ (void)sqe; (void)fd; (void)events; (void)user_data; }
+void uring_prep_recv(struct io_uring_sqe* sqe, int fd, void* buf, size_t len, uint64_t user_data)
+{ (void)sqe; (void)fd; (void)buf; (void)len; (void)user_data; }
+void uring_prep_recv_select(struct io_uring_sqe* sqe, int fd, const uring_bufs* b,
+                            uint64_t user_data)
+{ (void)sqe; (void)fd; (void)b; (void)user_data; }
+void uring_prep_send(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len, int flags,
+                     uint64_t user_data)
+{ (void)sqe; (void)fd; (void)buf; (void)len; (void)flags; (void)user_data; }
+
+#endif
@@ -0,0 +1,106 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  proxy_uring.h
+ *
+ *  Minimal io_uring binding for the event front end's --mode=uring:
+ *  the rings themselves, the few operations it submits, and a provided
+ *  buffer ring – no liburing, just the syscalls and the shared memory
+ *  layout from <linux/io_uring.h>.
+ *
+ *      • SQEs are filled in place and published in one go by
+ *        uring_enter(), which is also where the loop waits, so a
+ *        batch of completions and the submissions they caused cost a
+ *        single syscall.
+ *      • A provided buffer ring hands the kernel a pool of receive
+ *        buffers; a recv picks one only once data is there, so an idle
+ *        connection holds no buffer at all.
+ *
+ *  Needs Linux 6.0 (multishot accept, buffer rings, send MSG_WAITALL).
+ *  Where the headers are too old, or elsewhere, uring_init() fails with
+ *  ENOSYS; at runtime it fails with whatever the kernel said, and the
+ *  caller falls back to epoll.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#ifndef PROXY_URING_H
+#define PROXY_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+typedef struct uring {
+    int       fd;                   /* -1 → not set up                  */
+    unsigned  sq_mask, cq_mask, sq_entries;
+    unsigned* sq_head;              /* shared with the kernel           */
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    unsigned  tail;                 /* SQEs filled in, local            */
+    unsigned  pending;              /*   …not yet passed to the kernel  */
+    void*     sq_map;
+    void*     cq_map;
+    size_t    sq_map_len, cq_map_len, sqes_len;
+} uring;
+
+/* A completion, copied out of the ring.                               */
+typedef struct uring_cqe {
+    uint64_t  user_data;
+    int       res;                  /* result, or -errno                */
+    int       buffer;               /* provided buffer id, -1: none     */
+    int       more;                 /* a multishot op stays armed       */
+} uring_cqe;
+
+typedef struct uring_bufs {
+    struct io_uring_buf_ring* ring;
+    char*     base;                 /* count × (size + 1) bytes         */
+    unsigned  count, size;
+    uint16_t  group;
+    uint16_t  tail;
+} uring_bufs;
+
+/* Rings of `entries` SQEs (a power of two). -1 with errno on failure. */
+int   uring_init(uring* r, unsigned entries);
+void  uring_exit(uring* r);
+
+/* A zeroed SQE to fill in. When the ring is full, what is queued is
+ * submitted first; NULL only if even that fails.                     */
+struct io_uring_sqe* uring_sqe(uring* r);
+
+/* Make sure the next n uring_sqe() calls won't submit in between, as
+ * a linked chain needs. -1 if n SQEs can't be had.                   */
+int   uring_reserve(uring* r, unsigned n);
+
+/* The SQE's successor only starts once it has fully succeeded.       */
+void  uring_sqe_link(struct io_uring_sqe* sqe);
+
+/* Submit whatever is queued and wait for at least `wait` completions.
+ * -1 with errno (EINTR included) on failure.                         */
+int   uring_enter(uring* r, unsigned wait);
+
+/* Take the next completion into *cqe: 1, or 0 when there is none.   */
+int   uring_next(uring* r, uring_cqe* cqe);
+
+/* `count` buffers of `size` bytes as group `group`. Each has one more
+ * byte after `size`, so a receive can be NUL-terminated in place.    */
+int   uring_bufs_init(uring* r, uring_bufs* b, uint16_t group, unsigned count, unsigned size);
+void  uring_bufs_free(uring* r, uring_bufs* b);
+char* uring_buf(const uring_bufs* b, unsigned id);
+void  uring_buf_recycle(uring_bufs* b, unsigned id);
+
+/* Operations. user_data identifies the completion.                   */
+void  uring_prep_accept_multishot(struct io_uring_sqe* sqe, int fd, int flags, uint64_t user_data);
+void  uring_prep_poll_multishot(struct io_uring_sqe* sqe, int fd, unsigned events,
+                                uint64_t user_data);
+void  uring_prep_recv(struct io_uring_sqe* sqe, int fd, void* buf, size_t len,
+                      uint64_t user_data);
+void  uring_prep_recv_select(struct io_uring_sqe* sqe, int fd, const uring_bufs* b,
+                             uint64_t user_data);
+void  uring_prep_send(struct io_uring_sqe* sqe, int fd, const void* buf, size_t len,
+                      int flags, uint64_t user_data);
+
+#endif /* PROXY_URING_H */
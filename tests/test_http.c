@@ -0,0 +1,109 @@
+/*───────────────────────────────────────────────────────────────────────────
+ *  tests/test_http.c      –  response head rewriting (proxy_http.h)
+ *
+ *  http_recode_head() grows a head by a bounded amount per field, and
+ *  an origin chooses how many fields there are. These build heads with
+ *  many Vary fields and a long strong ETag and check the result field
+ *  by field; run under ASan (see the Makefile) to catch a short buffer.
+ *───────────────────────────────────────────────────────────────────────────*/
+
+#define _GNU_SOURCE
+#include "proxy_http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond) do {                                                   \
+    if (!(cond)) {                                                         \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++failures;                                                        \
+    }                                                                      \
+} while (0)
+
+/* Occurrences of needle in [s, s + len).                             */
+static unsigned count(const char* s, size_t len, const char* needle)
+{
+    size_t n = strlen(needle);
+    unsigned hits = 0;
+    for (size_t i = 0; i + n <= len; ++i)
+        if (memcmp(s + i, needle, n) == 0) ++hits;
+    return hits;
+}
+
+/* "HTTP/1.1 200 OK", `varies` short Vary lines, a strong ETag of
+ * etag_len bytes, a Content-Length and the blank line.              */
+static char* build_head(unsigned varies, size_t etag_len, size_t* len)
+{
+    size_t cap = 256 + varies * 16 + etag_len;
+    char* head = (char*)malloc(cap);
+    size_t n = (size_t)sprintf(head, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n");
+    for (unsigned i = 0; i < varies; ++i)
+        n += (size_t)sprintf(head + n, "Vary:x%u\r\n", i);
+    n += (size_t)sprintf(head + n, "ETag:\"");
+    memset(head + n, 'e', etag_len);
+    n += etag_len;
+    n += (size_t)sprintf(head + n, "\"\r\nContent-Length: 5\r\n\r\n");
+    *len = n;
+    return head;
+}
+
+static void test_coded(unsigned varies, size_t etag_len)
+{
+    size_t len, out_len;
+    char* head = build_head(varies, etag_len, &len);
+    char* out = http_recode_head(head, len, "gzip", 123456, &out_len);
+    CHECK(out != NULL);
+    if (out) {
+        CHECK(count(out, out_len, ", Accept-Encoding\r\n") == varies);
+        CHECK(count(out, out_len, "Vary: Accept-Encoding\r\n") == (varies ? 0u : 1u));
+        CHECK(count(out, out_len, "ETag: W/\"") == 1);
+        CHECK(count(out, out_len, "Content-Encoding: gzip\r\n") == 1);
+        CHECK(count(out, out_len, "Content-Length") == 1);
+        const char tail[] = "Content-Length: 123456\r\n\r\n";
+        CHECK(out_len >= sizeof tail - 1
+              && memcmp(out + out_len - (sizeof tail - 1), tail, sizeof tail - 1) == 0);
+        /* Every field gains ": " and CRLF back, a Vary its token, the
+         * ETag "W/"; two fields are added.                          */
+        size_t want = len + varies * (1 + 17) + 1 + 2
+                    + strlen("Content-Encoding: gzip\r\n")
+                    + (varies ? 0 : strlen("Vary: Accept-Encoding\r\n"))
+                    + strlen("123456") - 1;
+        CHECK(out_len == want);
+    }
+    free(out);
+    free(head);
+}
+
+static void test_identity(void)
+{
+    static const char head[] =
+        "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding\r\n"
+        "ETag: W/\"abc\"\r\nContent-Length: 40\r\n\r\n";
+    size_t out_len;
+    char* out = http_recode_head(head, sizeof head - 1, NULL, 1000, &out_len);
+    static const char want[] =
+        "HTTP/1.1 200 OK\r\nVary: Accept-Encoding\r\nETag: W/\"abc\"\r\n"
+        "Content-Length: 1000\r\n\r\n";
+    CHECK(out && out_len == sizeof want - 1 && memcmp(out, want, out_len) == 0);
+    free(out);
+}
+
+int main(void)
+{
+    test_coded(0, 8);
+    test_coded(1, 8);
+    test_coded(20, 8);
+    test_coded(500, 8);
+    test_coded(4, 64 * 1024);
+    test_identity();
+
+    if (failures) {
+        fprintf(stderr, "test_http: %d failed\n", failures);
+        return 1;
+    }
+    printf("test_http: ok\n");
+    return 0;
+}
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Generate proxy_headers.h / proxy_headers.c: well-known header names,
+their enum, and a perfect hash from name to enum.
+
+The hash looks at the length and four folded bytes of the name – first,
+last, second to last, middle – packed into one 64-bit word, multiplied
+by a seed and shifted down to HDR_TABLE_BITS. This script searches for
+a seed under which every name below lands in its own slot, so a lookup
+is one multiply, one table load and one length-checked compare that
+confirms the name (anything not in the list can still hash anywhere).
+
+Run from the repo root after editing NAMES:  make headers
+"""
+
+import random
+import sys
+
+# Canonical spelling; the enum is HDR_ + upper-cased, '-' → '_'.
+NAMES = [
+    "Host", "Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authorization",
+    "Proxy-Authenticate", "TE", "Trailer", "Transfer-Encoding", "Upgrade",
+    "Content-Length", "Content-Type", "Content-Encoding", "Accept", "Accept-Encoding",
+    "Accept-Language", "Accept-Charset", "User-Agent", "Referer", "Cookie",
+    "Authorization", "Cache-Control", "Pragma", "If-Modified-Since", "If-None-Match",
+    "If-Match", "If-Unmodified-Since", "If-Range", "Range", "Origin", "Expect", "Via",
+    "Forwarded", "X-Forwarded-For", "X-Forwarded-Proto", "X-Forwarded-Host", "DNT",
+    "Upgrade-Insecure-Requests", "Sec-Fetch-Site", "Sec-Fetch-Mode", "Sec-Fetch-User",
+    "Sec-Fetch-Dest", "Date", "Max-Forwards",
+]
+
+TABLE_BITS = 7
+MASK64 = (1 << 64) - 1
+
+
+def fold(c):
+    return ord(c) | 0x20
+
+
+def key(name):
+    n = len(name)
+    return ((n & 0xFF) | fold(name[0]) << 8 | fold(name[-1]) << 16
+            | fold(name[-2]) << 24 | fold(name[n // 2]) << 32)
+
+
+def slot(name, seed):
+    return ((key(name) * seed) & MASK64) >> (64 - TABLE_BITS)
+
+
+def find_seed():
+    keys = {key(n) for n in NAMES}
+    if len(keys) != len(NAMES):
+        sys.exit("two names share length and sampled bytes; sample another byte")
+    rng = random.Random(0x5EED)
+    for _ in range(1_000_000):
+        seed = rng.getrandbits(64) | 1
+        if len({slot(n, seed) for n in NAMES}) == len(NAMES):
+            return seed
+    sys.exit("no seed found; raise TABLE_BITS")
+
+
+def enum_name(name):
+    return "HDR_" + name.upper().replace("-", "_")
+
+
+BANNER = """\
+/*───────────────────────────────────────────────────────────────────────────
+ *  {file}
+ *
+ *  GENERATED by tools/gen_headers.py – edit the list there and run
+ *  `make headers`.
+ *───────────────────────────────────────────────────────────────────────────*/
+"""
+
+
+def write_header(seed):
+    out = [BANNER.format(file="proxy_headers.h"), """
+#ifndef PROXY_HEADERS_H
+#define PROXY_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Well-known header names. HDR_UNKNOWN is every other name.          */
+typedef enum http_header_id {
+    HDR_UNKNOWN = 0,
+"""]
+    for n in NAMES:
+        out.append("    %s,\n" % enum_name(n))
+    out.append("""    HDR__COUNT
+} http_header_id;
+
+#define HDR_TABLE_BITS  %d
+#define HDR_HASH_SEED   0x%016XULL
+
+/* Canonical spelling of each id ("" for HDR_UNKNOWN).                */
+extern const char* const http_header_names[HDR__COUNT];
+extern const uint8_t     http_header_lengths[HDR__COUNT];
+
+/* Case-insensitive classification of name[0..len).                   */
+http_header_id http_header_lookup(const char* name, size_t len);
+
+#endif /* PROXY_HEADERS_H */
+""" % (TABLE_BITS, seed))
+    with open("proxy_headers.h", "w") as f:
+        f.write("".join(out))
+
+
+def write_source(seed):
+    table = ["HDR_UNKNOWN"] * (1 << TABLE_BITS)
+    for n in NAMES:
+        table[slot(n, seed)] = enum_name(n)
+
+    out = [BANNER.format(file="proxy_headers.c"), """
+#include "proxy_headers.h"
+
+const char* const http_header_names[HDR__COUNT] = {
+    [HDR_UNKNOWN] = "",
+"""]
+    for n in NAMES:
+        out.append('    [%s] = "%s",\n' % (enum_name(n), n))
+    out.append("""};
+
+const uint8_t http_header_lengths[HDR__COUNT] = {
+""")
+    for n in NAMES:
+        out.append("    [%s] = %d,\n" % (enum_name(n), len(n)))
+    out.append("""};
+
+/* Hash slot → id; HDR_UNKNOWN where no well-known name lands.        */
+static const uint8_t slots[1u << HDR_TABLE_BITS] = {
+""")
+    for i in range(0, len(table), 4):
+        row = ", ".join(table[i:i + 4])
+        out.append("    %s,\n" % row)
+    out.append("""};
+
+http_header_id http_header_lookup(const char* name, size_t len)
+{
+    if (len < 2 || len > 255) return HDR_UNKNOWN;
+
+    const unsigned char* p = (const unsigned char*)name;
+    uint64_t key = (uint64_t)len
+                 | (uint64_t)(p[0] | 0x20) << 8
+                 | (uint64_t)(p[len - 1] | 0x20) << 16
+                 | (uint64_t)(p[len - 2] | 0x20) << 24
+                 | (uint64_t)(p[len / 2] | 0x20) << 32;
+    http_header_id id = (http_header_id)slots[(key * HDR_HASH_SEED) >> (64 - HDR_TABLE_BITS)];
+    if (id == HDR_UNKNOWN || http_header_lengths[id] != len) return HDR_UNKNOWN;
+
+    /* Confirm: names are tokens, so |0x20 folds case and nothing else. */
+    const unsigned char* c = (const unsigned char*)http_header_names[id];
+    for (size_t i = 0; i < len; ++i)
+        if ((p[i] | 0x20) != (c[i] | 0x20)) return HDR_UNKNOWN;
+    return id;
+}
+""")
+    with open("proxy_headers.c", "w") as f:
+        f.write("".join(out))
+
+
+if __name__ == "__main__":
+    s = find_seed()
+    write_header(s)
+    write_source(s)